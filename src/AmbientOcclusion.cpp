@@ -0,0 +1,282 @@
+#include "AmbientOcclusion.h"
+
+#include <algorithm>
+
+#include "VulkanEngine.h"
+
+namespace {
+    constexpr u32 WORKGROUP_SIZE = 8;
+
+    vk::raii::Sampler createSampler(const vk::Filter filter) {
+        const vk::SamplerCreateInfo samplerInfo = {
+            .magFilter = filter,
+            .minFilter = filter,
+            .mipmapMode = vk::SamplerMipmapMode::eNearest,
+            .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = vk::False,
+            .maxAnisotropy = 1.0f,
+            .compareEnable = vk::False,
+            .compareOp = vk::CompareOp::eAlways,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .unnormalizedCoordinates = vk::False
+        };
+        return {VulkanEngine::getDevice(), samplerInfo};
+    }
+
+    // parameters at binding 0, then the sampled inputs, then the storage image written
+    std::unique_ptr<Pipeline> createPipeline(const std::string& shader, const u32 inputCount) {
+        Pipeline::Builder builder;
+        builder
+            .addShaderStage(shader)
+            .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eCompute);
+        for (u32 i = 1; i <= inputCount; ++i) {
+            builder.addBinding(0, i, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute);
+        }
+        return builder
+            .addBinding(0, inputCount + 1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute)
+            .create();
+    }
+
+    void writeImage(const vk::raii::DescriptorSet& descriptorSet, const u32 binding, const vk::ImageView view, const vk::Sampler sampler) {
+        const bool storage = !sampler;
+        const vk::DescriptorImageInfo imageInfo = {
+            .sampler = sampler,
+            .imageView = view,
+            .imageLayout = storage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = *descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &imageInfo
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+}
+
+AmbientOcclusion::AmbientOcclusion(const vk::Extent2D extent)
+    : m_nearestSampler(createSampler(vk::Filter::eNearest))
+    , m_linearSampler(createSampler(vk::Filter::eLinear))
+{
+    m_depthPipeline = createPipeline("shaders/ssao_depth.comp.spv", 1);
+    m_depthMultisampledPipeline = createPipeline("shaders/ssao_depth_ms.comp.spv", 1);
+    m_occlusionPipeline = createPipeline("shaders/ssao.comp.spv", 1);
+    m_temporalPipeline = createPipeline("shaders/ssao_temporal.comp.spv", 3);
+
+    setExtent(extent);
+}
+
+void AmbientOcclusion::setExtent(const vk::Extent2D extent) {
+    m_extent = extent;
+    m_halfExtent = {(extent.width + 1) / 2, (extent.height + 1) / 2};
+    m_renderExtent = m_extent;
+    m_renderHalfExtent = m_halfExtent;
+    createHistory();
+}
+
+void AmbientOcclusion::update(const glm::mat4 &view, const glm::mat4 &projection, const float near, const float far, const vk::Extent2D renderExtent) {
+    // the history was rendered at a different scale, so can't be reprojected
+    if (renderExtent != m_renderExtent) {
+        m_renderExtent = renderExtent;
+        m_renderHalfExtent = {(renderExtent.width + 1) / 2, (renderExtent.height + 1) / 2};
+        m_historyValid = false;
+    }
+
+    const glm::mat4 viewProjection = projection * view;
+    m_params = VulkanEngine::getFrameAllocator()->push<Params>({
+        .projection = projection,
+        .reprojection = m_previousViewProjection * glm::inverse(view),
+        .fullSize = glm::vec2(m_renderExtent.width, m_renderExtent.height),
+        .halfSize = glm::vec2(m_renderHalfExtent.width, m_renderHalfExtent.height),
+        .near = near,
+        .far = far,
+        .radius = m_radius,
+        .intensity = m_intensity,
+        .sampleCount = m_sampleCount,
+        .frame = m_frame++,
+        .blend = m_temporal && m_historyValid ? TEMPORAL_BLEND : 1.0f,
+    });
+    m_previousViewProjection = viewProjection;
+    m_historyValid = true;
+}
+
+void AmbientOcclusion::addPasses(RenderGraph &graph, const RenderGraph::Handle depth, const vk::SampleCountFlagBits samples) {
+    m_depthResource = depth;
+    m_multisampled = samples != vk::SampleCountFlagBits::e1;
+    // the history is from whenever the passes last ran, if they have at all
+    m_historyValid = false;
+
+    m_historyResource = graph.importImage("SSAO History", HISTORY_FORMAT, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+    graph.setImage(m_historyResource, *m_history->getImage(), *m_history->getView());
+
+    const auto createHalfImage = [&](const std::string& name, const vk::Format format) {
+        return graph.createImage(name, {
+            .width = m_halfExtent.width,
+            .height = m_halfExtent.height,
+            .format = format,
+        });
+    };
+    m_halfDepth = createHalfImage("SSAO Depth", DEPTH_FORMAT);
+    m_rawOcclusion = createHalfImage("SSAO Occlusion", OCCLUSION_FORMAT);
+    m_accumulated = createHalfImage("SSAO Accumulated", HISTORY_FORMAT);
+
+    graph.addPass("SSAO Depth", {
+        {depth, ResourceUsage::Sampled},
+        {m_halfDepth, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer, m_multisampled ? *m_depthMultisampledPipeline : *m_depthPipeline, m_depthDescriptor);
+    });
+    graph.addPass("SSAO", {
+        {m_halfDepth, ResourceUsage::Sampled},
+        {m_rawOcclusion, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer, *m_occlusionPipeline, m_occlusionDescriptor);
+    });
+    graph.addPass("SSAO Temporal", {
+        {m_rawOcclusion, ResourceUsage::Sampled},
+        {m_halfDepth, ResourceUsage::Sampled},
+        {m_historyResource, ResourceUsage::Sampled},
+        {m_accumulated, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer, *m_temporalPipeline, m_temporalDescriptor);
+    });
+    graph.addPass("SSAO History", {
+        {m_accumulated, ResourceUsage::TransferSrc},
+        {m_historyResource, ResourceUsage::TransferDst},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        copyHistory(commandBuffer);
+    });
+}
+
+void AmbientOcclusion::writeDescriptors(const RenderGraph &graph) {
+    const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    const auto createDescriptor = [&](const Pipeline& pipeline) {
+        vk::raii::DescriptorSet descriptorSet = pipeline.createDescriptorSet(0);
+        frameAllocator->addToSet(descriptorSet, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(Params));
+        return descriptorSet;
+    };
+
+    m_depthDescriptor = createDescriptor(m_multisampled ? *m_depthMultisampledPipeline : *m_depthPipeline);
+    writeImage(m_depthDescriptor, 1, graph.getImageView(m_depthResource), *m_nearestSampler);
+    writeImage(m_depthDescriptor, 2, graph.getImageView(m_halfDepth), nullptr);
+
+    m_occlusionDescriptor = createDescriptor(*m_occlusionPipeline);
+    writeImage(m_occlusionDescriptor, 1, graph.getImageView(m_halfDepth), *m_nearestSampler);
+    writeImage(m_occlusionDescriptor, 2, graph.getImageView(m_rawOcclusion), nullptr);
+
+    m_temporalDescriptor = createDescriptor(*m_temporalPipeline);
+    writeImage(m_temporalDescriptor, 1, graph.getImageView(m_rawOcclusion), *m_nearestSampler);
+    writeImage(m_temporalDescriptor, 2, graph.getImageView(m_halfDepth), *m_nearestSampler);
+    writeImage(m_temporalDescriptor, 3, *m_history->getView(), *m_linearSampler);
+    writeImage(m_temporalDescriptor, 4, graph.getImageView(m_accumulated), nullptr);
+
+    m_accumulatedImage = graph.getImage(m_accumulated);
+}
+
+RenderGraph::Handle AmbientOcclusion::getResource() const {
+    return m_historyResource;
+}
+
+void AmbientOcclusion::addToSet(const vk::raii::DescriptorSet &descriptorSet, const u32 binding) const {
+    writeImage(descriptorSet, binding, *m_history->getView(), *m_nearestSampler);
+}
+
+void AmbientOcclusion::setEnabled(const bool enabled) {
+    m_enabled = enabled;
+    VulkanEngine::queueRendererRebuild();
+}
+
+bool AmbientOcclusion::getEnabled() const {
+    return m_enabled;
+}
+
+void AmbientOcclusion::setSampleCount(const u32 sampleCount) {
+    m_sampleCount = std::clamp(sampleCount, 1u, MAX_SAMPLES);
+}
+
+u32 AmbientOcclusion::getSampleCount() const {
+    return m_sampleCount;
+}
+
+void AmbientOcclusion::setRadius(const float radius) {
+    m_radius = radius;
+}
+
+float AmbientOcclusion::getRadius() const {
+    return m_radius;
+}
+
+void AmbientOcclusion::setIntensity(const float intensity) {
+    m_intensity = intensity;
+}
+
+float AmbientOcclusion::getIntensity() const {
+    return m_intensity;
+}
+
+void AmbientOcclusion::setTemporal(const bool enabled) {
+    m_temporal = enabled;
+}
+
+bool AmbientOcclusion::getTemporal() const {
+    return m_temporal;
+}
+
+void AmbientOcclusion::createHistory() {
+    m_history = std::make_unique<Image>(ImageCreateInfo {
+        .width = m_halfExtent.width,
+        .height = m_halfExtent.height,
+        .format = HISTORY_FORMAT,
+        .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+    });
+    m_historyValid = false;
+
+    // cleared to unoccluded, and left in the layout the graph imports it with
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    m_history->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    });
+    const vk::ImageSubresourceRange range = {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+    commandBuffer.clearColorImage(*m_history->getImage(), vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue(1.0f, 0.0f, 0.0f, 0.0f), range);
+    m_history->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    });
+    VulkanEngine::endSingleCommand(commandBuffer);
+}
+
+void AmbientOcclusion::dispatch(const vk::raii::CommandBuffer &commandBuffer, const Pipeline &pipeline, const vk::raii::DescriptorSet &descriptorSet) const {
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getPipeline());
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.getLayout(), 0, {*descriptorSet}, {m_params.offset});
+    commandBuffer.dispatch((m_renderHalfExtent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (m_renderHalfExtent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+}
+
+void AmbientOcclusion::copyHistory(const vk::raii::CommandBuffer &commandBuffer) const {
+    constexpr vk::ImageSubresourceLayers subresource = {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+    const vk::ImageCopy copy = {
+        .srcSubresource = subresource,
+        .srcOffset = {0, 0, 0},
+        .dstSubresource = subresource,
+        .dstOffset = {0, 0, 0},
+        .extent = {m_renderHalfExtent.width, m_renderHalfExtent.height, 1},
+    };
+    commandBuffer.copyImage(m_accumulatedImage, vk::ImageLayout::eTransferSrcOptimal, *m_history->getImage(), vk::ImageLayout::eTransferDstOptimal, copy);
+}
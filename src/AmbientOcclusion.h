@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "FrameAllocator.h"
+#include "Image.h"
+#include "Pipeline.h"
+#include "RenderGraph.h"
+
+// screen space ambient occlusion at half resolution - the depth buffer is halved, a few samples per texel are taken
+// and blurred, and the result is accumulated over frames by reprojecting last frame's. shading upsamples it using
+// only the texels on the same surface
+class AmbientOcclusion {
+public:
+    // std140 layout, matching Params in ssao.glsl
+    struct Params {
+        glm::mat4 projection;
+        glm::mat4 reprojection;
+        glm::vec2 fullSize;
+        glm::vec2 halfSize;
+        float near, far;
+        float radius;
+        float intensity;
+        u32 sampleCount;
+        u32 frame;
+        float blend;
+    };
+
+    static constexpr u32 MAX_SAMPLES = 32;
+    // weight of each new frame once the history is valid
+    static constexpr float TEMPORAL_BLEND = 0.1f;
+
+    explicit AmbientOcclusion(vk::Extent2D extent);
+
+    // recreate the history for a new extent - the graph has to be recreated afterwards
+    void setExtent(vk::Extent2D extent);
+
+    // push this frame's parameters - only while the passes are in the graph. occlusion is only computed for the top
+    // left renderExtent of the depth attachment
+    void update(const glm::mat4& view, const glm::mat4& projection, float near, float far, vk::Extent2D renderExtent);
+
+    // add the passes computing occlusion from the depth attachment, after whatever writes it
+    void addPasses(RenderGraph& graph, RenderGraph::Handle depth, vk::SampleCountFlagBits samples);
+    // point the passes at the graph's images, once it has been compiled
+    void writeDescriptors(const RenderGraph& graph);
+    // the occlusion the shading passes sample
+    RenderGraph::Handle getResource() const;
+
+    // point a combined image sampler binding at the occlusion - valid whether or not the passes are in the graph
+    void addToSet(const vk::raii::DescriptorSet& descriptorSet, u32 binding) const;
+
+    void setEnabled(bool enabled);
+    bool getEnabled() const;
+    void setSampleCount(u32 sampleCount);
+    u32 getSampleCount() const;
+    // view space radius samples are taken in
+    void setRadius(float radius);
+    float getRadius() const;
+    // exponent applied to the occlusion, darkening it
+    void setIntensity(float intensity);
+    float getIntensity() const;
+    void setTemporal(bool enabled);
+    bool getTemporal() const;
+
+private:
+    static constexpr vk::Format DEPTH_FORMAT = vk::Format::eR32Sfloat;
+    static constexpr vk::Format OCCLUSION_FORMAT = vk::Format::eR32Sfloat;
+    // occlusion and the view depth it was computed at
+    static constexpr vk::Format HISTORY_FORMAT = vk::Format::eR32G32Sfloat;
+
+    void createHistory();
+    void dispatch(const vk::raii::CommandBuffer& commandBuffer, const Pipeline& pipeline, const vk::raii::DescriptorSet& descriptorSet) const;
+    void copyHistory(const vk::raii::CommandBuffer& commandBuffer) const;
+
+    vk::Extent2D m_extent;
+    vk::Extent2D m_halfExtent;
+    // the part of the half resolution images written this frame
+    vk::Extent2D m_renderExtent;
+    vk::Extent2D m_renderHalfExtent;
+
+    std::unique_ptr<Pipeline> m_depthPipeline;
+    std::unique_ptr<Pipeline> m_depthMultisampledPipeline;
+    std::unique_ptr<Pipeline> m_occlusionPipeline;
+    std::unique_ptr<Pipeline> m_temporalPipeline;
+    vk::raii::DescriptorSet m_depthDescriptor = nullptr;
+    vk::raii::DescriptorSet m_occlusionDescriptor = nullptr;
+    vk::raii::DescriptorSet m_temporalDescriptor = nullptr;
+    vk::raii::Sampler m_nearestSampler = nullptr;
+    vk::raii::Sampler m_linearSampler = nullptr;
+
+    // this frame's accumulated occlusion, copied out of the graph so it's there to reproject next frame
+    std::unique_ptr<Image> m_history;
+
+    RenderGraph::Handle m_depthResource = 0;
+    RenderGraph::Handle m_halfDepth = 0;
+    RenderGraph::Handle m_rawOcclusion = 0;
+    RenderGraph::Handle m_accumulated = 0;
+    RenderGraph::Handle m_historyResource = 0;
+    vk::Image m_accumulatedImage = nullptr;
+    bool m_multisampled = false;
+
+    bool m_enabled = true;
+    u32 m_sampleCount = 8;
+    float m_radius = 0.5f;
+    float m_intensity = 1.5f;
+    bool m_temporal = true;
+
+    FrameAllocation<Params> m_params;
+    glm::mat4 m_previousViewProjection = glm::mat4(1.0f);
+    bool m_historyValid = false;
+    u32 m_frame = 0;
+};
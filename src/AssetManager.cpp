@@ -7,10 +7,74 @@
 #include <stb_image.h>
 #include <ktx.h>
 #include <fastgltf/glm_element_traits.hpp>
+#include <meshoptimizer.h>
 
 #include "Components.h"
 
-AssetManager::AssetManager() {
+namespace {
+    // each level aims for this fraction of the triangles of the one before
+    constexpr float LOD_REDUCTION = 0.5f;
+    // levels with fewer triangles than this aren't worth drawing instead
+    constexpr size_t MIN_LOD_TRIANGLES = 64;
+    // how much the vertex cache hit rate can be given up to draw fewer hidden pixels
+    constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    // reorder triangles for the post-transform vertex cache, then for overdraw where it costs little of that
+    // the mesh draws its triangles in meshlet order, and meshlets are grown from the triangles in this order, so they
+    // come out front to back much as the triangles do - the order within each meshlet is optimised as it's built
+    void orderTriangles(const std::vector<Vertex>& vertices, std::vector<u32>& indexes) {
+        meshopt_optimizeVertexCache(indexes.data(), indexes.data(), indexes.size(), vertices.size());
+        meshopt_optimizeOverdraw(indexes.data(), indexes.data(), indexes.size(), &vertices[0].pos.x, vertices.size(), sizeof(Vertex), OVERDRAW_THRESHOLD);
+    }
+
+    // order the triangles, then the vertices in the order the triangles first use them - vertices no triangle uses
+    // are dropped
+    void optimiseMesh(std::vector<Vertex>& vertices, std::vector<u32>& indexes) {
+        orderTriangles(vertices, indexes);
+        vertices.resize(meshopt_optimizeVertexFetch(vertices.data(), indexes.data(), indexes.size(), vertices.data(), vertices.size(), sizeof(Vertex)));
+    }
+
+    // average vertices transformed per triangle
+    float getAcmr(const std::vector<u32>& indexes, const size_t vertexCount) {
+        return meshopt_analyzeVertexCache(indexes.data(), indexes.size(), vertexCount, Mesh<>::ACMR_CACHE_SIZE, 0, 0).acmr;
+    }
+
+    struct MeshLods {
+        std::vector<std::vector<u32>> indexes;
+        std::vector<float> errors;
+    };
+
+    // quadric error simplified levels of detail over the same vertices, starting with the full detail indexes
+    MeshLods generateLods(const std::vector<Vertex>& vertices, std::vector<u32> indexes) {
+        MeshLods lods;
+        // reserved so the full detail indexes aren't moved while they're being simplified
+        lods.indexes.reserve(Mesh<>::MAX_LODS);
+        lods.indexes.push_back(std::move(indexes));
+        lods.errors.push_back(0.0f);
+
+        const std::vector<u32>& source = lods.indexes.front();
+        size_t targetCount = source.size();
+        while (lods.indexes.size() < Mesh<>::MAX_LODS) {
+            targetCount = static_cast<size_t>(static_cast<float>(targetCount) * LOD_REDUCTION) / 3 * 3;
+            if (targetCount < MIN_LOD_TRIANGLES * 3) break;
+
+            // always simplified from full detail, so the error is measured against it - it's relative to the mesh's
+            // extent, and isn't limited as levels are only picked once their error is small enough on screen
+            std::vector<u32> lod(source.size());
+            float error = 0.0f;
+            lod.resize(meshopt_simplify(lod.data(), source.data(), source.size(), &vertices[0].pos.x, vertices.size(), sizeof(Vertex), targetCount, 1.0f, 0, &error));
+            // the simplifier stops early once removing more would tear the mesh apart
+            if (static_cast<float>(lod.size()) > static_cast<float>(lods.indexes.back().size()) * 0.9f) break;
+            orderTriangles(vertices, lod);
+
+            lods.indexes.push_back(std::move(lod));
+            lods.errors.push_back(error);
+        }
+        return lods;
+    }
+}
+
+AssetManager::AssetManager() : m_geometryPool(1 << 18, 1 << 20) {
     stbi_set_flip_vertically_on_load(true);
 
     std::array<u8, 4> whitePixels = {255, 255, 255, 255};
@@ -71,7 +135,7 @@ AssetManager::AssetManager() {
         for (u32 i = 0; i < vertices.size(); ++i) {
             indexes.push_back(i);
         }
-        m_meshes.push_back(std::make_unique<Mesh<>>(vertices, indexes));
+        m_meshes.push_back(std::make_unique<Mesh<>>(m_geometryPool, vertices, indexes));
         m_unitCubeMesh = m_meshes.back().get();
     }
 }
@@ -197,7 +261,19 @@ ECS::Entity AssetManager::loadGLB(const std::filesystem::path& path) {
         Texture *metallicRoughnessTexture = material.pbrData.metallicRoughnessTexture.has_value() ? resolveTexture(material.pbrData.metallicRoughnessTexture.value().textureIndex, vk::Format::eR8G8B8A8Unorm) : m_pureWhite1x1Texture;
         Texture *aoTexture = material.occlusionTexture.has_value() ? resolveTexture(material.occlusionTexture.value().textureIndex, vk::Format::eR8G8B8A8Unorm) : m_pureWhite1x1Texture;
         Texture *normalTexture = material.normalTexture.has_value() ? resolveTexture(material.normalTexture.value().textureIndex, vk::Format::eR8G8B8A8Unorm) : m_normal1x1Texture;
-        m_materials.push_back(std::make_unique<Material>(baseTexture, metallicRoughnessTexture, aoTexture, normalTexture));
+        const auto& baseColour = material.pbrData.baseColorFactor;
+        const MaterialFactors factors = {
+            .baseColour = glm::vec4(baseColour[0], baseColour[1], baseColour[2], baseColour[3]),
+            .metallic = material.pbrData.metallicFactor,
+            .roughness = material.pbrData.roughnessFactor,
+            .aoStrength = material.occlusionTexture.has_value() ? material.occlusionTexture.value().strength : 1.0f,
+            .normalScale = material.normalTexture.has_value() ? material.normalTexture.value().scale : 1.0f,
+            .alphaCutoff = material.alphaCutoff
+        };
+        AlphaMode alphaMode = AlphaMode::Opaque;
+        if (material.alphaMode == fastgltf::AlphaMode::Mask) alphaMode = AlphaMode::Mask;
+        else if (material.alphaMode == fastgltf::AlphaMode::Blend) alphaMode = AlphaMode::Blend;
+        m_materials.push_back(std::make_unique<Material>(baseTexture, metallicRoughnessTexture, aoTexture, normalTexture, factors, alphaMode));
         materials.emplace_back(m_materials.back().get());
     }
     Logger::info("test");
@@ -297,6 +373,10 @@ Mesh<> * AssetManager::getUnitCube() const {
     return m_unitCubeMesh;
 }
 
+const GeometryPool<PackedVertex> & AssetManager::getGeometryPool() const {
+    return m_geometryPool;
+}
+
 std::unique_ptr<Mesh<>> AssetManager::loadMesh(const fastgltf::Asset& ctx, const fastgltf::Mesh &mesh) {
     if (mesh.primitives.size() > 1) {
         Logger::warn(std::format("Mesh loader does not currently support more than one 1 primitive per mesh, only the first was loaded ({} total)", mesh.primitives.size()));
@@ -337,7 +417,24 @@ std::unique_ptr<Mesh<>> AssetManager::loadMesh(const fastgltf::Asset& ctx, const
         indexes.push_back(index);
     });
 
-    return std::make_unique<Mesh<>>(vertices, indexes);
+    const size_t importedVertexCount = vertices.size();
+    const float importedAcmr = getAcmr(indexes, vertices.size());
+    optimiseMesh(vertices, indexes);
+
+    const MeshLods lods = generateLods(vertices, std::move(indexes));
+
+    // what dropping unused vertices and narrowing indexes saves in the geometry pool
+    size_t indexCount = 0;
+    for (const std::vector<u32>& lod : lods.indexes) {
+        indexCount += lod.size();
+    }
+    const bool shortIndexes = GeometryPool<PackedVertex>::getIndexType(static_cast<u32>(vertices.size())) == vk::IndexType::eUint16;
+    const size_t bytesSaved = (importedVertexCount - vertices.size()) * sizeof(PackedVertex) + (shortIndexes ? indexCount * (sizeof(u32) - sizeof(u16)) : 0);
+    auto result = std::make_unique<Mesh<>>(m_geometryPool, vertices, lods.indexes, lods.errors);
+    // measured on the meshlet ordered indexes the mesh uploads, as that's the order they're drawn in
+    Logger::info("Optimised mesh {}: ACMR {:.3f} -> {:.3f}, {} bit indexes, {} bytes saved", mesh.name, importedAcmr, result->getAcmr(), shortIndexes ? 16 : 32, bytesSaved);
+
+    return result;
 }
 
 void AssetManager::loadImage(std::string path) {
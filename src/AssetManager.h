@@ -17,10 +17,12 @@ public:
     std::unique_ptr<Skybox> loadSkybox(const std::string& folderPath, const char* ext = "png");
 
     Mesh<>* getUnitCube() const;
+    const GeometryPool<PackedVertex>& getGeometryPool() const;
 private:
     std::unique_ptr<Mesh<>> loadMesh(const fastgltf::Asset &ctx, const fastgltf::Mesh &mesh);
     void loadImage(std::string path);
 
+    GeometryPool<PackedVertex> m_geometryPool;
     std::vector<std::unique_ptr<Mesh<>>> m_meshes;
     std::vector<std::unique_ptr<Material>> m_materials;
     std::vector<std::unique_ptr<Texture>> m_textures;
@@ -3,55 +3,54 @@
 #include "Renderer3D.h"
 
 BoundingVolumeRenderer::BoundingVolumeRenderer(const Renderer3D* parentRenderer)
-	: m_modelUniforms(ECS::MAX_ENTITIES)
+	: m_geometryPool(128, 256)
 {
 	createPipeline(parentRenderer->getSampleCount());
 
 	m_frameDescriptor = m_pipeline->createDescriptorSet(FRAME_SET_NUMBER);
 	m_modelDescriptor = m_pipeline->createDescriptorSet(MODEL_SET_NUMBER);
 
-	m_frameUniforms.addToSet(m_frameDescriptor, 0);
-	m_modelUniforms.addToSet(m_modelDescriptor, 0);
+	const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+	frameAllocator->addToSet(m_frameDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(BoundingFrameUniform));
+	frameAllocator->addToSet(m_modelDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(BoundingVolumeUniform));
 
 	createVolumes();
 }
 
 void BoundingVolumeRenderer::draw(const vk::raii::CommandBuffer& commandBuffer) {
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline->getPipeline());
+	m_pipeline->bind(commandBuffer);
 
+	FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
 	const auto camera = ECS::getSystem<ControlledCameraSystem>();
-	m_frameUniforms.setData({
+	const auto frameUniforms = frameAllocator->push<BoundingFrameUniform>({
 		.view = camera->getViewMatrix(),
 		.projection = camera->getProjectionMatrix(),
 	});
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, {});
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, {frameUniforms.offset});
 
-	u32 i = 0;
 	for (const auto& sphere : m_sphereQueue) {
-		m_modelUniforms.setData(i, {
+		const auto modelUniforms = frameAllocator->push<BoundingVolumeUniform>({
 			.transform = glm::scale(glm::translate(glm::mat4(1.0f), sphere.sphere.center), glm::vec3(sphere.sphere.radius)),
 			.colour = sphere.colour
 		});
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {i * m_modelUniforms.getItemSize()});
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {modelUniforms.offset});
 		m_sphereMesh->draw(commandBuffer);
-		++i;
 	}
 	for (const auto& obb : m_obbQueue) {
-		m_modelUniforms.setData(i, {
+		const auto modelUniforms = frameAllocator->push<BoundingVolumeUniform>({
 			.transform = glm::scale(glm::translate(glm::mat4(1.0f), obb.obb.center) * glm::mat4_cast(obb.obb.rotation), obb.obb.extent),
 			.colour = obb.colour
 		});
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {i * m_modelUniforms.getItemSize()});
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {modelUniforms.offset});
 		m_cubeMesh->draw(commandBuffer);
-		++i;
 	}
 
 	m_sphereQueue.clear();
 	m_obbQueue.clear();
 }
 
-void BoundingVolumeRenderer::rebuild() {
-	createPipeline(VulkanEngine::getRenderer()->getSampleCount());
+void BoundingVolumeRenderer::setSampleCount(const vk::SampleCountFlagBits samples) {
+	m_pipeline->setSamples(samples);
 }
 
 void BoundingVolumeRenderer::queueSphere(const Sphere &sphere, const glm::vec3 &colour) {
@@ -68,10 +67,11 @@ void BoundingVolumeRenderer::createPipeline(const vk::SampleCountFlagBits sample
 		.addShaderStage("shaders/line.frag.spv")
 		.setVertexInfo(BasicVertex::getBindingDescription(), BasicVertex::getAttributeDescriptions())
 		.addAttachment(VulkanEngine::getSwapColourFormat())
-		.addBinding(0, 0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex) // view / project
+		.addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex) // view / project
 		.addBinding(2, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex) // model data
 		.setTopology(vk::PrimitiveTopology::eLineList)
 		.setSamples(samples)
+		.allowStateChanges()
 		.create();
 }
 
@@ -101,7 +101,7 @@ void BoundingVolumeRenderer::createVolumes() {
 			indexes.push_back(index - steps);
 		}
 
-		m_sphereMesh = std::make_unique<Mesh<BasicVertex>>(vertices, indexes);
+		m_sphereMesh = std::make_unique<Mesh<BasicVertex>>(m_geometryPool, vertices, indexes);
 	}
 
 	// cube
@@ -131,6 +131,6 @@ void BoundingVolumeRenderer::createVolumes() {
 			2, 6,
 			3, 7
 		};
-		m_cubeMesh = std::make_unique<Mesh<BasicVertex>>(vertices, indexes);
+		m_cubeMesh = std::make_unique<Mesh<BasicVertex>>(m_geometryPool, vertices, indexes);
 	}
 }
@@ -3,8 +3,10 @@
 #include <glm/glm.hpp>
 #include <vulkan/vulkan_raii.hpp>
 
+#include "ECS.h"
 #include "Volumes.h"
 #include "Pipeline.h"
+#include "FrameAllocator.h"
 #include "UniformBufferBlock.h"
 
 class BoundingVolumeRenderer {
@@ -12,7 +14,7 @@ public:
     explicit BoundingVolumeRenderer(const Renderer3D* parentRenderer);
 
     void draw(const vk::raii::CommandBuffer &commandBuffer);
-    void rebuild();
+    void setSampleCount(vk::SampleCountFlagBits samples);
 
     void queueSphere(const Sphere& sphere, const glm::vec3& colour);
     void queueOBB(const OBB& obb, const glm::vec3& colour);
@@ -43,15 +45,14 @@ private:
 
     std::unique_ptr<Pipeline> m_pipeline = nullptr;
 
+    // uniforms are pushed to the frame allocator and bound with dynamic offsets
     vk::raii::DescriptorSet m_frameDescriptor = nullptr;
     vk::raii::DescriptorSet m_modelDescriptor = nullptr;
 
-    UniformBufferBlock<BoundingFrameUniform> m_frameUniforms;
-    DynamicUniformBufferBlock<BoundingVolumeUniform> m_modelUniforms;
-
     std::vector<ColouredSphere> m_sphereQueue;
     std::vector<ColouredOBB> m_obbQueue;
 
+    GeometryPool<BasicVertex> m_geometryPool;
     std::unique_ptr<Mesh<BasicVertex>> m_sphereMesh = nullptr;
     std::unique_ptr<Mesh<BasicVertex>> m_cubeMesh = nullptr;
 };
@@ -0,0 +1,284 @@
+#include "ClusteredLighting.h"
+
+#include <bit>
+
+#include "ThreadPool.h"
+#include "VulkanEngine.h"
+
+namespace {
+    // lights the CPU path tests against a cluster at once - the test has no branches over a batch, so the compiler can
+    // vectorise it to the width of the target's vector registers
+    constexpr u32 LIGHT_BATCH = 8;
+
+    // view space bounding box of a cluster, from the rays through its tile's corners cut at its slice's depths
+    std::pair<glm::vec3, glm::vec3> getClusterBounds(const u32 x, const u32 y, const u32 z, const ClusteredLighting::ClusterParams& params) {
+        const auto viewRay = [&](const glm::vec2 ndc) {
+            const glm::vec4 point = params.inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            return glm::vec3(point) / point.w;
+        };
+        const glm::vec2 tileSize = glm::vec2(2.0f) / glm::vec2(ClusteredLighting::CLUSTERS_X, ClusteredLighting::CLUSTERS_Y);
+        const glm::vec3 minRay = viewRay(glm::vec2(x, y) * tileSize - 1.0f);
+        const glm::vec3 maxRay = viewRay(glm::vec2(x + 1, y + 1) * tileSize - 1.0f);
+
+        // slices are spaced exponentially, so clusters stay roughly cube shaped with distance
+        const float ratio = params.far / params.near;
+        const float nearDepth = params.near * std::pow(ratio, static_cast<float>(z) / ClusteredLighting::CLUSTERS_Z);
+        const float farDepth = params.near * std::pow(ratio, static_cast<float>(z + 1) / ClusteredLighting::CLUSTERS_Z);
+
+        // the camera looks down -z, so a ray reaches a depth d at d / -ray.z along it
+        const std::array corners = {
+            minRay * (nearDepth / -minRay.z),
+            minRay * (farDepth / -minRay.z),
+            maxRay * (nearDepth / -maxRay.z),
+            maxRay * (farDepth / -maxRay.z),
+        };
+        glm::vec3 minBound = corners[0];
+        glm::vec3 maxBound = corners[0];
+        for (const glm::vec3& corner : corners) {
+            minBound = glm::min(minBound, corner);
+            maxBound = glm::max(maxBound, corner);
+        }
+        return {minBound, maxBound};
+    }
+
+    void writeStorageBuffer(const vk::DescriptorSet descriptorSet, const u32 binding, const vk::Buffer buffer) {
+        const vk::DescriptorBufferInfo bufferInfo = {
+            .buffer = buffer,
+            .offset = 0,
+            .range = vk::WholeSize,
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &bufferInfo,
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+}
+
+ClusteredLighting::ClusteredLighting() {
+    reserveLights(LightSystem::INITIAL_LIGHT_CAPACITY);
+    std::tie(m_clusterBuffer, m_clusterMemory) = VulkanEngine::createBuffer(
+        sizeof(Cluster) * CLUSTER_COUNT,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+
+    m_pipeline = Pipeline::Builder()
+        .addShaderStage("shaders/cluster.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eCompute) // cluster parameters
+        .addBinding(0, 1, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute) // lights
+        .addBinding(0, 2, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute) // clusters
+        .create();
+
+    m_descriptorSet = m_pipeline->createDescriptorSet(0);
+    VulkanEngine::getFrameAllocator()->addToSet(m_descriptorSet, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(ClusterParams));
+    addToSet(m_descriptorSet, 1, 2);
+}
+
+void ClusteredLighting::update(const glm::mat4 &view, const glm::mat4 &projection, const float near, const float far) {
+    LightSystem* lightSystem = ECS::getSystem<LightSystem>();
+    const std::vector<u32>& changed = lightSystem->update();
+    const auto& lights = lightSystem->getLights();
+    m_lightCount = lightSystem->getLightCount();
+    m_uploadedLightCount = static_cast<u32>(changed.size());
+    if (m_lightCount > m_lightCapacity) {
+        reserveLights(std::max(m_lightCapacity * 2, m_lightCount));
+    }
+
+    FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    m_lightCopies.clear();
+    if (!changed.empty()) {
+        m_lightUploads = frameAllocator->allocate<LightSystem::PointLightData>(static_cast<u32>(changed.size()));
+        for (u32 i = 0; i < changed.size(); ++i) {
+            constexpr vk::DeviceSize lightSize = sizeof(LightSystem::PointLightData);
+            m_lightUploads.data[i] = lights[changed[i]];
+
+            const vk::DeviceSize dstOffset = changed[i] * lightSize;
+            // changed lights are found in order, so runs of neighbouring lights become a single copy
+            if (!m_lightCopies.empty() && m_lightCopies.back().dstOffset + m_lightCopies.back().size == dstOffset) {
+                m_lightCopies.back().size += lightSize;
+                continue;
+            }
+            m_lightCopies.push_back({
+                .srcOffset = m_lightUploads.offset + i * lightSize,
+                .dstOffset = dstOffset,
+                .size = lightSize,
+            });
+        }
+    }
+
+    m_params = frameAllocator->push<ClusterParams>({
+        .view = view,
+        .inverseProjection = glm::inverse(projection),
+        .near = near,
+        .far = far,
+        .lightCount = m_lightCount,
+    });
+
+    if (m_cpuClustering) {
+        buildClusters(*m_params.data);
+    }
+}
+
+void ClusteredLighting::addPasses(RenderGraph &graph) {
+    m_lightResource = graph.importBuffer("Lights");
+    m_clusterResource = graph.importBuffer("Clusters");
+    graph.setBuffer(m_lightResource, *m_lightBuffer);
+    graph.setBuffer(m_clusterResource, *m_clusterBuffer);
+
+    graph.addPass("Light Upload", {
+        {m_lightResource, ResourceUsage::TransferDst},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        uploadLights(commandBuffer);
+    });
+
+    if (m_cpuClustering) {
+        graph.addPass("Cluster Upload", {
+            {m_clusterResource, ResourceUsage::TransferDst},
+        }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+            uploadClusters(commandBuffer);
+        });
+        return;
+    }
+    graph.addPass("Light Clustering", {
+        {m_lightResource, ResourceUsage::StorageRead},
+        {m_clusterResource, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer);
+    });
+}
+
+RenderGraph::Handle ClusteredLighting::getLightResource() const {
+    return m_lightResource;
+}
+
+RenderGraph::Handle ClusteredLighting::getClusterResource() const {
+    return m_clusterResource;
+}
+
+void ClusteredLighting::setBuffers(RenderGraph &graph) const {
+    graph.setBuffer(m_lightResource, *m_lightBuffer);
+}
+
+void ClusteredLighting::addToSet(const vk::raii::DescriptorSet &descriptorSet, const u32 lightBinding, const u32 clusterBinding) {
+    writeStorageBuffer(descriptorSet, lightBinding, m_lightBuffer);
+    writeStorageBuffer(descriptorSet, clusterBinding, m_clusterBuffer);
+    m_lightBindings.emplace_back(*descriptorSet, lightBinding);
+}
+
+glm::vec2 ClusteredLighting::getSliceScaleBias(const float near, const float far) {
+    const float logRatio = std::log(far / near);
+    return {CLUSTERS_Z / logRatio, CLUSTERS_Z * std::log(near) / logRatio};
+}
+
+void ClusteredLighting::setCPUClustering(const bool enabled) {
+    m_cpuClustering = enabled;
+    VulkanEngine::queueRendererRebuild();
+}
+
+bool ClusteredLighting::getCPUClustering() const {
+    return m_cpuClustering;
+}
+
+u32 ClusteredLighting::getLightCount() const {
+    return m_lightCount;
+}
+
+u32 ClusteredLighting::getUploadedLightCount() const {
+    return m_uploadedLightCount;
+}
+
+void ClusteredLighting::reserveLights(const u32 capacity) {
+    auto [lightBuffer, lightMemory] = VulkanEngine::createBuffer(
+        sizeof(LightSystem::PointLightData) * capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+
+    // only lights that changed are uploaded, so the ones already there are moved across - and frames in flight may
+    // still be reading the old buffer
+    if (m_lightCapacity > 0) {
+        Logger::info("Growing light buffer to {} lights", capacity);
+        VulkanEngine::getDevice().waitIdle();
+        VulkanEngine::copyBuffer(m_lightBuffer, lightBuffer, sizeof(LightSystem::PointLightData) * m_lightCapacity);
+    }
+
+    m_lightBuffer = std::move(lightBuffer);
+    m_lightMemory = std::move(lightMemory);
+    m_lightCapacity = capacity;
+    for (const auto [descriptorSet, binding] : m_lightBindings) {
+        writeStorageBuffer(descriptorSet, binding, m_lightBuffer);
+    }
+}
+
+void ClusteredLighting::buildClusters(const ClusterParams &params) {
+    const auto& lights = ECS::getSystem<LightSystem>()->getLights();
+    // padded to whole batches with lights that reach nothing, as a negative squared range fails every test
+    const size_t paddedCount = (lights.size() + LIGHT_BATCH - 1) / LIGHT_BATCH * LIGHT_BATCH;
+    m_viewLights.x.assign(paddedCount, 0.0f);
+    m_viewLights.y.assign(paddedCount, 0.0f);
+    m_viewLights.z.assign(paddedCount, 0.0f);
+    m_viewLights.rangeSquared.assign(paddedCount, -1.0f);
+    for (u32 i = 0; i < lights.size(); ++i) {
+        const glm::vec3 position = glm::vec3(params.view * glm::vec4(lights[i].position, 1.0f));
+        m_viewLights.x[i] = position.x;
+        m_viewLights.y[i] = position.y;
+        m_viewLights.z[i] = position.z;
+        m_viewLights.rangeSquared[i] = lights[i].range * lights[i].range;
+    }
+
+    m_cpuClusters = VulkanEngine::getFrameAllocator()->allocate<Cluster>(CLUSTER_COUNT);
+    VulkanEngine::getThreadPool()->parallelFor(CLUSTER_COUNT, CLUSTERS_X * CLUSTERS_Y, [&](const u32 begin, const u32 end) {
+        for (u32 i = begin; i < end; ++i) {
+            const auto [minBound, maxBound] = getClusterBounds(i % CLUSTERS_X, i / CLUSTERS_X % CLUSTERS_Y, i / (CLUSTERS_X * CLUSTERS_Y), params);
+
+            Cluster& cluster = m_cpuClusters.data[i];
+            u32 count = 0;
+            for (u32 first = 0; first < paddedCount && count < MAX_LIGHTS_PER_CLUSTER; first += LIGHT_BATCH) {
+                const float* x = &m_viewLights.x[first];
+                const float* y = &m_viewLights.y[first];
+                const float* z = &m_viewLights.z[first];
+                const float* rangeSquared = &m_viewLights.rangeSquared[first];
+
+                // squared distance from each light to the closest point in the cluster, as a bit per light reaching it
+                u32 hits = 0;
+                for (u32 j = 0; j < LIGHT_BATCH; ++j) {
+                    const float dx = std::max(std::max(minBound.x - x[j], x[j] - maxBound.x), 0.0f);
+                    const float dy = std::max(std::max(minBound.y - y[j], y[j] - maxBound.y), 0.0f);
+                    const float dz = std::max(std::max(minBound.z - z[j], z[j] - maxBound.z), 0.0f);
+                    hits |= static_cast<u32>(dx * dx + dy * dy + dz * dz <= rangeSquared[j]) << j;
+                }
+
+                for (; hits != 0 && count < MAX_LIGHTS_PER_CLUSTER; hits &= hits - 1) {
+                    cluster.lights[count++] = first + std::countr_zero(hits);
+                }
+            }
+            cluster.lightCount = count;
+        }
+    });
+}
+
+void ClusteredLighting::uploadLights(const vk::raii::CommandBuffer &commandBuffer) const {
+    if (m_lightCopies.empty()) return;
+    commandBuffer.copyBuffer(m_lightUploads.buffer, *m_lightBuffer, m_lightCopies);
+}
+
+void ClusteredLighting::dispatch(const vk::raii::CommandBuffer &commandBuffer) const {
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline->getPipeline());
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipeline->getLayout(), 0, {*m_descriptorSet}, {m_params.offset});
+    // one workgroup per slice, with an invocation per cluster
+    commandBuffer.dispatch(1, 1, CLUSTERS_Z);
+}
+
+void ClusteredLighting::uploadClusters(const vk::raii::CommandBuffer &commandBuffer) const {
+    const vk::BufferCopy copy = {
+        .srcOffset = m_cpuClusters.offset,
+        .dstOffset = 0,
+        .size = sizeof(Cluster) * CLUSTER_COUNT,
+    };
+    commandBuffer.copyBuffer(m_cpuClusters.buffer, *m_clusterBuffer, copy);
+}
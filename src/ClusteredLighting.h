@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "FrameAllocator.h"
+#include "LightSystem.h"
+#include "Pipeline.h"
+#include "RenderGraph.h"
+
+// clustered forward lighting - the view frustum is split into a grid of froxels, each cluster gets the list of lights
+// whose range reaches it, and shading only loops over the lights in the fragment's cluster
+//
+// lights live in a device local buffer that only has the lights that changed copied into it, doubling in size whenever
+// there are more lights than it holds, and clusters are built by a compute pass, or on the CPU across the thread pool
+// as a fallback
+class ClusteredLighting {
+public:
+    // must match the defines in model.frag and cluster.comp
+    static constexpr u32 CLUSTERS_X = 16;
+    static constexpr u32 CLUSTERS_Y = 9;
+    static constexpr u32 CLUSTERS_Z = 24;
+    static constexpr u32 CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    // lights past this in a single cluster are ignored
+    static constexpr u32 MAX_LIGHTS_PER_CLUSTER = 64;
+
+    // std430 layout, matching Cluster in model.frag and cluster.comp
+    struct Cluster {
+        u32 lightCount;
+        std::array<u32, MAX_LIGHTS_PER_CLUSTER> lights;
+    };
+
+    // std140 layout, matching ClusterParams in cluster.comp
+    struct ClusterParams {
+        glm::mat4 view;
+        glm::mat4 inverseProjection;
+        float near, far;
+        u32 lightCount;
+    };
+
+    ClusteredLighting();
+
+    // upload the lights that changed and this frame's cluster parameters, building the clusters now on the CPU path
+    void update(const glm::mat4& view, const glm::mat4& projection, float near, float far);
+
+    // add the passes that upload lights and build clusters - shading passes read the light and cluster resources
+    void addPasses(RenderGraph& graph);
+    RenderGraph::Handle getLightResource() const;
+    RenderGraph::Handle getClusterResource() const;
+
+    // point the graph at the light buffer, before it is executed - the buffer is replaced as it grows
+    void setBuffers(RenderGraph& graph) const;
+
+    // point storage buffer bindings at the lights and clusters - the light binding is written again whenever the light
+    // buffer grows
+    void addToSet(const vk::raii::DescriptorSet& descriptorSet, u32 lightBinding, u32 clusterBinding);
+
+    // scale and bias that map the log of a view space depth to its cluster slice
+    static glm::vec2 getSliceScaleBias(float near, float far);
+
+    void setCPUClustering(bool enabled);
+    bool getCPUClustering() const;
+
+    u32 getLightCount() const;
+    // number of lights copied to the GPU this frame
+    u32 getUploadedLightCount() const;
+
+private:
+    // replace the light buffer with one holding capacity lights, keeping the lights already uploaded
+    void reserveLights(u32 capacity);
+    void buildClusters(const ClusterParams& params);
+    void uploadLights(const vk::raii::CommandBuffer& commandBuffer) const;
+    void dispatch(const vk::raii::CommandBuffer& commandBuffer) const;
+    void uploadClusters(const vk::raii::CommandBuffer& commandBuffer) const;
+
+    vk::raii::Buffer m_lightBuffer = nullptr;
+    vk::raii::DeviceMemory m_lightMemory = nullptr;
+    u32 m_lightCapacity = 0;
+    // every set and binding the light buffer was added to
+    std::vector<std::pair<vk::DescriptorSet, u32>> m_lightBindings;
+    vk::raii::Buffer m_clusterBuffer = nullptr;
+    vk::raii::DeviceMemory m_clusterMemory = nullptr;
+
+    std::unique_ptr<Pipeline> m_pipeline;
+    vk::raii::DescriptorSet m_descriptorSet = nullptr;
+
+    RenderGraph::Handle m_lightResource = 0;
+    RenderGraph::Handle m_clusterResource = 0;
+    bool m_cpuClustering = false;
+
+    // this frame's allocations from the frame allocator
+    FrameAllocation<ClusterParams> m_params;
+    FrameAllocation<LightSystem::PointLightData> m_lightUploads;
+    FrameAllocation<Cluster> m_cpuClusters;
+    std::vector<vk::BufferCopy> m_lightCopies;
+    u32 m_lightCount = 0;
+    u32 m_uploadedLightCount = 0;
+
+    // view space lights as a structure of arrays, so the CPU path tests them from contiguous floats
+    struct {
+        std::vector<float> x, y, z, rangeSquared;
+    } m_viewLights;
+};
@@ -17,6 +17,13 @@ using i32 = std::int32_t;
 constexpr u32 FRAME_SET_NUMBER = 0;
 constexpr u32 MATERIAL_SET_NUMBER = 1;
 constexpr u32 MODEL_SET_NUMBER = 2;
+// only in the pipelines drawing culled meshlets with mesh shaders, see MeshletCulling::addMeshBindings
+constexpr u32 MESHLET_SET_NUMBER = 3;
+
+// number of frames the CPU can record ahead of the GPU - every resource written while recording has this many copies
+// 2 keeps latency low, 3 gives more slack when the CPU and GPU times are close
+constexpr u32 FRAMES_IN_FLIGHT = 2;
+static_assert(FRAMES_IN_FLIGHT >= 1 && FRAMES_IN_FLIGHT <= 3);
 
 struct FrameTimeInfo {
     // time between each frame in milliseconds
@@ -75,6 +82,16 @@ inline std::vector<char> readFile(const std::string& filename) {
     return buffer;
 }
 
+// 64 bit FNV-1a - not for anything adversarial, but quick and stable between runs, so usable as a cache key
+inline u64 hashBytes(const void* data, const size_t size, u64 hash = 0xcbf29ce484222325) {
+    const auto bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
 inline std::string tolower(const std::string& str) {
     std::string cpy = str;
     std::ranges::transform(cpy.begin(), cpy.end(), cpy.begin(), [](unsigned char c) { return std::tolower(c); });
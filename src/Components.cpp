@@ -76,7 +76,7 @@ glm::quat Transform::getRotation(const glm::mat4& matrix) {
 
 void Transform::updateTransform(const ECS::Entity entity) {
     const auto hierarchy = ECS::getComponentOptional<HierarchyComponent>(entity);
-    auto& [position, rotation, scale, transform] = ECS::getComponent<Transform>(entity);
+    auto& [position, rotation, scale, transform, version] = ECS::getComponent<Transform>(entity);
 
     transform = glm::translate(glm::mat4(1.0f), position);
     transform = transform * glm::mat4_cast(rotation);
@@ -88,6 +88,7 @@ void Transform::updateTransform(const ECS::Entity entity) {
             transform = parentTransform->transform * transform;
         }
     }
+    ++version;
 
     if (ECS::hasComponent<BoundingVolume>(entity)) {
         ECS::getComponent<BoundingVolume>(entity) = BoundingVolume::from(entity);
@@ -37,6 +37,8 @@ struct Transform {
     glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
     glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
     glm::mat4 transform = glm::mat4(1.0f);
+    // incremented whenever the transform is recalculated, so systems caching anything derived from it can tell it moved
+    u32 version = 0;
 
     static glm::vec3 getTransform(const glm::mat4& matrix);
     static glm::vec3 getScale(const glm::mat4& matrix);
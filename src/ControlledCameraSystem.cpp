@@ -90,13 +90,22 @@ glm::mat4 ControlledCameraSystem::getViewMatrix() const {
     return glm::lookAt(camera.position, camera.position + front, up);
 }
 
-glm::mat4 ControlledCameraSystem::getProjectionMatrix() const {
+glm::mat4 ControlledCameraSystem::getProjectionMatrix(const bool jittered) const {
     const ControlledCamera& camera = getCamera();
     glm::mat4 temp = glm::perspective(camera.fov, camera.aspect, camera.near, camera.far);
     temp[1][1] *= -1; // glm assumes opengl coordinates so we flip for vulkan
+    if (jittered) {
+        // clip w is -z, so this shifts every point by the jitter after the perspective divide
+        temp[2][0] -= m_jitter.x;
+        temp[2][1] -= m_jitter.y;
+    }
     return temp;
 }
 
+void ControlledCameraSystem::setJitter(const glm::vec2 jitter) {
+    m_jitter = jitter;
+}
+
 Frustum ControlledCameraSystem::getFrustum() const {
     const ControlledCamera& camera = getCamera();
     const auto [cameraFront, cameraRight, cameraUp] = getVectors();
@@ -140,7 +149,7 @@ Ray ControlledCameraSystem::normalisedScreenToRay(const glm::vec2 normalisedScre
     const ControlledCamera& camera = getCamera();
     return {
         .origin = camera.position,
-        .direction = glm::normalize(glm::inverse(glm::mat3(getViewMatrix())) * glm::vec3(glm::vec2(glm::inverse(getProjectionMatrix()) * glm::vec4(normalisedScreenCoordinates.x, normalisedScreenCoordinates.y, -1.0f, 1.0f)), -1.0f))
+        .direction = glm::normalize(glm::inverse(glm::mat3(getViewMatrix())) * glm::vec3(glm::vec2(glm::inverse(getProjectionMatrix(false)) * glm::vec4(normalisedScreenCoordinates.x, normalisedScreenCoordinates.y, -1.0f, 1.0f)), -1.0f))
     };
 }
 
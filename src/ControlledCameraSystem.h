@@ -15,7 +15,10 @@ public:
     explicit ControlledCameraSystem();
     void update(float deltaTime) override;
     glm::mat4 getViewMatrix() const;
-    glm::mat4 getProjectionMatrix() const;
+    // jittered by the offset given to setJitter, unless asked otherwise
+    glm::mat4 getProjectionMatrix(bool jittered = true) const;
+    // offset the projection by a subpixel amount in NDC, for temporal anti-aliasing
+    void setJitter(glm::vec2 jitter);
     Frustum getFrustum() const;
     // get normalized vector
     glm::vec3 getFrontVector() const;
@@ -24,4 +27,6 @@ public:
 
 private:
     ControlledCamera& getCamera() const;
+
+    glm::vec2 m_jitter = glm::vec2(0.0f);
 };
@@ -7,7 +7,9 @@
 #include <ranges>
 
 #include "Components.h"
+#include "DrawQueue.h"
 #include "EntitySystem.h"
+#include "FrameAllocator.h"
 #include "Renderer3D.h"
 #include "VulkanEngine.h"
 
@@ -88,11 +90,6 @@ void DebugWindow::draw(const vk::raii::CommandBuffer& commandBuffer) {
     }
 }
 
-void DebugWindow::rebuild() const {
-    ImGui_ImplVulkan_Shutdown();
-    initVulkanImpl();
-}
-
 void DebugWindow::initVulkanImpl() const{
     auto colourFormat = static_cast<VkFormat>(VulkanEngine::getSwapColourFormat());
     ImGui_ImplVulkan_InitInfo initInfo = {
@@ -102,15 +99,17 @@ void DebugWindow::initVulkanImpl() const{
         .Device = *VulkanEngine::getDevice(),
         .Queue = *VulkanEngine::getGraphicsQueue(),
         .MinImageCount = 2,
-        .ImageCount = 2,
-        .MSAASamples = static_cast<VkSampleCountFlagBits>(VulkanEngine::getRenderer()->getSampleCount()),
+        // ImGui cycles its vertex buffers by image count, so there must be at least one per frame in flight
+        .ImageCount = std::max(2u, FRAMES_IN_FLIGHT),
+        // drawn in its own pass straight to the swap image, after the scene has been resolved and scaled up
+        .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
         .DescriptorPoolSize = 64,
         .UseDynamicRendering = true,
         .PipelineRenderingCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
             .colorAttachmentCount = 1,
             .pColorAttachmentFormats = &colourFormat,
-            .depthAttachmentFormat = static_cast<VkFormat>(VulkanEngine::getDepthFormat()),
+            .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
         }
     };
     ImGui_ImplVulkan_Init(&initInfo);
@@ -221,6 +220,10 @@ void DebugWindow::drawNodeRecursive(ECS::Entity entity) {
                 const auto& model = ECS::getComponent<Model3D>(entity);
                 ImGui::Text("Mesh: <0x%X>", model.mesh);
                 ImGui::Text("Material: <0x%X>", model.material);
+                for (u32 lod = 0; lod < model.mesh->getLodCount(); ++lod) {
+                    const MeshLod& level = model.mesh->getLod(lod);
+                    ImGui::Text(std::format("LOD {}: {} triangles (error {:.4f})", lod, level.indexCount / 3, level.error).c_str());
+                }
 
                 if (ImGui::Button("Highlight in world")) {
                     VulkanEngine::getRenderer()->highlightEntity(entity);
@@ -232,7 +235,7 @@ void DebugWindow::drawNodeRecursive(ECS::Entity entity) {
         // Transform
         if (ECS::hasComponent<Transform>(entity)) {
             if (ImGui::TreeNodeEx("Transform", defaultTreeFlags)) {
-                auto&[position, rotation, scale, transform] = ECS::getComponent<Transform>(entity);
+                auto&[position, rotation, scale, transform, version] = ECS::getComponent<Transform>(entity);
                 bool changed = false;
                 changed |= ImGui::DragFloat3("Position", glm::value_ptr(position), 0.01f);
                 changed |= ImGui::DragFloat4("Rotation", glm::value_ptr(rotation), 0.01f, -1.0f, 1.0f);
@@ -295,7 +298,7 @@ void DebugWindow::drawMatrix(const glm::mat4 &matrix) {
     ImGui::PopItemWidth();
 }
 
-void DebugWindow::performanceTab() const {
+void DebugWindow::performanceTab() {
     if (ImGui::BeginTabItem("Performance")) {
         // frame times
         FrameTimeInfo avgTimes = { 0.0, 0.0, 0.0, 0.0 };
@@ -331,7 +334,25 @@ void DebugWindow::performanceTab() const {
         const auto rendererInfo = VulkanEngine::getRenderer()->getDebugInfo();
         ImGui::Text(std::format("Total Instances:    {}", rendererInfo.totalInstanceCount).c_str());
         ImGui::Text(std::format("Rendered Instances: {}", rendererInfo.renderedInstanceCount).c_str());
-        ImGui::Text(std::format("Material Switches:  {}", rendererInfo.materialSwitches).c_str());
+        ImGui::Text(std::format("Draw Calls:         {} ({} without instancing)", rendererInfo.drawCalls, rendererInfo.uninstancedDrawCalls).c_str());
+        ImGui::Text(std::format("Triangles:          {}", rendererInfo.renderedTriangleCount).c_str());
+        const auto& lodCounts = rendererInfo.lodInstanceCounts;
+        ImGui::Text(std::format("Instances per LOD:  {} / {} / {} / {}", lodCounts[0], lodCounts[1], lodCounts[2], lodCounts[3]).c_str());
+        ImGui::Text(std::format("Small Features:     {} culled", rendererInfo.smallFeatureCount).c_str());
+        ImGui::Text(std::format("Meshlets:           {} tested over {} instances", rendererInfo.meshletCount, rendererInfo.meshletInstanceCount).c_str());
+        ImGui::Text(std::format("Draw Sort:          {:.3f} ms", rendererInfo.sortTime).c_str());
+
+        const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+        ImGui::Text(std::format("Frame Uploads:      {} / {}", storageSizeToString(frameAllocator->getUsedSize()), storageSizeToString(frameAllocator->getRegionSize())).c_str());
+
+        if (ImGui::Button("Benchmark Sort (100k)")) {
+            m_sortBenchmarkTime = DrawQueue::benchmark(100000, 10);
+            Logger::info("Sorted 100k draw keys in {:.3f} ms", m_sortBenchmarkTime);
+        }
+        if (m_sortBenchmarkTime >= 0.0) {
+            ImGui::SameLine();
+            ImGui::Text(std::format("{:.3f} ms", m_sortBenchmarkTime).c_str());
+        }
 
         ImGui::EndTabItem();
     }
@@ -369,29 +390,36 @@ void DebugWindow::renderTab() const {
             ImGui::EndCombo();
         }
 
-        static constexpr std::array sampleOptions = { vk::SampleCountFlagBits::e1, vk::SampleCountFlagBits::e2, vk::SampleCountFlagBits::e4, vk::SampleCountFlagBits::e8 };
-        static constexpr std::array sampleNames = { "Off", "MSAAx2", "MSAAx4", "MSAAx8" };
+        // TAA sits between off and the MSAA options, and is single sampled
+        static constexpr std::array sampleOptions = { vk::SampleCountFlagBits::e1, vk::SampleCountFlagBits::e1, vk::SampleCountFlagBits::e2, vk::SampleCountFlagBits::e4, vk::SampleCountFlagBits::e8 };
+        static constexpr std::array sampleNames = { "Off", "TAA", "MSAAx2", "MSAAx4", "MSAAx8" };
+        constexpr int temporalOption = 1;
 
         const auto currentSamples = VulkanEngine::getRenderer()->getSampleCount();
         int i = 0;
         switch (currentSamples) {
             case vk::SampleCountFlagBits::e1:
-                i = 0;
+                i = VulkanEngine::getRenderer()->getTemporalAntiAliasing() ? temporalOption : 0;
                 break;
             case vk::SampleCountFlagBits::e2:
-                i = 1;
+                i = 2;
                 break;
             case vk::SampleCountFlagBits::e4:
-                i = 2;
+                i = 3;
                 break;
             case vk::SampleCountFlagBits::e8:
-                i = 3;
+                i = 4;
                 break;
             default:
                 i = -1;
         }
-        if (ImGui::SliderInt("Antialiasing", &i, 0, static_cast<int>(sampleOptions.size()) - 1, sampleNames[i])) {
-            VulkanEngine::getRenderer()->setSampleCount(sampleOptions.at(i));
+        // the G-buffer is single sampled, so deferred shading can only use TAA
+        const int maxOption = VulkanEngine::getRenderer()->getDeferred() ? temporalOption : static_cast<int>(sampleOptions.size()) - 1;
+        if (ImGui::SliderInt("Antialiasing", &i, 0, maxOption, sampleNames[i])) {
+            VulkanEngine::getRenderer()->setTemporalAntiAliasing(i == temporalOption);
+            if (i != temporalOption) {
+                VulkanEngine::getRenderer()->setSampleCount(sampleOptions.at(i));
+            }
         }
 
         bool isVsync = VulkanEngine::getPresentMode() == vk::PresentModeKHR::eFifo;
@@ -399,6 +427,132 @@ void DebugWindow::renderTab() const {
             VulkanEngine::setPresentMode(isVsync ? vk::PresentModeKHR::eFifo : vk::PresentModeKHR::eImmediate);
         }
 
+        bool wireframe = VulkanEngine::getRenderer()->getWireframe();
+        if (ImGui::Checkbox("Wireframe", &wireframe)) {
+            VulkanEngine::getRenderer()->setWireframe(wireframe);
+        }
+
+        const auto renderer = VulkanEngine::getRenderer();
+
+        ImGui::SeparatorText("Dynamic Resolution");
+
+        bool dynamicResolution = renderer->getDynamicResolution();
+        if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution)) {
+            renderer->setDynamicResolution(dynamicResolution);
+        }
+        DynamicResolution& resolutionController = renderer->getResolutionController();
+        ImGui::BeginDisabled(!dynamicResolution);
+        float targetTime = static_cast<float>(resolutionController.getTargetTime());
+        if (ImGui::SliderFloat("Target GPU Time", &targetTime, 4.0f, 33.3f, "%.1f ms")) {
+            resolutionController.setTargetTime(targetTime);
+        }
+        float sharpness = renderer->getSharpness();
+        if (ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f)) {
+            renderer->setSharpness(sharpness);
+        }
+        ImGui::EndDisabled();
+        const vk::Extent2D renderExtent = renderer->getRenderExtent();
+        ImGui::Text(std::format("Rendering at {}x{} ({:.0f}%)", renderExtent.width, renderExtent.height, resolutionController.getScale() * 100.0f).c_str());
+
+        ImGui::SeparatorText("Level of Detail");
+
+        float lodBias = renderer->getLodBias();
+        if (ImGui::SliderFloat("LOD Bias", &lodBias, -2.0f, 4.0f)) {
+            renderer->setLodBias(lodBias);
+        }
+        float smallFeatureSize = renderer->getSmallFeatureSize();
+        if (ImGui::SliderFloat("Small Feature Culling", &smallFeatureSize, 0.0f, 8.0f, "%.1f px")) {
+            renderer->setSmallFeatureSize(smallFeatureSize);
+        }
+
+        ImGui::SeparatorText("Meshlet Culling");
+
+        MeshletCulling* meshletCulling = renderer->getMeshletCulling();
+        bool meshletCullingEnabled = meshletCulling->getEnabled();
+        if (ImGui::Checkbox("GPU Meshlet Culling", &meshletCullingEnabled)) {
+            meshletCulling->setEnabled(meshletCullingEnabled);
+        }
+        ImGui::BeginDisabled(!meshletCullingEnabled);
+        bool coneCulling = meshletCulling->getConeCulling();
+        if (ImGui::Checkbox("Backface Cones", &coneCulling)) {
+            meshletCulling->setConeCulling(coneCulling);
+        }
+        bool occlusionCulling = meshletCulling->getOcclusionCulling();
+        if (ImGui::Checkbox("Occlusion (last frame's depth)", &occlusionCulling)) {
+            meshletCulling->setOcclusionCulling(occlusionCulling);
+        }
+        ImGui::EndDisabled();
+
+        ImGui::SeparatorText("Lighting");
+
+        ClusteredLighting* lighting = renderer->getClusteredLighting();
+        ImGui::Text(std::format("Point lights: {} ({} uploaded)", lighting->getLightCount(), lighting->getUploadedLightCount()).c_str());
+        bool cpuClustering = lighting->getCPUClustering();
+        if (ImGui::Checkbox("CPU Light Clustering", &cpuClustering)) {
+            lighting->setCPUClustering(cpuClustering);
+        }
+
+        if (const ImageBasedLighting* imageBasedLighting = renderer->getImageBasedLighting()) {
+            ImGui::Text(imageBasedLighting->isCached() ? "Sky lighting: loaded from cache" : "Sky lighting: generated");
+        }
+
+        const ShadowMaps::DebugInfo shadows = renderer->getShadowMaps()->getDebugInfo();
+        ImGui::Text(std::format("Shadowed lights: {}", shadows.shadowedLights).c_str());
+        ImGui::Text(std::format("Shadow faces: {} cached, {} dynamic", shadows.cachedFaces, shadows.dynamicFaces).c_str());
+
+        ImGui::SeparatorText("Ambient Occlusion");
+
+        AmbientOcclusion* ambientOcclusion = renderer->getAmbientOcclusion();
+        // forward shading needs the pre-pass's depth to compute occlusion from
+        const bool ambientOcclusionAvailable = renderer->getDeferred() || renderer->getDepthPrepass();
+        ImGui::BeginDisabled(!ambientOcclusionAvailable);
+        bool ambientOcclusionEnabled = ambientOcclusion->getEnabled();
+        if (ImGui::Checkbox("SSAO", &ambientOcclusionEnabled)) {
+            ambientOcclusion->setEnabled(ambientOcclusionEnabled);
+        }
+        ImGui::EndDisabled();
+        if (!ambientOcclusionAvailable) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(needs a depth pre-pass)");
+        }
+        int sampleCount = static_cast<int>(ambientOcclusion->getSampleCount());
+        if (ImGui::SliderInt("Samples", &sampleCount, 4, static_cast<int>(AmbientOcclusion::MAX_SAMPLES))) {
+            ambientOcclusion->setSampleCount(static_cast<u32>(sampleCount));
+        }
+        float radius = ambientOcclusion->getRadius();
+        if (ImGui::SliderFloat("Radius", &radius, 0.05f, 2.0f)) {
+            ambientOcclusion->setRadius(radius);
+        }
+        float intensity = ambientOcclusion->getIntensity();
+        if (ImGui::SliderFloat("Intensity", &intensity, 0.5f, 4.0f)) {
+            ambientOcclusion->setIntensity(intensity);
+        }
+        bool temporal = ambientOcclusion->getTemporal();
+        if (ImGui::Checkbox("Temporal Accumulation", &temporal)) {
+            ambientOcclusion->setTemporal(temporal);
+        }
+
+        ImGui::SeparatorText("Passes");
+
+        bool depthPrepass = renderer->getDepthPrepass();
+        if (ImGui::Checkbox("Depth Pre-pass", &depthPrepass)) {
+            renderer->setDepthPrepass(depthPrepass);
+        }
+        bool deferred = renderer->getDeferred();
+        if (ImGui::Checkbox("Deferred Shading", &deferred)) {
+            renderer->setDeferred(deferred);
+        }
+
+        const RenderGraph* renderGraph = renderer->getRenderGraph();
+        for (const auto& pass : renderGraph->getPassInfo()) {
+            if (pass.culled) {
+                ImGui::TextDisabled(std::format("{:<16} culled", pass.name).c_str());
+                continue;
+            }
+            ImGui::Text(std::format("{:<16} {:.3f} ms", pass.name, pass.gpuTime).c_str());
+        }
+        ImGui::Text(std::format("Transient memory: {} ({} without aliasing)", storageSizeToString(renderGraph->getTransientMemorySize()), storageSizeToString(renderGraph->getUnaliasedMemorySize())).c_str());
+
         ImGui::EndTabItem();
     }
 }
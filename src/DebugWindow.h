@@ -21,7 +21,6 @@ public:
     DebugWindow();
     ~DebugWindow();
     void draw(const vk::raii::CommandBuffer& commandBuffer);
-    void rebuild() const;
 
 private:
     void initVulkanImpl() const;
@@ -32,7 +31,7 @@ private:
     void setFlagForAllEntities(DebugFlags flag, bool value);
     static void drawMatrix(const glm::mat4& mat);
 
-    void performanceTab() const;
+    void performanceTab();
     void renderTab() const;
     void ecsTab();
     void searchTab();
@@ -47,6 +46,8 @@ private:
     bool m_framesFilled = false;
 
     VRAMUsageInfo m_vramUsage;
+    // average time of the last draw sort benchmark in milliseconds, negative if it has not been run
+    double m_sortBenchmarkTime = -1.0;
 
     std::array<std::bitset<32>, ECS::MAX_ENTITIES> m_debugFlags;
 
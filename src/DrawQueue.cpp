@@ -0,0 +1,123 @@
+#include "DrawQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <random>
+
+static u64 quantiseDepth(const float depth) {
+    constexpr u32 maxDepth = (1u << DrawKey::DEPTH_BITS) - 1;
+    return static_cast<u32>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(maxDepth));
+}
+
+static u64 stateBits(const u32 pass, const u32 pipeline) {
+    using namespace DrawKey;
+    return static_cast<u64>(pass & ((1u << PASS_BITS) - 1)) << PASS_SHIFT
+        | static_cast<u64>(pipeline & ((1u << PIPELINE_BITS) - 1)) << PIPELINE_SHIFT;
+}
+
+u64 DrawKey::make(const u32 pass, const u32 pipeline, const u32 material, const u32 mesh, const float depth) {
+    return stateBits(pass, pipeline)
+        | static_cast<u64>(material & ((1u << MATERIAL_BITS) - 1)) << MATERIAL_SHIFT
+        | static_cast<u64>(mesh & ((1u << MESH_BITS) - 1)) << MESH_SHIFT
+        | quantiseDepth(depth);
+}
+
+u64 DrawKey::makeBlended(const u32 pass, const u32 pipeline, const u32 material, const u32 mesh, const float depth) {
+    return stateBits(pass, pipeline)
+        | quantiseDepth(1.0f - depth) << (MATERIAL_BITS + MESH_BITS)
+        | static_cast<u64>(material & ((1u << MATERIAL_BITS) - 1)) << MESH_BITS
+        | static_cast<u64>(mesh & ((1u << MESH_BITS) - 1));
+}
+
+DrawQueue::DrawQueue(const u32 capacity) : m_items(capacity), m_scratch(capacity) {}
+
+void DrawQueue::clear() {
+    m_size = 0;
+}
+
+void DrawQueue::push(const u64 key, const u32 value) {
+    assert(m_size < m_items.size());
+    m_items[m_size++] = {key, value};
+}
+
+void DrawQueue::pushConcurrent(const u64 key, const u32 value) {
+    const u32 index = std::atomic_ref(m_size).fetch_add(1, std::memory_order_relaxed);
+    assert(index < m_items.size());
+    m_items[index] = {key, value};
+}
+
+void DrawQueue::sort() {
+    constexpr u32 DIGIT_BITS = 8;
+    constexpr u32 RADIX = 1 << DIGIT_BITS;
+    constexpr u32 DIGITS = sizeof(u64) * 8 / DIGIT_BITS;
+
+    if (m_size < 2) return;
+
+    // count every digit in a single pass over the keys
+    std::array<std::array<u32, RADIX>, DIGITS> histograms = {};
+    for (u32 i = 0; i < m_size; ++i) {
+        const u64 key = m_items[i].key;
+        for (u32 digit = 0; digit < DIGITS; ++digit) {
+            ++histograms[digit][(key >> (digit * DIGIT_BITS)) & (RADIX - 1)];
+        }
+    }
+
+    DrawItem* src = m_items.data();
+    DrawItem* dst = m_scratch.data();
+    for (u32 digit = 0; digit < DIGITS; ++digit) {
+        const u32 shift = digit * DIGIT_BITS;
+        auto& histogram = histograms[digit];
+
+        // every key has the same value for this digit, so this pass would not reorder anything
+        if (histogram[(src[0].key >> shift) & (RADIX - 1)] == m_size) continue;
+
+        // exclusive prefix sum turns the counts into output offsets
+        u32 offset = 0;
+        for (u32& count : histogram) {
+            const u32 c = count;
+            count = offset;
+            offset += c;
+        }
+
+        for (u32 i = 0; i < m_size; ++i) {
+            dst[histogram[(src[i].key >> shift) & (RADIX - 1)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    // the sorted items ended up in the scratch buffer, swap the storage rather than copying back
+    if (src != m_items.data()) {
+        std::swap(m_items, m_scratch);
+    }
+}
+
+std::span<const DrawItem> DrawQueue::getItems() const {
+    return {m_items.data(), m_size};
+}
+
+u32 DrawQueue::size() const {
+    return m_size;
+}
+
+double DrawQueue::benchmark(const u32 count, const u32 iterations) {
+    DrawQueue queue(count);
+    std::mt19937_64 generator(0);
+
+    double totalTime = 0.0;
+    for (u32 iteration = 0; iteration < iterations; ++iteration) {
+        queue.clear();
+        for (u32 i = 0; i < count; ++i) {
+            queue.push(generator(), i);
+        }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        queue.sort();
+        const auto end = std::chrono::high_resolution_clock::now();
+        totalTime += std::chrono::duration<double, std::milli>(end - start).count();
+
+        if (!std::ranges::is_sorted(queue.getItems(), {}, &DrawItem::key)) {
+            Logger::warn("Draw queue benchmark produced unsorted output");
+        }
+    }
+    return totalTime / iterations;
+}
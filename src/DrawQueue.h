@@ -0,0 +1,60 @@
+#pragma once
+
+#include <span>
+
+#include "Common.h"
+
+// 64-bit draw sort key, most significant field first:
+// | pass (2) | pipeline (6) | material (16) | mesh (16) | depth (24) |
+// sorting by key groups draws by state, and draws with the same state by depth (front to back)
+// blended passes use | pass (2) | pipeline (6) | inverted depth (24) | material (16) | mesh (16) | instead,
+// so they come out back to front
+namespace DrawKey {
+    constexpr u32 DEPTH_BITS = 24;
+    constexpr u32 MESH_BITS = 16;
+    constexpr u32 MATERIAL_BITS = 16;
+    constexpr u32 PIPELINE_BITS = 6;
+    constexpr u32 PASS_BITS = 2;
+
+    constexpr u32 MESH_SHIFT = DEPTH_BITS;
+    constexpr u32 MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+    constexpr u32 PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+    constexpr u32 PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+    // depth is expected in [0, 1] and is clamped to it
+    u64 make(u32 pass, u32 pipeline, u32 material, u32 mesh, float depth);
+    u64 makeBlended(u32 pass, u32 pipeline, u32 material, u32 mesh, float depth);
+
+    constexpr u32 passOf(const u64 key) { return static_cast<u32>(key >> PASS_SHIFT); }
+    constexpr u32 pipelineOf(const u64 key) { return static_cast<u32>(key >> PIPELINE_SHIFT) & ((1u << PIPELINE_BITS) - 1); }
+}
+
+struct DrawItem {
+    u64 key;
+    u32 value;
+};
+
+// fixed capacity list of draws that is sorted by key every frame without allocating
+class DrawQueue {
+public:
+    explicit DrawQueue(u32 capacity);
+
+    void clear();
+    void push(u64 key, u32 value);
+    // safe to call from several threads at once, but not alongside any other method
+    void pushConcurrent(u64 key, u32 value);
+    // stable LSD radix sort on 8-bit digits, skipping digits that are the same for every key
+    void sort();
+
+    std::span<const DrawItem> getItems() const;
+    u32 size() const;
+
+    // sort `count` random keys `iterations` times, returning the average sort time in milliseconds
+    static double benchmark(u32 count, u32 iterations);
+
+private:
+    std::vector<DrawItem> m_items;
+    // destination for every other radix pass
+    std::vector<DrawItem> m_scratch;
+    u32 m_size = 0;
+};
@@ -0,0 +1,60 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::update(const double gpuTime) {
+    if (m_settleFrames > 0) {
+        --m_settleFrames;
+        return;
+    }
+
+    m_totalTime += gpuTime;
+    if (++m_sampleCount < SAMPLE_FRAMES) return;
+    const double averageTime = m_totalTime / m_sampleCount;
+    m_totalTime = 0.0;
+    m_sampleCount = 0;
+
+    // GPU time is roughly proportional to the number of pixels, so to the square of the scale
+    float scale = m_scale;
+    if (averageTime > m_targetTime) {
+        scale = m_scale * static_cast<float>(std::sqrt(m_targetTime / averageTime));
+        scale = std::floor(scale / SCALE_STEP) * SCALE_STEP;
+    }
+    else if (averageTime < m_targetTime * HEADROOM) {
+        // one step at a time, as the time at a higher scale is only an estimate
+        scale = m_scale + SCALE_STEP;
+    }
+    scale = std::clamp(scale, MIN_SCALE, 1.0f);
+
+    if (std::abs(scale - m_scale) > SCALE_STEP * 0.5f) {
+        m_scale = scale;
+        m_settleFrames = FRAMES_IN_FLIGHT;
+    }
+}
+
+void DynamicResolution::reset() {
+    m_scale = 1.0f;
+    m_totalTime = 0.0;
+    m_sampleCount = 0;
+    m_settleFrames = 0;
+}
+
+vk::Extent2D DynamicResolution::getRenderExtent(const vk::Extent2D extent) const {
+    return {
+        std::max(static_cast<u32>(static_cast<float>(extent.width) * m_scale), 1u),
+        std::max(static_cast<u32>(static_cast<float>(extent.height) * m_scale), 1u)
+    };
+}
+
+float DynamicResolution::getScale() const {
+    return m_scale;
+}
+
+void DynamicResolution::setTargetTime(const double targetTime) {
+    m_targetTime = targetTime;
+}
+
+double DynamicResolution::getTargetTime() const {
+    return m_targetTime;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include "Common.h"
+
+// picks the fraction of the output resolution to render at, so the GPU frame time stays near a target
+//
+// the scale is adjusted from the average of a few frames' timings, dropping as soon as the budget is exceeded but
+// only rising once there is clear headroom, so it doesn't oscillate around the target
+class DynamicResolution {
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    // the scale moves in steps, so small changes in timings don't change the resolution every time
+    static constexpr float SCALE_STEP = 0.05f;
+    // frames averaged for each adjustment
+    static constexpr u32 SAMPLE_FRAMES = 8;
+    // fraction of the target the frame time has to be under before the scale is raised
+    static constexpr float HEADROOM = 0.85f;
+
+    // give the GPU time of the latest completed frame in milliseconds
+    void update(double gpuTime);
+    // start again at full resolution
+    void reset();
+
+    vk::Extent2D getRenderExtent(vk::Extent2D extent) const;
+    float getScale() const;
+
+    void setTargetTime(double targetTime);
+    double getTargetTime() const;
+
+private:
+    float m_scale = 1.0f;
+    // 60 fps
+    double m_targetTime = 1000.0 / 60.0;
+
+    double m_totalTime = 0.0;
+    u32 m_sampleCount = 0;
+    // frames still in flight from before the last change, which were rendered at the old scale
+    u32 m_settleFrames = 0;
+};
@@ -62,7 +62,8 @@ namespace ECS {
         }
 
         T& getData(Entity entity) {
-            return m_components[m_entityToIndex[entity]];
+            // .at() rather than [] so that concurrent reads never touch the map
+            return m_components[m_entityToIndex.at(entity)];
         }
 
         void entityDestroyed(Entity entity) override {
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+#include "Common.h"
+
+// SPIR-V compiled into the executable when it's built, by the shader's file name such as "model.vert" - empty if
+// there is no shader with that name
+// defined in EmbeddedShaders.cpp, which is generated from EmbeddedShaders.cpp.in by the build
+std::span<const u32> getEmbeddedShader(std::string_view name);
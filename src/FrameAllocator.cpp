@@ -0,0 +1,65 @@
+#include "FrameAllocator.h"
+
+#include "VulkanEngine.h"
+
+FrameAllocator::FrameAllocator(const vk::DeviceSize regionSize) {
+    const vk::PhysicalDeviceLimits limits = VulkanEngine::getPhysicalDevice().getProperties().limits;
+    // both limits are powers of two, so the larger satisfies both
+    m_alignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+    m_regionSize = (regionSize + m_alignment - 1) & ~(m_alignment - 1);
+
+    const vk::DeviceSize bufferSize = m_regionSize * FRAMES_IN_FLIGHT;
+    std::tie(m_buffer, m_deviceMemory) = VulkanEngine::createBuffer(
+        bufferSize,
+        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible
+    );
+    m_data = static_cast<char*>(m_deviceMemory.mapMemory(0, bufferSize));
+}
+
+FrameAllocator::~FrameAllocator() {
+    m_deviceMemory.unmapMemory();
+}
+
+void FrameAllocator::beginFrame(const u32 frameIndex) {
+    assert(frameIndex < FRAMES_IN_FLIGHT);
+    m_regionStart = m_regionSize * frameIndex;
+    m_head = m_regionStart;
+}
+
+void FrameAllocator::addToSet(const vk::DescriptorSet descriptorSet, const u32 binding, const vk::DescriptorType type, const vk::DeviceSize range) const {
+    assert(type == vk::DescriptorType::eUniformBufferDynamic || type == vk::DescriptorType::eStorageBufferDynamic);
+    const vk::DescriptorBufferInfo bufferInfo = {
+        .buffer = m_buffer,
+        .offset = 0,
+        .range = range,
+    };
+
+    const vk::WriteDescriptorSet writeInfo = {
+        .dstSet = descriptorSet,
+        .dstBinding = binding,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = type,
+        .pBufferInfo = &bufferInfo,
+    };
+    VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+}
+
+vk::DeviceSize FrameAllocator::getRegionSize() const {
+    return m_regionSize;
+}
+
+vk::DeviceSize FrameAllocator::getUsedSize() const {
+    return m_head - m_regionStart;
+}
+
+u32 FrameAllocator::allocateBytes(const vk::DeviceSize size) {
+    const vk::DeviceSize offset = m_head;
+    const vk::DeviceSize end = offset + ((size + m_alignment - 1) & ~(m_alignment - 1));
+    if (end > m_regionStart + m_regionSize) {
+        throw std::runtime_error(std::format("Frame allocator region is full ({} bytes requested, {} of {} used)", size, getUsedSize(), m_regionSize));
+    }
+    m_head = end;
+    return static_cast<u32>(offset);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstring>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+
+// a block of transient data in the frame allocator, valid until the same frame slot comes round again
+template<typename T>
+struct FrameAllocation {
+    vk::Buffer buffer = nullptr;
+    // offset from the start of the buffer, usable as a dynamic offset or an indirect draw offset
+    u32 offset = 0;
+    T* data = nullptr;
+    u32 count = 0;
+};
+
+// one persistently mapped buffer split into a region per frame in flight, that per-frame data (uniforms, instance
+// data, draw commands) is bump allocated from - a region is only reset once the frame that last used it has passed
+// its fence, so writing never races the GPU and there are no per-frame buffer allocations
+class FrameAllocator {
+public:
+    explicit FrameAllocator(vk::DeviceSize regionSize);
+    ~FrameAllocator();
+
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    // start allocating from the region for frameIndex, discarding what was allocated there before
+    void beginFrame(u32 frameIndex);
+
+    // allocate space for count elements - aligned so it can be bound as a uniform or storage buffer
+    template<typename T>
+    FrameAllocation<T> allocate(const u32 count = 1) {
+        const u32 offset = allocateBytes(sizeof(T) * count);
+        return {
+            .buffer = *m_buffer,
+            .offset = offset,
+            .data = reinterpret_cast<T*>(m_data + offset),
+            .count = count,
+        };
+    }
+
+    // copy data into a new allocation
+    template<typename T>
+    FrameAllocation<T> push(const T& data) {
+        FrameAllocation<T> allocation = allocate<T>(1);
+        std::memcpy(allocation.data, &data, sizeof(T));
+        return allocation;
+    }
+
+    // point a dynamic uniform or storage buffer binding at the buffer - the allocation's offset is given when binding
+    void addToSet(vk::DescriptorSet descriptorSet, u32 binding, vk::DescriptorType type, vk::DeviceSize range) const;
+
+    vk::DeviceSize getRegionSize() const;
+    // bytes allocated in the current region so far
+    vk::DeviceSize getUsedSize() const;
+
+private:
+    u32 allocateBytes(vk::DeviceSize size);
+
+    vk::raii::Buffer m_buffer = nullptr;
+    vk::raii::DeviceMemory m_deviceMemory = nullptr;
+    char* m_data = nullptr;
+
+    vk::DeviceSize m_regionSize;
+    vk::DeviceSize m_alignment;
+    vk::DeviceSize m_regionStart = 0;
+    vk::DeviceSize m_head = 0;
+};
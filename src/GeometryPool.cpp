@@ -0,0 +1,180 @@
+#include "GeometryPool.h"
+
+#include "Vertex.h"
+#include "VulkanEngine.h"
+
+template<typename V>
+GeometryPool<V>::GeometryPool(const u32 vertexCapacity, const u32 indexCapacity) {
+    reserve(vertexCapacity, indexCapacity);
+    // meshlets are mostly close to full, so this is enough for the indexes' worth of them
+    reserveMeshlets(std::max(1u, indexCapacity / 256));
+}
+
+template<typename V>
+vk::IndexType GeometryPool<V>::getIndexType(const u32 vertexCount) {
+    return vertexCount < SHORT_INDEX_VERTEX_LIMIT ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+}
+
+template<typename V>
+GeometryAllocation GeometryPool<V>::allocate(const std::vector<V>& vertices, const std::vector<u32>& indexes) {
+    const auto vertexCount = static_cast<u32>(vertices.size());
+    const auto indexCount = static_cast<u32>(indexes.size());
+    const vk::IndexType indexType = getIndexType(vertexCount);
+    const bool shortIndexes = indexType == vk::IndexType::eUint16;
+    // index space is counted in 32 bit words
+    const u32 wordCount = shortIndexes ? (indexCount + 1) / 2 : indexCount;
+
+    if (m_vertexCount + vertexCount > m_vertexCapacity || m_indexCount + wordCount > m_indexCapacity) {
+        reserve(
+            std::max(m_vertexCapacity * 2, m_vertexCount + vertexCount),
+            std::max(m_indexCapacity * 2, m_indexCount + wordCount)
+        );
+    }
+
+    const GeometryAllocation allocation = {
+        .index = m_allocationCount++,
+        .firstIndex = shortIndexes ? m_indexCount * 2 : m_indexCount,
+        .indexCount = indexCount,
+        .vertexOffset = static_cast<i32>(m_vertexCount),
+        .vertexCount = vertexCount,
+        .indexType = indexType
+    };
+
+    upload(vertices.data(), sizeof(V) * vertexCount, m_vertexBuffer, sizeof(V) * m_vertexCount);
+    if (shortIndexes) {
+        const std::vector<u16> narrowed(indexes.begin(), indexes.end());
+        upload(narrowed.data(), sizeof(u16) * indexCount, m_indexBuffer, sizeof(u32) * m_indexCount);
+    }
+    else {
+        upload(indexes.data(), sizeof(u32) * indexCount, m_indexBuffer, sizeof(u32) * m_indexCount);
+    }
+
+    m_vertexCount += vertexCount;
+    m_indexCount += wordCount;
+    return allocation;
+}
+
+template<typename V>
+u32 GeometryPool<V>::allocateMeshlets(const std::vector<Meshlet>& meshlets) {
+    const auto meshletCount = static_cast<u32>(meshlets.size());
+    if (m_meshletCount + meshletCount > m_meshletCapacity) {
+        reserveMeshlets(std::max(m_meshletCapacity * 2, m_meshletCount + meshletCount));
+    }
+
+    const u32 firstMeshlet = m_meshletCount;
+    upload(meshlets.data(), sizeof(Meshlet) * meshletCount, m_meshletBuffer, sizeof(Meshlet) * m_meshletCount);
+    m_meshletCount += meshletCount;
+    return firstMeshlet;
+}
+
+template<typename V>
+void GeometryPool<V>::bind(const vk::raii::CommandBuffer& commandBuffer, const vk::IndexType indexType) const {
+    commandBuffer.bindVertexBuffers(0, *m_vertexBuffer, {0});
+    commandBuffer.bindIndexBuffer(m_indexBuffer, 0, indexType);
+}
+
+template<typename V>
+const vk::raii::Buffer& GeometryPool<V>::getVertexBuffer() const {
+    return m_vertexBuffer;
+}
+
+template<typename V>
+const vk::raii::Buffer& GeometryPool<V>::getIndexBuffer() const {
+    return m_indexBuffer;
+}
+
+template<typename V>
+const vk::raii::Buffer& GeometryPool<V>::getMeshletBuffer() const {
+    return m_meshletBuffer;
+}
+
+template<typename V>
+u32 GeometryPool<V>::getVertexCount() const {
+    return m_vertexCount;
+}
+
+template<typename V>
+u32 GeometryPool<V>::getIndexCount() const {
+    return m_indexCount;
+}
+
+template<typename V>
+u32 GeometryPool<V>::getMeshletCount() const {
+    return m_meshletCount;
+}
+
+template<typename V>
+u32 GeometryPool<V>::getAllocationCount() const {
+    return m_allocationCount;
+}
+
+template<typename V>
+void GeometryPool<V>::reserve(const u32 vertexCapacity, const u32 indexCapacity) {
+    // mesh shaders read vertices themselves
+    auto [vertexBuffer, vertexBufferMemory] = VulkanEngine::createBuffer(
+        sizeof(V) * vertexCapacity,
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    // the meshlet culling pass reads indexes to compact them, and mesh shaders to draw them
+    auto [indexBuffer, indexBufferMemory] = VulkanEngine::createBuffer(
+        sizeof(u32) * indexCapacity,
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+
+    // existing allocations keep their offsets, so only the contents need to be moved across
+    // this is only expected to happen while loading, but wait in case the old buffers are still in use
+    if (m_vertexCount > 0 || m_indexCount > 0) {
+        Logger::info("Growing geometry pool to {} vertices / {} index words", vertexCapacity, indexCapacity);
+        VulkanEngine::getDevice().waitIdle();
+        if (m_vertexCount > 0) VulkanEngine::copyBuffer(m_vertexBuffer, vertexBuffer, sizeof(V) * m_vertexCount);
+        if (m_indexCount > 0) VulkanEngine::copyBuffer(m_indexBuffer, indexBuffer, sizeof(u32) * m_indexCount);
+    }
+
+    m_vertexBuffer = std::move(vertexBuffer);
+    m_vertexBufferMemory = std::move(vertexBufferMemory);
+    m_indexBuffer = std::move(indexBuffer);
+    m_indexBufferMemory = std::move(indexBufferMemory);
+    m_vertexCapacity = vertexCapacity;
+    m_indexCapacity = indexCapacity;
+}
+
+template<typename V>
+void GeometryPool<V>::reserveMeshlets(const u32 meshletCapacity) {
+    auto [meshletBuffer, meshletBufferMemory] = VulkanEngine::createBuffer(
+        sizeof(Meshlet) * meshletCapacity,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+
+    if (m_meshletCount > 0) {
+        Logger::info("Growing geometry pool to {} meshlets", meshletCapacity);
+        VulkanEngine::getDevice().waitIdle();
+        VulkanEngine::copyBuffer(m_meshletBuffer, meshletBuffer, sizeof(Meshlet) * m_meshletCount);
+    }
+
+    m_meshletBuffer = std::move(meshletBuffer);
+    m_meshletBufferMemory = std::move(meshletBufferMemory);
+    m_meshletCapacity = meshletCapacity;
+}
+
+template<typename V>
+void GeometryPool<V>::upload(const void* data, const vk::DeviceSize size, const vk::Buffer dst, const vk::DeviceSize dstOffset) {
+    if (size == 0) return;
+
+    auto [stagingBuffer, stagingBufferMemory] = VulkanEngine::createBuffer(
+        size,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible
+    );
+
+    void* mapped = stagingBufferMemory.mapMemory(0, size, {});
+    std::memcpy(mapped, data, size);
+    stagingBufferMemory.unmapMemory();
+
+    VulkanEngine::copyBuffer(stagingBuffer, dst, size, 0, dstOffset);
+}
+
+template class GeometryPool<PackedVertex>;
+template class GeometryPool<BasicVertex>;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+
+// location of a mesh's data inside a geometry pool
+struct GeometryAllocation {
+    // allocations are numbered in order, so this is unique within the pool
+    u32 index = 0;
+    // in units of the index type - 16 bit indexes start on a 32 bit boundary, so a 32 bit range can never overlap them
+    u32 firstIndex = 0;
+    u32 indexCount = 0;
+    i32 vertexOffset = 0;
+    u32 vertexCount = 0;
+    vk::IndexType indexType = vk::IndexType::eUint32;
+};
+
+// a cluster of neighbouring triangles in a mesh, with the bounds it's culled by on the GPU
+// std430 layout, matching Meshlet in meshlet_cull.glsl
+struct alignas(16) Meshlet {
+    // bounding sphere in the mesh's space
+    glm::vec3 center;
+    float radius;
+    // every triangle faces away from a viewer whose direction from the centre is within the cutoff of -axis
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    // range of the pool's index buffer
+    u32 firstIndex;
+    u32 indexCount;
+    // whether the range is of 16 bit indexes, packed two to each 32 bit word of the index buffer
+    u32 shortIndexes;
+};
+
+// one large vertex buffer and one large index buffer that meshes are sub-allocated from,
+// so that every mesh in the pool can be drawn after a single bind - along with the meshlets splitting them up
+// meshes small enough have 16 bit indexes, so the index buffer is bound as either type depending on what's drawn
+template<typename V>
+class GeometryPool {
+public:
+    // meshes with fewer vertices than this have 16 bit indexes - the last index is left free, as it would restart
+    // primitives if that were ever enabled
+    static constexpr u32 SHORT_INDEX_VERTEX_LIMIT = 0xFFFF;
+
+    GeometryPool(u32 vertexCapacity, u32 indexCapacity);
+
+    // the type the indexes of a mesh with this many vertices are stored as
+    static vk::IndexType getIndexType(u32 vertexCount);
+
+    // upload the vertices and indexes to the end of the pool, growing it if needed
+    // indexes are relative to the first vertex of the mesh, and are narrowed to 16 bits if there are few enough vertices
+    GeometryAllocation allocate(const std::vector<V>& vertices, const std::vector<u32>& indexes);
+    // upload meshlets over indexes already in the pool, returning the index of the first
+    u32 allocateMeshlets(const std::vector<Meshlet>& meshlets);
+    // binds the index buffer as the given type, which has to match the type of the allocations drawn
+    void bind(const vk::raii::CommandBuffer& commandBuffer, vk::IndexType indexType = vk::IndexType::eUint32) const;
+
+    // the buffers can be replaced as the pool grows, so descriptors pointing at them have to be checked each frame
+    const vk::raii::Buffer& getVertexBuffer() const;
+    const vk::raii::Buffer& getIndexBuffer() const;
+    const vk::raii::Buffer& getMeshletBuffer() const;
+
+    u32 getVertexCount() const;
+    // in 32 bit words, with 16 bit indexes taking half a word each
+    u32 getIndexCount() const;
+    u32 getMeshletCount() const;
+    u32 getAllocationCount() const;
+
+private:
+    void reserve(u32 vertexCapacity, u32 indexCapacity);
+    void reserveMeshlets(u32 meshletCapacity);
+
+    static void upload(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset);
+
+    vk::raii::Buffer m_vertexBuffer = nullptr;
+    vk::raii::DeviceMemory m_vertexBufferMemory = nullptr;
+
+    vk::raii::Buffer m_indexBuffer = nullptr;
+    vk::raii::DeviceMemory m_indexBufferMemory = nullptr;
+
+    vk::raii::Buffer m_meshletBuffer = nullptr;
+    vk::raii::DeviceMemory m_meshletBufferMemory = nullptr;
+
+    u32 m_vertexCapacity = 0;
+    u32 m_indexCapacity = 0;
+    u32 m_meshletCapacity = 0;
+    u32 m_vertexCount = 0;
+    u32 m_indexCount = 0;
+    u32 m_meshletCount = 0;
+    u32 m_allocationCount = 0;
+};
@@ -46,52 +46,43 @@ void Image::changeLayout(const vk::raii::CommandBuffer &commandBuffer, const Ima
 		.newLayout = info.newLayout,
 		.mips = info.mips,
 		.arrayLayers = info.arrayLayers,
-		.aspect = m_aspect
+		.aspect = m_aspect,
+		.baseMip = info.baseMip
 	});
 }
 
-void Image::changeLayout(const vk::raii::CommandBuffer &commandBuffer, const vk::Image image, const ImageTransitionInfo &info) {
-	vk::PipelineStageFlags srcStage;
-	vk::PipelineStageFlags dstStage;
-	vk::AccessFlags srcAccess;
-	vk::AccessFlags dstAccess;
-
-	if (info.oldLayout == vk::ImageLayout::eUndefined && info.newLayout == vk::ImageLayout::eTransferDstOptimal) {
-		srcAccess = {};
-		dstAccess = vk::AccessFlagBits::eTransferWrite;
-		srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		dstStage = vk::PipelineStageFlagBits::eTransfer;
-	}
-	else if (info.oldLayout == vk::ImageLayout::eTransferDstOptimal && info.newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-		srcAccess = vk::AccessFlagBits::eTransferWrite;
-		dstAccess = vk::AccessFlagBits::eShaderRead;
-		srcStage = vk::PipelineStageFlagBits::eTransfer;
-		dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-	}
-	else if (info.oldLayout == vk::ImageLayout::eColorAttachmentOptimal && info.newLayout == vk::ImageLayout::ePresentSrcKHR) {
-		srcAccess = vk::AccessFlagBits::eColorAttachmentWrite;
-		dstAccess = {};
-		srcStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		dstStage = vk::PipelineStageFlagBits::eBottomOfPipe;
-	}
-	else if (info.oldLayout == vk::ImageLayout::eUndefined && info.newLayout == vk::ImageLayout::eColorAttachmentOptimal) {
-		srcAccess = {};
-		dstAccess = vk::AccessFlagBits::eColorAttachmentWrite;
-		srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		dstStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-	}
-	else if (info.oldLayout == vk::ImageLayout::eColorAttachmentOptimal && info.newLayout == vk::ImageLayout::eTransferSrcOptimal) {
-		srcAccess = vk::AccessFlagBits::eColorAttachmentWrite;
-		dstAccess = vk::AccessFlagBits::eTransferRead;
-		srcStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		dstStage = vk::PipelineStageFlagBits::eTransfer;
-	}
-	else {
-		throw std::invalid_argument("Layout transition not supported");
+// stages and access that use an image in the given layout - used for both sides of a transition
+static std::pair<vk::PipelineStageFlags2, vk::AccessFlags2> getLayoutScope(const vk::ImageLayout layout) {
+	switch (layout) {
+		case vk::ImageLayout::eUndefined:
+			return {vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone};
+		case vk::ImageLayout::eTransferDstOptimal:
+			return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite};
+		case vk::ImageLayout::eTransferSrcOptimal:
+			return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead};
+		case vk::ImageLayout::eShaderReadOnlyOptimal:
+			return {vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderSampledRead};
+		case vk::ImageLayout::eColorAttachmentOptimal:
+			return {vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite};
+		case vk::ImageLayout::eDepthAttachmentOptimal:
+			return {vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests, vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite};
+		case vk::ImageLayout::eGeneral:
+			return {vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite};
+		case vk::ImageLayout::ePresentSrcKHR:
+			return {vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone};
+		default:
+			throw std::invalid_argument("Layout transition not supported");
 	}
+}
+
+void Image::changeLayout(const vk::raii::CommandBuffer &commandBuffer, const vk::Image image, const ImageTransitionInfo &info) {
+	const auto [srcStage, srcAccess] = getLayoutScope(info.oldLayout);
+	const auto [dstStage, dstAccess] = getLayoutScope(info.newLayout);
 
-	const vk::ImageMemoryBarrier barrier = {
+	const vk::ImageMemoryBarrier2 barrier = {
+		.srcStageMask = srcStage,
 		.srcAccessMask = srcAccess,
+		.dstStageMask = dstStage,
 		.dstAccessMask = dstAccess,
 		.oldLayout = info.oldLayout,
 		.newLayout = info.newLayout,
@@ -100,13 +91,16 @@ void Image::changeLayout(const vk::raii::CommandBuffer &commandBuffer, const vk:
 		.image = image,
 		.subresourceRange = {
 			.aspectMask = info.aspect,
-			.baseMipLevel = 0,
+			.baseMipLevel = info.baseMip,
 			.levelCount = info.mips,
 			.baseArrayLayer = 0,
 			.layerCount = info.arrayLayers
 		}
 	};
-	commandBuffer.pipelineBarrier(srcStage, dstStage, {}, nullptr, nullptr, barrier);
+	commandBuffer.pipelineBarrier2({
+		.imageMemoryBarrierCount = 1,
+		.pImageMemoryBarriers = &barrier
+	});
 }
 
 const vk::raii::Image & Image::getImage() const {
@@ -27,6 +27,7 @@ struct ImageTransitionInfo {
     u32 mips = 1;
     u32 arrayLayers = 1;
     vk::ImageAspectFlagBits aspect = vk::ImageAspectFlagBits::eColor;
+    u32 baseMip = 0;
 };
 
 class Image {
@@ -0,0 +1,344 @@
+#include "ImageBasedLighting.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <ktx.h>
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include "Pipeline.h"
+#include "Skybox.h"
+#include "VulkanEngine.h"
+
+namespace {
+    constexpr u32 WORKGROUP_SIZE = 8;
+
+    u32 levelSize(const u32 size, const u32 level) {
+        return std::max(size >> level, 1u);
+    }
+
+    vk::DeviceSize levelBytes(const vk::Format format, const u32 size, const u32 level, const u32 faces) {
+        const vk::DeviceSize extent = levelSize(size, level);
+        return extent * extent * vk::blockSize(format) * faces;
+    }
+
+    void writeImage(const vk::raii::DescriptorSet& descriptorSet, const u32 binding, const vk::ImageView view, const vk::Sampler sampler) {
+        const bool storage = !sampler;
+        const vk::DescriptorImageInfo imageInfo = {
+            .sampler = sampler,
+            .imageView = view,
+            .imageLayout = storage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = *descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &imageInfo
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+}
+
+ImageBasedLighting::ImageBasedLighting(const Skybox &skybox) {
+    // the BRDF only depends on the settings, so it is shared between skies
+    struct Settings {
+        u32 version = CACHE_VERSION;
+        u32 irradianceSize = IRRADIANCE_SIZE;
+        u32 specularSize = SPECULAR_SIZE;
+        u32 specularMips = SPECULAR_MIPS;
+        u32 brdfSize = BRDF_SIZE;
+    } settings;
+    const u64 settingsHash = hashBytes(&settings, sizeof(Settings));
+    const u64 skyHash = hashBytes(&settings, sizeof(Settings), skybox.getSourceHash());
+
+    const std::filesystem::path directory = CACHE_DIRECTORY;
+    m_irradiance = createMap(directory / std::format("{:016x}_irradiance.ktx2", skyHash), CUBE_FORMAT, IRRADIANCE_SIZE, 1, 6);
+    m_specular = createMap(directory / std::format("{:016x}_specular.ktx2", skyHash), CUBE_FORMAT, SPECULAR_SIZE, SPECULAR_MIPS, 6);
+    m_brdf = createMap(directory / std::format("brdf_{:016x}.ktx2", settingsHash), BRDF_FORMAT, BRDF_SIZE, 1, 1);
+
+    std::vector<Map*> missing;
+    for (Map* map : {&m_irradiance, &m_specular, &m_brdf}) {
+        if (!load(*map)) {
+            missing.push_back(map);
+        }
+    }
+    if (!missing.empty()) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        generate(skybox, missing);
+        const std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+        Logger::info("Generated {} image based lighting maps in {:.1f} ms", missing.size(), time.count());
+    }
+
+    const vk::SamplerCreateInfo samplerInfo = {
+        .magFilter = vk::Filter::eLinear,
+        .minFilter = vk::Filter::eLinear,
+        .mipmapMode = vk::SamplerMipmapMode::eLinear,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+        .mipLodBias = 0.0f,
+        .anisotropyEnable = vk::False,
+        .maxAnisotropy = 1.0f,
+        .compareEnable = vk::False,
+        .compareOp = vk::CompareOp::eAlways,
+        .minLod = 0.0f,
+        .maxLod = vk::LodClampNone,
+        .unnormalizedCoordinates = vk::False
+    };
+    m_sampler = vk::raii::Sampler(VulkanEngine::getDevice(), samplerInfo);
+}
+
+void ImageBasedLighting::addToSet(const vk::raii::DescriptorSet &descriptorSet, const u32 irradianceBinding, const u32 specularBinding, const u32 brdfBinding) const {
+    writeImage(descriptorSet, irradianceBinding, *m_irradiance.image->getView(), *m_sampler);
+    writeImage(descriptorSet, specularBinding, *m_specular.image->getView(), *m_sampler);
+    writeImage(descriptorSet, brdfBinding, *m_brdf.image->getView(), *m_sampler);
+}
+
+bool ImageBasedLighting::isCached() const {
+    return m_irradiance.cached && m_specular.cached && m_brdf.cached;
+}
+
+ImageBasedLighting::Map ImageBasedLighting::createMap(std::filesystem::path path, const vk::Format format, const u32 size, const u32 mips, const u32 faces) {
+    const bool cube = faces == 6;
+    return {
+        .path = std::move(path),
+        .format = format,
+        .size = size,
+        .mips = mips,
+        .faces = faces,
+        .image = std::make_unique<Image>(ImageCreateInfo {
+            .width = size,
+            .height = size,
+            .format = format,
+            .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+            .mips = mips,
+            .arrayLayers = faces,
+            .viewType = cube ? vk::ImageViewType::eCube : vk::ImageViewType::e2D,
+            .flags = cube ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags{}
+        }),
+    };
+}
+
+bool ImageBasedLighting::load(Map &map) {
+    ktxTexture2* texture;
+    if (ktxTexture2_CreateFromNamedFile(map.path.string().c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) != KTX_SUCCESS) {
+        return false;
+    }
+    if (static_cast<vk::Format>(texture->vkFormat) != map.format || texture->baseWidth != map.size || texture->baseHeight != map.size ||
+        texture->numFaces != map.faces || texture->numLevels != map.mips || texture->numLayers != 1 || texture->supercompressionScheme != KTX_SS_NONE) {
+        ktxTexture2_Destroy(texture);
+        return false;
+    }
+
+    // the image data is uploaded as it is, with a region per level starting at its first face
+    const vk::DeviceSize totalSize = ktxTexture_GetDataSize(ktxTexture(texture));
+    auto [stagingBuffer, stagingMemory] = VulkanEngine::createBuffer(totalSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    std::memcpy(stagingMemory.mapMemory(0, totalSize), texture->pData, totalSize);
+
+    std::vector<vk::BufferImageCopy> regions;
+    for (u32 level = 0; level < map.mips; ++level) {
+        ktx_size_t offset = 0;
+        ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, 0, &offset);
+        regions.push_back({
+            .bufferOffset = offset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
+                .layerCount = map.faces
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {levelSize(map.size, level), levelSize(map.size, level), 1}
+        });
+    }
+    ktxTexture2_Destroy(texture);
+    stagingMemory.unmapMemory();
+
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    map.image->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferDstOptimal,
+        .mips = map.mips,
+        .arrayLayers = map.faces
+    });
+    commandBuffer.copyBufferToImage(stagingBuffer, map.image->getImage(), vk::ImageLayout::eTransferDstOptimal, regions);
+    map.image->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        .mips = map.mips,
+        .arrayLayers = map.faces
+    });
+    VulkanEngine::endSingleCommand(commandBuffer);
+
+    map.cached = true;
+    return true;
+}
+
+void ImageBasedLighting::generate(const Skybox &skybox, const std::vector<Map *> &maps) const {
+    // every level of every map is read back into one buffer, in order, to be written to the cache
+    std::vector<vk::DeviceSize> mapOffsets;
+    vk::DeviceSize readbackSize = 0;
+    for (const Map* map : maps) {
+        mapOffsets.push_back(readbackSize);
+        for (u32 level = 0; level < map->mips; ++level) {
+            readbackSize += levelBytes(map->format, map->size, level, map->faces);
+        }
+    }
+    auto [readbackBuffer, readbackMemory] = VulkanEngine::createBuffer(readbackSize, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    const auto irradiancePipeline = Pipeline::Builder()
+        .addShaderStage("shaders/ibl_irradiance.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute) // sky
+        .addBinding(0, 1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // irradiance
+        .create();
+    const auto specularPipeline = Pipeline::Builder()
+        .addShaderStage("shaders/ibl_specular.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute) // sky
+        .addBinding(0, 1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // specular level
+        .addSpecialisationConstant(0, SPECULAR_SIZE)
+        .addSpecialisationConstant(1, SPECULAR_MIPS)
+        .create();
+    const auto brdfPipeline = Pipeline::Builder()
+        .addShaderStage("shaders/ibl_brdf.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // lookup table
+        .create();
+
+    // a view and set per level, as each level is written as a storage image by its own dispatch
+    std::vector<vk::raii::ImageView> views;
+    std::vector<vk::raii::DescriptorSet> descriptorSets;
+    views.reserve(SPECULAR_MIPS * maps.size());
+
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    for (u32 i = 0; i < maps.size(); ++i) {
+        const Map& map = *maps.at(i);
+        const bool isBrdf = &map == &m_brdf;
+        const Pipeline& pipeline = isBrdf ? *brdfPipeline : &map == &m_irradiance ? *irradiancePipeline : *specularPipeline;
+
+        map.image->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eUndefined,
+            .newLayout = vk::ImageLayout::eGeneral,
+            .mips = map.mips,
+            .arrayLayers = map.faces
+        });
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getPipeline());
+        for (u32 level = 0; level < map.mips; ++level) {
+            const vk::ImageViewCreateInfo viewInfo = {
+                .image = map.image->getImage(),
+                .viewType = map.faces == 6 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D,
+                .format = map.format,
+                .subresourceRange = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .baseMipLevel = level,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = map.faces
+                }
+            };
+            const vk::raii::ImageView& view = views.emplace_back(VulkanEngine::getDevice(), viewInfo);
+            const vk::raii::DescriptorSet& descriptorSet = descriptorSets.emplace_back(pipeline.createDescriptorSet(0));
+            if (isBrdf) {
+                writeImage(descriptorSet, 0, *view, nullptr);
+            } else {
+                writeImage(descriptorSet, 0, *skybox.getImage().getView(), *skybox.getSampler());
+                writeImage(descriptorSet, 1, *view, nullptr);
+            }
+
+            const u32 groups = (levelSize(map.size, level) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.getLayout(), 0, {*descriptorSet}, {});
+            commandBuffer.dispatch(groups, groups, map.faces);
+        }
+
+        map.image->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eGeneral,
+            .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .mips = map.mips,
+            .arrayLayers = map.faces
+        });
+        std::vector<vk::BufferImageCopy> regions;
+        vk::DeviceSize offset = mapOffsets.at(i);
+        for (u32 level = 0; level < map.mips; ++level) {
+            regions.push_back({
+                .bufferOffset = offset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = map.faces
+                },
+                .imageOffset = {0, 0, 0},
+                .imageExtent = {levelSize(map.size, level), levelSize(map.size, level), 1}
+            });
+            offset += levelBytes(map.format, map.size, level, map.faces);
+        }
+        commandBuffer.copyImageToBuffer(map.image->getImage(), vk::ImageLayout::eTransferSrcOptimal, readbackBuffer, regions);
+        map.image->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+            .mips = map.mips,
+            .arrayLayers = map.faces
+        });
+    }
+    // the copies have to be visible to the host before the buffer is mapped
+    const vk::MemoryBarrier2 readbackBarrier = {
+        .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+        .dstAccessMask = vk::AccessFlagBits2::eHostRead
+    };
+    commandBuffer.pipelineBarrier2({
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &readbackBarrier
+    });
+    VulkanEngine::endSingleCommand(commandBuffer);
+
+    for (u32 i = 0; i < maps.size(); ++i) {
+        save(*maps.at(i), readbackMemory, mapOffsets.at(i));
+    }
+}
+
+void ImageBasedLighting::save(const Map &map, const vk::raii::DeviceMemory &memory, const vk::DeviceSize offset) {
+    ktxTextureCreateInfo createInfo = {};
+    createInfo.vkFormat = static_cast<u32>(map.format);
+    createInfo.baseWidth = map.size;
+    createInfo.baseHeight = map.size;
+    createInfo.baseDepth = 1;
+    createInfo.numDimensions = 2;
+    createInfo.numLevels = map.mips;
+    createInfo.numLayers = 1;
+    createInfo.numFaces = map.faces;
+    createInfo.isArray = KTX_FALSE;
+    createInfo.generateMipmaps = KTX_FALSE;
+    ktxTexture2* texture;
+    if (ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) != KTX_SUCCESS) {
+        Logger::warn("Unable to create image based lighting cache for {}", map.path.string());
+        return;
+    }
+
+    vk::DeviceSize totalSize = 0;
+    for (u32 level = 0; level < map.mips; ++level) {
+        totalSize += levelBytes(map.format, map.size, level, map.faces);
+    }
+    // the readback holds each level's faces one after the other, from the largest level down
+    const auto* data = static_cast<const u8*>(memory.mapMemory(offset, totalSize));
+    for (u32 level = 0; level < map.mips; ++level) {
+        const vk::DeviceSize faceSize = levelBytes(map.format, map.size, level, 1);
+        for (u32 face = 0; face < map.faces; ++face) {
+            ktxTexture_SetImageFromMemory(ktxTexture(texture), level, 0, face, data, faceSize);
+            data += faceSize;
+        }
+    }
+    memory.unmapMemory();
+
+    std::error_code error;
+    std::filesystem::create_directories(map.path.parent_path(), error);
+    if (error || ktxTexture2_WriteToNamedFile(texture, map.path.string().c_str()) != KTX_SUCCESS) {
+        Logger::warn("Unable to write image based lighting cache to {}", map.path.string());
+    }
+    ktxTexture2_Destroy(texture);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filesystem>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "Image.h"
+
+class Skybox;
+
+// ambient lighting from the skybox - an irradiance cubemap for diffuse, and for specular a cubemap prefiltered with
+// increasing roughness down its mips plus a BRDF lookup table
+//
+// the maps are generated by compute shaders, then cached on disk as KTX2 keyed by a hash of the sky and the settings
+// they were generated with, so later launches with the same sky only load them
+class ImageBasedLighting {
+public:
+    static constexpr u32 IRRADIANCE_SIZE = 32;
+    static constexpr u32 SPECULAR_SIZE = 256;
+    // must match lighting.glsl
+    static constexpr u32 SPECULAR_MIPS = 6;
+    static constexpr u32 BRDF_SIZE = 256;
+
+    explicit ImageBasedLighting(const Skybox& skybox);
+
+    // point combined image sampler bindings at the irradiance and specular cubemaps and the lookup table
+    void addToSet(const vk::raii::DescriptorSet& descriptorSet, u32 irradianceBinding, u32 specularBinding, u32 brdfBinding) const;
+
+    // whether the maps were all loaded from the cache rather than generated
+    bool isCached() const;
+
+private:
+    static constexpr vk::Format CUBE_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+    static constexpr vk::Format BRDF_FORMAT = vk::Format::eR32G32Sfloat;
+    // change whenever the generation does, so existing caches are regenerated
+    static constexpr u32 CACHE_VERSION = 1;
+    static constexpr const char* CACHE_DIRECTORY = "cache/ibl";
+
+    struct Map {
+        std::filesystem::path path;
+        vk::Format format;
+        u32 size;
+        u32 mips;
+        // 6 for a cubemap, 1 for a 2D image
+        u32 faces;
+        std::unique_ptr<Image> image;
+        bool cached = false;
+    };
+
+    static Map createMap(std::filesystem::path path, vk::Format format, u32 size, u32 mips, u32 faces);
+    // returns false if the cache is missing or doesn't match the map
+    static bool load(Map& map);
+    // fill each map that wasn't loaded, then write it to the cache
+    void generate(const Skybox& skybox, const std::vector<Map*>& maps) const;
+    static void save(const Map& map, const vk::raii::DeviceMemory& memory, vk::DeviceSize offset);
+
+    Map m_irradiance;
+    Map m_specular;
+    Map m_brdf;
+    vk::raii::Sampler m_sampler = nullptr;
+};
@@ -1,18 +1,67 @@
 #include "LightSystem.h"
 
-std::array<LightSystem::PointLightFragData, LightSystem::MAX_LIGHTS> LightSystem::getLights(u32 &number) const {
-    std::array<PointLightFragData, MAX_LIGHTS> ret{};
-    u32 i = 0;
-    for (const ECS::Entity entity : m_entities) {
-        auto& element = ret.at(i++);
-        auto& lightData = ECS::getComponent<PointLight>(entity);
-        auto& positionData = ECS::getComponent<Transform>(entity);
-        element.colour = lightData.colour;
-        element.strength = lightData.strength;
-        // get the full transformed (parented) translation data from the matrix
-        element.position = glm::vec3(positionData.transform[3]);
-        if (i == MAX_LIGHTS) break;
+void LightSystem::onEntityAdd(const ECS::Entity entity) {
+    System::onEntityAdd(entity);
+    m_entityToIndex[entity] = static_cast<u32>(m_lightEntities.size());
+    m_lightEntities.push_back(entity);
+    m_lights.emplace_back();
+    m_dirty.push_back(true);
+}
+
+void LightSystem::onEntityRemove(const ECS::Entity entity) {
+    const auto it = m_entityToIndex.find(entity);
+    if (it == m_entityToIndex.end()) return;
+    System::onEntityRemove(entity);
+
+    const u32 index = it->second;
+    const u32 last = static_cast<u32>(m_lightEntities.size() - 1);
+    if (index != last) {
+        m_lightEntities[index] = m_lightEntities[last];
+        m_lights[index] = m_lights[last];
+        m_dirty[index] = true;
+        m_entityToIndex[m_lightEntities[index]] = index;
+    }
+    m_entityToIndex.erase(it);
+    m_lightEntities.pop_back();
+    m_lights.pop_back();
+    m_dirty.pop_back();
+}
+
+const std::vector<u32>& LightSystem::update() {
+    m_changed.clear();
+    for (u32 i = 0; i < m_lightEntities.size(); ++i) {
+        const auto& lightData = ECS::getComponent<PointLight>(m_lightEntities[i]);
+        const auto& positionData = ECS::getComponent<Transform>(m_lightEntities[i]);
+        const PointLightData light = {
+            // get the full transformed (parented) translation data from the matrix
+            .position = glm::vec3(positionData.transform[3]),
+            .range = getRange(lightData),
+            .colour = lightData.colour,
+            .strength = lightData.strength,
+        };
+        if (!m_dirty[i] && m_lights[i] == light) continue;
+
+        m_lights[i] = light;
+        m_dirty[i] = false;
+        m_changed.push_back(i);
     }
-    number = i;
-    return ret;
+    return m_changed;
+}
+
+const std::vector<LightSystem::PointLightData>& LightSystem::getLights() const {
+    return m_lights;
+}
+
+u32 LightSystem::getLightCount() const {
+    return static_cast<u32>(m_lights.size());
+}
+
+const std::vector<ECS::Entity> & LightSystem::getLightEntities() const {
+    return m_lightEntities;
+}
+
+float LightSystem::getRange(const PointLight &light) {
+    // solve strength * colour / distance^2 = cutoff for the brightest channel
+    const float brightness = light.strength * std::max({light.colour.r, light.colour.g, light.colour.b});
+    return std::sqrt(std::max(brightness, 0.0f) / ATTENUATION_CUTOFF);
 }
@@ -3,14 +3,44 @@
 #include "ECS.h"
 #include "Components.h"
 
+// keeps every point light packed for the GPU, tracking which ones changed since they were last uploaded
 class LightSystem : public ECS::System {
 public:
-    struct PointLightFragData {
-        alignas (16) glm::vec3 position;
-        alignas (16) glm::vec3 colour;
-        alignas (4) float strength;
+    // std430 layout, matching PointLight in model.frag and cluster.comp
+    struct PointLightData {
+        glm::vec3 position;
+        // distance where the light's contribution falls below ATTENUATION_CUTOFF
+        float range;
+        glm::vec3 colour;
+        float strength;
+
+        bool operator==(const PointLightData&) const = default;
     };
 
-    static constexpr u32 MAX_LIGHTS = 4;
-    std::array<PointLightFragData, MAX_LIGHTS> getLights(u32 &number) const;
+    // lights the GPU's light buffers are sized for at first - they double whenever there are more
+    static constexpr u32 INITIAL_LIGHT_CAPACITY = 1024;
+    // radiance below which a light is treated as having no effect
+    static constexpr float ATTENUATION_CUTOFF = 0.01f;
+
+    void onEntityAdd(ECS::Entity entity) override;
+    void onEntityRemove(ECS::Entity entity) override;
+
+    // repack every light, returning the indices of the ones that changed since the last call
+    const std::vector<u32>& update();
+
+    const std::vector<PointLightData>& getLights() const;
+    u32 getLightCount() const;
+    // the entity of each light, in the same order as getLights
+    const std::vector<ECS::Entity>& getLightEntities() const;
+
+    static float getRange(const PointLight& light);
+
+private:
+    // lights are kept dense, so removing one moves the last light into its slot
+    std::vector<ECS::Entity> m_lightEntities;
+    std::unordered_map<ECS::Entity, u32> m_entityToIndex;
+    std::vector<PointLightData> m_lights;
+    // slots that have to be uploaded whatever their contents, after being added or moved
+    std::vector<bool> m_dirty;
+    std::vector<u32> m_changed;
 };
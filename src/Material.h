@@ -4,13 +4,34 @@
 
 #include "Texture.h"
 
+// how a material's base colour alpha is used, matching glTF's alphaMode
+enum class AlphaMode : u32 {
+    Opaque = 0,
+    Mask = 1,
+    Blend = 2
+};
+
+// scalar factors applied on top of a material's textures
+struct MaterialFactors {
+    glm::vec4 baseColour = glm::vec4(1.0f);
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+    float aoStrength = 1.0f;
+    float normalScale = 1.0f;
+    // fragments with a lower alpha are discarded by masked materials
+    float alphaCutoff = 0.5f;
+};
+
 class Material {
 public:
-    Material(const Texture *base, const Texture *metallicRoughness, const Texture *ao, const Texture *normal);
-    void use(const vk::raii::CommandBuffer& commandBuffer, const vk::raii::PipelineLayout& layout) const;
+    Material(const Texture *base, const Texture *metallicRoughness, const Texture *ao, const Texture *normal, const MaterialFactors& factors = {}, AlphaMode alphaMode = AlphaMode::Opaque);
+    // index of this material in the renderer's material table
+    u32 getID() const;
+    AlphaMode getAlphaMode() const;
 
 private:
     const Texture *m_base, *m_metallicRoughness, *m_ao, *m_normal;
-    glm::vec3 m_baseMulti, m_metallicRoughnessMulti, m_aoMulti;
-    vk::raii::DescriptorSet m_descriptorSet = nullptr;
-};
\ No newline at end of file
+    MaterialFactors m_factors;
+    AlphaMode m_alphaMode;
+    u32 m_id;
+};
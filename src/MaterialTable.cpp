@@ -0,0 +1,96 @@
+#include "MaterialTable.h"
+
+#include "VulkanEngine.h"
+
+MaterialTable::MaterialTable() : m_materials(MAX_MATERIALS) {
+    // this must match the material set declared by the renderer's pipelines
+    const std::array bindings = {
+        vk::DescriptorSetLayoutBinding {
+            .binding = MATERIAL_BINDING,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eFragment
+        },
+        vk::DescriptorSetLayoutBinding {
+            .binding = TEXTURE_BINDING,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .descriptorCount = MAX_TEXTURES,
+            .stageFlags = vk::ShaderStageFlagBits::eFragment
+        }
+    };
+    const std::array<vk::DescriptorBindingFlags, bindings.size()> bindingFlags = {
+        vk::DescriptorBindingFlags{},
+        vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+    };
+
+    const vk::StructureChain createInfo = {
+        vk::DescriptorSetLayoutCreateInfo {
+            .flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+            .bindingCount = static_cast<u32>(bindings.size()),
+            .pBindings = bindings.data()
+        },
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo {
+            .bindingCount = static_cast<u32>(bindingFlags.size()),
+            .pBindingFlags = bindingFlags.data()
+        }
+    };
+    m_layout = vk::raii::DescriptorSetLayout(VulkanEngine::getDevice(), createInfo.get<vk::DescriptorSetLayoutCreateInfo>());
+
+    const vk::DescriptorSetAllocateInfo allocInfo = {
+        .descriptorPool = VulkanEngine::getDescriptorPool(),
+        .descriptorSetCount = 1,
+        .pSetLayouts = &*m_layout
+    };
+    m_descriptorSet = std::move(VulkanEngine::getDevice().allocateDescriptorSets(allocInfo).front());
+
+    m_materials.addToSet(m_descriptorSet, MATERIAL_BINDING);
+}
+
+u32 MaterialTable::addTexture(const Texture *texture) {
+    if (const auto it = m_textureIndices.find(texture); it != m_textureIndices.end()) {
+        return it->second;
+    }
+
+    const auto index = static_cast<u32>(m_textureIndices.size());
+    if (index >= MAX_TEXTURES) {
+        Logger::error("Exceeded the maximum number of bindless textures ({})", MAX_TEXTURES);
+    }
+
+    const vk::DescriptorImageInfo imageInfo = {
+        .sampler = texture->getSampler(),
+        .imageView = texture->getImage().getView(),
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    const vk::WriteDescriptorSet writeInfo = {
+        .dstSet = m_descriptorSet,
+        .dstBinding = TEXTURE_BINDING,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &imageInfo
+    };
+    VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+
+    m_textureIndices.insert({texture, index});
+    return index;
+}
+
+u32 MaterialTable::addMaterial(const MaterialData &data) {
+    if (m_materialCount >= MAX_MATERIALS) {
+        Logger::error("Exceeded the maximum number of materials ({})", MAX_MATERIALS);
+    }
+    m_materials.setData(m_materialCount, data);
+    return m_materialCount++;
+}
+
+void MaterialTable::bind(const vk::raii::CommandBuffer &commandBuffer, const vk::raii::PipelineLayout &layout) const {
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, MATERIAL_SET_NUMBER, *m_descriptorSet, nullptr);
+}
+
+u32 MaterialTable::getTextureCount() const {
+    return static_cast<u32>(m_textureIndices.size());
+}
+
+u32 MaterialTable::getMaterialCount() const {
+    return m_materialCount;
+}
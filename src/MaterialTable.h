@@ -0,0 +1,56 @@
+#pragma once
+
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "Texture.h"
+#include "UniformBufferBlock.h"
+
+// material data as laid out in the material storage buffer (std430)
+struct alignas(16) MaterialData {
+    glm::vec4 baseColourFactor;
+    // indexes into the bindless texture array
+    u32 baseTexture;
+    u32 metallicRoughnessTexture;
+    u32 aoTexture;
+    u32 normalTexture;
+    float metallicFactor;
+    float roughnessFactor;
+    float aoStrength;
+    float normalScale;
+    float alphaCutoff;
+};
+
+// bindless material storage - every texture lives in one update-after-bind sampler array and every
+// material in one storage buffer, so a single descriptor set serves all materials
+class MaterialTable {
+public:
+    static constexpr u32 MAX_TEXTURES = 4096;
+    static constexpr u32 MAX_MATERIALS = 1024;
+
+    static constexpr u32 MATERIAL_BINDING = 0;
+    static constexpr u32 TEXTURE_BINDING = 1;
+
+    MaterialTable();
+
+    // add a texture to the sampler array, returning its index - textures that were already added are not duplicated
+    u32 addTexture(const Texture* texture);
+    // add a material to the material buffer, returning its index
+    u32 addMaterial(const MaterialData& data);
+
+    void bind(const vk::raii::CommandBuffer& commandBuffer, const vk::raii::PipelineLayout& layout) const;
+
+    u32 getTextureCount() const;
+    u32 getMaterialCount() const;
+
+private:
+    vk::raii::DescriptorSetLayout m_layout = nullptr;
+    vk::raii::DescriptorSet m_descriptorSet = nullptr;
+
+    StorageBufferBlock<MaterialData> m_materials;
+    std::unordered_map<const Texture*, u32> m_textureIndices;
+    u32 m_materialCount = 0;
+};
@@ -1,22 +1,168 @@
 #include "Mesh.h"
 
+#include <glm/gtc/matrix_transform.hpp>
+#include <meshoptimizer.h>
+
 #include "VulkanEngine.h"
 
+namespace {
+    // favours meshlets whose triangles face the same way, so more of them can be culled by their cone
+    constexpr float MESHLET_CONE_WEIGHT = 0.25f;
+
+    // split a level into meshlets of neighbouring triangles, appending its indexes in meshlet order and the meshlets
+    // with their bounds - the meshlets' index ranges are relative to the start of indexes
+    // this is the order the level is drawn in, so the triangles within each meshlet are reordered for the vertex cache
+    template<typename V>
+    void buildMeshlets(const std::vector<V>& vertices, const std::vector<u32>& lod, std::vector<u32>& indexes, std::vector<Meshlet>& meshlets) {
+        constexpr u32 maxVertices = Mesh<V>::MESHLET_MAX_VERTICES;
+        constexpr u32 maxTriangles = Mesh<V>::MESHLET_MAX_TRIANGLES;
+        const size_t maxMeshlets = meshopt_buildMeshletsBound(lod.size(), maxVertices, maxTriangles);
+        std::vector<meshopt_Meshlet> built(maxMeshlets);
+        std::vector<u32> meshletVertices(maxMeshlets * maxVertices);
+        std::vector<u8> meshletTriangles(maxMeshlets * maxTriangles * 3);
+        built.resize(meshopt_buildMeshlets(
+            built.data(), meshletVertices.data(), meshletTriangles.data(), lod.data(), lod.size(),
+            &vertices[0].pos.x, vertices.size(), sizeof(V), maxVertices, maxTriangles, MESHLET_CONE_WEIGHT
+        ));
+
+        for (const meshopt_Meshlet& meshlet : built) {
+            // triangles index the meshlet's own vertex list, which indexes the mesh's
+            u32* localVertices = &meshletVertices[meshlet.vertex_offset];
+            u8* triangles = &meshletTriangles[meshlet.triangle_offset];
+            meshopt_optimizeMeshlet(localVertices, triangles, meshlet.triangle_count, meshlet.vertex_count);
+            const meshopt_Bounds bounds = meshopt_computeMeshletBounds(localVertices, triangles, meshlet.triangle_count, &vertices[0].pos.x, vertices.size(), sizeof(V));
+
+            meshlets.push_back({
+                .center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]),
+                .radius = bounds.radius,
+                .coneAxis = glm::vec3(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2]),
+                .coneCutoff = bounds.cone_cutoff,
+                .firstIndex = static_cast<u32>(indexes.size()),
+                .indexCount = meshlet.triangle_count * 3,
+            });
+            for (u32 i = 0; i < meshlet.triangle_count * 3; ++i) {
+                indexes.push_back(localVertices[triangles[i]]);
+            }
+        }
+    }
+}
+
 template<ValidVertex V>
-Mesh<V>::Mesh(const std::vector<V>& vertices, const std::vector<u32> &indexes)
-    : m_indexCount(static_cast<u32>(indexes.size()))
-    , m_indexType(vk::IndexType::eUint32)
+Mesh<V>::Mesh(Pool& pool, const std::vector<V>& vertices, const std::vector<u32> &indexes)
+    : Mesh(pool, vertices, std::vector<std::vector<u32>>{indexes}, {0.0f})
+{}
+
+template<ValidVertex V>
+Mesh<V>::Mesh(Pool& pool, const std::vector<V>& vertices, const std::vector<std::vector<u32>>& lodIndexes, const std::vector<float>& lodErrors)
+    : m_pool(&pool)
     , m_localOBB(resolveOBB(vertices))
 {
-    createVertexBuffer(vertices);
-    createIndexBuffer(indexes);
+    assert(!vertices.empty() && !lodIndexes.empty() && lodIndexes.size() <= MAX_LODS && lodIndexes.size() == lodErrors.size());
+
+    // every level goes into the pool as one allocation, one after the other, in meshlet order
+    std::vector<u32> indexes;
+    std::vector<Meshlet> meshlets;
+    std::vector<u32> lodIndexCounts;
+    std::vector<u32> lodMeshletCounts;
+    for (const std::vector<u32>& lod : lodIndexes) {
+        const size_t firstIndex = indexes.size();
+        const size_t firstMeshlet = meshlets.size();
+        buildMeshlets(vertices, lod, indexes, meshlets);
+        lodIndexCounts.push_back(static_cast<u32>(indexes.size() - firstIndex));
+        lodMeshletCounts.push_back(static_cast<u32>(meshlets.size() - firstMeshlet));
+    }
+    m_acmr = meshopt_analyzeVertexCache(indexes.data(), lodIndexCounts.front(), vertices.size(), ACMR_CACHE_SIZE, 0, 0).acmr;
+
+    if constexpr (QUANTISED) {
+        // positions are quantised over a cube around the bounds, so the dequantisation is a uniform scale
+        const glm::vec3 center = m_localOBB.center;
+        float scale = glm::max(m_localOBB.extent.x, glm::max(m_localOBB.extent.y, m_localOBB.extent.z));
+        if (scale <= 0.0f) scale = 1.0f;
+        m_dequantisation = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(scale));
+
+        std::vector<typename V::Packed> packed;
+        packed.reserve(vertices.size());
+        for (const V& vertex : vertices) {
+            packed.push_back(V::pack(vertex, center, scale));
+        }
+        m_allocation = pool.allocate(packed, indexes);
+
+        // meshlet bounds are culled in the same space as the positions
+        for (Meshlet& meshlet : meshlets) {
+            meshlet.center = (meshlet.center - center) / scale;
+            meshlet.radius /= scale;
+        }
+    }
+    else {
+        m_allocation = pool.allocate(vertices, indexes);
+    }
+
+    for (Meshlet& meshlet : meshlets) {
+        meshlet.firstIndex += m_allocation.firstIndex;
+        meshlet.shortIndexes = m_allocation.indexType == vk::IndexType::eUint16;
+    }
+    u32 firstMeshlet = pool.allocateMeshlets(meshlets);
+
+    u32 firstIndex = m_allocation.firstIndex;
+    for (u32 i = 0; i < lodIndexes.size(); ++i) {
+        m_lods.push_back({
+            .firstIndex = firstIndex,
+            .indexCount = lodIndexCounts[i],
+            .error = lodErrors[i],
+            .firstMeshlet = firstMeshlet,
+            .meshletCount = lodMeshletCounts[i],
+        });
+        firstIndex += lodIndexCounts[i];
+        firstMeshlet += lodMeshletCounts[i];
+    }
 }
 
 template<ValidVertex V>
-void Mesh<V>::draw(const vk::raii::CommandBuffer& commandBuffer) const {
-    commandBuffer.bindVertexBuffers(0, *m_vertexBuffer, {0});
-    commandBuffer.bindIndexBuffer(m_indexBuffer, 0, m_indexType);
-    commandBuffer.drawIndexed(m_indexCount, 1, 0, 0, 0);
+void Mesh<V>::draw(const vk::raii::CommandBuffer& commandBuffer, const u32 instanceCount, const u32 firstInstance) const {
+    m_pool->bind(commandBuffer, m_allocation.indexType);
+    commandBuffer.drawIndexed(m_lods.front().indexCount, instanceCount, m_lods.front().firstIndex, m_allocation.vertexOffset, firstInstance);
+}
+
+template<ValidVertex V>
+vk::DrawIndexedIndirectCommand Mesh<V>::getDrawCommand(const u32 instanceCount, const u32 firstInstance, const u32 lod) const {
+    const MeshLod& level = m_lods.at(lod);
+    return {
+        .indexCount = level.indexCount,
+        .instanceCount = instanceCount,
+        .firstIndex = level.firstIndex,
+        .vertexOffset = m_allocation.vertexOffset,
+        .firstInstance = firstInstance
+    };
+}
+
+template<ValidVertex V>
+u32 Mesh<V>::selectLod(const float size, const float maxError) const {
+    // errors only grow down the levels
+    u32 lod = 0;
+    while (lod + 1 < m_lods.size() && m_lods[lod + 1].error * size <= maxError) {
+        ++lod;
+    }
+    return lod;
+}
+
+template<ValidVertex V>
+u32 Mesh<V>::getLodCount() const {
+    return static_cast<u32>(m_lods.size());
+}
+
+template<ValidVertex V>
+const MeshLod & Mesh<V>::getLod(const u32 lod) const {
+    return m_lods.at(lod);
+}
+
+template<ValidVertex V>
+vk::IndexType Mesh<V>::getIndexType() const {
+    return m_allocation.indexType;
+}
+
+template<ValidVertex V>
+float Mesh<V>::getAcmr() const {
+    return m_acmr;
 }
 
 template<ValidVertex V>
@@ -25,26 +171,13 @@ OBB Mesh<V>::getLocalOBB() const {
 }
 
 template<ValidVertex V>
-void Mesh<V>::createVertexBuffer(const std::vector<V>& vertices) {
-    const u64 bufferSize = sizeof(V) * vertices.size();
-
-    auto [stagingBuffer, stagingBufferMemory] = VulkanEngine::createBuffer(
-        bufferSize,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible
-    );
-
-    void* data = stagingBufferMemory.mapMemory(0, bufferSize, {});
-    memcpy(data, vertices.data(), bufferSize);
-    stagingBufferMemory.unmapMemory();
-
-    std::tie(m_vertexBuffer, m_vertexBufferMemory) = VulkanEngine::createBuffer(
-        bufferSize,
-        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
-    );
-
-    VulkanEngine::copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
+const glm::mat4& Mesh<V>::getDequantisation() const {
+    return m_dequantisation;
+}
+
+template<ValidVertex V>
+u32 Mesh<V>::getID() const {
+    return m_allocation.index;
 }
 
 template<ValidVertex V>
@@ -81,28 +214,5 @@ OBB Mesh<V>::resolveOBB(const std::vector<V>& vertices) {
     };
 }
 
-template<ValidVertex V>
-void Mesh<V>::createIndexBuffer(const std::vector<u32>& indexes) {
-    const u64 bufferSize = sizeof(u32) * indexes.size();
-
-    auto [stagingBuffer, stagingBufferMemory] = VulkanEngine::createBuffer(
-        bufferSize,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible
-    );
-
-    void* data = stagingBufferMemory.mapMemory(0, bufferSize, {});
-    std::memcpy(data, indexes.data(), bufferSize);
-    stagingBufferMemory.unmapMemory();
-
-    std::tie(m_indexBuffer, m_indexBufferMemory) = VulkanEngine::createBuffer(
-        bufferSize,
-        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
-    );
-
-    VulkanEngine::copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
-}
-
 template class Mesh<Vertex>;
 template class Mesh<BasicVertex>;
\ No newline at end of file
@@ -5,37 +5,76 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include "Common.h"
+#include "GeometryPool.h"
 #include "Vertex.h"
 #include "Volumes.h"
 
 template<typename V>
 concept ValidVertex = requires (V v) {
     { v.pos } -> std::same_as<glm::vec3&>;
+    // the layout the vertex is uploaded to the geometry pool as
+    typename V::Packed;
+};
+
+// one level of detail - a range of the pool's index buffer over the mesh's vertices
+struct MeshLod {
+    u32 firstIndex;
+    u32 indexCount;
+    // how far the surface deviates from full detail, relative to the size of the mesh
+    float error;
+    // range of the pool's meshlets, which cover the level's indexes in order
+    u32 firstMeshlet;
+    u32 meshletCount;
 };
 
 template<ValidVertex V = Vertex>
 class Mesh {
 public:
-    Mesh(const std::vector<V>& vertices, const std::vector<u32> &indexes);
-    void draw(const vk::raii::CommandBuffer &commandBuffer) const;
+    static constexpr u32 MAX_LODS = 4;
+    // limits on the size of a meshlet - the triangle limit has to be a multiple of 4 for the meshlet builder
+    static constexpr u32 MESHLET_MAX_VERTICES = 64;
+    static constexpr u32 MESHLET_MAX_TRIANGLES = 124;
+    // the post-transform cache size ACMRs are simulated with
+    static constexpr u32 ACMR_CACHE_SIZE = 16;
+    // vertices packed into some other layout have their positions quantised, anything else is uploaded as it is
+    static constexpr bool QUANTISED = !std::same_as<V, typename V::Packed>;
 
-    OBB getLocalOBB() const;
-private:
-    void createVertexBuffer(const std::vector<V> &vertices);
+    using Pool = GeometryPool<typename V::Packed>;
+
+    Mesh(Pool& pool, const std::vector<V>& vertices, const std::vector<u32> &indexes);
+    // levels of detail from full detail down, all indexing the same vertices, with the error of each
+    // each level is split into meshlets, and its indexes reordered so every meshlet is a contiguous range
+    Mesh(Pool& pool, const std::vector<V>& vertices, const std::vector<std::vector<u32>>& lodIndexes, const std::vector<float>& lodErrors);
+    // bind the geometry pool and draw this mesh on its own at full detail
+    void draw(const vk::raii::CommandBuffer &commandBuffer, u32 instanceCount = 1, u32 firstInstance = 0) const;
+    // command to draw this mesh with drawIndexedIndirect, for when the geometry pool is already bound as its index type
+    vk::DrawIndexedIndirectCommand getDrawCommand(u32 instanceCount, u32 firstInstance, u32 lod = 0) const;
 
-    void createIndexBuffer(const std::vector<u32>& indexes);
+    // the coarsest level whose error stays under maxError pixels, with the mesh covering size pixels on screen
+    u32 selectLod(float size, float maxError) const;
+    u32 getLodCount() const;
+    const MeshLod& getLod(u32 lod) const;
+    // the type the pool's index buffer has to be bound as to draw this mesh
+    vk::IndexType getIndexType() const;
+    // average vertices transformed per triangle drawing full detail, in the order its indexes are uploaded in
+    float getAcmr() const;
 
+    OBB getLocalOBB() const;
+    // transform from the positions stored in the pool to the mesh's space, which has to be folded into the model
+    // matrix of every instance drawn - the identity unless the mesh is quantised
+    // the scale is uniform, so the normal matrix derived from the model matrix is unaffected
+    const glm::mat4& getDequantisation() const;
+    // index of this mesh within its geometry pool
+    u32 getID() const;
+private:
     // calculate the distance of the furthest vertex from the origin
     OBB resolveOBB(const std::vector<V>& vertices);
 
-    vk::raii::Buffer m_vertexBuffer = nullptr;
-    vk::raii::DeviceMemory m_vertexBufferMemory = nullptr;
-
-    vk::raii::Buffer m_indexBuffer = nullptr;
-    vk::raii::DeviceMemory m_indexBufferMemory = nullptr;
-
-    u32 m_indexCount;
-    vk::IndexType m_indexType;
+    const Pool* m_pool;
+    GeometryAllocation m_allocation;
+    std::vector<MeshLod> m_lods;
+    float m_acmr = 0.0f;
 
     OBB m_localOBB;
+    glm::mat4 m_dequantisation = glm::mat4(1.0f);
 };
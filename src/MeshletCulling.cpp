@@ -0,0 +1,456 @@
+#include "MeshletCulling.h"
+
+#include <bit>
+
+#include "AssetManager.h"
+#include "Renderer3D.h"
+#include "VulkanEngine.h"
+
+namespace {
+    constexpr u32 WORKGROUP_SIZE = 8;
+
+    void writeImage(const vk::raii::DescriptorSet& descriptorSet, const u32 binding, const vk::ImageView view, const vk::Sampler sampler) {
+        const bool storage = !sampler;
+        const vk::DescriptorImageInfo imageInfo = {
+            .sampler = sampler,
+            .imageView = view,
+            .imageLayout = storage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = *descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &imageInfo
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+
+    void writeStorageBuffer(const vk::raii::DescriptorSet& descriptorSet, const u32 binding, const vk::Buffer buffer) {
+        const vk::DescriptorBufferInfo bufferInfo = {
+            .buffer = buffer,
+            .offset = 0,
+            .range = vk::WholeSize,
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = *descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &bufferInfo,
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+
+    u32 groupCount(const u32 size) {
+        return (size + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+    }
+
+    u32 taskGroupCount(const u32 meshletCount) {
+        return (meshletCount + MeshletCulling::TASK_MESHLETS - 1) / MeshletCulling::TASK_MESHLETS;
+    }
+}
+
+MeshletCulling::MeshletCulling(const vk::Extent2D extent)
+    : m_meshShading(VulkanEngine::getMeshShaderSupport())
+{
+    m_cullPipeline = Pipeline::Builder()
+        .addShaderStage("shaders/meshlet_cull.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eCompute) // parameters
+        .addBinding(0, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute) // depth pyramid
+        .addBinding(0, 2, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute) // meshlets
+        .addBinding(0, 3, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute) // pool indexes
+        .addBinding(0, 4, vk::DescriptorType::eStorageBufferDynamic, vk::ShaderStageFlagBits::eCompute) // instances
+        .addBinding(0, 5, vk::DescriptorType::eStorageBufferDynamic, vk::ShaderStageFlagBits::eCompute) // model data
+        .addBinding(0, 6, vk::DescriptorType::eStorageBufferDynamic, vk::ShaderStageFlagBits::eCompute) // draw commands
+        .addBinding(0, 7, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute) // compacted indexes
+        .create();
+    const auto createDepthPipeline = [](const std::string& shader) {
+        return Pipeline::Builder()
+            .addShaderStage(shader)
+            .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eCompute) // parameters
+            .addBinding(0, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute) // depth
+            .addBinding(0, 2, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // first level
+            .create();
+    };
+    m_depthPipeline = createDepthPipeline("shaders/hiz_depth.comp.spv");
+    m_depthMultisampledPipeline = createDepthPipeline("shaders/hiz_depth_ms.comp.spv");
+    m_reducePipeline = Pipeline::Builder()
+        .addShaderStage("shaders/hiz_reduce.comp.spv")
+        .addBinding(0, 0, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // level before
+        .addBinding(0, 1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute) // level written
+        .create();
+
+    // levels are fetched directly, so filtering never applies - but the sampler mustn't clamp them to the first
+    const vk::SamplerCreateInfo samplerInfo = {
+        .magFilter = vk::Filter::eNearest,
+        .minFilter = vk::Filter::eNearest,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+        .mipLodBias = 0.0f,
+        .anisotropyEnable = vk::False,
+        .maxAnisotropy = 1.0f,
+        .compareEnable = vk::False,
+        .compareOp = vk::CompareOp::eAlways,
+        .minLod = 0.0f,
+        .maxLod = vk::LodClampNone,
+        .unnormalizedCoordinates = vk::False
+    };
+    m_sampler = vk::raii::Sampler(VulkanEngine::getDevice(), samplerInfo);
+
+    m_cullDescriptor = m_cullPipeline->createDescriptorSet(0);
+    const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    frameAllocator->addToSet(m_cullDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(Params));
+    frameAllocator->addToSet(m_cullDescriptor, 4, vk::DescriptorType::eStorageBufferDynamic, sizeof(Instance) * ECS::MAX_ENTITIES);
+    frameAllocator->addToSet(m_cullDescriptor, 5, vk::DescriptorType::eStorageBufferDynamic, sizeof(ModelUniforms) * ECS::MAX_ENTITIES);
+    frameAllocator->addToSet(m_cullDescriptor, 6, vk::DescriptorType::eStorageBufferDynamic, sizeof(vk::DrawIndexedIndirectCommand) * ECS::MAX_ENTITIES);
+
+    // mesh shaders draw the meshlets kept straight from the pool's indexes, so there's nothing to compact them into
+    if (m_meshShading) {
+        const auto properties = VulkanEngine::getPhysicalDevice().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+        const auto& meshProperties = properties.get<vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+        m_maxTaskWorkGroups = meshProperties.maxTaskWorkGroupTotalCount;
+        m_maxTaskWorkGroupCount = meshProperties.maxTaskWorkGroupCount;
+    }
+    else {
+        std::tie(m_indexBuffer, m_indexMemory) = VulkanEngine::createBuffer(
+            sizeof(u32) * MAX_INDEXES,
+            vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        );
+        // the pool's buffers are written on the first update, as the pool doesn't exist yet
+        writeStorageBuffer(m_cullDescriptor, 7, *m_indexBuffer);
+    }
+
+    setExtent(extent);
+}
+
+void MeshletCulling::addMeshBindings(Pipeline::Builder& builder) {
+    constexpr vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+    builder
+        .addBinding(MESHLET_SET_NUMBER, 0, vk::DescriptorType::eUniformBufferDynamic, stages) // parameters
+        .addBinding(MESHLET_SET_NUMBER, 1, vk::DescriptorType::eCombinedImageSampler, stages) // depth pyramid
+        .addBinding(MESHLET_SET_NUMBER, 2, vk::DescriptorType::eStorageBuffer, stages) // meshlets
+        .addBinding(MESHLET_SET_NUMBER, 3, vk::DescriptorType::eStorageBuffer, stages) // pool indexes
+        .addBinding(MESHLET_SET_NUMBER, 4, vk::DescriptorType::eStorageBufferDynamic, stages) // instances
+        .addBinding(MESHLET_SET_NUMBER, 5, vk::DescriptorType::eStorageBuffer, stages) // pool vertices
+        .addBinding(MESHLET_SET_NUMBER, 6, vk::DescriptorType::eStorageBufferDynamic, stages); // draw commands
+}
+
+void MeshletCulling::createMeshDescriptor(const Pipeline& pipeline) {
+    m_meshDescriptor = pipeline.createDescriptorSet(MESHLET_SET_NUMBER);
+    const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    frameAllocator->addToSet(m_meshDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(Params));
+    frameAllocator->addToSet(m_meshDescriptor, 4, vk::DescriptorType::eStorageBufferDynamic, sizeof(Instance) * ECS::MAX_ENTITIES);
+    frameAllocator->addToSet(m_meshDescriptor, 6, vk::DescriptorType::eStorageBufferDynamic, sizeof(vk::DrawIndexedIndirectCommand) * ECS::MAX_ENTITIES);
+    writeImage(m_meshDescriptor, 1, *m_pyramid->getView(), *m_sampler);
+    // the pool's buffers are written again on the next update
+    m_poolVertexBuffer = nullptr;
+}
+
+bool MeshletCulling::getMeshShading() const {
+    return m_meshShading;
+}
+
+void MeshletCulling::setExtent(const vk::Extent2D extent) {
+    m_extent = extent;
+    m_renderExtent = extent;
+    m_previousRenderExtent = extent;
+    createPyramid();
+}
+
+void MeshletCulling::begin() {
+    // every instance could be culled, and the bindings' dynamic ranges cover that many
+    FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    m_instances = frameAllocator->allocate<Instance>(ECS::MAX_ENTITIES);
+    m_commands = frameAllocator->allocate<vk::DrawIndexedIndirectCommand>(ECS::MAX_ENTITIES);
+    m_instanceCount = 0;
+    m_indexCount = 0;
+    m_meshletCount = 0;
+    m_maxInstanceMeshlets = 0;
+}
+
+bool MeshletCulling::canCull(const Mesh<>& mesh, const u32 lod, const u32 instanceCount) const {
+    const MeshLod& level = mesh.getLod(lod);
+    if (level.meshletCount < MIN_MESHLETS) return false;
+    if (m_meshShading) {
+        // every instance is given a row of as many task shader workgroups as the one with the most meshlets, and in
+        // the worst case they're all in one draw
+        const u32 groupsPerInstance = taskGroupCount(std::max(m_maxInstanceMeshlets, level.meshletCount));
+        const u32 rows = m_instanceCount + instanceCount;
+        return groupsPerInstance <= m_maxTaskWorkGroupCount[0] && rows <= m_maxTaskWorkGroupCount[1]
+            && static_cast<u64>(groupsPerInstance) * rows <= m_maxTaskWorkGroups;
+    }
+    return static_cast<u64>(m_indexCount) + static_cast<u64>(level.indexCount) * instanceCount <= MAX_INDEXES;
+}
+
+void MeshletCulling::addInstance(const Mesh<>& mesh, const u32 lod, const u32 modelIndex) {
+    const MeshLod& level = mesh.getLod(lod);
+    m_instances.data[m_instanceCount] = {
+        .firstMeshlet = level.firstMeshlet,
+        .meshletCount = level.meshletCount,
+    };
+    // the cull pass counts up the indexes of the meshlets it keeps, copying them to the start of the instance's range
+    vk::DrawIndexedIndirectCommand command = mesh.getDrawCommand(1, modelIndex, lod);
+    command.indexCount = 0;
+    command.firstIndex = m_indexCount;
+    m_commands.data[m_instanceCount] = command;
+
+    ++m_instanceCount;
+    m_indexCount += level.indexCount;
+    m_meshletCount += level.meshletCount;
+    m_maxInstanceMeshlets = std::max(m_maxInstanceMeshlets, level.meshletCount);
+}
+
+void MeshletCulling::update(const Frustum& frustum, const glm::mat4& viewProjection, const glm::vec3 cameraPosition, const vk::Extent2D renderExtent, const u32 modelOffset, const glm::uvec3 firstInstances) {
+    // the pool only grows while loading, but the descriptors can't be rewritten while a frame might be using them
+    const auto& pool = VulkanEngine::getAssetManager()->getGeometryPool();
+    if (*pool.getVertexBuffer() != m_poolVertexBuffer || *pool.getIndexBuffer() != m_poolIndexBuffer || *pool.getMeshletBuffer() != m_poolMeshletBuffer) {
+        VulkanEngine::getDevice().waitIdle();
+        writePoolBuffers();
+    }
+
+    m_previousRenderExtent = m_renderExtent;
+    m_renderExtent = renderExtent;
+    m_modelOffset = modelOffset;
+
+    const auto toVec4 = [](const Plane& plane) {
+        return glm::vec4(plane.normal, plane.d);
+    };
+    m_params = VulkanEngine::getFrameAllocator()->push<Params>({
+        .previousViewProjection = m_previousViewProjection,
+        .frustumPlanes = {toVec4(frustum.top), toVec4(frustum.bottom), toVec4(frustum.right), toVec4(frustum.left), toVec4(frustum.near), toVec4(frustum.far)},
+        .firstInstances = glm::uvec4(firstInstances, 0),
+        .cameraPosition = cameraPosition,
+        .instanceCount = m_instanceCount,
+        .renderSize = glm::vec2(m_renderExtent.width, m_renderExtent.height),
+        .previousRenderSize = glm::vec2(m_previousRenderExtent.width, m_previousRenderExtent.height),
+        .pyramidLevels = static_cast<u32>(m_pyramidLevels.size()),
+        .coneCulling = m_coneCulling,
+        .occlusionCulling = m_pyramidActive && m_pyramidValid,
+    });
+    m_previousViewProjection = viewProjection;
+    m_pyramidValid = m_pyramidActive;
+}
+
+void MeshletCulling::setBuffers(RenderGraph &graph) const {
+    if (m_meshShading) return;
+    graph.setBuffer(m_commandResource, m_commands.buffer);
+}
+
+void MeshletCulling::addCullPass(RenderGraph &graph) {
+    // the pyramid is last frame's, so it's only there to sample if the pass building it is in the graph too
+    m_pyramidResource = graph.importImage("Depth Pyramid", PYRAMID_FORMAT, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+    graph.setImage(m_pyramidResource, *m_pyramid->getImage(), *m_pyramid->getView());
+    m_pyramidActive = false;
+    m_pyramidValid = false;
+
+    // task shaders cull as each pass draws, and their commands are only read from the frame allocator
+    if (m_meshShading) return;
+
+    m_commandResource = graph.importBuffer("Meshlet Commands");
+    m_indexResource = graph.importBuffer("Meshlet Indexes");
+    graph.setBuffer(m_indexResource, *m_indexBuffer);
+
+    std::vector<RenderGraph::Access> accesses = {
+        {m_commandResource, ResourceUsage::StorageWrite},
+        {m_indexResource, ResourceUsage::StorageWrite},
+    };
+    if (m_occlusionCulling) {
+        accesses.push_back({m_pyramidResource, ResourceUsage::Sampled});
+    }
+    graph.addPass("Meshlet Culling", accesses, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        cull(commandBuffer);
+    });
+}
+
+void MeshletCulling::addPyramidPass(RenderGraph &graph, const RenderGraph::Handle depth, const vk::SampleCountFlagBits samples) {
+    if (!m_occlusionCulling) return;
+    m_depthResource = depth;
+    m_multisampled = samples != vk::SampleCountFlagBits::e1;
+    m_pyramidActive = true;
+
+    graph.addPass("Depth Pyramid", {
+        {depth, ResourceUsage::Sampled},
+        {m_pyramidResource, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        buildPyramid(commandBuffer);
+    });
+}
+
+void MeshletCulling::writeDescriptors(const RenderGraph &graph) {
+    if (!m_pyramidActive) return;
+
+    m_depthDescriptor = (m_multisampled ? *m_depthMultisampledPipeline : *m_depthPipeline).createDescriptorSet(0);
+    VulkanEngine::getFrameAllocator()->addToSet(m_depthDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(Params));
+    writeImage(m_depthDescriptor, 1, graph.getImageView(m_depthResource), *m_sampler);
+    writeImage(m_depthDescriptor, 2, *m_pyramidLevels.front(), nullptr);
+}
+
+RenderGraph::Handle MeshletCulling::getCommandResource() const {
+    return m_commandResource;
+}
+
+RenderGraph::Handle MeshletCulling::getIndexResource() const {
+    return m_indexResource;
+}
+
+RenderGraph::Handle MeshletCulling::getPyramidResource() const {
+    return m_pyramidResource;
+}
+
+const FrameAllocation<vk::DrawIndexedIndirectCommand>& MeshletCulling::getCommands() const {
+    return m_commands;
+}
+
+u32 MeshletCulling::getCommandCount() const {
+    return m_instanceCount;
+}
+
+void MeshletCulling::bindIndexBuffer(const vk::raii::CommandBuffer &commandBuffer) const {
+    // compacted indexes are always 32 bit, whatever the type of the pool's they were copied from
+    commandBuffer.bindIndexBuffer(m_indexBuffer, 0, vk::IndexType::eUint32);
+}
+
+void MeshletCulling::drawMeshTasks(const vk::raii::CommandBuffer &commandBuffer, const Pipeline& pipeline, const u32 instanceCount) const {
+    // dynamic offsets in binding order
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.getLayout(), MESHLET_SET_NUMBER, {*m_meshDescriptor}, {m_params.offset, m_instances.offset, m_commands.offset});
+    // a row of task shader workgroups per instance, long enough for the one with the most meshlets
+    commandBuffer.drawMeshTasksEXT(taskGroupCount(m_maxInstanceMeshlets), instanceCount, 1);
+}
+
+u32 MeshletCulling::getMeshletCount() const {
+    return m_meshletCount;
+}
+
+void MeshletCulling::setEnabled(const bool enabled) {
+    m_enabled = enabled;
+    VulkanEngine::queueRendererRebuild();
+}
+
+bool MeshletCulling::getEnabled() const {
+    return m_enabled;
+}
+
+void MeshletCulling::setConeCulling(const bool enabled) {
+    m_coneCulling = enabled;
+}
+
+bool MeshletCulling::getConeCulling() const {
+    return m_coneCulling;
+}
+
+void MeshletCulling::setOcclusionCulling(const bool enabled) {
+    m_occlusionCulling = enabled;
+    VulkanEngine::queueRendererRebuild();
+}
+
+bool MeshletCulling::getOcclusionCulling() const {
+    return m_occlusionCulling;
+}
+
+void MeshletCulling::createPyramid() {
+    // the first level halves the attachments, and is a power of two so every texel covers a whole block of pixels
+    m_pyramidExtent = {
+        std::bit_ceil((m_extent.width + 1) / 2),
+        std::bit_ceil((m_extent.height + 1) / 2),
+    };
+    const u32 levelCount = std::bit_width(std::max(m_pyramidExtent.width, m_pyramidExtent.height));
+    m_pyramid = std::make_unique<Image>(ImageCreateInfo {
+        .width = m_pyramidExtent.width,
+        .height = m_pyramidExtent.height,
+        .format = PYRAMID_FORMAT,
+        .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+        .mips = levelCount,
+    });
+    m_pyramidValid = false;
+
+    m_pyramidLevels.clear();
+    for (u32 level = 0; level < levelCount; ++level) {
+        const vk::ImageViewCreateInfo viewInfo = {
+            .image = *m_pyramid->getImage(),
+            .viewType = vk::ImageViewType::e2D,
+            .format = PYRAMID_FORMAT,
+            .subresourceRange = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel = level,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+        m_pyramidLevels.emplace_back(VulkanEngine::getDevice(), viewInfo);
+    }
+
+    m_reduceDescriptors.clear();
+    for (u32 level = 1; level < levelCount; ++level) {
+        vk::raii::DescriptorSet& descriptorSet = m_reduceDescriptors.emplace_back(m_reducePipeline->createDescriptorSet(0));
+        writeImage(descriptorSet, 0, *m_pyramidLevels.at(level - 1), nullptr);
+        writeImage(descriptorSet, 1, *m_pyramidLevels.at(level), nullptr);
+    }
+    writeImage(m_cullDescriptor, 1, *m_pyramid->getView(), *m_sampler);
+    if (*m_meshDescriptor) {
+        writeImage(m_meshDescriptor, 1, *m_pyramid->getView(), *m_sampler);
+    }
+
+    // left in the layout the graph imports it with - it's never sampled until it has been built
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    m_pyramid->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        .mips = levelCount,
+    });
+    VulkanEngine::endSingleCommand(commandBuffer);
+}
+
+void MeshletCulling::writePoolBuffers() {
+    const auto& pool = VulkanEngine::getAssetManager()->getGeometryPool();
+    m_poolVertexBuffer = *pool.getVertexBuffer();
+    m_poolIndexBuffer = *pool.getIndexBuffer();
+    m_poolMeshletBuffer = *pool.getMeshletBuffer();
+    writeStorageBuffer(m_cullDescriptor, 2, m_poolMeshletBuffer);
+    writeStorageBuffer(m_cullDescriptor, 3, m_poolIndexBuffer);
+    if (*m_meshDescriptor) {
+        writeStorageBuffer(m_meshDescriptor, 2, m_poolMeshletBuffer);
+        writeStorageBuffer(m_meshDescriptor, 3, m_poolIndexBuffer);
+        writeStorageBuffer(m_meshDescriptor, 5, m_poolVertexBuffer);
+    }
+}
+
+void MeshletCulling::cull(const vk::raii::CommandBuffer &commandBuffer) const {
+    if (m_instanceCount == 0) return;
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_cullPipeline->getPipeline());
+    // dynamic offsets in binding order
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_cullPipeline->getLayout(), 0, {*m_cullDescriptor}, {m_params.offset, m_instances.offset, m_modelOffset, m_commands.offset});
+    // one workgroup per instance, each looping over its meshlets
+    commandBuffer.dispatch(m_instanceCount, 1, 1);
+}
+
+void MeshletCulling::buildPyramid(const vk::raii::CommandBuffer &commandBuffer) const {
+    // every texel is written, so whatever was left outside this frame's render region is never read as depth
+    const Pipeline& depthPipeline = m_multisampled ? *m_depthMultisampledPipeline : *m_depthPipeline;
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, depthPipeline.getPipeline());
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, depthPipeline.getLayout(), 0, {*m_depthDescriptor}, {m_params.offset});
+    commandBuffer.dispatch(groupCount(m_pyramidExtent.width), groupCount(m_pyramidExtent.height), 1);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_reducePipeline->getPipeline());
+    constexpr vk::MemoryBarrier2 levelBarrier = {
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead
+    };
+    for (u32 level = 1; level < m_pyramidLevels.size(); ++level) {
+        // each level reads the one before, so has to wait for it
+        commandBuffer.pipelineBarrier2({
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &levelBarrier
+        });
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_reducePipeline->getLayout(), 0, {*m_reduceDescriptors.at(level - 1)}, {});
+        commandBuffer.dispatch(groupCount(std::max(1u, m_pyramidExtent.width >> level)), groupCount(std::max(1u, m_pyramidExtent.height >> level)), 1);
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "FrameAllocator.h"
+#include "Image.h"
+#include "Mesh.h"
+#include "Pipeline.h"
+#include "RenderGraph.h"
+#include "Volumes.h"
+
+// culls the meshlets of each instance on the GPU before it's drawn, testing every meshlet against the frustum, its
+// normal cone and a depth pyramid built from the last frame
+//
+// with mesh shaders, task shaders test the meshlets as each pass draws them and launch a mesh shader workgroup for
+// every one left - otherwise a compute pass copies the indexes of the ones left into a buffer of their own, with a
+// draw command per instance counting them
+//
+// occlusion is tested against where things were last frame, so something only just uncovered shows up a frame late
+class MeshletCulling {
+public:
+    // std140 layout, matching Params in meshlet.glsl
+    struct Params {
+        glm::mat4 previousViewProjection;
+        // inward facing planes as (normal, distance)
+        std::array<glm::vec4, 6> frustumPlanes;
+        // the first culled instance of each alpha mode's pipeline, for the task shaders - w is unused
+        glm::uvec4 firstInstances;
+        glm::vec3 cameraPosition;
+        u32 instanceCount;
+        // the region of the depth attachment rendered to this frame, and the one the pyramid was built from
+        glm::vec2 renderSize;
+        glm::vec2 previousRenderSize;
+        u32 pyramidLevels;
+        u32 coneCulling;
+        u32 occlusionCulling;
+    };
+
+    // std430 layout, matching Instance in meshlet_cull.glsl - the instance's draw command has the same index
+    struct Instance {
+        u32 firstMeshlet;
+        u32 meshletCount;
+    };
+
+    // indexes the culled meshlets can be copied into each frame - instances past this are drawn whole
+    static constexpr u32 MAX_INDEXES = 1 << 23;
+    // meshlets tested by each task shader workgroup, matching meshlet_cull.glsl
+    static constexpr u32 TASK_MESHLETS = 32;
+    // levels with fewer meshlets than this are drawn whole, as there's too little to cull to be worth losing instancing
+    static constexpr u32 MIN_MESHLETS = 4;
+    static constexpr vk::Format PYRAMID_FORMAT = vk::Format::eR32Sfloat;
+
+    explicit MeshletCulling(vk::Extent2D extent);
+
+    // the set mesh shading pipelines read the culling's buffers from, which drawMeshTasks binds
+    static void addMeshBindings(Pipeline::Builder& builder);
+    // create the set drawMeshTasks binds, from any pipeline with the mesh bindings - only with mesh shading
+    void createMeshDescriptor(const Pipeline& pipeline);
+    // whether meshlets are culled in task shaders as they're drawn, rather than by a compute pass beforehand
+    bool getMeshShading() const;
+
+    // recreate the depth pyramid for a new extent - the graph has to be recreated afterwards
+    void setExtent(vk::Extent2D extent);
+
+    // start this frame's list of instances
+    void begin();
+    // whether the instances of a level would be culled, if there is room for them all
+    bool canCull(const Mesh<>& mesh, u32 lod, u32 instanceCount) const;
+    // queue an instance to be culled, where modelIndex is its index into the model uniforms
+    void addInstance(const Mesh<>& mesh, u32 lod, u32 modelIndex);
+    // push this frame's parameters, once every instance has been added - firstInstances is the first instance of each
+    // alpha mode's pipeline
+    void update(const Frustum& frustum, const glm::mat4& viewProjection, glm::vec3 cameraPosition, vk::Extent2D renderExtent, u32 modelOffset, glm::uvec3 firstInstances);
+    // point the graph at this frame's draw commands, before it is executed
+    void setBuffers(RenderGraph& graph) const;
+
+    // add the pass culling this frame's instances, before anything draws them - with mesh shading they're culled as
+    // they're drawn, so only the depth pyramid is imported
+    void addCullPass(RenderGraph& graph);
+    // add the pass building the depth pyramid the next frame is tested against, once depth is final
+    void addPyramidPass(RenderGraph& graph, RenderGraph::Handle depth, vk::SampleCountFlagBits samples);
+    // point the passes at the graph's images, once it has been compiled
+    void writeDescriptors(const RenderGraph& graph);
+
+    // the draw commands and compacted indexes, read by the passes drawing the culled instances
+    RenderGraph::Handle getCommandResource() const;
+    RenderGraph::Handle getIndexResource() const;
+    // sampled by the passes drawing the culled instances with mesh shading, when occlusion culling
+    RenderGraph::Handle getPyramidResource() const;
+    const FrameAllocation<vk::DrawIndexedIndirectCommand>& getCommands() const;
+    u32 getCommandCount() const;
+    void bindIndexBuffer(const vk::raii::CommandBuffer& commandBuffer) const;
+    // draw a range of the culled instances with a mesh shading pipeline, once it's bound - the range is the one
+    // firstInstances gives the pipeline's alpha mode
+    void drawMeshTasks(const vk::raii::CommandBuffer& commandBuffer, const Pipeline& pipeline, u32 instanceCount) const;
+
+    // meshlets sent to be tested this frame
+    u32 getMeshletCount() const;
+
+    void setEnabled(bool enabled);
+    bool getEnabled() const;
+    void setConeCulling(bool enabled);
+    bool getConeCulling() const;
+    void setOcclusionCulling(bool enabled);
+    bool getOcclusionCulling() const;
+
+private:
+    void createPyramid();
+    void writePoolBuffers();
+    void cull(const vk::raii::CommandBuffer& commandBuffer) const;
+    void buildPyramid(const vk::raii::CommandBuffer& commandBuffer) const;
+
+    vk::Extent2D m_extent;
+    vk::Extent2D m_renderExtent;
+    vk::Extent2D m_previousRenderExtent;
+
+    std::unique_ptr<Pipeline> m_cullPipeline;
+    std::unique_ptr<Pipeline> m_depthPipeline;
+    std::unique_ptr<Pipeline> m_depthMultisampledPipeline;
+    std::unique_ptr<Pipeline> m_reducePipeline;
+    vk::raii::DescriptorSet m_cullDescriptor = nullptr;
+    vk::raii::DescriptorSet m_meshDescriptor = nullptr;
+    vk::raii::DescriptorSet m_depthDescriptor = nullptr;
+    // one per level after the first, reading the level before
+    std::vector<vk::raii::DescriptorSet> m_reduceDescriptors;
+    vk::raii::Sampler m_sampler = nullptr;
+
+    vk::raii::Buffer m_indexBuffer = nullptr;
+    vk::raii::DeviceMemory m_indexMemory = nullptr;
+    // the geometry pool's buffers the descriptors were written with
+    vk::Buffer m_poolVertexBuffer = nullptr;
+    vk::Buffer m_poolIndexBuffer = nullptr;
+    vk::Buffer m_poolMeshletBuffer = nullptr;
+
+    // the furthest depth over power of two blocks of pixels, with each level halving the last
+    std::unique_ptr<Image> m_pyramid;
+    std::vector<vk::raii::ImageView> m_pyramidLevels;
+    vk::Extent2D m_pyramidExtent;
+
+    RenderGraph::Handle m_commandResource = 0;
+    RenderGraph::Handle m_indexResource = 0;
+    RenderGraph::Handle m_pyramidResource = 0;
+    RenderGraph::Handle m_depthResource = 0;
+    bool m_multisampled = false;
+    // whether the pyramid is built this frame, and whether it holds the last frame's depth
+    bool m_pyramidActive = false;
+    bool m_pyramidValid = false;
+
+    bool m_meshShading;
+    // the most task shader workgroups a single draw can launch, in total and along each dimension
+    u32 m_maxTaskWorkGroups = 0;
+    std::array<u32, 3> m_maxTaskWorkGroupCount = {};
+
+    bool m_enabled = true;
+    bool m_coneCulling = true;
+    bool m_occlusionCulling = true;
+
+    // this frame's allocations from the frame allocator
+    FrameAllocation<Params> m_params;
+    FrameAllocation<Instance> m_instances;
+    FrameAllocation<vk::DrawIndexedIndirectCommand> m_commands;
+    u32 m_instanceCount = 0;
+    u32 m_indexCount = 0;
+    u32 m_meshletCount = 0;
+    // the most meshlets of any one instance, which sets how many task shader workgroups each instance is given
+    u32 m_maxInstanceMeshlets = 0;
+    u32 m_modelOffset = 0;
+    glm::mat4 m_previousViewProjection = glm::mat4(1.0f);
+};
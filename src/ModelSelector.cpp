@@ -14,12 +14,14 @@ ModelSelector::ModelSelector(const vk::Extent2D extent) : m_extent(extent) {
         .addShaderStage("shaders/id.vert.spv")
         .addShaderStage("shaders/id.frag.spv")
         .addAttachment(getTextureFormat())
-        .setVertexInfo(Vertex::getBindingDescription(), Vertex::getAttributeDescriptions())
+        .setVertexInfo(PackedVertex::getBindingDescription(), PackedVertex::getAttributeDescriptions())
         .addBinding(FRAME_SET_NUMBER, 0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex)
-        .addBinding(MODEL_SET_NUMBER, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex)
+        .addBinding(MODEL_SET_NUMBER, 0, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex)
         .create();
 
-    createAttachments();
+    createRenderGraph();
+    // only the pixel under the cursor is read back
+    std::tie(m_outputBuffer, m_outputBufferMemory) = VulkanEngine::createBuffer(sizeof(ECS::Entity), vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
 
     m_modelDescriptor = m_pipeline->createDescriptorSet(MODEL_SET_NUMBER);
     m_frameDescriptor = m_pipeline->createDescriptorSet(FRAME_SET_NUMBER);
@@ -59,7 +61,7 @@ void ModelSelector::disable() {
 
 void ModelSelector::setExtent(vk::Extent2D extent) {
     m_extent = extent;
-    createAttachments();
+    createRenderGraph();
 }
 
 ECS::Entity ModelSelector::getSelected() const {
@@ -68,21 +70,36 @@ ECS::Entity ModelSelector::getSelected() const {
 
 ECS::Entity ModelSelector::calculateSelectedEntity() {
     glm::vec2 mousePosition = InputManager::mousePos();
-    auto iMousePosition = glm::ivec2(mousePosition);
+    m_selectionPixel = glm::ivec2(mousePosition);
     const auto [winWidth, winHeight] = VulkanEngine::getWindowSize();
+    mousePosition /= glm::vec2(winWidth, winHeight);
+    mousePosition = mousePosition * 2.0f - 1.0f;
+    m_selectionRay = ECS::getSystem<ControlledCameraSystem>()->normalisedScreenToRay(mousePosition);
+
+    const auto commandBuffer = VulkanEngine::beginSingleCommand();
+    m_renderGraph->setBuffer(m_outputResource, *m_outputBuffer);
+    m_renderGraph->execute(commandBuffer);
+    VulkanEngine::endSingleCommand(commandBuffer);
+
+    void* data = m_outputBufferMemory.mapMemory(0, sizeof(ECS::Entity));
+    ECS::Entity selected = *static_cast<ECS::Entity*>(data);
+    m_outputBufferMemory.unmapMemory();
 
-    auto commandBuffer = VulkanEngine::beginSingleCommand();
-    m_colorImage->changeLayout(commandBuffer, {vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal});
+    return selected;
+}
+
+void ModelSelector::drawEntityIDs(const vk::raii::CommandBuffer &commandBuffer) {
+    const auto [winWidth, winHeight] = VulkanEngine::getWindowSize();
 
     const vk::RenderingAttachmentInfo colourAttachment = {
-        .imageView = m_colorImage->getView(),
+        .imageView = m_renderGraph->getImageView(m_idResource),
         .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
         .loadOp = vk::AttachmentLoadOp::eClear,
         .storeOp = vk::AttachmentStoreOp::eStore,
         .clearValue = vk::ClearColorValue(*reinterpret_cast<const float*>(&ECS::NULL_ENTITY), 0.0f, 0.0f, 0.0f)
     };
     const vk::RenderingAttachmentInfo depthAttachment = {
-        .imageView = m_depthImage->getView(),
+        .imageView = m_renderGraph->getImageView(m_depthResource),
         .imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
         .loadOp = vk::AttachmentLoadOp::eClear,
         .storeOp = vk::AttachmentStoreOp::eDontCare,
@@ -119,40 +136,46 @@ ECS::Entity ModelSelector::calculateSelectedEntity() {
     const auto camera = ECS::getSystem<ControlledCameraSystem>();
     m_frameUniforms.setData({
         .view = camera->getViewMatrix(),
-        .projection = camera->getProjectionMatrix(),
+        .projection = camera->getProjectionMatrix(false),
     });
     commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, {});
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {});
 
-    mousePosition /= glm::vec2(winWidth, winHeight);
-    mousePosition = mousePosition * 2.0f - 1.0f;
-
-    u32 i = 0;
-    const Ray ray = camera->normalisedScreenToRay(mousePosition);
+    // group the entities hit by the ray by mesh so each mesh is drawn once, instanced
+    for (auto& entities : m_candidates | std::views::values) {
+        entities.clear();
+    }
     for (const auto entity : VulkanEngine::getRenderer()->getLastRenderedEntities()) {
         assert(ECS::hasComponent<BoundingVolume>(entity));
         assert(ECS::hasComponent<Transform>(entity));
         assert(ECS::hasComponent<Model3D>(entity));
 
-        const auto& obb = ECS::getComponent<BoundingVolume>(entity).obb;
-
-        if (obb.intersects(ray) >= 0.0f) {
+        if (ECS::getComponent<BoundingVolume>(entity).obb.intersects(m_selectionRay) >= 0.0f) {
+            m_candidates[ECS::getComponent<Model3D>(entity).mesh].push_back(entity);
+        }
+    }
 
-            // valid object - render and test
-            m_modelUniforms.setData(i, {ECS::getComponent<Transform>(entity).transform, entity});
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {i * m_modelUniforms.getItemSize()});
-            const auto& model3D = ECS::getComponent<Model3D>(entity);
-            model3D.mesh->draw(commandBuffer);
-            ++i;
+    u32 i = 0;
+    for (const auto& [mesh, entities] : m_candidates) {
+        const u32 firstInstance = i;
+        for (const auto entity : entities) {
             if (i == m_modelUniforms.getSize()) {
                 Logger::warn("Model selected detected more than the max configured number of entities ({})", m_modelUniforms.getSize());
                 break;
             }
+            // valid object - render and test
+            m_modelUniforms.setData(i, {ModelUniforms::from(ECS::getComponent<Transform>(entity).transform * mesh->getDequantisation()).transform, entity});
+            ++i;
+        }
+        if (i > firstInstance) {
+            mesh->draw(commandBuffer, i - firstInstance, firstInstance);
         }
     }
 
     commandBuffer.endRendering();
-    m_colorImage->changeLayout(commandBuffer, {vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal});
+}
 
+void ModelSelector::copySelectedID(const vk::raii::CommandBuffer &commandBuffer) const {
     const vk::BufferImageCopy region = {
         .bufferOffset = 0,
         .bufferRowLength = 0,
@@ -163,36 +186,42 @@ ECS::Entity ModelSelector::calculateSelectedEntity() {
             .baseArrayLayer = 0,
             .layerCount = 1
         },
-        .imageOffset = {iMousePosition.x, iMousePosition.y, 0},
+        .imageOffset = {m_selectionPixel.x, m_selectionPixel.y, 0},
         .imageExtent = {1, 1, 1}
     };
-    commandBuffer.copyImageToBuffer(m_colorImage->getImage(), vk::ImageLayout::eTransferSrcOptimal, m_outputBuffer, region);
-    VulkanEngine::endSingleCommand(commandBuffer);
-
-    void* data = m_outputBufferMemory.mapMemory(0, m_outputBuffer.getMemoryRequirements().size);
-    ECS::Entity selected = *static_cast<ECS::Entity*>(data);
-    m_outputBufferMemory.unmapMemory();
-
-    return selected;
+    commandBuffer.copyImageToBuffer(m_renderGraph->getImage(m_idResource), vk::ImageLayout::eTransferSrcOptimal, m_outputBuffer, region);
 }
 
-void ModelSelector::createAttachments() {
-    m_colorImage = std::make_unique<Image>(ImageCreateInfo{
-		.width = m_extent.width,
-		.height = m_extent.height,
-		.format = getTextureFormat(),
-		.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
-	});
+void ModelSelector::createRenderGraph() {
+    m_renderGraph = std::make_unique<RenderGraph>();
+    RenderGraph& graph = *m_renderGraph;
 
-    m_depthImage = std::make_unique<Image>(ImageCreateInfo{
+    m_idResource = graph.createImage("Entity IDs", {
+        .width = m_extent.width,
+        .height = m_extent.height,
+        .format = getTextureFormat(),
+    });
+    m_depthResource = graph.createImage("Selection Depth", {
         .width = m_extent.width,
         .height = m_extent.height,
         .format = VulkanEngine::getDepthFormat(),
-        .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
-        .aspect = vk::ImageAspectFlagBits::eDepth
+    });
+    m_outputResource = graph.importBuffer("Selection Output");
+
+    graph.addPass("Entity IDs", {
+        {m_idResource, ResourceUsage::ColourAttachment},
+        {m_depthResource, ResourceUsage::DepthAttachment},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        drawEntityIDs(commandBuffer);
+    });
+    graph.addPass("Read Back", {
+        {m_idResource, ResourceUsage::TransferSrc},
+        {m_outputResource, ResourceUsage::TransferDst},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        copySelectedID(commandBuffer);
     });
 
-    std::tie(m_outputBuffer, m_outputBufferMemory) = VulkanEngine::createBuffer(m_colorImage->getImage().getMemoryRequirements().size, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+    graph.compile();
 }
 
 constexpr vk::Format ModelSelector::getTextureFormat() const {
@@ -4,7 +4,9 @@
 
 #include "Common.h"
 #include "ECS.h"
+#include "RenderGraph.h"
 #include "UniformBufferBlock.h"
+#include "Volumes.h"
 
 class ModelSelector : public IUpdatable {
 public:
@@ -27,13 +29,17 @@ private:
         glm::mat4 projection;
     };
 
-    struct SelectorModelUniform {
-        glm::mat4 transform;
+    // aligned to match the std430 array stride in id.vert
+    struct alignas(16) SelectorModelUniform {
+        glm::mat3x4 transform;
         ECS::Entity ID;
     };
 
     ECS::Entity calculateSelectedEntity();
-    void createAttachments();
+    // draw every entity under the cursor with its ID as the colour
+    void drawEntityIDs(const vk::raii::CommandBuffer& commandBuffer);
+    void copySelectedID(const vk::raii::CommandBuffer& commandBuffer) const;
+    void createRenderGraph();
 
     vk::Extent2D m_extent;
 
@@ -42,8 +48,13 @@ private:
 
     std::unique_ptr<Pipeline> m_pipeline;
 
-    std::unique_ptr<Image> m_colorImage;
-    std::unique_ptr<Image> m_depthImage;
+    std::unique_ptr<RenderGraph> m_renderGraph;
+    RenderGraph::Handle m_idResource = 0;
+    RenderGraph::Handle m_depthResource = 0;
+    RenderGraph::Handle m_outputResource = 0;
+
+    Ray m_selectionRay;
+    glm::ivec2 m_selectionPixel;
 
     vk::raii::Buffer m_outputBuffer = nullptr;
     vk::raii::DeviceMemory m_outputBufferMemory = nullptr;
@@ -51,6 +62,10 @@ private:
     vk::raii::DescriptorSet m_frameDescriptor = nullptr;
     vk::raii::DescriptorSet m_modelDescriptor = nullptr;
 
+    // only used by the selection command, which is waited on before returning, so these don't need a copy per frame
+    // in flight
     UniformBufferBlock<SelectorFrameUniform> m_frameUniforms;
-    DynamicUniformBufferBlock<SelectorModelUniform> m_modelUniforms;
+    StorageBufferBlock<SelectorModelUniform> m_modelUniforms;
+
+    std::unordered_map<Mesh<>*, std::vector<ECS::Entity>> m_candidates;
 };
@@ -1,7 +1,20 @@
 #include "Pipeline.h"
 
+#include <algorithm>
+#include <chrono>
+
+#include "PipelineCache.h"
+#include "ShaderReloader.h"
 #include "VulkanEngine.h"
 
+// the parts a pipeline is linked from with graphics pipeline libraries, in the order Pipeline keeps them
+static constexpr std::array LIBRARY_PARTS = {
+	vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface,
+	vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders,
+	vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader,
+	vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface,
+};
+
 Pipeline::Builder::Builder() {
 	m_inputAssembly = {
 		.topology = vk::PrimitiveTopology::eTriangleList
@@ -43,12 +56,6 @@ Pipeline::Builder& Pipeline::Builder::setVertexInfo(const vk::VertexInputBinding
 
 	m_bindings = bindings;
 	m_attributes = attributes;
-	m_vertexInputInfo = {
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &bindings,
-		.vertexAttributeDescriptionCount = static_cast<u32>(attributes.size()),
-		.pVertexAttributeDescriptions = attributes.data()
-	};
 	return *this;
 }
 
@@ -60,22 +67,33 @@ Pipeline::Builder & Pipeline::Builder::addShaderStage(std::string path) {
 	else if (path.ends_with(".frag.spv")) {
 		stage = vk::ShaderStageFlagBits::eFragment;
 	}
+	else if (path.ends_with(".comp.spv")) {
+		stage = vk::ShaderStageFlagBits::eCompute;
+	}
+	else if (path.ends_with(".task.spv")) {
+		stage = vk::ShaderStageFlagBits::eTaskEXT;
+	}
+	else if (path.ends_with(".mesh.spv")) {
+		stage = vk::ShaderStageFlagBits::eMeshEXT;
+	}
 	else {
 		Logger::warn("Unrecognised shader stage: {}", path);
 		stage = vk::ShaderStageFlagBits::eAll;
 	}
-	const std::vector<char> code = readFile(path);
-	const vk::ShaderModuleCreateInfo createInfo = {
-		.codeSize = code.size() * sizeof(char),
-		.pCode = reinterpret_cast<const u32*>(code.data())
-	};
+	m_shaders.insert({stage, VulkanEngine::getPipelineCache()->getShaderModule(path)});
+	m_shaderPaths.insert({stage, std::move(path)});
+	return *this;
+}
 
-	m_shaders.insert({stage, vk::raii::ShaderModule(VulkanEngine::getDevice(), createInfo)});
+Pipeline::Builder & Pipeline::Builder::addBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlags stages) {
+	m_descriptorBindings.at(set).emplace_back(binding, type, 1, stages);
+	m_descriptorBindingFlags.at(set).emplace_back();
 	return *this;
 }
 
-Pipeline::Builder & Pipeline::Builder::addBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlagBits stage) {
-	m_descriptorBindings.at(set).emplace_back(binding, type, 1, stage);
+Pipeline::Builder & Pipeline::Builder::addBindlessBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlagBits stage, u32 count) {
+	m_descriptorBindings.at(set).emplace_back(binding, type, count, stage);
+	m_descriptorBindingFlags.at(set).emplace_back(vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind);
 	return *this;
 }
 
@@ -94,6 +112,11 @@ Pipeline::Builder & Pipeline::Builder::setTopology(const vk::PrimitiveTopology t
 	return *this;
 }
 
+Pipeline::Builder & Pipeline::Builder::setCullMode(const vk::CullModeFlags cullMode) {
+	m_rasterizer.cullMode = cullMode;
+	return *this;
+}
+
 Pipeline::Builder & Pipeline::Builder::setDepthCompareOp(const vk::CompareOp compareOp) {
 	m_depthStencil.depthCompareOp = compareOp;
 	return *this;
@@ -105,6 +128,34 @@ Pipeline::Builder & Pipeline::Builder::disableDepthTest() {
 	return *this;
 }
 
+Pipeline::Builder & Pipeline::Builder::disableDepthWrite() {
+	m_depthStencil.depthWriteEnable = vk::False;
+	return *this;
+}
+
+Pipeline::Builder & Pipeline::Builder::disableDepthAttachment() {
+	disableDepthTest();
+	m_depthAttachment = false;
+	return *this;
+}
+
+Pipeline::Builder & Pipeline::Builder::setDepthBias(const float constantFactor, const float slopeFactor) {
+	m_rasterizer.depthBiasEnable = vk::True;
+	m_rasterizer.depthBiasConstantFactor = constantFactor;
+	m_rasterizer.depthBiasSlopeFactor = slopeFactor;
+	return *this;
+}
+
+Pipeline::Builder & Pipeline::Builder::addSpecialisationConstant(const u32 id, const u32 value) {
+	m_specialisationEntries.push_back({
+		.constantID = id,
+		.offset = static_cast<u32>(m_specialisationData.size() * sizeof(u32)),
+		.size = sizeof(u32)
+	});
+	m_specialisationData.push_back(value);
+	return *this;
+}
+
 Pipeline::Builder & Pipeline::Builder::setSamples(vk::SampleCountFlagBits samples) {
 	m_multisampling.rasterizationSamples = samples;
 	return *this;
@@ -132,6 +183,11 @@ Pipeline::Builder & Pipeline::Builder::enableAlphaBlending() {
 	return *this;
 }
 
+Pipeline::Builder & Pipeline::Builder::allowStateChanges() {
+	m_stateChanges = true;
+	return *this;
+}
+
 Pipeline::Builder & Pipeline::Builder::addAttachment(const vk::Format format) {
 	m_attachments.push_back({
 		.blendEnable = vk::False,
@@ -142,20 +198,44 @@ Pipeline::Builder & Pipeline::Builder::addAttachment(const vk::Format format) {
 }
 
 std::unique_ptr<Pipeline> Pipeline::Builder::create() {
-	assert(m_shaders.contains(vk::ShaderStageFlagBits::eVertex));
-	assert(m_shaders.contains(vk::ShaderStageFlagBits::eFragment));
-	assert(!m_attachments.empty());
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	PipelineCache* pipelineCache = VulkanEngine::getPipelineCache();
+	const auto countCreation = [&] {
+		pipelineCache->addPipelineCreation(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+	};
+
+	// a compute stage makes a compute pipeline, and the graphics state is ignored
+	const bool compute = m_shaders.contains(vk::ShaderStageFlagBits::eCompute);
+	assert(compute ? m_shaders.size() == 1 : m_shaders.contains(vk::ShaderStageFlagBits::eVertex) || hasMeshStage());
+	// pipelines without a fragment stage or colour attachments only write depth, and pipelines without vertex input
+	// generate their vertices from gl_VertexIndex
 	assert(m_attachments.size() == m_colourFormats.size());
-	assert(!m_attributes.empty());
 
 	std::vector<vk::raii::DescriptorSetLayout> descriptorLayouts;
 	std::vector<vk::DescriptorSetLayout> cLayouts;
-	for (const auto & bindings : m_descriptorBindings) {
-		vk::DescriptorSetLayoutCreateInfo createInfo = {
-			.bindingCount = static_cast<u32>(bindings.size()),
-			.pBindings = bindings.data()
+	for (u32 set = 0; set < m_descriptorBindings.size(); ++set) {
+		const auto& bindings = m_descriptorBindings.at(set);
+		const auto& bindingFlags = m_descriptorBindingFlags.at(set);
+
+		vk::DescriptorSetLayoutCreateFlags layoutFlags;
+		for (const auto flags : bindingFlags) {
+			if (flags & vk::DescriptorBindingFlagBits::eUpdateAfterBind) {
+				layoutFlags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+			}
+		}
+
+		const vk::StructureChain createInfo = {
+			vk::DescriptorSetLayoutCreateInfo {
+				.flags = layoutFlags,
+				.bindingCount = static_cast<u32>(bindings.size()),
+				.pBindings = bindings.data()
+			},
+			vk::DescriptorSetLayoutBindingFlagsCreateInfo {
+				.bindingCount = static_cast<u32>(bindingFlags.size()),
+				.pBindingFlags = bindingFlags.data()
+			}
 		};
-		descriptorLayouts.emplace_back(VulkanEngine::getDevice(), createInfo);
+		descriptorLayouts.emplace_back(VulkanEngine::getDevice(), createInfo.get<vk::DescriptorSetLayoutCreateInfo>());
 		cLayouts.push_back(*descriptorLayouts.back());
 	}
 
@@ -166,18 +246,117 @@ std::unique_ptr<Pipeline> Pipeline::Builder::create() {
 
 	vk::raii::PipelineLayout pipelineLayout(VulkanEngine::getDevice(), pipelineLayoutInfo);
 
+	auto result = std::make_unique<Pipeline>(nullptr, std::move(pipelineLayout), std::move(descriptorLayouts));
+	if (compute) {
+		result->m_pipeline = createComputePipeline(result->m_layout);
+		result->m_bindPoint = vk::PipelineBindPoint::eCompute;
+	}
+	// mesh shading pipelines have no vertex input part to link, so they are always built whole
+	else if (m_stateChanges && VulkanEngine::getPipelineStateSupport() == PipelineStateSupport::Library && !hasMeshStage()) {
+		for (const auto part : LIBRARY_PARTS) {
+			result->m_libraries.push_back(createGraphicsPipeline(result->m_layout, part));
+		}
+		result->m_pipeline = result->link(result->m_libraries);
+	}
+	else {
+		result->m_pipeline = createGraphicsPipeline(result->m_layout, {});
+	}
+	result->m_builder = std::make_unique<Builder>(*this);
+	countCreation();
+
+	if (ShaderReloader* shaderReloader = VulkanEngine::getShaderReloader()) {
+		shaderReloader->addPipeline(result.get());
+	}
+	return result;
+}
+
+bool Pipeline::Builder::usesShader(const std::string &path) const {
+	return std::ranges::any_of(m_shaderPaths, [&path](const auto& stagePath) { return stagePath.second == path; });
+}
+
+bool Pipeline::Builder::usesShaderModule(const vk::ShaderModule shaderModule) const {
+	return std::ranges::any_of(m_shaders, [shaderModule](const auto& stageModule) { return stageModule.second == shaderModule; });
+}
+
+void Pipeline::Builder::reloadShaders() {
+	for (const auto& [stage, path] : m_shaderPaths) {
+		m_shaders.at(stage) = VulkanEngine::getPipelineCache()->getShaderModule(path);
+	}
+}
+
+vk::raii::Pipeline Pipeline::Builder::createComputePipeline(const vk::raii::PipelineLayout &layout) const {
+	const vk::SpecializationInfo specialisationInfo = {
+		.mapEntryCount = static_cast<u32>(m_specialisationEntries.size()),
+		.pMapEntries = m_specialisationEntries.data(),
+		.dataSize = m_specialisationData.size() * sizeof(u32),
+		.pData = m_specialisationData.data()
+	};
+	const vk::ComputePipelineCreateInfo createInfo = {
+		.stage = {
+			.stage = vk::ShaderStageFlagBits::eCompute,
+			.module = m_shaders.at(vk::ShaderStageFlagBits::eCompute),
+			.pName = "main",
+			.pSpecializationInfo = m_specialisationEntries.empty() ? nullptr : &specialisationInfo
+		},
+		.layout = layout
+	};
+	return vk::raii::Pipeline(VulkanEngine::getDevice(), VulkanEngine::getPipelineCache()->getCache(), createInfo);
+}
+
+bool Pipeline::Builder::hasMeshStage() const {
+	return m_shaders.contains(vk::ShaderStageFlagBits::eMeshEXT);
+}
+
+std::vector<vk::DynamicState> Pipeline::Builder::getDynamicStates() const {
+	std::vector<vk::DynamicState> dynamicStates = m_dynamicStates;
+	if (m_stateChanges) {
+		dynamicStates.insert(dynamicStates.end(), {vk::DynamicState::eDepthTestEnable, vk::DynamicState::eDepthWriteEnable, vk::DynamicState::eDepthCompareOp});
+		if (VulkanEngine::getPipelineStateSupport() == PipelineStateSupport::Dynamic) {
+			dynamicStates.insert(dynamicStates.end(), {vk::DynamicState::eRasterizationSamplesEXT, vk::DynamicState::ePolygonModeEXT});
+		}
+	}
+	return dynamicStates;
+}
+
+vk::raii::Pipeline Pipeline::Builder::createGraphicsPipeline(const vk::raii::PipelineLayout& layout, const vk::GraphicsPipelineLibraryFlagsEXT parts) const {
+	const bool library = static_cast<bool>(parts);
+	const auto hasPart = [&](const vk::GraphicsPipelineLibraryFlagBitsEXT part) {
+		return !library || static_cast<bool>(parts & part);
+	};
+
+	const vk::SpecializationInfo specialisationInfo = {
+		.mapEntryCount = static_cast<u32>(m_specialisationEntries.size()),
+		.pMapEntries = m_specialisationEntries.data(),
+		.dataSize = m_specialisationData.size() * sizeof(u32),
+		.pData = m_specialisationData.data()
+	};
+
+	// the vertex stage belongs to the pre-rasterisation part and the fragment stage to the fragment shader part
 	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
 	for (const auto& [stage, shader] : m_shaders) {
+		const bool fragment = stage == vk::ShaderStageFlagBits::eFragment;
+		if (!hasPart(fragment ? vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader : vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders)) {
+			continue;
+		}
 		shaderStages.push_back(vk::PipelineShaderStageCreateInfo{
 			.stage = stage,
 			.module = shader,
 			.pName = "main",
+			.pSpecializationInfo = m_specialisationEntries.empty() ? nullptr : &specialisationInfo
 		});
 	}
 
+	const vk::PipelineVertexInputStateCreateInfo vertexInputInfo = {
+		.vertexBindingDescriptionCount = m_attributes.empty() ? 0u : 1u,
+		.pVertexBindingDescriptions = &m_bindings,
+		.vertexAttributeDescriptionCount = static_cast<u32>(m_attributes.size()),
+		.pVertexAttributeDescriptions = m_attributes.data()
+	};
+
+	const std::vector<vk::DynamicState> dynamicStates = getDynamicStates();
 	const vk::PipelineDynamicStateCreateInfo dynamicState = {
-		.dynamicStateCount = static_cast<u32>(m_dynamicStates.size()),
-		.pDynamicStates = m_dynamicStates.data()
+		.dynamicStateCount = static_cast<u32>(dynamicStates.size()),
+		.pDynamicStates = dynamicStates.data()
 	};
 
 	const vk::PipelineColorBlendStateCreateInfo colorBlending = {
@@ -186,33 +365,43 @@ std::unique_ptr<Pipeline> Pipeline::Builder::create() {
 		.pAttachments = m_attachments.data()
 	};
 
+	// mesh shaders read their own vertices
+	const bool vertexInput = hasPart(vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface) && !hasMeshStage();
+	const bool preRasterisation = hasPart(vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders);
+	const bool fragmentShader = hasPart(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader);
+	const bool fragmentOutput = hasPart(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface);
 	vk::StructureChain chain = {
 		vk::GraphicsPipelineCreateInfo {
+			.flags = library ? vk::PipelineCreateFlags(vk::PipelineCreateFlagBits::eLibraryKHR) : vk::PipelineCreateFlags(),
 			.stageCount = static_cast<u32>(shaderStages.size()),
 			.pStages = shaderStages.data(),
-			.pVertexInputState = &m_vertexInputInfo,
-			.pInputAssemblyState = &m_inputAssembly,
-			.pViewportState = &m_viewportState,
-			.pRasterizationState = &m_rasterizer,
-			.pMultisampleState = &m_multisampling,
-			.pDepthStencilState = &m_depthStencil,
-			.pColorBlendState = &colorBlending,
+			.pVertexInputState = vertexInput ? &vertexInputInfo : nullptr,
+			.pInputAssemblyState = vertexInput ? &m_inputAssembly : nullptr,
+			.pViewportState = preRasterisation ? &m_viewportState : nullptr,
+			.pRasterizationState = preRasterisation ? &m_rasterizer : nullptr,
+			// without sample shading the fragment shader part doesn't need the sample count, so changing it only
+			// relinks the fragment output part
+			.pMultisampleState = fragmentOutput ? &m_multisampling : nullptr,
+			.pDepthStencilState = fragmentShader ? &m_depthStencil : nullptr,
+			.pColorBlendState = fragmentOutput ? &colorBlending : nullptr,
 			.pDynamicState = &dynamicState,
-			.layout = pipelineLayout,
+			.layout = layout,
 			.subpass = 0
 		},
+		vk::GraphicsPipelineLibraryCreateInfoEXT {
+			.flags = parts
+		},
 		vk::PipelineRenderingCreateInfo {
 			.colorAttachmentCount = static_cast<u32>(m_colourFormats.size()),
 			.pColorAttachmentFormats = m_colourFormats.data(),
-			.depthAttachmentFormat = VulkanEngine::getDepthFormat()
+			.depthAttachmentFormat = m_depthAttachment ? VulkanEngine::getDepthFormat() : vk::Format::eUndefined
 		}
 	};
+	if (!library) {
+		chain.unlink<vk::GraphicsPipelineLibraryCreateInfoEXT>();
+	}
 
-	return std::make_unique<Pipeline>(
-		vk::raii::Pipeline(VulkanEngine::getDevice(), nullptr, chain.get<vk::GraphicsPipelineCreateInfo>()),
-		std::move(pipelineLayout),
-		std::move(descriptorLayouts)
-	);
+	return vk::raii::Pipeline(VulkanEngine::getDevice(), VulkanEngine::getPipelineCache()->getCache(), chain.get<vk::GraphicsPipelineCreateInfo>());
 }
 
 Pipeline::Pipeline(vk::raii::Pipeline pipeline, vk::raii::PipelineLayout layout, std::vector<vk::raii::DescriptorSetLayout> descriptorSetLayouts)
@@ -221,6 +410,12 @@ Pipeline::Pipeline(vk::raii::Pipeline pipeline, vk::raii::PipelineLayout layout,
 	, m_descriptorLayouts(std::move(descriptorSetLayouts))
 {}
 
+Pipeline::~Pipeline() {
+	if (ShaderReloader* shaderReloader = VulkanEngine::getShaderReloader()) {
+		shaderReloader->removePipeline(this);
+	}
+}
+
 vk::raii::DescriptorSet Pipeline::createDescriptorSet(const u32 set) const {
 	 vk::DescriptorSetAllocateInfo allocInfo = {
 		.descriptorPool = VulkanEngine::getDescriptorPool(),
@@ -241,3 +436,113 @@ const vk::raii::PipelineLayout& Pipeline::getLayout() const {
 const vk::raii::DescriptorSetLayout & Pipeline::getDescriptorLayout(u32 set) const {
 	return m_descriptorLayouts.at(set);
 }
+
+void Pipeline::bind(const vk::raii::CommandBuffer &commandBuffer) const {
+	commandBuffer.bindPipeline(m_bindPoint, m_pipeline);
+	if (!m_builder->m_stateChanges) return;
+
+	commandBuffer.setDepthTestEnable(m_builder->m_depthStencil.depthTestEnable);
+	commandBuffer.setDepthWriteEnable(m_builder->m_depthStencil.depthWriteEnable);
+	commandBuffer.setDepthCompareOp(m_builder->m_depthStencil.depthCompareOp);
+	if (VulkanEngine::getPipelineStateSupport() == PipelineStateSupport::Dynamic) {
+		commandBuffer.setRasterizationSamplesEXT(m_builder->m_multisampling.rasterizationSamples);
+		commandBuffer.setPolygonModeEXT(m_builder->m_rasterizer.polygonMode);
+	}
+}
+
+void Pipeline::setSamples(const vk::SampleCountFlagBits samples) {
+	assert(m_builder->m_stateChanges);
+	if (m_builder->m_multisampling.rasterizationSamples == samples) return;
+	m_builder->m_multisampling.rasterizationSamples = samples;
+	rebuild(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface);
+}
+
+void Pipeline::setPolygonMode(const vk::PolygonMode polygonMode) {
+	assert(m_builder->m_stateChanges);
+	if (m_builder->m_rasterizer.polygonMode == polygonMode) return;
+	m_builder->m_rasterizer.polygonMode = polygonMode;
+	rebuild(vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders);
+}
+
+void Pipeline::setDepthState(const bool depthWrite, const vk::CompareOp compareOp) {
+	assert(m_builder->m_stateChanges);
+	m_builder->m_depthStencil.depthWriteEnable = depthWrite;
+	m_builder->m_depthStencil.depthCompareOp = compareOp;
+}
+
+void Pipeline::rebuild(const vk::GraphicsPipelineLibraryFlagBitsEXT part) {
+	switch (VulkanEngine::getPipelineStateSupport()) {
+		case PipelineStateSupport::Dynamic:
+			break;
+		case PipelineStateSupport::Library:
+			// mesh shading pipelines are built without libraries
+			if (hasLibraries()) {
+				const auto index = std::ranges::find(LIBRARY_PARTS, part) - LIBRARY_PARTS.begin();
+				m_libraries.at(index) = m_builder->createGraphicsPipeline(m_layout, part);
+				m_pipeline = link(m_libraries);
+				break;
+			}
+			[[fallthrough]];
+		case PipelineStateSupport::Rebuild:
+			m_pipeline = m_builder->createGraphicsPipeline(m_layout, {});
+			break;
+	}
+	++m_version;
+}
+
+vk::raii::Pipeline Pipeline::link(const std::vector<vk::raii::Pipeline>& libraries) const {
+	std::vector<vk::Pipeline> libraryHandles;
+	for (const auto& library : libraries) {
+		libraryHandles.push_back(*library);
+	}
+	// linked without link time optimisation, which is what keeps relinking cheap enough to do between frames
+	const vk::StructureChain chain = {
+		vk::GraphicsPipelineCreateInfo {
+			.layout = m_layout
+		},
+		vk::PipelineLibraryCreateInfoKHR {
+			.libraryCount = static_cast<u32>(libraryHandles.size()),
+			.pLibraries = libraryHandles.data()
+		}
+	};
+	return vk::raii::Pipeline(VulkanEngine::getDevice(), VulkanEngine::getPipelineCache()->getCache(), chain.get<vk::GraphicsPipelineCreateInfo>());
+}
+
+const Pipeline::Builder & Pipeline::getBuilder() const {
+	return *m_builder;
+}
+
+u32 Pipeline::getVersion() const {
+	return m_version;
+}
+
+bool Pipeline::hasLibraries() const {
+	return !m_libraries.empty();
+}
+
+Pipeline::Replacement Pipeline::buildReplacement(const Builder &builder, const bool libraries) const {
+	Replacement replacement;
+	replacement.shaders = builder.m_shaders;
+	if (m_bindPoint == vk::PipelineBindPoint::eCompute) {
+		replacement.pipeline = builder.createComputePipeline(m_layout);
+	}
+	else if (libraries) {
+		for (const auto part : LIBRARY_PARTS) {
+			replacement.libraries.push_back(builder.createGraphicsPipeline(m_layout, part));
+		}
+		replacement.pipeline = link(replacement.libraries);
+	}
+	else {
+		replacement.pipeline = builder.createGraphicsPipeline(m_layout, {});
+	}
+	return replacement;
+}
+
+Pipeline::Replacement Pipeline::replace(Replacement replacement) {
+	// only the modules are taken from the replacement's builder, as the state may have changed since it was copied
+	m_builder->m_shaders = std::move(replacement.shaders);
+	std::swap(m_pipeline, replacement.pipeline);
+	std::swap(m_libraries, replacement.libraries);
+	++m_version;
+	return replacement;
+}
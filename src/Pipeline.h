@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <unordered_map>
 #include <vulkan/vulkan_raii.hpp>
 #include "Common.h"
@@ -10,22 +11,54 @@ public:
     public:
         Builder();
         Builder& setVertexInfo(const vk::VertexInputBindingDescription& bindings, const std::vector<vk::VertexInputAttributeDescription>& attributes);
+        // the stage comes from the extension - a .comp.spv stage makes a compute pipeline, and .task.spv and .mesh.spv
+        // stages take the place of the vertex stage and vertex input
+        // modules are shared through the engine's PipelineCache, which has the SPIR-V embedded in the executable
         Builder& addShaderStage(std::string path);
-        Builder& addBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlagBits stage);
+        Builder& addBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlags stages);
+        // partially bound array of descriptors that can be updated after being bound
+        Builder& addBindlessBinding(u32 set, u32 binding, vk::DescriptorType type, vk::ShaderStageFlagBits stage, u32 count);
         Builder& addDynamicState(vk::DynamicState state);
         Builder& setPolygonMode(vk::PolygonMode polygonMode);
         Builder& setTopology(vk::PrimitiveTopology topology);
+        Builder& setCullMode(vk::CullModeFlags cullMode);
         Builder& setDepthCompareOp(vk::CompareOp compareOp);
         Builder& disableDepthTest();
+        Builder& disableDepthWrite();
+        // for passes rendering without a depth attachment
+        Builder& disableDepthAttachment();
+        // offset depth by a constant and the polygon's slope, to keep surfaces from shadowing themselves
+        Builder& setDepthBias(float constantFactor, float slopeFactor);
+        // constant_id values, shared by every shader stage
+        Builder& addSpecialisationConstant(u32 id, u32 value);
         Builder& setSamples(vk::SampleCountFlagBits samples);
         Builder& addAttachment(vk::Format format);
         Builder& addAttachment(vk::Format format, const vk::PipelineColorBlendAttachmentState& attachment);
         Builder& enableAlphaBlending(); // make sure to call this after addAttachment
+        // the sample count, polygon mode and depth state can be changed with Pipeline's setters after creation, which
+        // must be bound with Pipeline::bind - see PipelineStateSupport for how
+        Builder& allowStateChanges();
         std::unique_ptr<Pipeline> create();
 
+        // whether a stage was added from path, given as "shaders/<name>.spv"
+        bool usesShader(const std::string& path) const;
+        // whether any stage is currently built from shaderModule
+        bool usesShaderModule(vk::ShaderModule shaderModule) const;
+        // fetch every stage's module from the PipelineCache again, after one has been reloaded
+        void reloadShaders();
+
     private:
-        std::unordered_map<vk::ShaderStageFlagBits, vk::raii::ShaderModule> m_shaders;
-        vk::PipelineVertexInputStateCreateInfo m_vertexInputInfo;
+        friend class Pipeline;
+
+        std::vector<vk::DynamicState> getDynamicStates() const;
+        bool hasMeshStage() const;
+        vk::raii::Pipeline createComputePipeline(const vk::raii::PipelineLayout& layout) const;
+        // the whole pipeline when parts is empty, or a library of only those parts
+        vk::raii::Pipeline createGraphicsPipeline(const vk::raii::PipelineLayout& layout, vk::GraphicsPipelineLibraryFlagsEXT parts) const;
+
+        // owned by the PipelineCache
+        std::unordered_map<vk::ShaderStageFlagBits, vk::ShaderModule> m_shaders;
+        std::unordered_map<vk::ShaderStageFlagBits, std::string> m_shaderPaths;
         vk::VertexInputBindingDescription m_bindings;
         std::vector<vk::VertexInputAttributeDescription> m_attributes;
 
@@ -35,20 +68,68 @@ public:
         vk::PipelineRasterizationStateCreateInfo m_rasterizer;
         vk::PipelineMultisampleStateCreateInfo m_multisampling;
         vk::PipelineDepthStencilStateCreateInfo m_depthStencil;
+        bool m_depthAttachment = true;
 
         std::array<std::vector<vk::DescriptorSetLayoutBinding>, 4> m_descriptorBindings;
+        std::array<std::vector<vk::DescriptorBindingFlags>, 4> m_descriptorBindingFlags;
         std::vector<vk::PipelineColorBlendAttachmentState> m_attachments;
         std::vector<vk::Format> m_colourFormats;
+
+        std::vector<vk::SpecializationMapEntry> m_specialisationEntries;
+        std::vector<u32> m_specialisationData;
+        bool m_stateChanges = false;
+    };
+
+    // the pipeline objects built from a copy of the builder with new shader modules, to be swapped in by replace
+    struct Replacement {
+        vk::raii::Pipeline pipeline = nullptr;
+        std::vector<vk::raii::Pipeline> libraries;
+        std::unordered_map<vk::ShaderStageFlagBits, vk::ShaderModule> shaders;
     };
 
     Pipeline(vk::raii::Pipeline pipeline, vk::raii::PipelineLayout layout, std::vector<vk::raii::DescriptorSetLayout> descriptorSetLayouts);
+    ~Pipeline();
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
     vk::raii::DescriptorSet createDescriptorSet(u32 set) const;
     const vk::raii::Pipeline& getPipeline() const;
     const vk::raii::PipelineLayout& getLayout() const;
     const vk::raii::DescriptorSetLayout& getDescriptorLayout(u32 set) const;
 
+    // bind the pipeline, along with the state it sets while recording
+    void bind(const vk::raii::CommandBuffer& commandBuffer) const;
+
+    // only for pipelines built with Builder::allowStateChanges - unless the state is dynamic the pipeline is replaced,
+    // so it mustn't be in use by the device
+    void setSamples(vk::SampleCountFlagBits samples);
+    void setPolygonMode(vk::PolygonMode polygonMode);
+    // always dynamic, as depth state is core since Vulkan 1.3
+    void setDepthState(bool depthWrite, vk::CompareOp compareOp);
+
+    // for ShaderReloader - the builder holds the pipeline's current state, and the version changes whenever the
+    // pipeline object does, so a replacement started from an older one can be told apart
+    const Builder& getBuilder() const;
+    u32 getVersion() const;
+    bool hasLibraries() const;
+    // safe to call from another thread, as it only reads the layout, which never changes
+    Replacement buildReplacement(const Builder& builder, bool libraries) const;
+    // swap in a replacement, returning the objects it replaced - they must be kept until no frame in flight uses them
+    Replacement replace(Replacement replacement);
+
 private:
+    // relink the library part holding the changed state, or build the pipeline again without libraries
+    void rebuild(vk::GraphicsPipelineLibraryFlagBitsEXT part);
+    vk::raii::Pipeline link(const std::vector<vk::raii::Pipeline>& libraries) const;
+
     vk::raii::Pipeline m_pipeline = nullptr;
     vk::raii::PipelineLayout m_layout = nullptr;
     std::vector<vk::raii::DescriptorSetLayout> m_descriptorLayouts;
+    vk::PipelineBindPoint m_bindPoint = vk::PipelineBindPoint::eGraphics;
+
+    // kept to rebuild from, holding the current state
+    std::unique_ptr<Builder> m_builder;
+    // one per part in LIBRARY_PARTS, when pipelines are linked from libraries
+    std::vector<vk::raii::Pipeline> m_libraries;
+    u32 m_version = 0;
 };
@@ -0,0 +1,124 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "EmbeddedShaders.h"
+#include "VulkanEngine.h"
+
+namespace {
+    // the driver is allowed to reject data from another device or driver version anyway, but not all of them check
+    // as carefully, so the header is validated against the device first
+    bool isCompatible(const std::vector<char>& data) {
+        vk::PipelineCacheHeaderVersionOne header;
+        if (data.size() < sizeof(header)) return false;
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        const vk::PhysicalDeviceProperties properties = VulkanEngine::getPhysicalDevice().getProperties();
+        return header.headerSize >= sizeof(header)
+            && header.headerVersion == vk::PipelineCacheHeaderVersion::eOne
+            && header.vendorID == properties.vendorID
+            && header.deviceID == properties.deviceID
+            && std::memcmp(header.pipelineCacheUUID.data(), properties.pipelineCacheUUID.data(), vk::UuidSize) == 0;
+    }
+}
+
+PipelineCache::PipelineCache(std::string path) : m_path(std::move(path)) {
+    std::vector<char> data;
+    if (std::filesystem::exists(m_path)) {
+        data = readFile(m_path);
+        if (isCompatible(data)) {
+            m_warm = true;
+            Logger::info("Loaded pipeline cache '{}' ({} KB)", m_path, data.size() / 1024);
+        }
+        else {
+            Logger::info("Pipeline cache '{}' was saved by a different device or driver, starting empty", m_path);
+            data.clear();
+        }
+    }
+
+    const vk::PipelineCacheCreateInfo createInfo = {
+        .initialDataSize = data.size(),
+        .pInitialData = data.data()
+    };
+    m_cache = vk::raii::PipelineCache(VulkanEngine::getDevice(), createInfo);
+}
+
+void PipelineCache::save() const {
+    const std::vector<u8> data = m_cache.getData();
+
+    // written alongside and moved over the old cache, so a run stopped part way through can't leave half of one
+    const std::string tempPath = m_path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            Logger::warn("Failed to write pipeline cache '{}'", tempPath);
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, m_path, error);
+    if (error) {
+        Logger::warn("Failed to replace pipeline cache '{}': {}", m_path, error.message());
+        return;
+    }
+    Logger::info("Saved pipeline cache '{}' ({} KB)", m_path, data.size() / 1024);
+}
+
+const vk::raii::PipelineCache& PipelineCache::getCache() const {
+    return m_cache;
+}
+
+vk::ShaderModule PipelineCache::getShaderModule(const std::string& path) {
+    if (const auto it = m_shaderModules.find(path); it != m_shaderModules.end()) {
+        return *it->second;
+    }
+
+    // embedded shaders are looked up by name, without the directory or .spv
+    const std::span<const u32> embedded = getEmbeddedShader(std::filesystem::path(path).stem().string());
+    std::vector<char> file;
+    vk::ShaderModuleCreateInfo createInfo;
+    if (!embedded.empty()) {
+        createInfo.codeSize = embedded.size_bytes();
+        createInfo.pCode = embedded.data();
+    }
+    else {
+        file = readFile(path);
+        createInfo.codeSize = file.size();
+        createInfo.pCode = reinterpret_cast<const u32*>(file.data());
+    }
+
+    return *m_shaderModules.emplace(path, vk::raii::ShaderModule(VulkanEngine::getDevice(), createInfo)).first->second;
+}
+
+vk::raii::ShaderModule PipelineCache::replaceShaderModule(const std::string& path, const std::span<const u32> code) {
+    const vk::ShaderModuleCreateInfo createInfo = {
+        .codeSize = code.size_bytes(),
+        .pCode = code.data()
+    };
+    vk::raii::ShaderModule shaderModule(VulkanEngine::getDevice(), createInfo);
+    if (const auto it = m_shaderModules.find(path); it != m_shaderModules.end()) {
+        std::swap(it->second, shaderModule);
+        return shaderModule;
+    }
+    m_shaderModules.emplace(path, std::move(shaderModule));
+    return nullptr;
+}
+
+void PipelineCache::addPipelineCreation(const double milliseconds) {
+    ++m_pipelineCount;
+    m_creationTime += milliseconds;
+}
+
+u32 PipelineCache::getPipelineCount() const {
+    return m_pipelineCount;
+}
+
+double PipelineCache::getCreationTime() const {
+    return m_creationTime;
+}
+
+bool PipelineCache::isWarm() const {
+    return m_warm;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <unordered_map>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+
+// the pipeline cache every pipeline is created through, kept on disk between runs, along with the shader modules
+// pipelines are built from - rebuilding pipelines, e.g. for a new sample count without dynamic state, reuses both
+class PipelineCache {
+public:
+    // loads the cache an earlier run saved to path, unless it came from a different device or driver
+    explicit PipelineCache(std::string path);
+    // write the cache back to disk, once no more pipelines are being created
+    void save() const;
+
+    const vk::raii::PipelineCache& getCache() const;
+    // module for a shader given as "shaders/<name>.spv", created the first time it's asked for - the SPIR-V embedded
+    // in the executable is used if there is any, and the file otherwise
+    vk::ShaderModule getShaderModule(const std::string& path);
+    // swap in a module for a reloaded shader, which getShaderModule returns from then on - the module it replaces is
+    // returned, as builders holding it may still build pipelines from it
+    vk::raii::ShaderModule replaceShaderModule(const std::string& path, std::span<const u32> code);
+
+    // counted by Pipeline::Builder, to compare starting with and without a saved cache
+    void addPipelineCreation(double milliseconds);
+    u32 getPipelineCount() const;
+    double getCreationTime() const;
+    // whether the cache was loaded from disk, so pipelines could come from it
+    bool isWarm() const;
+
+private:
+    std::string m_path;
+    vk::raii::PipelineCache m_cache = nullptr;
+    std::unordered_map<std::string, vk::raii::ShaderModule> m_shaderModules;
+    bool m_warm = false;
+
+    u32 m_pipelineCount = 0;
+    double m_creationTime = 0.0;
+};
@@ -0,0 +1,494 @@
+#include "RenderGraph.h"
+
+#include <ranges>
+
+#include "VulkanEngine.h"
+
+namespace {
+    struct UsageInfo {
+        vk::PipelineStageFlags2 stages;
+        vk::AccessFlags2 access;
+        // layout images are transitioned to, unused for buffers
+        vk::ImageLayout layout;
+        vk::ImageUsageFlags imageUsage;
+        bool write;
+    };
+
+    UsageInfo getUsageInfo(const ResourceUsage usage) {
+        using Stage = vk::PipelineStageFlagBits2;
+        using Access = vk::AccessFlagBits2;
+        vk::PipelineStageFlags2 shaderStages = Stage::eVertexShader | Stage::eFragmentShader | Stage::eComputeShader;
+        vk::PipelineStageFlags2 sampledStages = Stage::eFragmentShader | Stage::eComputeShader;
+        // meshlets are culled in task shaders, testing the depth pyramid - but the stages can only be named when the
+        // device has them
+        if (VulkanEngine::getMeshShaderSupport()) {
+            shaderStages |= Stage::eTaskShaderEXT | Stage::eMeshShaderEXT;
+            sampledStages |= Stage::eTaskShaderEXT;
+        }
+
+        switch (usage) {
+            case ResourceUsage::ColourAttachment:
+                return {Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageUsageFlagBits::eColorAttachment, true};
+            case ResourceUsage::DepthAttachment:
+                return {Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite, vk::ImageLayout::eDepthAttachmentOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, true};
+            case ResourceUsage::Sampled:
+                return {sampledStages, Access::eShaderSampledRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled, false};
+            case ResourceUsage::StorageRead:
+                return {shaderStages, Access::eShaderStorageRead, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, false};
+            case ResourceUsage::StorageWrite:
+                return {shaderStages, Access::eShaderStorageRead | Access::eShaderStorageWrite, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, true};
+            case ResourceUsage::UniformRead:
+                return {shaderStages, Access::eUniformRead, vk::ImageLayout::eUndefined, {}, false};
+            case ResourceUsage::IndirectRead:
+                return {Stage::eDrawIndirect, Access::eIndirectCommandRead, vk::ImageLayout::eUndefined, {}, false};
+            case ResourceUsage::IndexRead:
+                return {Stage::eIndexInput, Access::eIndexRead, vk::ImageLayout::eUndefined, {}, false};
+            case ResourceUsage::TransferSrc:
+                return {Stage::eTransfer, Access::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageUsageFlagBits::eTransferSrc, false};
+            case ResourceUsage::TransferDst:
+                return {Stage::eTransfer, Access::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageUsageFlagBits::eTransferDst, true};
+        }
+        throw std::invalid_argument("Unknown resource usage");
+    }
+
+    vk::ImageAspectFlags getAspect(const vk::Format format) {
+        switch (format) {
+            case vk::Format::eD16Unorm:
+            case vk::Format::eX8D24UnormPack32:
+            case vk::Format::eD32Sfloat:
+                return vk::ImageAspectFlagBits::eDepth;
+            case vk::Format::eD16UnormS8Uint:
+            case vk::Format::eD24UnormS8Uint:
+            case vk::Format::eD32SfloatS8Uint:
+                return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+            default:
+                return vk::ImageAspectFlagBits::eColor;
+        }
+    }
+
+    vk::DeviceSize alignUp(const vk::DeviceSize value, const vk::DeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+RenderGraph::RenderGraph(const bool timed) : m_timed(timed) {}
+
+RenderGraph::Handle RenderGraph::createImage(const std::string &name, const ImageDesc &desc) {
+    assert(!m_compiled);
+    m_resources.push_back({
+        .name = name,
+        .isImage = true,
+        .imported = false,
+        .desc = desc,
+    });
+    return static_cast<Handle>(m_resources.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::importImage(const std::string &name, const vk::Format format, const vk::ImageLayout initialLayout, const vk::ImageLayout finalLayout, const vk::PipelineStageFlags2 waitStages) {
+    assert(!m_compiled);
+    m_resources.push_back({
+        .name = name,
+        .isImage = true,
+        .imported = true,
+        .desc = {.width = 0, .height = 0, .format = format},
+        .initialLayout = initialLayout,
+        .finalLayout = finalLayout,
+        .waitStages = waitStages,
+    });
+    return static_cast<Handle>(m_resources.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::importBuffer(const std::string &name) {
+    assert(!m_compiled);
+    m_resources.push_back({
+        .name = name,
+        .isImage = false,
+        .imported = true,
+    });
+    return static_cast<Handle>(m_resources.size() - 1);
+}
+
+void RenderGraph::addPass(const std::string &name, const std::vector<Access> &accesses, ExecuteFunction execute) {
+    assert(!m_compiled);
+    for (const auto& [resource, usage] : accesses) {
+        m_resources.at(resource).usage |= getUsageInfo(usage).imageUsage;
+    }
+    m_passes.push_back({
+        .name = name,
+        .accesses = accesses,
+        .execute = std::move(execute),
+    });
+}
+
+void RenderGraph::compile() {
+    assert(!m_compiled);
+    cullPasses();
+    allocateTransients();
+
+    for (auto& pass : m_passes) {
+        if (pass.culled) continue;
+        pass.timestampIndex = m_timedPassCount++;
+    }
+    m_passTimes.assign(m_passes.size(), 0.0);
+    if (m_timed && m_timedPassCount > 0) {
+        const vk::QueryPoolCreateInfo createInfo = {
+            .queryType = vk::QueryType::eTimestamp,
+            .queryCount = 2 * m_timedPassCount * FRAMES_IN_FLIGHT,
+        };
+        m_queryPool = vk::raii::QueryPool(VulkanEngine::getDevice(), createInfo);
+    }
+
+    m_compiled = true;
+}
+
+void RenderGraph::setImage(const Handle resource, const vk::Image image, const vk::ImageView view) {
+    Resource& r = m_resources.at(resource);
+    assert(r.isImage && r.imported);
+    r.image = image;
+    r.view = view;
+}
+
+void RenderGraph::setBuffer(const Handle resource, const vk::Buffer buffer) {
+    Resource& r = m_resources.at(resource);
+    assert(!r.isImage && r.imported);
+    r.buffer = buffer;
+}
+
+void RenderGraph::execute(const vk::raii::CommandBuffer &commandBuffer) {
+    assert(m_compiled);
+
+    const u32 firstQuery = VulkanEngine::getFrameIndex() * m_timedPassCount * 2;
+    if (*m_queryPool) {
+        readTimestamps();
+        commandBuffer.resetQueryPool(m_queryPool, firstQuery, m_timedPassCount * 2);
+    }
+
+    for (auto& resource : m_resources) {
+        if (resource.imported) {
+            // imported buffers persist between frames, so the previous execute's uses are kept for the first barrier
+            // to wait on
+            if (!resource.isImage) continue;
+            // uses outside the graph are synchronised by whoever imports it, apart from the semaphore wait
+            resource.state = {
+                .layout = resource.initialLayout,
+                .writeStages = resource.waitStages,
+            };
+        }
+        else {
+            // transient contents are discarded, but the previous frame's stages are kept so its uses finish first
+            resource.state.layout = vk::ImageLayout::eUndefined;
+        }
+    }
+
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+    const auto flushBarriers = [&] {
+        if (imageBarriers.empty() && bufferBarriers.empty()) return;
+        const vk::DependencyInfo dependencyInfo = {
+            .bufferMemoryBarrierCount = static_cast<u32>(bufferBarriers.size()),
+            .pBufferMemoryBarriers = bufferBarriers.data(),
+            .imageMemoryBarrierCount = static_cast<u32>(imageBarriers.size()),
+            .pImageMemoryBarriers = imageBarriers.data(),
+        };
+        commandBuffer.pipelineBarrier2(dependencyInfo);
+        imageBarriers.clear();
+        bufferBarriers.clear();
+    };
+
+    for (const auto& pass : m_passes) {
+        if (pass.culled) continue;
+
+        for (const auto& [resource, usage] : pass.accesses) {
+            addBarrier(m_resources.at(resource), usage, imageBarriers, bufferBarriers);
+        }
+        flushBarriers();
+
+        if (*m_queryPool) commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool, firstQuery + pass.timestampIndex * 2);
+        pass.execute(commandBuffer);
+        if (*m_queryPool) commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPool, firstQuery + pass.timestampIndex * 2 + 1);
+    }
+
+    // hand imported images back in the layout their owner expects
+    for (auto& resource : m_resources) {
+        if (!resource.isImage || !resource.imported) continue;
+        if (resource.finalLayout == vk::ImageLayout::eUndefined || resource.finalLayout == resource.state.layout) continue;
+
+        imageBarriers.push_back({
+            .srcStageMask = resource.state.writeStages | resource.state.readStages,
+            .srcAccessMask = resource.state.writeAccess,
+            .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+            .dstAccessMask = vk::AccessFlagBits2::eNone,
+            .oldLayout = resource.state.layout,
+            .newLayout = resource.finalLayout,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = resource.image,
+            .subresourceRange = {
+                .aspectMask = getAspect(resource.desc.format),
+                .baseMipLevel = 0,
+                .levelCount = vk::RemainingMipLevels,
+                .baseArrayLayer = 0,
+                .layerCount = vk::RemainingArrayLayers
+            }
+        });
+        resource.state.layout = resource.finalLayout;
+    }
+    flushBarriers();
+
+    if (*m_queryPool) m_timestampsWritten.at(VulkanEngine::getFrameIndex()) = true;
+}
+
+vk::Image RenderGraph::getImage(const Handle resource) const {
+    return m_resources.at(resource).image;
+}
+
+vk::ImageView RenderGraph::getImageView(const Handle resource) const {
+    return m_resources.at(resource).view;
+}
+
+std::vector<RenderGraph::PassInfo> RenderGraph::getPassInfo() const {
+    std::vector<PassInfo> info;
+    info.reserve(m_passes.size());
+    for (u32 i = 0; i < m_passes.size(); ++i) {
+        info.push_back({m_passes[i].name, m_passes[i].culled, m_passTimes.empty() ? 0.0 : m_passTimes[i]});
+    }
+    return info;
+}
+
+vk::DeviceSize RenderGraph::getTransientMemorySize() const {
+    return m_transientMemorySize;
+}
+
+vk::DeviceSize RenderGraph::getUnaliasedMemorySize() const {
+    return m_unaliasedMemorySize;
+}
+
+void RenderGraph::cullPasses() {
+    // walk backwards from the imported resources, keeping only passes that write something that is used later
+    std::vector<bool> needed(m_resources.size());
+    for (u32 i = 0; i < m_resources.size(); ++i) {
+        needed[i] = m_resources[i].imported;
+    }
+
+    for (auto& pass : std::ranges::reverse_view(m_passes)) {
+        pass.culled = std::ranges::none_of(pass.accesses, [&](const Access& access) {
+            return getUsageInfo(access.usage).write && needed[access.resource];
+        });
+        if (pass.culled) {
+            Logger::info("Culled render pass {}", pass.name);
+            continue;
+        }
+        for (const auto& access : pass.accesses) {
+            needed[access.resource] = true;
+        }
+    }
+}
+
+void RenderGraph::allocateTransients() {
+    // lifetimes of the transients, in terms of the passes that are left
+    std::vector<Handle> transients;
+    for (u32 passIndex = 0; passIndex < m_passes.size(); ++passIndex) {
+        if (m_passes[passIndex].culled) continue;
+        for (const auto& access : m_passes[passIndex].accesses) {
+            Resource& resource = m_resources.at(access.resource);
+            if (resource.imported) continue;
+            if (std::ranges::find(transients, access.resource) == transients.end()) {
+                transients.push_back(access.resource);
+                resource.firstPass = passIndex;
+            }
+            resource.lastPass = passIndex;
+        }
+    }
+    if (transients.empty()) return;
+
+    // a slot is a range of memory shared by transients that are never alive at the same time
+    struct Slot {
+        u32 endPass;
+        vk::DeviceSize size;
+        vk::DeviceSize alignment;
+        u32 memoryTypeBits;
+        Handle first;
+        Handle last;
+        vk::DeviceSize offset = 0;
+    };
+    std::vector<Slot> slots;
+    std::vector<u32> slotIndices;
+
+    // transients were found in order of first use, so each slot's occupants end up in order too
+    for (const Handle handle : transients) {
+        Resource& resource = m_resources.at(handle);
+        const vk::ImageCreateInfo imageInfo = {
+            .imageType = vk::ImageType::e2D,
+            .format = resource.desc.format,
+            .extent = {
+                .width = resource.desc.width,
+                .height = resource.desc.height,
+                .depth = 1
+            },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = resource.desc.samples,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = resource.usage,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        };
+        resource.ownedImage = vk::raii::Image(VulkanEngine::getDevice(), imageInfo);
+        const vk::MemoryRequirements requirements = resource.ownedImage.getMemoryRequirements();
+        m_unaliasedMemorySize += requirements.size;
+
+        const auto slot = std::ranges::find_if(slots, [&](const Slot& s) {
+            return s.endPass < resource.firstPass && (s.memoryTypeBits & requirements.memoryTypeBits) != 0;
+        });
+        if (slot == slots.end()) {
+            slotIndices.push_back(static_cast<u32>(slots.size()));
+            slots.push_back({resource.lastPass, requirements.size, requirements.alignment, requirements.memoryTypeBits, handle, handle});
+            continue;
+        }
+        resource.aliasedFrom = slot->last;
+        slot->endPass = resource.lastPass;
+        slot->size = std::max(slot->size, requirements.size);
+        slot->alignment = std::max(slot->alignment, requirements.alignment);
+        slot->memoryTypeBits &= requirements.memoryTypeBits;
+        slot->last = handle;
+        slotIndices.push_back(static_cast<u32>(slot - slots.begin()));
+    }
+
+    vk::DeviceSize size = 0;
+    vk::DeviceSize alignment = 1;
+    u32 memoryTypeBits = ~0u;
+    for (auto& slot : slots) {
+        slot.offset = alignUp(size, slot.alignment);
+        size = slot.offset + slot.size;
+        alignment = std::max(alignment, slot.alignment);
+        memoryTypeBits &= slot.memoryTypeBits;
+
+        // the first occupant follows the last one from the previous frame
+        if (slot.first != slot.last) {
+            m_resources.at(slot.first).aliasedFrom = slot.last;
+        }
+    }
+    if (memoryTypeBits == 0) {
+        throw std::runtime_error("Render graph transients have no memory type in common");
+    }
+
+    m_transientMemorySize = size;
+    m_transientMemory = VulkanEngine::allocateMemory({size, alignment, memoryTypeBits}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    for (u32 i = 0; i < transients.size(); ++i) {
+        Resource& resource = m_resources.at(transients[i]);
+        resource.ownedImage.bindMemory(m_transientMemory, slots.at(slotIndices[i]).offset);
+
+        const vk::ImageViewCreateInfo viewInfo = {
+            .image = resource.ownedImage,
+            .viewType = vk::ImageViewType::e2D,
+            .format = resource.desc.format,
+            .subresourceRange = {
+                // views of depth / stencil images only see depth
+                .aspectMask = getAspect(resource.desc.format) & ~vk::ImageAspectFlagBits::eStencil,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+        resource.ownedView = vk::raii::ImageView(VulkanEngine::getDevice(), viewInfo);
+        resource.image = *resource.ownedImage;
+        resource.view = *resource.ownedView;
+    }
+
+    Logger::info("Render graph transients use {} ({} without aliasing)", storageSizeToString(m_transientMemorySize), storageSizeToString(m_unaliasedMemorySize));
+}
+
+void RenderGraph::readTimestamps() {
+    // the last frame to use this frame's queries has passed its fence, so they don't need waiting on
+    const u32 frameIndex = VulkanEngine::getFrameIndex();
+    if (!m_timestampsWritten.at(frameIndex)) return;
+
+    const u32 queryCount = m_timedPassCount * 2;
+    auto [result, data] = m_queryPool.getResults<u64>(frameIndex * queryCount, queryCount, queryCount * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess) return;
+
+    const float nsPerTick = VulkanEngine::getPhysicalDevice().getProperties().limits.timestampPeriod;
+    for (u32 i = 0; i < m_passes.size(); ++i) {
+        const Pass& pass = m_passes[i];
+        if (pass.culled) continue;
+        m_passTimes[i] = static_cast<double>(data[pass.timestampIndex * 2 + 1] - data[pass.timestampIndex * 2]) * nsPerTick / 1000000.0;
+    }
+}
+
+void RenderGraph::addBarrier(Resource &resource, const ResourceUsage usage, std::vector<vk::ImageMemoryBarrier2> &imageBarriers, std::vector<vk::BufferMemoryBarrier2> &bufferBarriers) const {
+    const UsageInfo info = getUsageInfo(usage);
+    ResourceState& state = resource.state;
+
+    vk::PipelineStageFlags2 srcStages;
+    vk::AccessFlags2 srcAccess;
+    const bool layoutChange = resource.isImage && state.layout != info.layout;
+    if (layoutChange || info.write) {
+        // wait for the last write and every read since, and make the write available
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        if (resource.aliasedFrom.has_value() && state.layout == vk::ImageLayout::eUndefined) {
+            // the memory was last used by another transient
+            const ResourceState& previous = m_resources.at(*resource.aliasedFrom).state;
+            srcStages |= previous.writeStages | previous.readStages;
+            srcAccess |= previous.writeAccess;
+        }
+
+        // a layout transition acts as a write, so later reads from other stages wait for it
+        state.writeStages = info.stages;
+        state.writeAccess = info.write ? info.access : vk::AccessFlagBits2::eNone;
+        state.visibleStages = info.stages;
+        state.visibleAccess = info.access;
+        state.readStages = info.write ? vk::PipelineStageFlagBits2::eNone : info.stages;
+
+        // nothing to wait for
+        if (!layoutChange && !srcStages) return;
+    }
+    else {
+        state.readStages |= info.stages;
+        // reads only wait if the last write hasn't been made visible to them yet
+        const bool visible = (info.stages & ~state.visibleStages) == vk::PipelineStageFlags2{} && (info.access & ~state.visibleAccess) == vk::AccessFlags2{};
+        if (!state.writeStages || visible) return;
+
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+        state.visibleStages |= info.stages;
+        state.visibleAccess |= info.access;
+    }
+
+    if (!resource.isImage) {
+        bufferBarriers.push_back({
+            .srcStageMask = srcStages,
+            .srcAccessMask = srcAccess,
+            .dstStageMask = info.stages,
+            .dstAccessMask = info.access,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .buffer = resource.buffer,
+            .offset = 0,
+            .size = vk::WholeSize
+        });
+        return;
+    }
+
+    imageBarriers.push_back({
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = info.stages,
+        .dstAccessMask = info.access,
+        .oldLayout = layoutChange ? state.layout : info.layout,
+        .newLayout = info.layout,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = resource.image,
+        .subresourceRange = {
+            .aspectMask = getAspect(resource.desc.format),
+            .baseMipLevel = 0,
+            .levelCount = vk::RemainingMipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = vk::RemainingArrayLayers
+        }
+    });
+    state.layout = info.layout;
+}
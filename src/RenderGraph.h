@@ -0,0 +1,154 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+
+// how a pass uses a resource - each usage maps to the stages, access and (for images) layout it needs
+enum class ResourceUsage : u32 {
+    ColourAttachment,
+    // depth test and write
+    DepthAttachment,
+    // sampled in a fragment, compute or task shader
+    Sampled,
+    StorageRead,
+    StorageWrite,
+    UniformRead,
+    IndirectRead,
+    // bound as the index buffer of a draw
+    IndexRead,
+    TransferSrc,
+    TransferDst,
+};
+
+// passes declare the images and buffers they use, and the graph works out everything in between: passes whose
+// output is never used are culled, barriers are derived from each resource's previous use and batched per pass,
+// and transient images whose lifetimes don't overlap share memory
+//
+// the graph is built and compiled once for a given configuration, then executed every frame
+class RenderGraph {
+public:
+    using Handle = u32;
+    using ExecuteFunction = std::function<void(const vk::raii::CommandBuffer&)>;
+
+    struct ImageDesc {
+        u32 width, height;
+        vk::Format format;
+        vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+    };
+
+    struct Access {
+        Handle resource;
+        ResourceUsage usage;
+    };
+
+    struct PassInfo {
+        std::string name;
+        bool culled;
+        // GPU time from the last completed frame in milliseconds, if the graph is timed
+        double gpuTime;
+    };
+
+    // timed graphs write a timestamp around every pass - only for graphs executed once per frame in flight
+    explicit RenderGraph(bool timed = false);
+
+    // an image owned by the graph - its usage flags come from the passes that use it and its contents don't
+    // survive between frames
+    Handle createImage(const std::string& name, const ImageDesc& desc);
+    // an image owned elsewhere, given with setImage before each execute
+    // waitStages are the stages a semaphore wait before the graph blocks, so the first barrier chains onto it
+    Handle importImage(const std::string& name, vk::Format format, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 waitStages = {});
+    // a buffer owned elsewhere, given with setBuffer before each execute - it keeps its state between executes, so
+    // a pass writing it waits for the last frame's reads
+    Handle importBuffer(const std::string& name);
+
+    // passes run in the order they are added
+    void addPass(const std::string& name, const std::vector<Access>& accesses, ExecuteFunction execute);
+
+    // cull unused passes and allocate the transient images - no passes or resources can be added afterwards
+    void compile();
+
+    void setImage(Handle resource, vk::Image image, vk::ImageView view);
+    void setBuffer(Handle resource, vk::Buffer buffer);
+
+    // record every pass that wasn't culled, along with the barriers before it
+    void execute(const vk::raii::CommandBuffer& commandBuffer);
+
+    vk::Image getImage(Handle resource) const;
+    vk::ImageView getImageView(Handle resource) const;
+
+    std::vector<PassInfo> getPassInfo() const;
+    // memory backing the transient images, and what it would be without aliasing
+    vk::DeviceSize getTransientMemorySize() const;
+    vk::DeviceSize getUnaliasedMemorySize() const;
+
+private:
+    // synchronisation scope of a resource's uses since its last write
+    struct ResourceState {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags2 writeStages = vk::PipelineStageFlagBits2::eNone;
+        vk::AccessFlags2 writeAccess = vk::AccessFlagBits2::eNone;
+        // stages and access the last write has been made visible to
+        vk::PipelineStageFlags2 visibleStages = vk::PipelineStageFlagBits2::eNone;
+        vk::AccessFlags2 visibleAccess = vk::AccessFlagBits2::eNone;
+        // reads since the last write, which a following write has to wait for
+        vk::PipelineStageFlags2 readStages = vk::PipelineStageFlagBits2::eNone;
+    };
+
+    struct Resource {
+        std::string name;
+        bool isImage;
+        bool imported;
+        ImageDesc desc;
+        vk::ImageUsageFlags usage;
+        vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags2 waitStages = vk::PipelineStageFlagBits2::eNone;
+
+        vk::Image image = nullptr;
+        vk::ImageView view = nullptr;
+        vk::Buffer buffer = nullptr;
+        vk::raii::Image ownedImage = nullptr;
+        vk::raii::ImageView ownedView = nullptr;
+
+        // first and last pass that uses the resource, and the transient that used its memory before it
+        u32 firstPass = 0;
+        u32 lastPass = 0;
+        std::optional<Handle> aliasedFrom;
+
+        ResourceState state;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Access> accesses;
+        ExecuteFunction execute;
+        bool culled = false;
+        // index of the pass's timestamps within a frame's queries
+        u32 timestampIndex = 0;
+    };
+
+    void cullPasses();
+    void allocateTransients();
+    void readTimestamps();
+    // update the resource's state for the access, adding a barrier if it needs one
+    void addBarrier(Resource& resource, ResourceUsage usage, std::vector<vk::ImageMemoryBarrier2>& imageBarriers, std::vector<vk::BufferMemoryBarrier2>& bufferBarriers) const;
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    bool m_compiled = false;
+
+    vk::raii::DeviceMemory m_transientMemory = nullptr;
+    vk::DeviceSize m_transientMemorySize = 0;
+    vk::DeviceSize m_unaliasedMemorySize = 0;
+
+    bool m_timed;
+    u32 m_timedPassCount = 0;
+    vk::raii::QueryPool m_queryPool = nullptr;
+    std::array<bool, FRAMES_IN_FLIGHT> m_timestampsWritten = {};
+    std::vector<double> m_passTimes;
+};
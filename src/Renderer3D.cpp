@@ -1,31 +1,88 @@
 #include "Renderer3D.h"
 
+#include <atomic>
 #include <chrono>
 
-#include <glm/gtc/matrix_inverse.hpp>
-
 #include "AssetManager.h"
 #include "Components.h"
 #include "DebugWindow.h"
 #include "Skybox.h"
+#include "ThreadPool.h"
 
 Renderer3D::Renderer3D(const vk::Extent2D extent)
     : m_extent(extent)
-    , m_modelUniforms(ECS::MAX_ENTITIES)
+	, m_renderExtent(extent)
+	, m_materialTable(std::make_unique<MaterialTable>())
+	, m_clusteredLighting(std::make_unique<ClusteredLighting>())
+	, m_shadowMaps(std::make_unique<ShadowMaps>())
+	, m_ambientOcclusion(std::make_unique<AmbientOcclusion>(extent))
+	, m_temporalAntiAliasing(std::make_unique<TemporalAntiAliasing>(extent))
+	, m_meshletCulling(std::make_unique<MeshletCulling>(extent))
+	, m_multiDrawIndirect(VulkanEngine::getPhysicalDevice().getFeatures().multiDrawIndirect)
 	, m_boundingVolumeRenderer(std::make_unique<BoundingVolumeRenderer>(this))
 	, m_modelSelector(std::make_unique<ModelSelector>(m_extent))
+	, m_entityLods(ECS::MAX_ENTITIES, 0)
+	, m_drawQueue(ECS::MAX_ENTITIES)
 {
+	// G-buffer texels are fetched directly, so filtering never applies
+	const vk::SamplerCreateInfo samplerInfo = {
+		.magFilter = vk::Filter::eNearest,
+		.minFilter = vk::Filter::eNearest,
+		.mipmapMode = vk::SamplerMipmapMode::eNearest,
+		.addressModeU = vk::SamplerAddressMode::eClampToEdge,
+		.addressModeV = vk::SamplerAddressMode::eClampToEdge,
+		.addressModeW = vk::SamplerAddressMode::eClampToEdge,
+		.mipLodBias = 0.0f,
+		.anisotropyEnable = vk::False,
+		.maxAnisotropy = 1.0f,
+		.compareEnable = vk::False,
+		.compareOp = vk::CompareOp::eAlways,
+		.minLod = 0.0f,
+		.maxLod = 0.0f,
+		.unnormalizedCoordinates = vk::False
+	};
+	m_gBufferSampler = vk::raii::Sampler(VulkanEngine::getDevice(), samplerInfo);
+
+	// the scene is filtered as it is scaled up
+	vk::SamplerCreateInfo upscaleSamplerInfo = samplerInfo;
+	upscaleSamplerInfo.magFilter = vk::Filter::eLinear;
+	upscaleSamplerInfo.minFilter = vk::Filter::eLinear;
+	m_upscaleSampler = vk::raii::Sampler(VulkanEngine::getDevice(), upscaleSamplerInfo);
+
 	createPipelines();
-	createAttachments();
 
 	m_frameDescriptor = m_pipeline->createDescriptorSet(FRAME_SET_NUMBER);
 	m_modelDescriptor = m_pipeline->createDescriptorSet(MODEL_SET_NUMBER);
-	m_skyboxDescriptor = m_skyboxPipeline->createDescriptorSet(FRAME_SET_NUMBER);
 
-    m_frameUniforms.addToSet(m_frameDescriptor, 0);
-	m_frameUniforms.addToSet(m_skyboxDescriptor, 0);
-    m_fragFrameUniforms.addToSet(m_frameDescriptor, 1);
-    m_modelUniforms.addToSet(m_modelDescriptor, 0);
+	const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+	frameAllocator->addToSet(m_frameDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(FrameUniforms));
+	frameAllocator->addToSet(m_frameDescriptor, 1, vk::DescriptorType::eUniformBufferDynamic, sizeof(FragFrameData));
+	frameAllocator->addToSet(m_modelDescriptor, 0, vk::DescriptorType::eStorageBufferDynamic, sizeof(ModelUniforms) * ECS::MAX_ENTITIES);
+	m_clusteredLighting->addToSet(m_frameDescriptor, 3, 4);
+	m_shadowMaps->addToSet(m_frameDescriptor, 5, 6);
+
+	std::array<u8, 4> blackPixel = {0, 0, 0, 255};
+	std::array<unsigned char*, 6> blackFaces;
+	blackFaces.fill(blackPixel.data());
+	m_fallbackSkybox = std::make_unique<Skybox>(blackFaces, 1, 1);
+	bindSkybox(*m_fallbackSkybox);
+
+	for (u32 i = 0; i < FRAMES_IN_FLIGHT * SECONDARY_COUNT; ++i) {
+		SecondaryCommands& secondary = m_secondaryCommands.emplace_back();
+		secondary.pool = vk::raii::CommandPool(VulkanEngine::getDevice(), {
+			.flags = vk::CommandPoolCreateFlagBits::eTransient,
+			.queueFamilyIndex = VulkanEngine::getGraphicsQueueFamily()
+		});
+		vk::raii::CommandBuffers commandBuffers(VulkanEngine::getDevice(), {
+			.commandPool = secondary.pool,
+			.level = vk::CommandBufferLevel::eSecondary,
+			.commandBufferCount = 1
+		});
+		secondary.commandBuffer = std::move(commandBuffers.front());
+	}
+
+	// after the frame set exists, as the graph writes the occlusion into it
+	createRenderGraph();
 
     // create camera
 	m_camera = ECS::createEntity();
@@ -35,47 +92,92 @@ Renderer3D::Renderer3D(const vk::Extent2D extent)
 	VulkanEngine::addUpdateListener(m_modelSelector.get());
 }
 
-void Renderer3D::render(const vk::raii::CommandBuffer &commandBuffer, const vk::Image& image, const vk::ImageView& imageView) {
-	beginRender(commandBuffer, image, imageView);
-	setDynamicParameters(commandBuffer);
-	drawSkybox(commandBuffer);
-	setFrameUniforms(commandBuffer);
-	drawModels(commandBuffer);
-	m_boundingVolumeRenderer->draw(commandBuffer);
-	VulkanEngine::getDebugWindow()->draw(commandBuffer);
-	endRender(commandBuffer, image);
-}
-
 void Renderer3D::onEntityAdd(const ECS::Entity entity) {
 	System::onEntityAdd(entity);
-	const auto& modelInfo = ECS::getComponent<Model3D>(entity);
-	if (!m_sortedEntities.contains(modelInfo.material)) {
-		m_sortedEntities.insert({modelInfo.material, std::vector<ECS::Entity>()});
-	}
-	m_sortedEntities.at(modelInfo.material).push_back(entity);
+	m_shadowMaps->onCasterAdd(entity);
 }
 
 void Renderer3D::onEntityRemove(const ECS::Entity entity) {
 	System::onEntityRemove(entity);
-	const auto& modelInfo = ECS::getComponent<Model3D>(entity);
-	std::erase(m_sortedEntities.at(modelInfo.material), entity);
+	m_shadowMaps->onCasterRemove(entity);
+}
+
+void Renderer3D::render(const vk::raii::CommandBuffer &commandBuffer, const vk::Image& image, const vk::ImageView& imageView) {
+	// picked before anything sized from it is written this frame
+	if (m_dynamicResolutionEnabled) {
+		m_dynamicResolution.update(VulkanEngine::get().getFrameTimeInfo().gpuTime);
+		m_renderExtent = m_dynamicResolution.getRenderExtent(m_extent);
+	}
+	else {
+		m_renderExtent = m_extent;
+	}
+	const auto camera = ECS::getSystem<ControlledCameraSystem>();
+	camera->setJitter(m_temporalAntiAliasingEnabled ? m_temporalAntiAliasing->nextJitter(m_renderExtent) : glm::vec2(0.0f));
+
+	buildDrawList();
+
+	// descriptor sets and dynamic state stay bound across every pass in the graph
+	setFrameUniforms();
+	bindSharedState(commandBuffer);
+	setDynamicParameters(commandBuffer);
+
+	m_renderGraph->setImage(m_swapImage, image, imageView);
+	if (m_temporalAntiAliasingEnabled) {
+		m_temporalAntiAliasing->setImages(*m_renderGraph);
+	}
+	m_clusteredLighting->setBuffers(*m_renderGraph);
+	if (m_meshletCullingActive) {
+		m_meshletCulling->setBuffers(*m_renderGraph);
+	}
+	m_renderGraph->execute(commandBuffer);
 }
 
 const Pipeline * Renderer3D::getPipeline() const {
 	return m_pipeline.get();
 }
 
+const RenderGraph * Renderer3D::getRenderGraph() const {
+	return m_renderGraph.get();
+}
+
+ClusteredLighting * Renderer3D::getClusteredLighting() const {
+	return m_clusteredLighting.get();
+}
+
+ShadowMaps * Renderer3D::getShadowMaps() const {
+	return m_shadowMaps.get();
+}
+
+AmbientOcclusion * Renderer3D::getAmbientOcclusion() const {
+	return m_ambientOcclusion.get();
+}
+
+MeshletCulling * Renderer3D::getMeshletCulling() const {
+	return m_meshletCulling.get();
+}
+
+ImageBasedLighting * Renderer3D::getImageBasedLighting() const {
+	return m_imageBasedLighting.get();
+}
+
+MaterialTable * Renderer3D::getMaterialTable() const {
+	return m_materialTable.get();
+}
+
 void Renderer3D::rebuild() {
-	createAttachments();
-	createPipelines();
-	VulkanEngine::getDebugWindow()->rebuild();
-	m_boundingVolumeRenderer->rebuild();
+	// the options only change pipeline state, and the debug window is drawn single sampled straight to the swap image,
+	// so neither is built again - only the graph, whose attachments depend on them
+	updatePipelines();
+	createRenderGraph();
 }
 
 void Renderer3D::setExtent(vk::Extent2D extent) {
 	m_extent = extent;
 	ECS::getComponent<ControlledCamera>(m_camera).aspect = static_cast<float>(extent.width) / static_cast<float>(extent.height);
-	createAttachments();
+	m_ambientOcclusion->setExtent(extent);
+	m_temporalAntiAliasing->setExtent(extent);
+	m_meshletCulling->setExtent(extent);
+	createRenderGraph();
 	m_modelSelector->setExtent(extent);
 }
 
@@ -105,107 +207,644 @@ void Renderer3D::setSampleCount(const vk::SampleCountFlagBits samples) {
 }
 
 vk::SampleCountFlagBits Renderer3D::getSampleCount() const {
-	return m_samples;
+	return m_deferred || m_temporalAntiAliasingEnabled ? vk::SampleCountFlagBits::e1 : m_samples;
+}
+
+void Renderer3D::setWireframe(const bool enabled) {
+	m_wireframe = enabled;
+	// nothing but pipeline state changes, so there's nothing to wait for when it's set while recording
+	if (VulkanEngine::getPipelineStateSupport() == PipelineStateSupport::Dynamic) {
+		updatePipelines();
+	}
+	else {
+		VulkanEngine::queueRendererRebuild();
+	}
+}
+
+bool Renderer3D::getWireframe() const {
+	return m_wireframe;
+}
+
+void Renderer3D::setTemporalAntiAliasing(const bool enabled) {
+	m_temporalAntiAliasingEnabled = enabled;
+	VulkanEngine::queueRendererRebuild();
+}
+
+bool Renderer3D::getTemporalAntiAliasing() const {
+	return m_temporalAntiAliasingEnabled;
+}
+
+void Renderer3D::setLodBias(const float bias) {
+	m_lodBias = bias;
+}
+
+float Renderer3D::getLodBias() const {
+	return m_lodBias;
+}
+
+void Renderer3D::setSmallFeatureSize(const float size) {
+	m_smallFeatureSize = size;
+}
+
+float Renderer3D::getSmallFeatureSize() const {
+	return m_smallFeatureSize;
 }
 
 void Renderer3D::setSkybox(const std::shared_ptr<Skybox> &skybox) {
 	m_skybox = skybox;
-	m_skybox->addToSet(m_skyboxDescriptor, 1);
+	bindSkybox(*m_skybox);
+}
+
+void Renderer3D::setDepthPrepass(const bool enabled) {
+	m_depthPrepass = enabled;
+	VulkanEngine::queueRendererRebuild();
+}
+
+bool Renderer3D::getDepthPrepass() const {
+	return m_depthPrepass;
+}
+
+void Renderer3D::setDeferred(const bool enabled) {
+	m_deferred = enabled;
+	VulkanEngine::queueRendererRebuild();
 }
 
+bool Renderer3D::getDeferred() const {
+	return m_deferred;
+}
+
+void Renderer3D::setDynamicResolution(const bool enabled) {
+	m_dynamicResolutionEnabled = enabled;
+	m_dynamicResolution.reset();
+	VulkanEngine::queueRendererRebuild();
+}
+
+bool Renderer3D::getDynamicResolution() const {
+	return m_dynamicResolutionEnabled;
+}
+
+DynamicResolution & Renderer3D::getResolutionController() {
+	return m_dynamicResolution;
+}
+
+vk::Extent2D Renderer3D::getRenderExtent() const {
+	return m_renderExtent;
+}
+
+void Renderer3D::setSharpness(const float sharpness) {
+	m_sharpness = sharpness;
+}
+
+float Renderer3D::getSharpness() const {
+	return m_sharpness;
+}
+
+// the stages reading the frame's matrices and the model data - the mesh shading stages too where the device has them,
+// as the stage flags of the shared sets have to be the same in every pipeline for them to stay bound between pipelines
+static vk::ShaderStageFlags getGeometryStages() {
+	vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eVertex;
+	if (VulkanEngine::getMeshShaderSupport()) {
+		stages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+	}
+	return stages;
+}
+
+// every pipeline drawn in the depth pre-pass and the shading pass declares the same sets, so the frame, material and
+// model sets only need to be bound once per frame
+static Pipeline::Builder& addSharedBindings(Pipeline::Builder& builder) {
+	const vk::ShaderStageFlags geometryStages = getGeometryStages();
+	return builder
+		.addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, geometryStages) // view / project
+		.addBinding(0, 1, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eFragment) // frame data - lights & camera
+		.addBinding(0, 2, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // skybox
+		.addBinding(0, 3, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment) // point lights
+		.addBinding(0, 4, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment) // light clusters
+		.addBinding(0, 5, vk::DescriptorType::eStorageBufferDynamic, vk::ShaderStageFlagBits::eFragment) // shadow faces
+		.addBinding(0, 6, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // shadow atlas
+		.addBinding(0, 7, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // ambient occlusion
+		.addBinding(0, 8, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // irradiance
+		.addBinding(0, 9, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // prefiltered specular
+		.addBinding(0, 10, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // BRDF lookup table
+
+		// must match the layout created by MaterialTable
+		.addBinding(1, MaterialTable::MATERIAL_BINDING, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eFragment) // material data
+		.addBindlessBinding(1, MaterialTable::TEXTURE_BINDING, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment, MaterialTable::MAX_TEXTURES) // material textures
+
+		.addBinding(2, 0, vk::DescriptorType::eStorageBufferDynamic, geometryStages); // model data
+}
+
+// the vertex shader drawing instances whole, or in place of it the task and mesh shaders drawing the meshlets the
+// task shader keeps - name is the shader both are named after
+static Pipeline::Builder& addGeometryStages(Pipeline::Builder& builder, const std::string& name, const bool meshShading) {
+	if (meshShading) {
+		builder
+			.addShaderStage("shaders/meshlet.task.spv")
+			.addShaderStage("shaders/" + name + ".mesh.spv");
+		MeshletCulling::addMeshBindings(builder);
+		return builder;
+	}
+	return builder
+		.addShaderStage("shaders/" + name + ".vert.spv")
+		.setVertexInfo(PackedVertex::getBindingDescription(), PackedVertex::getAttributeDescriptions());
+}
+
+// pipelines are created with the current options, and afterwards only their state is changed by updatePipelines
 void Renderer3D::createPipelines() {
-	m_pipeline = Pipeline::Builder()
-		.addShaderStage("shaders/model.vert.spv")
-        .addShaderStage("shaders/model.frag.spv")
-        .setVertexInfo(Vertex::getBindingDescription(), Vertex::getAttributeDescriptions())
-		.addAttachment(VulkanEngine::getSwapColourFormat())
-		.setSamples(m_samples)
-		.enableAlphaBlending()
+	const vk::SampleCountFlagBits samples = getSampleCount();
+	const vk::PolygonMode polygonMode = getPolygonMode();
+
+	// one pipeline per alpha mode, differing only in the ALPHA_MODE constant and blending
+	const auto createModelPipeline = [this, samples, polygonMode](const AlphaMode alphaMode, const bool meshShading = false) {
+		Pipeline::Builder builder;
+		addGeometryStages(builder, "model", meshShading)
+			.addShaderStage("shaders/model.frag.spv")
+			.addAttachment(VulkanEngine::getSwapColourFormat())
+			.setSamples(samples)
+			.setPolygonMode(polygonMode)
+			.addSpecialisationConstant(0, static_cast<u32>(alphaMode))
+			.allowStateChanges();
+		addSharedBindings(builder);
+
+		if (alphaMode == AlphaMode::Blend) {
+			builder.enableAlphaBlending().disableDepthWrite();
+		}
+		else if (m_depthPrepass) {
+			builder.setDepthCompareOp(PREPASS_COMPARE_OP).disableDepthWrite();
+		}
+		return builder.create();
+	};
+	m_pipeline = createModelPipeline(AlphaMode::Opaque);
+	m_maskPipeline = createModelPipeline(AlphaMode::Mask);
+	m_blendPipeline = createModelPipeline(AlphaMode::Blend);
 
-        .addBinding(0, 0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex) // view / project
-        .addBinding(0, 1, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eFragment) // frame data - lights & camera
+	// position only, with a fragment shader for alpha testing masked materials - the task shader reads the constant
+	// too, to find which instances are the alpha mode's
+	const auto createDepthPipeline = [samples, polygonMode](const AlphaMode alphaMode, const bool meshShading = false) {
+		Pipeline::Builder builder;
+		addGeometryStages(builder, "depth", meshShading)
+			.setSamples(samples)
+			.setPolygonMode(polygonMode)
+			.addSpecialisationConstant(0, static_cast<u32>(alphaMode))
+			.allowStateChanges();
+		addSharedBindings(builder);
 
-        .addBinding(1, 0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // material - base
-        .addBinding(1, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // material - mr
-        .addBinding(1, 2, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // material - ao
-        .addBinding(1, 3, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // material - normal
+		if (alphaMode == AlphaMode::Mask) {
+			builder.addShaderStage("shaders/depth.frag.spv");
+		}
+		return builder.create();
+	};
+	m_depthPipeline = createDepthPipeline(AlphaMode::Opaque);
+	m_depthMaskPipeline = createDepthPipeline(AlphaMode::Mask);
 
-        .addBinding(2, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex) // model data
-		.create();
+	// blended instances are never culled, so they have no mesh shading pipeline
+	if (m_meshletCulling->getMeshShading()) {
+		m_meshPipeline = createModelPipeline(AlphaMode::Opaque, true);
+		m_meshMaskPipeline = createModelPipeline(AlphaMode::Mask, true);
+		m_meshDepthPipeline = createDepthPipeline(AlphaMode::Opaque, true);
+		m_meshDepthMaskPipeline = createDepthPipeline(AlphaMode::Mask, true);
+		m_meshletCulling->createMeshDescriptor(*m_meshPipeline);
+	}
 
-	m_xrayPipeline = Pipeline::Builder()
+	Pipeline::Builder xrayBuilder;
+	xrayBuilder
 		.addShaderStage("shaders/xray.vert.spv")
 		.addShaderStage("shaders/xray.frag.spv")
-		.setVertexInfo(Vertex::getBindingDescription(), Vertex::getAttributeDescriptions())
+		.setVertexInfo(PackedVertex::getBindingDescription(), PackedVertex::getAttributeDescriptions())
 		.addAttachment(VulkanEngine::getSwapColourFormat())
 		.setPolygonMode(vk::PolygonMode::eLine)
-		.setSamples(m_samples)
+		.setSamples(samples)
 		.disableDepthTest()
-		.addBinding(0, 0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex)
-		.addBinding(2, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex)
-        .addBinding(0, 1, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eFragment) // unused
-		.create();
+		.allowStateChanges();
+	m_xrayPipeline = addSharedBindings(xrayBuilder).create();
 
-	m_skyboxPipeline = Pipeline::Builder()
+	// skybox vertices are projected onto the far plane, so it only shows where nothing else has been drawn
+	Pipeline::Builder skyboxBuilder;
+	skyboxBuilder
 		.addShaderStage("shaders/skybox.vert.spv")
 		.addShaderStage("shaders/skybox.frag.spv")
-		.setVertexInfo(Vertex::getBindingDescription(), Vertex::getAttributeDescriptions())
+		.setVertexInfo(PackedVertex::getBindingDescription(), PackedVertex::getAttributeDescriptions())
 		.addAttachment(VulkanEngine::getSwapColourFormat())
-		.setSamples(m_samples)
-		.disableDepthTest()
-		.addBinding(0, 0, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex)
-		.addBinding(0, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment)
-		.create();
+		.setSamples(samples)
+		.setDepthCompareOp(vk::CompareOp::eLessOrEqual)
+		.disableDepthWrite()
+		.allowStateChanges();
+	m_skyboxPipeline = addSharedBindings(skyboxBuilder).create();
+
+	// the scene is scaled up into the swap image after everything else, so it isn't multisampled and has no depth
+	Pipeline::Builder upscaleBuilder;
+	upscaleBuilder
+		.addShaderStage("shaders/fullscreen.vert.spv")
+		.addShaderStage("shaders/upscale.frag.spv")
+		.addAttachment(VulkanEngine::getSwapColourFormat())
+		.setCullMode(vk::CullModeFlagBits::eNone)
+		.disableDepthAttachment()
+		.addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eFragment) // upscale parameters
+		.addBinding(0, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment); // scene
+	m_upscalePipeline = upscaleBuilder.create();
+
+	if (m_deferred) {
+		createDeferredPipelines();
+	}
+}
+
+// only created once deferred shading is first enabled, and kept after
+void Renderer3D::createDeferredPipelines() {
+	const vk::PolygonMode polygonMode = getPolygonMode();
+
+	// same as the model pipelines, but writing the surface to the G-buffer instead of shading it
+	const auto createGBufferPipeline = [this, polygonMode](const AlphaMode alphaMode, const bool meshShading = false) {
+		Pipeline::Builder builder;
+		addGeometryStages(builder, "model", meshShading)
+			.addShaderStage("shaders/gbuffer.frag.spv")
+			.addAttachment(GBUFFER_ALBEDO_FORMAT)
+			.addAttachment(GBUFFER_NORMAL_FORMAT)
+			.addAttachment(GBUFFER_MATERIAL_FORMAT)
+			.setPolygonMode(polygonMode)
+			.addSpecialisationConstant(0, static_cast<u32>(alphaMode))
+			.allowStateChanges();
+		addSharedBindings(builder);
+
+		if (m_depthPrepass) {
+			builder.setDepthCompareOp(PREPASS_COMPARE_OP).disableDepthWrite();
+		}
+		return builder.create();
+	};
+	m_gBufferPipeline = createGBufferPipeline(AlphaMode::Opaque);
+	m_gBufferMaskPipeline = createGBufferPipeline(AlphaMode::Mask);
+	if (m_meshletCulling->getMeshShading()) {
+		m_meshGBufferPipeline = createGBufferPipeline(AlphaMode::Opaque, true);
+		m_meshGBufferMaskPipeline = createGBufferPipeline(AlphaMode::Mask, true);
+	}
+
+	Pipeline::Builder deferredBuilder;
+	deferredBuilder
+		.addShaderStage("shaders/fullscreen.vert.spv")
+		.addShaderStage("shaders/deferred.frag.spv")
+		.addAttachment(VulkanEngine::getSwapColourFormat())
+		.setCullMode(vk::CullModeFlagBits::eNone)
+		.disableDepthAttachment()
+		.addBinding(3, 0, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // albedo / AO
+		.addBinding(3, 1, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // normal
+		.addBinding(3, 2, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment) // metallic / roughness
+		.addBinding(3, 3, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eFragment); // depth
+	m_deferredPipeline = addSharedBindings(deferredBuilder).create();
 }
 
-void Renderer3D::createAttachments() {
-	m_depthImage = std::make_unique<Image>(ImageCreateInfo{
+void Renderer3D::updatePipelines() {
+	if (m_deferred && m_gBufferPipeline == nullptr) {
+		createDeferredPipelines();
+	}
+
+	const vk::SampleCountFlagBits samples = getSampleCount();
+	std::vector<Pipeline*> multisampledPipelines = {m_pipeline.get(), m_maskPipeline.get(), m_blendPipeline.get(), m_depthPipeline.get(), m_depthMaskPipeline.get(), m_xrayPipeline.get(), m_skyboxPipeline.get()};
+	// the highlight is always drawn as lines, and the skybox always filled
+	std::vector<Pipeline*> surfacePipelines = {m_pipeline.get(), m_maskPipeline.get(), m_blendPipeline.get(), m_depthPipeline.get(), m_depthMaskPipeline.get()};
+	// blended models are never in the pre-pass, so they are always tested normally
+	std::vector<Pipeline*> prepassPipelines = {m_pipeline.get(), m_maskPipeline.get()};
+	if (m_meshPipeline != nullptr) {
+		multisampledPipelines.insert(multisampledPipelines.end(), {m_meshPipeline.get(), m_meshMaskPipeline.get(), m_meshDepthPipeline.get(), m_meshDepthMaskPipeline.get()});
+		surfacePipelines.insert(surfacePipelines.end(), {m_meshPipeline.get(), m_meshMaskPipeline.get(), m_meshDepthPipeline.get(), m_meshDepthMaskPipeline.get()});
+		prepassPipelines.insert(prepassPipelines.end(), {m_meshPipeline.get(), m_meshMaskPipeline.get()});
+	}
+	if (m_gBufferPipeline != nullptr) {
+		surfacePipelines.insert(surfacePipelines.end(), {m_gBufferPipeline.get(), m_gBufferMaskPipeline.get()});
+		prepassPipelines.insert(prepassPipelines.end(), {m_gBufferPipeline.get(), m_gBufferMaskPipeline.get()});
+	}
+	if (m_meshGBufferPipeline != nullptr) {
+		surfacePipelines.insert(surfacePipelines.end(), {m_meshGBufferPipeline.get(), m_meshGBufferMaskPipeline.get()});
+		prepassPipelines.insert(prepassPipelines.end(), {m_meshGBufferPipeline.get(), m_meshGBufferMaskPipeline.get()});
+	}
+
+	for (Pipeline* pipeline : multisampledPipelines) {
+		pipeline->setSamples(samples);
+	}
+	m_boundingVolumeRenderer->setSampleCount(samples);
+	for (Pipeline* pipeline : surfacePipelines) {
+		pipeline->setPolygonMode(getPolygonMode());
+	}
+	for (Pipeline* pipeline : prepassPipelines) {
+		pipeline->setDepthState(!m_depthPrepass, m_depthPrepass ? PREPASS_COMPARE_OP : vk::CompareOp::eLess);
+	}
+}
+
+vk::PolygonMode Renderer3D::getPolygonMode() const {
+	return m_wireframe ? vk::PolygonMode::eLine : vk::PolygonMode::eFill;
+}
+
+void Renderer3D::createRenderGraph() {
+	m_renderGraph = std::make_unique<RenderGraph>(true);
+	RenderGraph& graph = *m_renderGraph;
+	const vk::SampleCountFlagBits samples = getSampleCount();
+
+	// the acquire semaphore is waited on at colour output, so the first transition waits there too
+	m_swapImage = graph.importImage("Swapchain", VulkanEngine::getSwapColourFormat(), vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput);
+	// attachments are always the size of the output, and with dynamic resolution only the top left is rendered to -
+	// so the scale can change every frame without reallocating anything
+	m_upscaleActive = m_dynamicResolutionEnabled || m_temporalAntiAliasingEnabled;
+	m_sceneColour = m_swapImage;
+	if (m_upscaleActive) {
+		m_sceneColour = graph.createImage("Scene Colour", {
+			.width = m_extent.width,
+			.height = m_extent.height,
+			.format = VulkanEngine::getSwapColourFormat(),
+		});
+	}
+	// once the scene is shaded it's anti-aliased and scaled up, then the UI is drawn over it at full resolution
+	const auto addOverlayPass = [&] {
+		if (m_meshletCullingActive) {
+			m_meshletCulling->addPyramidPass(graph, m_depthAttachment, samples);
+		}
+
+		m_upscaleSource = m_sceneColour;
+		if (m_temporalAntiAliasingEnabled) {
+			m_temporalAntiAliasing->addPasses(graph, m_depthAttachment, m_sceneColour);
+			m_upscaleSource = m_temporalAntiAliasing->getResource();
+		}
+
+		std::vector<RenderGraph::Access> accesses = {
+			{m_swapImage, ResourceUsage::ColourAttachment},
+		};
+		if (m_upscaleActive) {
+			accesses.push_back({m_upscaleSource, ResourceUsage::Sampled});
+		}
+		graph.addPass(m_upscaleActive ? "Upscale" : "Overlay", accesses, [this](const vk::raii::CommandBuffer& commandBuffer) {
+			drawOverlay(commandBuffer);
+		});
+	};
+
+	m_clusteredLighting->addPasses(graph);
+	const RenderGraph::Handle lights = m_clusteredLighting->getLightResource();
+	const RenderGraph::Handle clusters = m_clusteredLighting->getClusterResource();
+
+	// the shadow passes bind their own pipeline layout and viewports, so the shared state is put back after them
+	m_shadowMaps->addResources(graph);
+	const RenderGraph::Handle shadowCache = m_shadowMaps->getCacheResource();
+	const RenderGraph::Handle shadowAtlas = m_shadowMaps->getAtlasResource();
+	graph.addPass("Shadow Cache", {
+		{shadowCache, ResourceUsage::DepthAttachment},
+	}, [this](const vk::raii::CommandBuffer& commandBuffer) {
+		m_shadowMaps->drawCache(commandBuffer);
+	});
+	graph.addPass("Shadow Copy", {
+		{shadowCache, ResourceUsage::TransferSrc},
+		{shadowAtlas, ResourceUsage::TransferDst},
+	}, [this](const vk::raii::CommandBuffer& commandBuffer) {
+		m_shadowMaps->copyCache(commandBuffer);
+	});
+	graph.addPass("Shadow Dynamic", {
+		{shadowAtlas, ResourceUsage::DepthAttachment},
+	}, [this](const vk::raii::CommandBuffer& commandBuffer) {
+		m_shadowMaps->drawDynamic(commandBuffer);
+		bindSharedState(commandBuffer);
+		setDynamicParameters(commandBuffer);
+	});
+
+	// opaque and masked instances have their meshlets culled before anything draws them, so every pass drawing them
+	// reads the commands and indexes the culling wrote - or with mesh shading culls them itself, sampling the pyramid
+	m_meshletCullingActive = m_meshletCulling->getEnabled();
+	if (m_meshletCullingActive) {
+		m_meshletCulling->addCullPass(graph);
+	}
+	const auto withDraws = [&](std::vector<RenderGraph::Access> accesses) {
+		if (m_meshletCullingActive && m_meshletCulling->getMeshShading()) {
+			if (m_meshletCulling->getOcclusionCulling()) {
+				accesses.push_back({m_meshletCulling->getPyramidResource(), ResourceUsage::Sampled});
+			}
+		}
+		else if (m_meshletCullingActive) {
+			accesses.push_back({m_meshletCulling->getCommandResource(), ResourceUsage::IndirectRead});
+			accesses.push_back({m_meshletCulling->getIndexResource(), ResourceUsage::IndexRead});
+		}
+		return accesses;
+	};
+
+	m_depthAttachment = graph.createImage("Depth", {
 		.width = m_extent.width,
 		.height = m_extent.height,
 		.format = VulkanEngine::getDepthFormat(),
-		.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
-		.aspect = vk::ImageAspectFlagBits::eDepth,
-		.samples = m_samples,
+		.samples = samples,
 	});
 
-	m_colorImage = std::make_unique<Image>(ImageCreateInfo{
-		.width = m_extent.width,
-		.height = m_extent.height,
-		.format = VulkanEngine::getSwapColourFormat(),
-		.usage = vk::ImageUsageFlagBits::eColorAttachment,
-		.samples = m_samples
+	if (m_depthPrepass) {
+		graph.addPass("Depth Pre-pass", withDraws({
+			{m_depthAttachment, ResourceUsage::DepthAttachment},
+		}), [this](const vk::raii::CommandBuffer& commandBuffer) {
+			drawDepthPrepass(commandBuffer);
+		});
+	}
+
+	// the occlusion is computed from depth once every opaque surface has been written, and sampled by shading
+	m_ambientOcclusionActive = m_ambientOcclusion->getEnabled() && (m_deferred || m_depthPrepass);
+	m_ambientOcclusion->addToSet(m_frameDescriptor, 7);
+	std::vector<RenderGraph::Access> lightingAccesses = {
+		{lights, ResourceUsage::StorageRead},
+		{clusters, ResourceUsage::StorageRead},
+		{shadowAtlas, ResourceUsage::Sampled},
+	};
+	const auto addAmbientOcclusion = [&] {
+		m_ambientOcclusion->addPasses(graph, m_depthAttachment, samples);
+		lightingAccesses.push_back({m_ambientOcclusion->getResource(), ResourceUsage::Sampled});
+	};
+	const auto withLighting = [&](std::vector<RenderGraph::Access> accesses) {
+		accesses.insert(accesses.end(), lightingAccesses.begin(), lightingAccesses.end());
+		return accesses;
+	};
+	if (m_ambientOcclusionActive && !m_deferred) {
+		addAmbientOcclusion();
+	}
+
+	if (m_deferred) {
+		const auto createGBufferImage = [&](const std::string& name, const vk::Format format) {
+			return graph.createImage(name, {
+				.width = m_extent.width,
+				.height = m_extent.height,
+				.format = format,
+			});
+		};
+		m_gBufferAlbedo = createGBufferImage("G-Buffer Albedo", GBUFFER_ALBEDO_FORMAT);
+		m_gBufferNormal = createGBufferImage("G-Buffer Normal", GBUFFER_NORMAL_FORMAT);
+		m_gBufferMaterial = createGBufferImage("G-Buffer Material", GBUFFER_MATERIAL_FORMAT);
+
+		graph.addPass("G-Buffer", withDraws({
+			{m_gBufferAlbedo, ResourceUsage::ColourAttachment},
+			{m_gBufferNormal, ResourceUsage::ColourAttachment},
+			{m_gBufferMaterial, ResourceUsage::ColourAttachment},
+			{m_depthAttachment, ResourceUsage::DepthAttachment},
+		}), [this](const vk::raii::CommandBuffer& commandBuffer) {
+			drawGBuffer(commandBuffer);
+		});
+		if (m_ambientOcclusionActive) {
+			addAmbientOcclusion();
+		}
+		graph.addPass("Deferred Lighting", withLighting({
+			{m_sceneColour, ResourceUsage::ColourAttachment},
+			{m_gBufferAlbedo, ResourceUsage::Sampled},
+			{m_gBufferNormal, ResourceUsage::Sampled},
+			{m_gBufferMaterial, ResourceUsage::Sampled},
+			{m_depthAttachment, ResourceUsage::Sampled},
+		}), [this](const vk::raii::CommandBuffer& commandBuffer) {
+			drawDeferredLighting(commandBuffer);
+		});
+		graph.addPass("Forward", withLighting({
+			{m_sceneColour, ResourceUsage::ColourAttachment},
+			{m_depthAttachment, ResourceUsage::DepthAttachment},
+		}), [this](const vk::raii::CommandBuffer& commandBuffer) {
+			beginRender(commandBuffer, vk::AttachmentLoadOp::eLoad, vk::AttachmentLoadOp::eLoad);
+			drawAfterOpaque(commandBuffer);
+			commandBuffer.endRendering();
+		});
+
+		addOverlayPass();
+
+		graph.compile();
+		writeGBufferDescriptor();
+		if (m_ambientOcclusionActive) {
+			m_ambientOcclusion->writeDescriptors(graph);
+		}
+		if (m_temporalAntiAliasingEnabled) {
+			m_temporalAntiAliasing->writeDescriptors(graph);
+		}
+		if (m_meshletCullingActive) {
+			m_meshletCulling->writeDescriptors(graph);
+		}
+		if (m_upscaleActive) {
+			writeUpscaleDescriptor();
+		}
+		return;
+	}
+
+	std::vector<RenderGraph::Access> shadingAccesses = withDraws(withLighting({
+		{m_sceneColour, ResourceUsage::ColourAttachment},
+		{m_depthAttachment, ResourceUsage::DepthAttachment},
+	}));
+	if (samples != vk::SampleCountFlagBits::e1) {
+		m_colourAttachment = graph.createImage("Colour", {
+			.width = m_extent.width,
+			.height = m_extent.height,
+			.format = VulkanEngine::getSwapColourFormat(),
+			.samples = samples,
+		});
+		shadingAccesses.push_back({m_colourAttachment, ResourceUsage::ColourAttachment});
+	}
+	graph.addPass("Shading", shadingAccesses, [this](const vk::raii::CommandBuffer& commandBuffer) {
+		// each opaque pipeline's draws are recorded on a thread of their own
+		constexpr std::array alphaModes = {AlphaMode::Opaque, AlphaMode::Mask};
+		std::array<u32, alphaModes.size()> drawCalls = {};
+		std::array<vk::CommandBuffer, SECONDARY_COUNT> secondaries;
+		VulkanEngine::getThreadPool()->parallelFor(static_cast<u32>(alphaModes.size()), 1, [&](const u32 begin, const u32 end) {
+			for (u32 i = begin; i < end; ++i) {
+				const vk::raii::CommandBuffer& secondary = beginSecondary(i);
+				drawCalls.at(i) = drawModels(secondary, alphaModes.at(i));
+				secondary.end();
+				secondaries.at(i) = *secondary;
+			}
+		});
+		// the bounding volumes push to the frame allocator, so everything after the opaque models stays on this thread
+		const vk::raii::CommandBuffer& afterOpaque = beginSecondary(static_cast<u32>(alphaModes.size()));
+		drawAfterOpaque(afterOpaque);
+		afterOpaque.end();
+		secondaries.back() = *afterOpaque;
+
+		for (const u32 count : drawCalls) {
+			m_debugInfo.drawCalls += count;
+		}
+		beginRender(commandBuffer, vk::AttachmentLoadOp::eClear, m_depthPrepass ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear, vk::RenderingFlagBits::eContentsSecondaryCommandBuffers);
+		commandBuffer.executeCommands(secondaries);
+		commandBuffer.endRendering();
 	});
+	addOverlayPass();
+
+	graph.compile();
+	if (m_ambientOcclusionActive) {
+		m_ambientOcclusion->writeDescriptors(graph);
+	}
+	if (m_temporalAntiAliasingEnabled) {
+		m_temporalAntiAliasing->writeDescriptors(graph);
+	}
+	if (m_meshletCullingActive) {
+		m_meshletCulling->writeDescriptors(graph);
+	}
+	if (m_upscaleActive) {
+		writeUpscaleDescriptor();
+	}
 }
 
-void Renderer3D::beginRender(const vk::raii::CommandBuffer& commandBuffer, const vk::Image& image, const vk::ImageView& imageView) const {
-	Image::changeLayout(commandBuffer, image, {vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal});
+void Renderer3D::writeGBufferDescriptor() {
+	m_gBufferDescriptor = m_deferredPipeline->createDescriptorSet(3);
+
+	// bindings follow the order of the images
+	const std::array images = {m_gBufferAlbedo, m_gBufferNormal, m_gBufferMaterial, m_depthAttachment};
+	std::array<vk::DescriptorImageInfo, images.size()> imageInfos;
+	std::array<vk::WriteDescriptorSet, images.size()> writes;
+	for (u32 i = 0; i < images.size(); ++i) {
+		imageInfos[i] = {
+			.sampler = *m_gBufferSampler,
+			.imageView = m_renderGraph->getImageView(images[i]),
+			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+		};
+		writes[i] = {
+			.dstSet = *m_gBufferDescriptor,
+			.dstBinding = i,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = vk::DescriptorType::eCombinedImageSampler,
+			.pImageInfo = &imageInfos[i]
+		};
+	}
+	VulkanEngine::getDevice().updateDescriptorSets(writes, nullptr);
+}
+
+void Renderer3D::writeUpscaleDescriptor() {
+	m_upscaleDescriptor = m_upscalePipeline->createDescriptorSet(0);
+	VulkanEngine::getFrameAllocator()->addToSet(m_upscaleDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(UpscaleParams));
+
+	const vk::DescriptorImageInfo imageInfo = {
+		.sampler = *m_upscaleSampler,
+		.imageView = m_renderGraph->getImageView(m_upscaleSource),
+		.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+	};
+	const vk::WriteDescriptorSet write = {
+		.dstSet = *m_upscaleDescriptor,
+		.dstBinding = 1,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		.pImageInfo = &imageInfo
+	};
+	VulkanEngine::getDevice().updateDescriptorSets(write, nullptr);
+}
+
+void Renderer3D::beginRender(const vk::raii::CommandBuffer& commandBuffer, const vk::AttachmentLoadOp colourLoadOp, const vk::AttachmentLoadOp depthLoadOp, const vk::RenderingFlags flags) const {
+	const vk::ImageView sceneView = m_renderGraph->getImageView(m_sceneColour);
 	vk::RenderingAttachmentInfo colourAttachment = {
-		.imageView = imageView,
+		.imageView = sceneView,
 		.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
-		.loadOp = vk::AttachmentLoadOp::eClear,
+		.loadOp = colourLoadOp,
 		.storeOp = vk::AttachmentStoreOp::eStore,
 		.clearValue = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 0.0f),
 	};
-	if (m_samples != vk::SampleCountFlagBits::e1) {
-		colourAttachment.imageView = m_colorImage->getView();
+	if (getSampleCount() != vk::SampleCountFlagBits::e1) {
+		colourAttachment.imageView = m_renderGraph->getImageView(m_colourAttachment);
 		colourAttachment.resolveMode = vk::ResolveModeFlagBits::eAverage;
-		colourAttachment.resolveImageView = imageView;
+		colourAttachment.resolveImageView = sceneView;
 		colourAttachment.resolveImageLayout = vk::ImageLayout::eColorAttachmentOptimal;
 	}
 
 	const std::array attachments = { colourAttachment };
 
 	vk::RenderingAttachmentInfo depthAttachment = {
-		.imageView = m_depthImage->getView(),
+		.imageView = m_renderGraph->getImageView(m_depthAttachment),
 		.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
-		.loadOp = vk::AttachmentLoadOp::eClear,
-		.storeOp = vk::AttachmentStoreOp::eDontCare,
+		.loadOp = depthLoadOp,
+		// temporal anti-aliasing reprojects from depth afterwards, and the depth pyramid is built from it
+		.storeOp = m_temporalAntiAliasingEnabled || (m_meshletCullingActive && m_meshletCulling->getOcclusionCulling()) ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare,
 		.clearValue = vk::ClearDepthStencilValue(1.0f, 0)
 	};
 	vk::RenderingInfo renderingInfo = {
+		.flags = flags,
 		.renderArea = {
 			.offset = {0, 0},
-			.extent = m_extent
+			.extent = m_renderExtent
 		},
 		.layerCount = 1,
 		.colorAttachmentCount = static_cast<u32>(attachments.size()),
@@ -216,103 +855,464 @@ void Renderer3D::beginRender(const vk::raii::CommandBuffer& commandBuffer, const
 	commandBuffer.beginRendering(renderingInfo);
 }
 
+const vk::raii::CommandBuffer& Renderer3D::beginSecondary(const u32 slot) const {
+	// the frame's fence has been waited on, so nothing from the last time this frame index was recorded is still in use
+	const SecondaryCommands& secondary = m_secondaryCommands.at(VulkanEngine::getFrameIndex() * SECONDARY_COUNT + slot);
+	secondary.pool.reset();
+
+	// must match the attachments beginRender uses
+	const vk::Format colourFormat = VulkanEngine::getSwapColourFormat();
+	const vk::CommandBufferInheritanceRenderingInfo renderingInfo = {
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &colourFormat,
+		.depthAttachmentFormat = VulkanEngine::getDepthFormat(),
+		.rasterizationSamples = getSampleCount()
+	};
+	const vk::CommandBufferInheritanceInfo inheritanceInfo = {
+		.pNext = &renderingInfo
+	};
+	secondary.commandBuffer.begin({
+		.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+		.pInheritanceInfo = &inheritanceInfo
+	});
+
+	bindSharedState(secondary.commandBuffer);
+	setDynamicParameters(secondary.commandBuffer);
+	return secondary.commandBuffer;
+}
+
 void Renderer3D::setDynamicParameters(const vk::raii::CommandBuffer& commandBuffer) const {
+	setViewport(commandBuffer, m_renderExtent);
+}
+
+void Renderer3D::setViewport(const vk::raii::CommandBuffer &commandBuffer, const vk::Extent2D extent) {
 	const vk::Viewport viewport = {
 		.x = 0.0f,
 		.y = 0.0f,
-		.width = static_cast<float>(m_extent.width),
-		.height = static_cast<float>(m_extent.height),
+		.width = static_cast<float>(extent.width),
+		.height = static_cast<float>(extent.height),
 		.minDepth = 0.0f,
 		.maxDepth = 1.0f
 	};
 	const vk::Rect2D scissor = {
 		.offset = {0, 0},
-		.extent = m_extent
+		.extent = extent
 	};
 	commandBuffer.setViewport(0, viewport);
 	commandBuffer.setScissor(0, scissor);
 }
 
-void Renderer3D::setFrameUniforms(const vk::raii::CommandBuffer& commandBuffer) {
+void Renderer3D::setFrameUniforms() {
 	const auto camera = ECS::getSystem<ControlledCameraSystem>();
 	const auto& cameraData = ECS::getComponent<ControlledCamera>(m_camera);
-	m_frameUniforms.setData({
-		.view = camera->getViewMatrix(),
-		.projection = camera->getProjectionMatrix(),
+	const glm::mat4 view = camera->getViewMatrix();
+	const glm::mat4 projection = camera->getProjectionMatrix();
+	FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+	m_frameUniforms = frameAllocator->push<FrameUniforms>({
+		.view = view,
+		.projection = projection,
 	});
 
-	u32 nLights;
-	m_fragFrameUniforms.setData({
+	const glm::vec2 sliceScaleBias = ClusteredLighting::getSliceScaleBias(cameraData.near, cameraData.far);
+	m_fragFrameUniforms = frameAllocator->push<FragFrameData>({
+		.view = view,
+		.inverseViewProjection = glm::inverse(projection * view),
 		.cameraPosition = cameraData.position,
-		.lights = ECS::getSystem<LightSystem>()->getLights(nLights),
-		.nLights = nLights,
 		.far = cameraData.far,
-		.fog = cameraData.far / 20.0f
+		.screenSize = glm::vec2(m_renderExtent.width, m_renderExtent.height),
+		.clusterScale = sliceScaleBias.x,
+		.clusterBias = sliceScaleBias.y,
+		.fog = cameraData.far / 20.0f,
+		.ambientOcclusionEnabled = m_ambientOcclusionActive
 	});
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, nullptr);
+
+	m_clusteredLighting->update(view, projection, cameraData.near, cameraData.far);
+	// after the lights have been repacked, so the shadows follow this frame's lights
+	m_shadowMaps->update(m_entityList, camera->getFrustum(), cameraData, m_renderExtent.height);
+	if (m_ambientOcclusionActive) {
+		m_ambientOcclusion->update(view, projection, cameraData.near, cameraData.far, m_renderExtent);
+	}
+	if (m_temporalAntiAliasingEnabled) {
+		m_temporalAntiAliasing->update(view, camera->getProjectionMatrix(false), m_renderExtent);
+	}
+	if (m_meshletCullingActive) {
+		const glm::uvec3 firstInstances(m_culledCommands[0].first, m_culledCommands[1].first, m_culledCommands[2].first);
+		m_meshletCulling->update(camera->getFrustum(), projection * view, cameraData.position, m_renderExtent, m_modelUniforms.offset, firstInstances);
+	}
+	if (m_upscaleActive) {
+		m_upscaleParams = frameAllocator->push<UpscaleParams>({
+			.renderScale = glm::vec2(m_renderExtent.width, m_renderExtent.height) / glm::vec2(m_extent.width, m_extent.height),
+			.texelSize = 1.0f / glm::vec2(m_extent.width, m_extent.height),
+			.sharpness = m_sharpness,
+		});
+	}
 }
 
-void Renderer3D::drawModels(const vk::raii::CommandBuffer& commandBuffer) {
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline->getPipeline());
-	m_debugInfo = {
-		.totalInstanceCount = 0,
-		.renderedInstanceCount = 0,
-		.materialSwitches = 0
-	};
+void Renderer3D::bindSharedState(const vk::raii::CommandBuffer &commandBuffer) const {
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, {m_frameUniforms.offset, m_fragFrameUniforms.offset, m_shadowMaps->getDataOffset()});
+	m_materialTable->bind(commandBuffer, m_pipeline->getLayout());
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {m_modelUniforms.offset});
+	VulkanEngine::getAssetManager()->getGeometryPool().bind(commandBuffer);
+}
+
+void Renderer3D::buildDrawList() {
+	m_debugInfo = {};
 
 	const Frustum cameraFrustum = ECS::getSystem<ControlledCameraSystem>()->getFrustum();
+	const auto& cameraData = ECS::getComponent<ControlledCamera>(m_camera);
+	// pixels covered by something one unit across, one unit in front of the camera
+	const float pixelsPerUnit = static_cast<float>(m_renderExtent.height) / (2.0f * std::tan(cameraData.fov * 0.5f));
+	const float maxLodError = LOD_PIXEL_ERROR * std::exp2(m_lodBias);
+	std::atomic<u32> smallFeatureCount = 0;
 
-	m_renderedEntities.clear();
-	i32 highlightedIndex = ECS::NULL_ENTITY;
-	i32 i = 0;
-	for (const auto& [material, entities] : m_sortedEntities) {
-		bool firstRendered = true;
-		for (const ECS::Entity entity : entities) {
-			++m_debugInfo.totalInstanceCount;
+	// build a key for every visible entity, spread across the thread pool
+	m_entityList.assign(m_entities.begin(), m_entities.end());
+	m_debugInfo.totalInstanceCount = static_cast<u32>(m_entityList.size());
+	m_drawQueue.clear();
+	VulkanEngine::getThreadPool()->parallelFor(static_cast<u32>(m_entityList.size()), 256, [&](const u32 begin, const u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			const ECS::Entity entity = m_entityList[i];
+			const OBB& obb = ECS::getComponent<BoundingVolume>(entity).obb;
+			if (!cameraFrustum.intersects(obb)) continue;
 
-			if (!cameraFrustum.intersects(ECS::getComponent<BoundingVolume>(entity).obb)) continue;
+			const auto& model = ECS::getComponent<Model3D>(entity);
+			const float distance = glm::distance(obb.center, cameraData.position);
+			// the OBB's bounding sphere projected to the screen, as big as it gets once the camera is inside it
+			const float radius = glm::length(obb.extent);
+			const float size = distance > radius ? 2.0f * radius / distance * pixelsPerUnit : std::numeric_limits<float>::max();
+			if (size < m_smallFeatureSize) {
+				++smallFeatureCount;
+				continue;
+			}
+			const u32 lod = model.mesh->selectLod(size, maxLodError);
+			m_entityLods[entity] = static_cast<u8>(lod);
+
+			const float depth = distance / cameraData.far;
+			// passes run in alpha mode order, so blended geometry is drawn over everything else - each level of
+			// detail sorts as its own mesh, so instances at the same level are batched together
+			const auto pass = static_cast<u32>(model.material->getAlphaMode());
+			const u32 geometry = model.mesh->getID() * Mesh<>::MAX_LODS + lod;
+			const u64 key = model.material->getAlphaMode() == AlphaMode::Blend
+				? DrawKey::makeBlended(pass, pass, model.material->getID(), geometry, depth)
+				: DrawKey::make(pass, pass, model.material->getID(), geometry, depth);
+			m_drawQueue.pushConcurrent(key, static_cast<u32>(entity));
+		}
+	});
+
+	const auto sortStart = std::chrono::high_resolution_clock::now();
+	m_drawQueue.sort();
+	m_debugInfo.smallFeatureCount = smallFeatureCount;
+	m_debugInfo.sortTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count();
 
-			m_renderedEntities.push_back(entity);
+	const auto items = m_drawQueue.getItems();
 
-			++m_debugInfo.renderedInstanceCount;
+	// the model set's dynamic range covers MAX_ENTITIES instances, so the whole range is reserved - there can't be more
+	// commands than instances
+	FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+	m_modelUniforms = frameAllocator->allocate<ModelUniforms>(ECS::MAX_ENTITIES);
+	// commands of each index type are written to a region of their own, so every pipeline's are contiguous
+	const u32 commandCapacity = std::max(1u, static_cast<u32>(items.size()));
+	m_drawCommands = frameAllocator->allocate<vk::DrawIndexedIndirectCommand>(commandCapacity * static_cast<u32>(INDEX_TYPES.size()));
+	if (m_meshletCullingActive) {
+		m_meshletCulling->begin();
+	}
 
-			auto& modelInfo = ECS::getComponent<Model3D>(entity);
-			auto& modelTransform = ECS::getComponent<Transform>(entity);
-			m_modelUniforms.setData(i, {modelTransform.transform, glm::mat4(glm::mat3(glm::inverseTranspose(modelTransform.transform)))});
+	// instance data is written in sorted order, so each batch below is a contiguous range
+	m_renderedEntities.resize(items.size());
+	VulkanEngine::getThreadPool()->parallelFor(static_cast<u32>(items.size()), 256, [&](const u32 begin, const u32 end) {
+		for (u32 i = begin; i < end; ++i) {
+			const auto entity = static_cast<ECS::Entity>(items[i].value);
+			const auto& model = ECS::getComponent<Model3D>(entity);
+			m_modelUniforms.data[i] = ModelUniforms::from(ECS::getComponent<Transform>(entity).transform * model.mesh->getDequantisation(), model.material->getID());
+			m_renderedEntities[i] = entity;
+		}
+	});
 
-			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {i * m_modelUniforms.getItemSize()});
+	// each run of items with the same mesh and pipeline becomes one instanced command - materials are per instance,
+	// so they don't split a run
+	m_highlightedIndex = ECS::NULL_ENTITY;
+	m_pipelineCommands = {};
+	m_culledCommands = {};
+	std::array<u32, INDEX_TYPES.size()> commandCounts = {};
+	for (u32 i = 0; i < INDEX_TYPES.size(); ++i) {
+		commandCounts[i] = i * commandCapacity;
+	}
+	u32 batchPipeline = 0;
+	u32 firstInstance = 0;
+	const Mesh<>* batchMesh = nullptr;
+	u32 batchLod = 0;
+	const auto flushBatch = [&](const u32 endInstance) {
+		if (batchMesh == nullptr) return;
+		const u32 instanceCount = endInstance - firstInstance;
+		m_debugInfo.lodInstanceCounts.at(batchLod) += instanceCount;
+		m_debugInfo.renderedTriangleCount += static_cast<u64>(batchMesh->getLod(batchLod).indexCount / 3) * instanceCount;
 
-			if (firstRendered) {
-				material->use(commandBuffer, m_pipeline->getLayout());
-				++m_debugInfo.materialSwitches;
-				firstRendered = false;
+		// each instance culled gets its own command, as each keeps different meshlets
+		const bool culled = m_meshletCullingActive
+			&& batchPipeline != static_cast<u32>(AlphaMode::Blend)
+			&& m_meshletCulling->canCull(*batchMesh, batchLod, instanceCount);
+		if (culled) {
+			for (u32 instance = firstInstance; instance < endInstance; ++instance) {
+				m_meshletCulling->addInstance(*batchMesh, batchLod, instance);
 			}
+			m_culledCommands.at(batchPipeline).second += instanceCount;
+			m_debugInfo.meshletInstanceCount += instanceCount;
+			return;
+		}
+		const auto indexType = static_cast<u32>(std::ranges::find(INDEX_TYPES, batchMesh->getIndexType()) - INDEX_TYPES.begin());
+		auto& [firstCommand, commandCount] = m_pipelineCommands.at(batchPipeline).at(indexType);
+		// items are sorted by pipeline, so its range starts at its first command
+		if (commandCount == 0) firstCommand = commandCounts[indexType];
+		m_drawCommands.data[commandCounts[indexType]++] = batchMesh->getDrawCommand(instanceCount, firstInstance, batchLod);
+		++commandCount;
+	};
 
-			modelInfo.mesh->draw(commandBuffer);
+	for (u32 i = 0; i < items.size(); ++i) {
+		const auto entity = static_cast<ECS::Entity>(items[i].value);
+		const auto& model = ECS::getComponent<Model3D>(entity);
+		const u32 pipeline = DrawKey::pipelineOf(items[i].key);
+		const u32 lod = m_entityLods[entity];
 
-			if (m_highlightedEntity == entity) highlightedIndex = i;
-			++i;
+		if (batchMesh != model.mesh || batchLod != lod || batchPipeline != pipeline) {
+			flushBatch(i);
+			if (m_meshletCullingActive && (batchMesh == nullptr || batchPipeline != pipeline)) {
+				m_culledCommands.at(pipeline).first = m_meshletCulling->getCommandCount();
+			}
+			batchPipeline = pipeline;
+			batchMesh = model.mesh;
+			batchLod = lod;
+			firstInstance = i;
 		}
+
+		if (m_highlightedEntity == entity) m_highlightedIndex = static_cast<i32>(i);
+	}
+	flushBatch(static_cast<u32>(items.size()));
+
+	m_debugInfo.renderedInstanceCount = static_cast<u32>(items.size());
+	m_debugInfo.uninstancedDrawCalls = m_debugInfo.renderedInstanceCount;
+	if (m_meshletCullingActive) {
+		m_debugInfo.meshletCount = m_meshletCulling->getMeshletCount();
+	}
+}
+
+void Renderer3D::drawDepthPrepass(const vk::raii::CommandBuffer &commandBuffer) {
+	const vk::RenderingAttachmentInfo depthAttachment = {
+		.imageView = m_renderGraph->getImageView(m_depthAttachment),
+		.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+		.loadOp = vk::AttachmentLoadOp::eClear,
+		.storeOp = vk::AttachmentStoreOp::eStore,
+		.clearValue = vk::ClearDepthStencilValue(1.0f, 0)
+	};
+	const vk::RenderingInfo renderingInfo = {
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = m_renderExtent
+		},
+		.layerCount = 1,
+		.pDepthAttachment = &depthAttachment
+	};
+	commandBuffer.beginRendering(renderingInfo);
+
+	// blended models don't write depth, so they are left out
+	const std::array pipelines = {m_depthPipeline.get(), m_depthMaskPipeline.get()};
+	const std::array meshPipelines = {m_meshDepthPipeline.get(), m_meshDepthMaskPipeline.get()};
+	for (u32 i = 0; i < pipelines.size(); ++i) {
+		if (getPipelineCommandCount(i) == 0) continue;
+		pipelines.at(i)->bind(commandBuffer);
+		m_debugInfo.drawCalls += drawPipelineCommands(commandBuffer, i, meshPipelines.at(i));
 	}
-	if (highlightedIndex != ECS::NULL_ENTITY) {
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_xrayPipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, nullptr);
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_xrayPipeline->getPipeline());
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_xrayPipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {highlightedIndex * m_modelUniforms.getItemSize()});
-		ECS::getComponent<Model3D>(m_highlightedEntity).mesh->draw(commandBuffer);
+
+	commandBuffer.endRendering();
+}
+
+u32 Renderer3D::drawModels(const vk::raii::CommandBuffer &commandBuffer, const AlphaMode alphaMode) const {
+	const auto pipeline = static_cast<u32>(alphaMode);
+	if (getPipelineCommandCount(pipeline) == 0) return 0;
+
+	const std::array pipelines = {m_pipeline.get(), m_maskPipeline.get(), m_blendPipeline.get()};
+	const std::array meshPipelines = {m_meshPipeline.get(), m_meshMaskPipeline.get(), static_cast<Pipeline*>(nullptr)};
+	pipelines.at(pipeline)->bind(commandBuffer);
+	// every material is reachable through the material table, so each pipeline needs a single indirect draw
+	return drawPipelineCommands(commandBuffer, pipeline, meshPipelines.at(pipeline));
+}
+
+void Renderer3D::drawGBuffer(const vk::raii::CommandBuffer &commandBuffer) {
+	// the lighting pass skips every pixel left at the far plane, so the G-buffer never needs clearing
+	const auto gBufferAttachment = [this](const RenderGraph::Handle image) {
+		return vk::RenderingAttachmentInfo {
+			.imageView = m_renderGraph->getImageView(image),
+			.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+			.loadOp = vk::AttachmentLoadOp::eDontCare,
+			.storeOp = vk::AttachmentStoreOp::eStore,
+		};
+	};
+	const std::array colourAttachments = {
+		gBufferAttachment(m_gBufferAlbedo),
+		gBufferAttachment(m_gBufferNormal),
+		gBufferAttachment(m_gBufferMaterial),
+	};
+	const vk::RenderingAttachmentInfo depthAttachment = {
+		.imageView = m_renderGraph->getImageView(m_depthAttachment),
+		.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+		.loadOp = m_depthPrepass ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear,
+		.storeOp = vk::AttachmentStoreOp::eStore,
+		.clearValue = vk::ClearDepthStencilValue(1.0f, 0)
+	};
+	const vk::RenderingInfo renderingInfo = {
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = m_renderExtent
+		},
+		.layerCount = 1,
+		.colorAttachmentCount = static_cast<u32>(colourAttachments.size()),
+		.pColorAttachments = colourAttachments.data(),
+		.pDepthAttachment = &depthAttachment
+	};
+	commandBuffer.beginRendering(renderingInfo);
+
+	// blended models can't be stored in the G-buffer, so they are drawn forward afterwards
+	const std::array pipelines = {m_gBufferPipeline.get(), m_gBufferMaskPipeline.get()};
+	const std::array meshPipelines = {m_meshGBufferPipeline.get(), m_meshGBufferMaskPipeline.get()};
+	for (u32 i = 0; i < pipelines.size(); ++i) {
+		if (getPipelineCommandCount(i) == 0) continue;
+		pipelines.at(i)->bind(commandBuffer);
+		m_debugInfo.drawCalls += drawPipelineCommands(commandBuffer, i, meshPipelines.at(i));
 	}
+
+	commandBuffer.endRendering();
+}
+
+void Renderer3D::drawDeferredLighting(const vk::raii::CommandBuffer &commandBuffer) const {
+	const vk::RenderingAttachmentInfo colourAttachment = {
+		.imageView = m_renderGraph->getImageView(m_sceneColour),
+		.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+		.loadOp = vk::AttachmentLoadOp::eClear,
+		.storeOp = vk::AttachmentStoreOp::eStore,
+		.clearValue = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 0.0f),
+	};
+	const vk::RenderingInfo renderingInfo = {
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = m_renderExtent
+		},
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &colourAttachment
+	};
+	commandBuffer.beginRendering(renderingInfo);
+
+	// the shared sets stay bound, as the lighting pipeline only adds the G-buffer set after them
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_deferredPipeline->getPipeline());
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_deferredPipeline->getLayout(), 3, {*m_gBufferDescriptor}, {});
+	commandBuffer.draw(3, 1, 0, 0);
+
+	commandBuffer.endRendering();
+}
+
+void Renderer3D::drawAfterOpaque(const vk::raii::CommandBuffer &commandBuffer) {
+	// the skybox only fills pixels left at the far plane, and blended models need it behind them
+	drawSkybox(commandBuffer);
+	m_debugInfo.drawCalls += drawModels(commandBuffer, AlphaMode::Blend);
+	drawHighlight(commandBuffer);
+
+	m_boundingVolumeRenderer->draw(commandBuffer);
+}
+
+void Renderer3D::drawOverlay(const vk::raii::CommandBuffer &commandBuffer) const {
+	const vk::RenderingAttachmentInfo colourAttachment = {
+		.imageView = m_renderGraph->getImageView(m_swapImage),
+		.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+		// the upscale writes every pixel
+		.loadOp = m_upscaleActive ? vk::AttachmentLoadOp::eDontCare : vk::AttachmentLoadOp::eLoad,
+		.storeOp = vk::AttachmentStoreOp::eStore,
+	};
+	const vk::RenderingInfo renderingInfo = {
+		.renderArea = {
+			.offset = {0, 0},
+			.extent = m_extent
+		},
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &colourAttachment
+	};
+	commandBuffer.beginRendering(renderingInfo);
+
+	if (m_upscaleActive) {
+		setViewport(commandBuffer, m_extent);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_upscalePipeline->getPipeline());
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_upscalePipeline->getLayout(), 0, {*m_upscaleDescriptor}, {m_upscaleParams.offset});
+		commandBuffer.draw(3, 1, 0, 0);
+	}
+	VulkanEngine::getDebugWindow()->draw(commandBuffer);
+
+	commandBuffer.endRendering();
+}
+
+void Renderer3D::drawHighlight(const vk::raii::CommandBuffer &commandBuffer) const {
+	if (m_highlightedIndex == ECS::NULL_ENTITY) return;
+
+	m_xrayPipeline->bind(commandBuffer);
+	ECS::getComponent<Model3D>(m_highlightedEntity).mesh->draw(commandBuffer, 1, static_cast<u32>(m_highlightedIndex));
+}
+
+u32 Renderer3D::drawPipelineCommands(const vk::raii::CommandBuffer &commandBuffer, const u32 pipeline, const Pipeline* meshPipeline) const {
+	// the index buffer is left bound as whatever was drawn last - anything drawn afterwards binds its own
+	const auto& pool = VulkanEngine::getAssetManager()->getGeometryPool();
+	u32 drawCalls = 0;
+	for (u32 i = 0; i < INDEX_TYPES.size(); ++i) {
+		const auto [firstCommand, commandCount] = m_pipelineCommands.at(pipeline).at(i);
+		if (commandCount == 0) continue;
+		pool.bind(commandBuffer, INDEX_TYPES[i]);
+		drawCalls += drawIndirect(commandBuffer, m_drawCommands, firstCommand, commandCount);
+	}
+
+	const auto [firstCulled, culledCount] = m_culledCommands.at(pipeline);
+	if (culledCount == 0) return drawCalls;
+	if (meshPipeline != nullptr) {
+		// the shared sets stay bound, as the layouts only differ after them
+		meshPipeline->bind(commandBuffer);
+		m_meshletCulling->drawMeshTasks(commandBuffer, *meshPipeline, culledCount);
+		return drawCalls + 1;
+	}
+	// culled instances index the compacted indexes in place of the pool's
+	m_meshletCulling->bindIndexBuffer(commandBuffer);
+	return drawCalls + drawIndirect(commandBuffer, m_meshletCulling->getCommands(), firstCulled, culledCount);
+}
+
+u32 Renderer3D::getPipelineCommandCount(const u32 pipeline) const {
+	u32 count = m_culledCommands.at(pipeline).second;
+	for (const auto& commands : m_pipelineCommands.at(pipeline)) {
+		count += commands.second;
+	}
+	return count;
+}
+
+u32 Renderer3D::drawIndirect(const vk::raii::CommandBuffer &commandBuffer, const FrameAllocation<vk::DrawIndexedIndirectCommand>& commands, const u32 firstCommand, const u32 commandCount) const {
+	constexpr u32 stride = sizeof(vk::DrawIndexedIndirectCommand);
+	if (m_multiDrawIndirect) {
+		commandBuffer.drawIndexedIndirect(commands.buffer, commands.offset + firstCommand * stride, commandCount, stride);
+		return 1;
+	}
+	// without the multiDrawIndirect feature, the draw count must be 0 or 1
+	for (u32 i = 0; i < commandCount; ++i) {
+		commandBuffer.drawIndexedIndirect(commands.buffer, commands.offset + (firstCommand + i) * stride, 1, stride);
+	}
+	return commandCount;
 }
 
 void Renderer3D::drawSkybox(const vk::raii::CommandBuffer &commandBuffer) {
+	// the fallback is only there to be sampled, and the clear colour stands in for it
 	if (m_skybox == nullptr) return;
 
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_skyboxPipeline->getPipeline());
-	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_skyboxPipeline->getLayout(), FRAME_SET_NUMBER, {m_skyboxDescriptor}, nullptr);
+	m_skyboxPipeline->bind(commandBuffer);
 	VulkanEngine::getAssetManager()->getUnitCube()->draw(commandBuffer);
 }
 
-void Renderer3D::endRender(const vk::raii::CommandBuffer& commandBuffer, const vk::Image& image) const {
-	commandBuffer.endRendering();
-	Image::changeLayout(commandBuffer, image, {vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR});
+void Renderer3D::bindSkybox(const Skybox& skybox) {
+	// fog is blended towards the skybox and ambient light comes from it in the model shader
+	skybox.addToSet(m_frameDescriptor, 2);
+	m_imageBasedLighting = std::make_unique<ImageBasedLighting>(skybox);
+	m_imageBasedLighting->addToSet(m_frameDescriptor, 8, 9, 10);
 }
 
 void Renderer3D::highlightEntity(ECS::Entity entity) {
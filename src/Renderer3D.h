@@ -2,46 +2,104 @@
 
 #include <vulkan/vulkan_raii.hpp>
 
+#include "AmbientOcclusion.h"
+#include "ClusteredLighting.h"
+#include "DrawQueue.h"
+#include "DynamicResolution.h"
 #include "ECS.h"
-#include "LightSystem.h"
+#include "FrameAllocator.h"
+#include "ImageBasedLighting.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "Mesh.h"
+#include "MeshletCulling.h"
 #include "Pipeline.h"
+#include "RenderGraph.h"
+#include "ShadowMaps.h"
 #include "UniformBufferBlock.h"
 #include "BoundingVolumeRenderer.h"
 #include "ModelSelector.h"
 #include "Skybox.h"
+#include "TemporalAntiAliasing.h"
 
 struct FrameUniforms {
     glm::mat4 view;
     glm::mat4 projection;
 };
 
-struct ModelUniforms {
-    glm::mat4 transform;
-    glm::mat4 normal;
+// per-object data, tightly packed into a storage buffer and indexed with gl_InstanceIndex
+// the normal matrix is derived from the transform in the vertex shader
+// the transform has the mesh's dequantisation folded in, taking positions straight from the geometry pool
+struct alignas(16) ModelUniforms {
+    // first three rows of the affine model matrix - the last row is always (0, 0, 0, 1)
+    glm::mat3x4 transform;
+    // index into the material table
+    u32 materialID;
+
+    static ModelUniforms from(const glm::mat4& transform, const u32 materialID = 0) {
+        return { glm::mat3x4(glm::transpose(transform)), materialID };
+    }
 };
 
 struct FragFrameData {
+    glm::mat4 view;
+    // reconstructs world positions from depth in the deferred lighting pass
+    glm::mat4 inverseViewProjection;
     glm::vec3 cameraPosition;
-    std::array<LightSystem::PointLightFragData, LightSystem::MAX_LIGHTS> lights;
-    u32 nLights;
-    float far, fog;
+    float far;
+    glm::vec2 screenSize;
+    // from ClusteredLighting::getSliceScaleBias
+    float clusterScale, clusterBias;
+    float fog;
+    // whether the shading passes should sample the screen space occlusion
+    u32 ambientOcclusionEnabled;
+};
+
+// matching upscale.frag
+struct UpscaleParams {
+    // fraction of the scene image that was rendered to
+    glm::vec2 renderScale;
+    // size of a texel of the scene image in UVs
+    glm::vec2 texelSize;
+    float sharpness;
 };
 
 struct RendererDebugInfo {
     u32 totalInstanceCount = 0;
     u32 renderedInstanceCount = 0;
-    u32 materialSwitches = 0;
+    u32 drawCalls = 0;
+    // number of draw calls that would have been issued with one draw per instance
+    u32 uninstancedDrawCalls = 0;
+    // time taken to sort the draw queue in milliseconds
+    double sortTime = 0.0;
+    // instances drawn at each level of detail
+    std::array<u32, Mesh<>::MAX_LODS> lodInstanceCounts = {};
+    u64 renderedTriangleCount = 0;
+    // instances skipped for covering too few pixels to be seen
+    u32 smallFeatureCount = 0;
+    // instances whose meshlets were culled on the GPU, and the meshlets tested
+    u32 meshletInstanceCount = 0;
+    u32 meshletCount = 0;
 };
 
 class Renderer3D final : public ECS::System {
 public:
     explicit Renderer3D(vk::Extent2D extent);
-    void render(const vk::raii::CommandBuffer &commandBuffer, const vk::Image &image, const vk::ImageView &imageView);
 
     void onEntityAdd(ECS::Entity entity) override;
     void onEntityRemove(ECS::Entity entity) override;
 
+    void render(const vk::raii::CommandBuffer &commandBuffer, const vk::Image &image, const vk::ImageView &imageView);
+
     const Pipeline* getPipeline() const;
+    const RenderGraph* getRenderGraph() const;
+    ClusteredLighting* getClusteredLighting() const;
+    ShadowMaps* getShadowMaps() const;
+    AmbientOcclusion* getAmbientOcclusion() const;
+    MeshletCulling* getMeshletCulling() const;
+    // only once a skybox has been set
+    ImageBasedLighting* getImageBasedLighting() const;
+    MaterialTable* getMaterialTable() const;
 
     void rebuild();
 
@@ -53,53 +111,215 @@ public:
     ECS::Entity getCamera() const;
 
     void setSampleCount(vk::SampleCountFlagBits samples);
+    // the sample count being rendered with - deferred shading and temporal anti-aliasing are always single sampled
     vk::SampleCountFlagBits getSampleCount() const;
 
+    // draw models as lines, without waiting for the device when pipelines can set it while recording
+    void setWireframe(bool enabled);
+    bool getWireframe() const;
+
+    // anti-alias by accumulating jittered frames instead of multisampling
+    void setTemporalAntiAliasing(bool enabled);
+    bool getTemporalAntiAliasing() const;
+
     void setSkybox(const std::shared_ptr<Skybox>& skybox);
 
+    // lay down depth before shading, so each pixel is only shaded once
+    void setDepthPrepass(bool enabled);
+    bool getDepthPrepass() const;
+
+    // write opaque and alpha masked models to a G-buffer and light them in one full screen pass, rather than shading
+    // every fragment as it is drawn - blended models are still shaded forward on top
+    void setDeferred(bool enabled);
+    bool getDeferred() const;
+
+    // render at a fraction of the output resolution picked to hold a GPU frame time, then scale up to the output
+    void setDynamicResolution(bool enabled);
+    bool getDynamicResolution() const;
+    DynamicResolution& getResolutionController();
+    // the resolution the scene was last rendered at
+    vk::Extent2D getRenderExtent() const;
+    // strength of the sharpening applied while scaling up, from 0 to 1
+    void setSharpness(float sharpness);
+    float getSharpness() const;
+
+    // levels of detail are picked to keep their error under a pixel - each step of bias doubles that
+    void setLodBias(float bias);
+    float getLodBias() const;
+    // models covering fewer pixels than this across are culled, or nothing is with 0
+    void setSmallFeatureSize(float size);
+    float getSmallFeatureSize() const;
+
     void highlightEntity(ECS::Entity entity);
     ECS::Entity getHighlightedEntity() const;
 
 private:
+    // screen space error in pixels levels of detail are picked to stay under, before the bias
+    static constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+    // G-buffer formats, matching gbuffer.frag - albedo with AO in alpha, octahedral normals, metallic and roughness
+    static constexpr vk::Format GBUFFER_ALBEDO_FORMAT = vk::Format::eR8G8B8A8Srgb;
+    static constexpr vk::Format GBUFFER_NORMAL_FORMAT = vk::Format::eR16G16Sfloat;
+    static constexpr vk::Format GBUFFER_MATERIAL_FORMAT = vk::Format::eR8G8Unorm;
+    // the pre-pass has already resolved visibility, so only the visible fragment is shaded
+    static constexpr vk::CompareOp PREPASS_COMPARE_OP = vk::CompareOp::eEqual;
+
     void createPipelines();
-    void createAttachments();
+    void createDeferredPipelines();
+    // change the state of existing pipelines to match the options, without building them again where the device allows
+    void updatePipelines();
+    vk::PolygonMode getPolygonMode() const;
+    // declare the frame's passes and the attachments between them
+    void createRenderGraph();
+    void writeGBufferDescriptor();
 
-    void beginRender(const vk::raii::CommandBuffer &commandBuffer, const vk::Image &image, const vk::ImageView &imageView) const;
+    void beginRender(const vk::raii::CommandBuffer &commandBuffer, vk::AttachmentLoadOp colourLoadOp, vk::AttachmentLoadOp depthLoadOp, vk::RenderingFlags flags = {}) const;
+    // reset and begin one of this frame's secondary command buffers, to be executed inside beginRender's rendering,
+    // with the shared state bound again as nothing carries over from the primary
+    const vk::raii::CommandBuffer& beginSecondary(u32 slot) const;
     void setDynamicParameters(const vk::raii::CommandBuffer &commandBuffer) const;
-    void setFrameUniforms(const vk::raii::CommandBuffer &commandBuffer);
-    void drawModels(const vk::raii::CommandBuffer &commandBuffer);
+    static void setViewport(const vk::raii::CommandBuffer &commandBuffer, vk::Extent2D extent);
+    void setFrameUniforms();
+    void bindSharedState(const vk::raii::CommandBuffer &commandBuffer) const;
+    // cull and sort the models, writing their instance data and draw commands
+    void buildDrawList();
+    void drawDepthPrepass(const vk::raii::CommandBuffer &commandBuffer);
+    // returns the draw calls made, so it can be recorded from other threads without touching m_debugInfo
+    u32 drawModels(const vk::raii::CommandBuffer &commandBuffer, AlphaMode alphaMode) const;
+    void drawGBuffer(const vk::raii::CommandBuffer &commandBuffer);
+    void drawDeferredLighting(const vk::raii::CommandBuffer &commandBuffer) const;
+    // the skybox, blended models and bounding volumes, drawn once opaque models are in the colour and depth attachments
+    void drawAfterOpaque(const vk::raii::CommandBuffer &commandBuffer);
+    // scale the scene up to the output if it was rendered smaller, then draw the UI over it
+    void drawOverlay(const vk::raii::CommandBuffer &commandBuffer) const;
+    void writeUpscaleDescriptor();
+    void drawHighlight(const vk::raii::CommandBuffer &commandBuffer) const;
+    // draw the commands of one of the alpha mode's pipelines, once it's bound - instances drawn whole, then the ones
+    // whose meshlets were culled, with meshPipeline if there is one for the alpha mode
+    u32 drawPipelineCommands(const vk::raii::CommandBuffer &commandBuffer, u32 pipeline, const Pipeline* meshPipeline) const;
+    u32 getPipelineCommandCount(u32 pipeline) const;
+    u32 drawIndirect(const vk::raii::CommandBuffer &commandBuffer, const FrameAllocation<vk::DrawIndexedIndirectCommand>& commands, u32 firstCommand, u32 commandCount) const;
     void drawSkybox(const vk::raii::CommandBuffer &commandBuffer);
-    void endRender(const vk::raii::CommandBuffer &commandBuffer, const vk::Image &image) const;
+    // point the frame set's sky and ambient lighting bindings at the skybox, generating its lighting
+    void bindSkybox(const Skybox& skybox);
 
+    // size of the output and every attachment
     vk::Extent2D m_extent;
+    // the region of the attachments rendered to this frame, smaller than m_extent with dynamic resolution
+    vk::Extent2D m_renderExtent;
 
+    // opaque, alpha masked and alpha blended models
     std::unique_ptr<Pipeline> m_pipeline = nullptr;
+    std::unique_ptr<Pipeline> m_maskPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_blendPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_depthPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_depthMaskPipeline = nullptr;
     std::unique_ptr<Pipeline> m_xrayPipeline = nullptr;
     std::unique_ptr<Pipeline> m_skyboxPipeline = nullptr;
+    // only created for deferred shading
+    std::unique_ptr<Pipeline> m_gBufferPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_gBufferMaskPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_deferredPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_upscalePipeline = nullptr;
+    // the opaque and masked pipelines again, drawing the instances whose meshlets are culled with task and mesh
+    // shaders - only created where the device has them, and the G-buffer's only for deferred shading
+    std::unique_ptr<Pipeline> m_meshPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_meshMaskPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_meshDepthPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_meshDepthMaskPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_meshGBufferPipeline = nullptr;
+    std::unique_ptr<Pipeline> m_meshGBufferMaskPipeline = nullptr;
 
-    std::unique_ptr<Image> m_colorImage;
-    std::unique_ptr<Image> m_depthImage;
+    std::unique_ptr<RenderGraph> m_renderGraph;
+    RenderGraph::Handle m_swapImage = 0;
+    // what the scene is shaded into - the swap image, or an image the final pass scales up or copies into it
+    RenderGraph::Handle m_sceneColour = 0;
+    // what the final pass samples - the scene colour, or its temporally anti-aliased result
+    RenderGraph::Handle m_upscaleSource = 0;
+    // only used with MSAA, resolving into the swap image
+    RenderGraph::Handle m_colourAttachment = 0;
+    RenderGraph::Handle m_depthAttachment = 0;
+    RenderGraph::Handle m_gBufferAlbedo = 0;
+    RenderGraph::Handle m_gBufferNormal = 0;
+    RenderGraph::Handle m_gBufferMaterial = 0;
 
     vk::SampleCountFlagBits m_samples = vk::SampleCountFlagBits::e4;
+    bool m_depthPrepass = true;
+    bool m_wireframe = false;
+    bool m_deferred = false;
+    bool m_dynamicResolutionEnabled = false;
+    bool m_temporalAntiAliasingEnabled = false;
+    // whether the scene is rendered to its own image and drawn into the swap image by the final pass
+    bool m_upscaleActive = false;
+    float m_sharpness = 0.5f;
+    float m_lodBias = 0.0f;
+    float m_smallFeatureSize = 1.0f;
+    DynamicResolution m_dynamicResolution;
+
+    // G-buffer attachments and depth for the deferred lighting pass, rewritten whenever the graph is
+    vk::raii::DescriptorSet m_gBufferDescriptor = nullptr;
+    vk::raii::Sampler m_gBufferSampler = nullptr;
+    // the scene image and upscale parameters, rewritten whenever the graph is
+    vk::raii::DescriptorSet m_upscaleDescriptor = nullptr;
+    vk::raii::Sampler m_upscaleSampler = nullptr;
 
     ECS::Entity m_camera;
 
+    // black, and bound until a skybox is set, so the frame set never has its sky and ambient lighting unwritten
+    std::unique_ptr<Skybox> m_fallbackSkybox;
     std::shared_ptr<Skybox> m_skybox;
-    vk::raii::DescriptorSet m_skyboxDescriptor = nullptr;
+    std::unique_ptr<ImageBasedLighting> m_imageBasedLighting;
 
+    // point at the frame allocator, with this frame's allocations given as dynamic offsets
     vk::raii::DescriptorSet m_frameDescriptor = nullptr;
     vk::raii::DescriptorSet m_modelDescriptor = nullptr;
 
-    UniformBufferBlock<FrameUniforms> m_frameUniforms;
-    DynamicUniformBufferBlock<ModelUniforms> m_modelUniforms;
-    UniformBufferBlock<FragFrameData> m_fragFrameUniforms;
+    // this frame's allocations from the frame allocator
+    FrameAllocation<FrameUniforms> m_frameUniforms;
+    FrameAllocation<FragFrameData> m_fragFrameUniforms;
+    FrameAllocation<UpscaleParams> m_upscaleParams;
+    FrameAllocation<ModelUniforms> m_modelUniforms;
+    FrameAllocation<vk::DrawIndexedIndirectCommand> m_drawCommands;
+
+    std::unique_ptr<MaterialTable> m_materialTable;
+    std::unique_ptr<ClusteredLighting> m_clusteredLighting;
+    std::unique_ptr<ShadowMaps> m_shadowMaps;
+    std::unique_ptr<AmbientOcclusion> m_ambientOcclusion;
+    std::unique_ptr<TemporalAntiAliasing> m_temporalAntiAliasing;
+    std::unique_ptr<MeshletCulling> m_meshletCulling;
+    // occlusion needs depth before shading, so forward shading only has it with a depth pre-pass
+    bool m_ambientOcclusionActive = false;
+    bool m_meshletCullingActive = false;
+    bool m_multiDrawIndirect;
 
     std::unique_ptr<BoundingVolumeRenderer> m_boundingVolumeRenderer;
     std::unique_ptr<ModelSelector> m_modelSelector;
 
     RendererDebugInfo m_debugInfo;
 
-    std::unordered_map<Material*, std::vector<ECS::Entity>> m_sortedEntities;
+    // the opaque and masked models are each recorded on their own thread, and what is drawn after them on this one
+    static constexpr u32 SECONDARY_COUNT = 3;
+    // each secondary command buffer has its own pool, as a pool can only be recorded into from one thread at a time
+    struct SecondaryCommands {
+        vk::raii::CommandPool pool = nullptr;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+    };
+    // SECONDARY_COUNT for each frame in flight
+    std::vector<SecondaryCommands> m_secondaryCommands;
+
+    // m_entities copied into a vector each frame, so it can be split between threads
+    std::vector<ECS::Entity> m_entityList;
+    // level of detail picked for each entity this frame, indexed by entity
+    std::vector<u8> m_entityLods;
+    DrawQueue m_drawQueue;
+    // the geometry pool's index buffer is bound as each in turn, so commands are split by the index type of their mesh
+    static constexpr std::array INDEX_TYPES = {vk::IndexType::eUint32, vk::IndexType::eUint16};
+    // [first command, command count] for each alpha mode's pipeline and each of INDEX_TYPES
+    std::array<std::array<std::pair<u32, u32>, INDEX_TYPES.size()>, 3> m_pipelineCommands = {};
+    // the same for the meshlet culling's commands - blended instances are never culled, as the order
+    // meshlets are kept in changes from frame to frame and would change how they blend
+    std::array<std::pair<u32, u32>, 3> m_culledCommands = {};
+    i32 m_highlightedIndex = ECS::NULL_ENTITY;
     std::vector<ECS::Entity> m_renderedEntities;
 
     ECS::Entity m_highlightedEntity = -1;
@@ -0,0 +1,300 @@
+#include "ShaderReloader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#ifdef SHADER_HOT_RELOAD
+#include <shaderc/shaderc.hpp>
+#endif
+
+#include "PipelineCache.h"
+#include "VulkanEngine.h"
+
+namespace {
+    constexpr std::array STAGE_EXTENSIONS = {".vert", ".frag", ".comp", ".task", ".mesh"};
+    // shared code, pulled into stages with #include
+    constexpr auto INCLUDE_EXTENSION = ".glsl";
+
+#ifdef SHADER_HOT_RELOAD
+    // resolves #include against the source directory, as glslc does for the shaders embedded at build time
+    class FileIncluder : public shaderc::CompileOptions::IncluderInterface {
+    public:
+        explicit FileIncluder(std::filesystem::path directory) : m_directory(std::move(directory)) {}
+
+        shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type, const char*, size_t) override {
+            auto* include = new Include;
+            const std::filesystem::path path = m_directory / requestedSource;
+            if (std::ifstream file(path); file.is_open()) {
+                include->name = path.string();
+                include->content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+            else {
+                // an empty name tells shaderc the include failed, with the content as the reason
+                include->content = std::format("Cannot open {}", path.string());
+            }
+            include->result = {
+                .source_name = include->name.data(),
+                .source_name_length = include->name.size(),
+                .content = include->content.data(),
+                .content_length = include->content.size(),
+                .user_data = include
+            };
+            return &include->result;
+        }
+
+        void ReleaseInclude(shaderc_include_result* data) override {
+            delete static_cast<Include*>(data->user_data);
+        }
+
+    private:
+        struct Include {
+            std::string name;
+            std::string content;
+            shaderc_include_result result;
+        };
+
+        std::filesystem::path m_directory;
+    };
+#endif
+}
+
+ShaderReloader::ShaderReloader(std::filesystem::path sourceDirectory)
+    : m_sourceDirectory(std::move(sourceDirectory))
+{
+    Logger::info("Watching '{}' for shader changes", m_sourceDirectory.string());
+    m_worker = std::thread(&ShaderReloader::workerLoop, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+    {
+        std::scoped_lock lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_all();
+    m_worker.join();
+}
+
+void ShaderReloader::addPipeline(Pipeline* pipeline) {
+    m_pipelines.insert(pipeline);
+}
+
+void ShaderReloader::removePipeline(Pipeline* pipeline) {
+    m_pipelines.erase(pipeline);
+    m_replacedShaderModules.erase(pipeline);
+
+    std::unique_lock lock(m_mutex);
+    std::erase_if(m_builds, [pipeline](const Build& build) { return build.pipeline == pipeline; });
+    // the worker reads the pipeline's layout while building it
+    m_buildCondition.wait(lock, [this, pipeline] { return m_building != pipeline; });
+    std::erase_if(m_finishedBuilds, [pipeline](const FinishedBuild& build) { return build.pipeline == pipeline; });
+}
+
+void ShaderReloader::update() {
+    ++m_frame;
+    // the fence of every frame recorded FRAMES_IN_FLIGHT or more frames ago has been waited on, so nothing retired
+    // before those frames is still in use
+    while (!m_retiredPipelines.empty() && m_retiredPipelines.front().frame + FRAMES_IN_FLIGHT <= m_frame) {
+        m_retiredPipelines.pop_front();
+    }
+
+    std::vector<CompiledShader> compiledShaders;
+    std::vector<FinishedBuild> finishedBuilds;
+    std::vector<std::string> errors;
+    {
+        std::scoped_lock lock(m_mutex);
+        std::swap(compiledShaders, m_compiledShaders);
+        std::swap(finishedBuilds, m_finishedBuilds);
+        std::swap(errors, m_errors);
+    }
+    for (const std::string& error : errors) {
+        Logger::warn(error);
+    }
+
+    // a pipeline using more than one changed shader is only built again once
+    std::unordered_set<Pipeline*> changedPipelines;
+    for (const auto& [name, code] : compiledShaders) {
+        const std::string path = std::format("shaders/{}.spv", name);
+        const auto replaced = std::make_shared<vk::raii::ShaderModule>(VulkanEngine::getPipelineCache()->replaceShaderModule(path, code));
+
+        u32 pipelineCount = 0;
+        for (Pipeline* pipeline : m_pipelines) {
+            if (pipeline->getBuilder().usesShader(path)) {
+                changedPipelines.insert(pipeline);
+                m_replacedShaderModules[pipeline].push_back(replaced);
+                ++pipelineCount;
+            }
+        }
+        Logger::info("Reloaded {}, rebuilding {} pipelines", name, pipelineCount);
+    }
+    for (Pipeline* pipeline : changedPipelines) {
+        queueBuild(pipeline);
+    }
+
+    // builds of removed pipelines are discarded as they're removed, so every pipeline here is still alive
+    for (auto& [pipeline, version, replacement] : finishedBuilds) {
+        // its state was changed by rebuilding it while this was being built, so the replacement has the old state
+        if (pipeline->getVersion() != version) {
+            queueBuild(pipeline);
+            continue;
+        }
+        Pipeline::Replacement retired = pipeline->replace(std::move(replacement));
+        m_retiredPipelines.push_back({m_frame, std::move(retired), releaseShaderModules(pipeline)});
+    }
+}
+
+std::vector<ShaderReloader::SharedShaderModule> ShaderReloader::releaseShaderModules(Pipeline* pipeline) {
+    std::vector<SharedShaderModule> released;
+    const auto it = m_replacedShaderModules.find(pipeline);
+    if (it == m_replacedShaderModules.end()) return released;
+
+    // a module the replacement was built from, superseded while it was being built, is still used
+    std::vector<SharedShaderModule>& shaderModules = it->second;
+    const auto unused = std::ranges::partition(shaderModules, [pipeline](const SharedShaderModule& shaderModule) {
+        return pipeline->getBuilder().usesShaderModule(**shaderModule);
+    });
+    released.assign(std::make_move_iterator(unused.begin()), std::make_move_iterator(unused.end()));
+    shaderModules.erase(unused.begin(), unused.end());
+    if (shaderModules.empty()) {
+        m_replacedShaderModules.erase(it);
+    }
+    return released;
+}
+
+void ShaderReloader::workerLoop() {
+    std::unique_lock lock(m_mutex);
+    while (!m_stopping) {
+        // builds come first, as the shaders they are for have already been compiled
+        if (!m_builds.empty()) {
+            Build build = std::move(m_builds.front());
+            m_builds.pop_front();
+            m_building = build.pipeline;
+            lock.unlock();
+
+            std::optional<Pipeline::Replacement> replacement;
+            std::string error;
+            try {
+                replacement = build.pipeline->buildReplacement(build.builder, build.libraries);
+            }
+            catch (const vk::SystemError& e) {
+                error = e.what();
+            }
+
+            lock.lock();
+            if (replacement) {
+                m_finishedBuilds.push_back({build.pipeline, build.version, std::move(*replacement)});
+            }
+            else {
+                m_errors.push_back(std::format("Failed to rebuild pipeline: {}", error));
+            }
+            m_building = nullptr;
+            m_buildCondition.notify_all();
+            continue;
+        }
+
+        lock.unlock();
+        for (const std::string& name : findChangedShaders()) {
+            std::string error;
+            std::optional<std::vector<u32>> code = compile(name, error);
+
+            lock.lock();
+            if (code) {
+                m_compiledShaders.push_back({name, std::move(*code)});
+            }
+            else {
+                m_errors.push_back(std::format("Failed to compile {}, keeping the last version:\n{}", name, error));
+            }
+            lock.unlock();
+        }
+
+        lock.lock();
+        m_wakeCondition.wait_for(lock, POLL_INTERVAL, [this] { return m_stopping || !m_builds.empty(); });
+    }
+}
+
+std::vector<std::string> ShaderReloader::findChangedShaders() {
+    std::vector<std::string> stages;
+    std::vector<std::string> changedStages;
+    bool includeChanged = false;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(m_sourceDirectory, error)) {
+        if (!entry.is_regular_file()) continue;
+        const auto writeTime = entry.last_write_time(error);
+        if (error) continue;
+
+        const std::string name = entry.path().filename().string();
+        const std::string extension = entry.path().extension().string();
+        const bool include = extension == INCLUDE_EXTENSION;
+        if (!include && std::ranges::find(STAGE_EXTENSIONS, extension) == STAGE_EXTENSIONS.end()) continue;
+        if (!include) {
+            stages.push_back(name);
+        }
+
+        // the first check only records the times, as the embedded shaders were compiled from those sources
+        const auto [it, added] = m_writeTimes.try_emplace(name, writeTime);
+        if (added || it->second == writeTime) continue;
+        it->second = writeTime;
+
+        if (include) {
+            includeChanged = true;
+        }
+        else {
+            changedStages.push_back(name);
+        }
+    }
+
+    // shared code is pulled in with #include, so every shader is compiled again when any of it changes
+    return includeChanged ? stages : changedStages;
+}
+
+std::optional<std::vector<u32>> ShaderReloader::compile(const std::string& name, std::string& error) const {
+#ifdef SHADER_HOT_RELOAD
+    static const std::unordered_map<std::string, shaderc_shader_kind> shaderKinds = {
+        {".vert", shaderc_vertex_shader},
+        {".frag", shaderc_fragment_shader},
+        {".comp", shaderc_compute_shader},
+        {".task", shaderc_task_shader},
+        {".mesh", shaderc_mesh_shader},
+    };
+    const std::filesystem::path path = m_sourceDirectory / name;
+    const auto kind = shaderKinds.find(path.extension().string());
+    if (kind == shaderKinds.end()) {
+        error = "Unrecognised shader stage";
+        return std::nullopt;
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        error = "Failed to open file";
+        return std::nullopt;
+    }
+    const std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // the same options glslc compiles the embedded shaders with
+    shaderc::CompileOptions options;
+    options.SetIncluder(std::make_unique<FileIncluder>(m_sourceDirectory));
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+    const shaderc::Compiler compiler;
+    const shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind->second, path.string().c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+        error = result.GetErrorMessage();
+        return std::nullopt;
+    }
+    return std::vector<u32>(result.cbegin(), result.cend());
+#else
+    error = "Built without shaderc";
+    return std::nullopt;
+#endif
+}
+
+void ShaderReloader::queueBuild(Pipeline* pipeline) {
+    Pipeline::Builder builder = pipeline->getBuilder();
+    builder.reloadShaders();
+
+    std::scoped_lock lock(m_mutex);
+    // a build still waiting to start is superseded
+    std::erase_if(m_builds, [pipeline](const Build& build) { return build.pipeline == pipeline; });
+    m_builds.push_back({pipeline, pipeline->getVersion(), std::move(builder), pipeline->hasLibraries()});
+    m_wakeCondition.notify_one();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Common.h"
+#include "Pipeline.h"
+
+// recompiles shaders in the source directory as they are saved, and builds the pipelines using them again, both on a
+// worker thread so the render thread never waits on either - rebuilt pipelines are swapped in between frames, and what
+// they replaced is destroyed once every frame that could be using it has finished
+//
+// only the SPIR-V is replaced, so changing a shader's descriptor bindings or vertex inputs still needs a restart
+class ShaderReloader {
+public:
+    // sources are checked for changes this often
+    static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+    explicit ShaderReloader(std::filesystem::path sourceDirectory);
+    ~ShaderReloader();
+
+    ShaderReloader(const ShaderReloader&) = delete;
+    ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+    // called by Pipeline as pipelines are created and destroyed - removing one waits for a build of it to finish
+    void addPipeline(Pipeline* pipeline);
+    void removePipeline(Pipeline* pipeline);
+
+    // once per frame, after waiting for the frame's fence and before recording it - swaps in reloaded shaders and
+    // pipelines, and destroys retired pipelines along with the shader modules they were the last to use
+    void update();
+
+private:
+    struct CompiledShader {
+        // the source's file name, e.g. model.frag
+        std::string name;
+        std::vector<u32> code;
+    };
+
+    struct Build {
+        Pipeline* pipeline;
+        u32 version;
+        Pipeline::Builder builder;
+        bool libraries;
+    };
+
+    struct FinishedBuild {
+        Pipeline* pipeline;
+        u32 version;
+        Pipeline::Replacement replacement;
+    };
+
+    using SharedShaderModule = std::shared_ptr<vk::raii::ShaderModule>;
+
+    struct RetiredPipeline {
+        u64 frame;
+        Pipeline::Replacement replacement;
+        // replaced modules the pipeline's builder stopped using with this replacement
+        std::vector<SharedShaderModule> shaderModules;
+    };
+
+    void workerLoop();
+    // compare the sources' write times against the last check, returning the shaders that need compiling
+    std::vector<std::string> findChangedShaders();
+    // nullopt, with the reason in error, if the shader fails to compile
+    std::optional<std::vector<u32>> compile(const std::string& name, std::string& error) const;
+    // copy the pipeline's builder with the current shader modules, to be built on the worker
+    void queueBuild(Pipeline* pipeline);
+    // take the replaced modules the pipeline's builder no longer uses, after swapping in a replacement
+    std::vector<SharedShaderModule> releaseShaderModules(Pipeline* pipeline);
+
+    std::filesystem::path m_sourceDirectory;
+    // only used by the worker
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_writeTimes;
+
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_buildCondition;
+    bool m_stopping = false;
+    // the worker's queue and results, guarded by m_mutex
+    std::deque<Build> m_builds;
+    // the pipeline being built on the worker, which can't be destroyed until it finishes
+    Pipeline* m_building = nullptr;
+    std::vector<CompiledShader> m_compiledShaders;
+    std::vector<FinishedBuild> m_finishedBuilds;
+    std::vector<std::string> m_errors;
+
+    // only used by the render thread
+    std::unordered_set<Pipeline*> m_pipelines;
+    std::deque<RetiredPipeline> m_retiredPipelines;
+    // replaced modules each pipeline's builder may still be using, shared by every pipeline built from them - they're
+    // retired along with the pipeline once it has been rebuilt without them
+    std::unordered_map<Pipeline*, std::vector<SharedShaderModule>> m_replacedShaderModules;
+    u64 m_frame = 0;
+};
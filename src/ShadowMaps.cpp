@@ -0,0 +1,580 @@
+#include "ShadowMaps.h"
+
+#include <algorithm>
+#include <bit>
+#include <ranges>
+#include <tuple>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "AssetManager.h"
+#include "Components.h"
+#include "Renderer3D.h"
+#include "VulkanEngine.h"
+
+namespace {
+    // near plane of every face - anything closer to the light than this doesn't cast a shadow
+    constexpr float SHADOW_NEAR = 0.05f;
+
+    // +x, -x, +y, -y, +z, -z, matching the face picked from the major axis in lighting.glsl
+    constexpr std::array<std::pair<glm::vec3, glm::vec3>, ShadowMaps::FACE_COUNT> FACE_DIRECTIONS = {{
+        {{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+        {{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+        {{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+        {{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+        {{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}},
+        {{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}},
+    }};
+}
+
+AtlasAllocator::AtlasAllocator(const u32 size, const u32 minTileSize)
+    : m_size(size)
+    , m_freeTiles(std::countr_zero(size / minTileSize) + 1)
+{
+    assert(std::has_single_bit(size) && std::has_single_bit(minTileSize));
+    m_freeTiles.at(0).emplace_back(0, 0);
+}
+
+std::optional<glm::uvec2> AtlasAllocator::allocate(const u32 size) {
+    assert(std::has_single_bit(size) && size <= m_size);
+    const u32 level = getLevel(size);
+    if (level >= m_freeTiles.size()) return std::nullopt;
+
+    // take the smallest free tile that fits
+    i32 from = static_cast<i32>(level);
+    while (from >= 0 && m_freeTiles.at(from).empty()) --from;
+    if (from < 0) return std::nullopt;
+
+    const glm::uvec2 tile = m_freeTiles.at(from).back();
+    m_freeTiles.at(from).pop_back();
+
+    // split it down to the requested size, keeping the top left quarter each time
+    for (u32 i = from + 1; i <= level; ++i) {
+        const u32 half = m_size >> i;
+        m_freeTiles.at(i).push_back(tile + glm::uvec2(half, 0));
+        m_freeTiles.at(i).push_back(tile + glm::uvec2(0, half));
+        m_freeTiles.at(i).push_back(tile + glm::uvec2(half, half));
+    }
+    return tile;
+}
+
+void AtlasAllocator::free(glm::uvec2 offset, const u32 size) {
+    u32 level = getLevel(size);
+
+    // merge with the other three quarters of the parent tile for as long as they are all free
+    while (level > 0) {
+        const u32 parentSize = m_size >> (level - 1);
+        const glm::uvec2 parent = offset / parentSize * parentSize;
+        const auto isSibling = [&](const glm::uvec2 tile) {
+            return tile / parentSize * parentSize == parent;
+        };
+
+        auto& tiles = m_freeTiles.at(level);
+        if (std::ranges::count_if(tiles, isSibling) < 3) break;
+        std::erase_if(tiles, isSibling);
+        offset = parent;
+        --level;
+    }
+    m_freeTiles.at(level).push_back(offset);
+}
+
+u32 AtlasAllocator::getLevel(const u32 size) const {
+    return std::countr_zero(m_size / size);
+}
+
+ShadowMaps::ShadowMaps()
+    : m_allocator(ATLAS_SIZE, MIN_TILE_SIZE)
+    , m_multiDrawIndirect(VulkanEngine::getPhysicalDevice().getFeatures().multiDrawIndirect)
+    , m_casters(ECS::MAX_ENTITIES)
+{
+    const auto createAtlas = [](const vk::ImageUsageFlags usage) {
+        return std::make_unique<Image>(ImageCreateInfo {
+            .width = ATLAS_SIZE,
+            .height = ATLAS_SIZE,
+            .format = VulkanEngine::getDepthFormat(),
+            .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | usage,
+            .aspect = vk::ImageAspectFlagBits::eDepth,
+        });
+    };
+    m_cacheAtlas = createAtlas(vk::ImageUsageFlagBits::eTransferSrc);
+    m_atlas = createAtlas(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+
+    // the graph leaves the atlases in these layouts between frames - every tile is cleared or copied before it's read,
+    // so the contents don't matter yet
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    m_cacheAtlas->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+    });
+    m_atlas->changeLayout(commandBuffer, {
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    });
+    VulkanEngine::endSingleCommand(commandBuffer);
+
+    // compare sampler, filtered for 2x2 PCF where the depth format supports it
+    const bool linear = static_cast<bool>(VulkanEngine::getPhysicalDevice().getFormatProperties(VulkanEngine::getDepthFormat()).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+    const vk::Filter filter = linear ? vk::Filter::eLinear : vk::Filter::eNearest;
+    const vk::SamplerCreateInfo samplerInfo = {
+        .magFilter = filter,
+        .minFilter = filter,
+        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+        .mipLodBias = 0.0f,
+        .anisotropyEnable = vk::False,
+        .maxAnisotropy = 1.0f,
+        .compareEnable = vk::True,
+        .compareOp = vk::CompareOp::eLessOrEqual,
+        .minLod = 0.0f,
+        .maxLod = 0.0f,
+        .unnormalizedCoordinates = vk::False
+    };
+    m_sampler = vk::raii::Sampler(VulkanEngine::getDevice(), samplerInfo);
+
+    // position only, with each face's matrices in place of the camera's
+    m_pipeline = Pipeline::Builder()
+        .addShaderStage("shaders/depth.vert.spv")
+        .setVertexInfo(PackedVertex::getBindingDescription(), PackedVertex::getAttributeDescriptions())
+        .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eVertex) // face view / projection
+        .addBinding(2, 0, vk::DescriptorType::eStorageBufferDynamic, vk::ShaderStageFlagBits::eVertex) // model data
+        .setDepthBias(1.25f, 1.75f)
+        .create();
+
+    m_frameDescriptor = m_pipeline->createDescriptorSet(FRAME_SET_NUMBER);
+    m_modelDescriptor = m_pipeline->createDescriptorSet(MODEL_SET_NUMBER);
+    const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    frameAllocator->addToSet(m_frameDescriptor, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(FrameUniforms));
+    frameAllocator->addToSet(m_modelDescriptor, 0, vk::DescriptorType::eStorageBufferDynamic, sizeof(ModelUniforms) * ECS::MAX_ENTITIES);
+}
+
+void ShadowMaps::onCasterAdd(const ECS::Entity entity) {
+    // baked on the next update, once its bounding volume exists
+    m_casters.at(entity) = {};
+}
+
+void ShadowMaps::onCasterRemove(const ECS::Entity entity) {
+    CasterState& caster = m_casters.at(entity);
+    // moving casters aren't in the cache, and the faces they were drawn into are recopied anyway
+    if (caster.known && !caster.dynamic) {
+        invalidate(caster.bakedBounds);
+    }
+    caster = {};
+}
+
+void ShadowMaps::update(const std::vector<ECS::Entity> &casters, const Frustum &cameraFrustum, const ControlledCamera &camera, const u32 screenHeight) {
+    m_debugInfo = {};
+    trackCasters(casters);
+
+    // lights reaching into the view, largest on screen first
+    const LightSystem* lightSystem = ECS::getSystem<LightSystem>();
+    const auto& lights = lightSystem->getLights();
+    const auto& lightEntities = lightSystem->getLightEntities();
+    const float projectionScale = 1.0f / std::tan(camera.fov * 0.5f);
+    std::vector<std::pair<float, u32>> candidates;
+    for (u32 i = 0; i < lights.size(); ++i) {
+        if (lights[i].range <= SHADOW_NEAR) continue;
+        if (!cameraFrustum.intersects(Sphere{lights[i].position, lights[i].range})) continue;
+
+        // fraction of the screen height the light's range covers, which is all of it once the camera is inside
+        const float distance = glm::distance(lights[i].position, camera.position);
+        const float coverage = distance <= lights[i].range ? 1.0f : std::min(1.0f, lights[i].range / distance * projectionScale);
+        candidates.emplace_back(coverage, i);
+    }
+    const auto shadowedCount = std::min(static_cast<u32>(candidates.size()), MAX_SHADOWED_LIGHTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + shadowedCount, candidates.end(), std::greater());
+    candidates.resize(shadowedCount);
+
+    std::vector<bool> selected(ECS::MAX_ENTITIES);
+    for (const u32 index : candidates | std::views::values) {
+        selected[lightEntities[index]] = true;
+    }
+    std::erase_if(m_lights, [&](const auto& entry) {
+        if (selected[entry.first]) return false;
+        freeTiles(entry.second);
+        return true;
+    });
+
+    const auto getTileSize = [&](const float coverage) {
+        const auto pixels = static_cast<u32>(coverage * static_cast<float>(screenHeight));
+        return std::clamp(std::bit_ceil(std::max(pixels, 1u)), MIN_TILE_SIZE, MAX_TILE_SIZE);
+    };
+    // shrink first, so the space is there for lights growing or appearing - a light only shrinks once it wants a
+    // quarter of its size, so it doesn't flicker between sizes
+    for (const auto [coverage, index] : candidates) {
+        const auto it = m_lights.find(lightEntities[index]);
+        if (it == m_lights.end()) continue;
+        const u32 tileSize = getTileSize(coverage);
+        if (tileSize * 4 > it->second.tileSize) continue;
+        freeTiles(it->second);
+        allocateTiles(it->second, tileSize);
+    }
+    for (const auto [coverage, index] : candidates) {
+        const u32 tileSize = getTileSize(coverage);
+        const auto it = m_lights.find(lightEntities[index]);
+        if (it == m_lights.end()) {
+            ShadowedLight light;
+            if (allocateTiles(light, tileSize)) {
+                m_lights.emplace(lightEntities[index], light);
+            }
+        }
+        else if (tileSize > it->second.tileSize) {
+            // the old tiles are free again, so this can't do worse than the current size
+            const u32 oldSize = it->second.tileSize;
+            freeTiles(it->second);
+            if (!allocateTiles(it->second, tileSize)) {
+                allocateTiles(it->second, oldSize);
+            }
+        }
+    }
+
+    // instance data for every caster, indexed by its position in the caster list
+    FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    const auto models = frameAllocator->allocate<ModelUniforms>(ECS::MAX_ENTITIES);
+    m_modelOffset = models.offset;
+    std::vector<u32> staticCasters;
+    std::vector<u32> dynamicCasters;
+    for (u32 i = 0; i < casters.size(); ++i) {
+        const auto& model = ECS::getComponent<Model3D>(casters[i]);
+        // blended surfaces don't write depth, and masked ones are drawn solid
+        if (model.material->getAlphaMode() == AlphaMode::Blend) continue;
+        models.data[i] = ModelUniforms::from(ECS::getComponent<Transform>(casters[i]).transform * model.mesh->getDequantisation(), model.material->getID());
+        (m_casters[casters[i]].dynamic ? dynamicCasters : staticCasters).push_back(i);
+    }
+
+    if (lights.size() > m_lightCapacity) {
+        reserveLights(std::max(m_lightCapacity * 2, static_cast<u32>(lights.size())));
+    }
+    const FrameAllocation<u8> data = frameAllocator->allocate<u8>(static_cast<u32>(getDataSize()));
+    m_data = {
+        .buffer = data.buffer,
+        .offset = data.offset,
+        .data = reinterpret_cast<ShadowData*>(data.data),
+        .count = 1,
+    };
+    m_lightFaces = std::span(reinterpret_cast<i32*>(data.data + sizeof(ShadowData)), lights.size());
+    std::ranges::fill(m_lightFaces, -1);
+    m_cacheDraws.clear();
+    m_dynamicDraws.clear();
+    m_copies.clear();
+    m_commandList.clear();
+
+    // one command per caster in the face's frustum, each drawing its own instance - split by the index type of the
+    // caster's mesh, so each type is drawn with the pool bound as it
+    const auto cullCasters = [&](const std::vector<u32>& instances, const Frustum& frustum) {
+        const auto firstCommand = static_cast<u32>(m_commandList.size());
+        m_shortCommandList.clear();
+        for (const u32 instance : instances) {
+            if (!frustum.intersects(ECS::getComponent<BoundingVolume>(casters[instance]).obb)) continue;
+            const Mesh<>* mesh = ECS::getComponent<Model3D>(casters[instance]).mesh;
+            (mesh->getIndexType() == vk::IndexType::eUint16 ? m_shortCommandList : m_commandList).push_back(mesh->getDrawCommand(1, instance));
+        }
+        m_commandList.insert(m_commandList.end(), m_shortCommandList.begin(), m_shortCommandList.end());
+        return std::tuple(firstCommand, static_cast<u32>(m_commandList.size()) - firstCommand, static_cast<u32>(m_shortCommandList.size()));
+    };
+
+    u32 firstFace = 0;
+    for (const u32 index : candidates | std::views::values) {
+        const auto it = m_lights.find(lightEntities[index]);
+        if (it == m_lights.end() || it->second.tileSize == 0) continue;
+        ShadowedLight& light = it->second;
+
+        if (!light.built || light.position != lights[index].position || light.range != lights[index].range) {
+            light.built = true;
+            light.position = lights[index].position;
+            light.range = lights[index].range;
+            light.cached = {};
+
+            // matches the camera's projection, so the faces wind the same way as the camera
+            glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR, light.range);
+            projection[1][1] *= -1.0f;
+            for (u32 face = 0; face < FACE_COUNT; ++face) {
+                const auto& [direction, up] = FACE_DIRECTIONS[face];
+                light.views[face] = glm::lookAt(light.position, light.position + direction, up);
+                light.frusta[face] = Frustum::fromMatrix(projection * light.views[face]);
+            }
+            light.projection = projection;
+        }
+
+        m_lightFaces[index] = static_cast<i32>(firstFace);
+        for (u32 face = 0; face < FACE_COUNT; ++face) {
+            const glm::uvec2 tile = light.tiles[face];
+            m_data.data->faces[firstFace + face] = {
+                .viewProjection = light.projection * light.views[face],
+                .atlasRect = glm::vec4(glm::vec2(tile), glm::vec2(light.tileSize)) / static_cast<float>(ATLAS_SIZE),
+            };
+
+            // pushed only for faces that are drawn
+            std::optional<u32> uniformOffset;
+            const auto getUniformOffset = [&] {
+                if (!uniformOffset) {
+                    uniformOffset = frameAllocator->push<FrameUniforms>({
+                        .view = light.views[face],
+                        .projection = light.projection,
+                    }).offset;
+                }
+                return *uniformOffset;
+            };
+
+            const bool redraw = !light.cached[face];
+            if (redraw) {
+                const auto [firstCommand, commandCount, shortCommandCount] = cullCasters(staticCasters, light.frusta[face]);
+                // drawn even without casters, to clear the tile
+                m_cacheDraws.push_back({tile, light.tileSize, getUniformOffset(), firstCommand, commandCount, shortCommandCount});
+                light.cached[face] = true;
+                ++m_debugInfo.cachedFaces;
+            }
+
+            const auto [firstCommand, commandCount, shortCommandCount] = cullCasters(dynamicCasters, light.frusta[face]);
+            if (commandCount > 0) {
+                m_dynamicDraws.push_back({tile, light.tileSize, getUniformOffset(), firstCommand, commandCount, shortCommandCount});
+                ++m_debugInfo.dynamicFaces;
+            }
+
+            // the sampled tile only changes when its cache does, or when moving casters are drawn over it or were last
+            // frame
+            if (redraw || commandCount > 0 || light.hadDynamic[face]) {
+                const vk::ImageSubresourceLayers subresource = {
+                    .aspectMask = vk::ImageAspectFlagBits::eDepth,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                };
+                const vk::Offset3D offset = {static_cast<i32>(tile.x), static_cast<i32>(tile.y), 0};
+                m_copies.push_back({
+                    .srcSubresource = subresource,
+                    .srcOffset = offset,
+                    .dstSubresource = subresource,
+                    .dstOffset = offset,
+                    .extent = {light.tileSize, light.tileSize, 1},
+                });
+            }
+            light.hadDynamic[face] = commandCount > 0;
+        }
+
+        firstFace += FACE_COUNT;
+        ++m_debugInfo.shadowedLights;
+    }
+
+    m_commands = frameAllocator->allocate<vk::DrawIndexedIndirectCommand>(std::max(1u, static_cast<u32>(m_commandList.size())));
+    std::ranges::copy(m_commandList, m_commands.data);
+}
+
+void ShadowMaps::addResources(RenderGraph &graph) {
+    // the previous frame's last use of each atlas isn't tracked, so the first barrier waits on everything before it
+    m_cacheResource = graph.importImage("Shadow Cache", VulkanEngine::getDepthFormat(), vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+    m_atlasResource = graph.importImage("Shadow Atlas", VulkanEngine::getDepthFormat(), vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+    graph.setImage(m_cacheResource, *m_cacheAtlas->getImage(), *m_cacheAtlas->getView());
+    graph.setImage(m_atlasResource, *m_atlas->getImage(), *m_atlas->getView());
+}
+
+RenderGraph::Handle ShadowMaps::getCacheResource() const {
+    return m_cacheResource;
+}
+
+RenderGraph::Handle ShadowMaps::getAtlasResource() const {
+    return m_atlasResource;
+}
+
+void ShadowMaps::drawCache(const vk::raii::CommandBuffer &commandBuffer) const {
+    drawFaces(commandBuffer, *m_cacheAtlas, m_cacheDraws, true);
+}
+
+void ShadowMaps::copyCache(const vk::raii::CommandBuffer &commandBuffer) const {
+    if (m_copies.empty()) return;
+    commandBuffer.copyImage(*m_cacheAtlas->getImage(), vk::ImageLayout::eTransferSrcOptimal, *m_atlas->getImage(), vk::ImageLayout::eTransferDstOptimal, m_copies);
+}
+
+void ShadowMaps::drawDynamic(const vk::raii::CommandBuffer &commandBuffer) const {
+    drawFaces(commandBuffer, *m_atlas, m_dynamicDraws, false);
+}
+
+void ShadowMaps::addToSet(const vk::raii::DescriptorSet &descriptorSet, const u32 dataBinding, const u32 atlasBinding) {
+    VulkanEngine::getFrameAllocator()->addToSet(descriptorSet, dataBinding, vk::DescriptorType::eStorageBufferDynamic, getDataSize());
+    m_dataBindings.emplace_back(*descriptorSet, dataBinding);
+
+    const vk::DescriptorImageInfo imageInfo = {
+        .sampler = *m_sampler,
+        .imageView = *m_atlas->getView(),
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    const vk::WriteDescriptorSet writeInfo = {
+        .dstSet = *descriptorSet,
+        .dstBinding = atlasBinding,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &imageInfo
+    };
+    VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+}
+
+vk::DeviceSize ShadowMaps::getDataSize() const {
+    return sizeof(ShadowData) + sizeof(i32) * m_lightCapacity;
+}
+
+void ShadowMaps::reserveLights(const u32 capacity) {
+    Logger::info("Growing shadow data to {} lights", capacity);
+    m_lightCapacity = capacity;
+    // the sets may still be in use by frames in flight
+    VulkanEngine::getDevice().waitIdle();
+    for (const auto [descriptorSet, binding] : m_dataBindings) {
+        VulkanEngine::getFrameAllocator()->addToSet(descriptorSet, binding, vk::DescriptorType::eStorageBufferDynamic, getDataSize());
+    }
+}
+
+u32 ShadowMaps::getDataOffset() const {
+    return m_data.offset;
+}
+
+ShadowMaps::DebugInfo ShadowMaps::getDebugInfo() const {
+    return m_debugInfo;
+}
+
+void ShadowMaps::trackCasters(const std::vector<ECS::Entity> &casters) {
+    for (const ECS::Entity entity : casters) {
+        CasterState& caster = m_casters[entity];
+        const u32 version = ECS::getComponent<Transform>(entity).version;
+        const OBB& bounds = ECS::getComponent<BoundingVolume>(entity).obb;
+
+        if (!caster.known) {
+            caster = {.known = true, .dynamic = false, .version = version, .stillFrames = 0, .bakedBounds = bounds};
+            invalidate(bounds);
+        }
+        else if (caster.version != version) {
+            caster.version = version;
+            caster.stillFrames = 0;
+            // take it out of the cache where it was baked
+            if (!caster.dynamic) {
+                caster.dynamic = true;
+                invalidate(caster.bakedBounds);
+            }
+        }
+        else if (caster.dynamic && ++caster.stillFrames >= STATIC_DELAY) {
+            caster.dynamic = false;
+            caster.bakedBounds = bounds;
+            invalidate(bounds);
+        }
+    }
+}
+
+void ShadowMaps::invalidate(const OBB &bounds) {
+    for (ShadowedLight& light : m_lights | std::views::values) {
+        for (u32 face = 0; face < FACE_COUNT; ++face) {
+            if (light.cached[face] && light.frusta[face].intersects(bounds)) {
+                light.cached[face] = false;
+            }
+        }
+    }
+}
+
+bool ShadowMaps::allocateTiles(ShadowedLight &light, const u32 tileSize) {
+    // fall back to smaller tiles when the atlas is full
+    for (u32 size = tileSize; size >= MIN_TILE_SIZE; size /= 2) {
+        u32 allocated = 0;
+        for (; allocated < FACE_COUNT; ++allocated) {
+            const auto tile = m_allocator.allocate(size);
+            if (!tile) break;
+            light.tiles[allocated] = *tile;
+        }
+        if (allocated == FACE_COUNT) {
+            light.tileSize = size;
+            light.cached = {};
+            return true;
+        }
+        for (u32 i = 0; i < allocated; ++i) {
+            m_allocator.free(light.tiles[i], size);
+        }
+    }
+    light.tileSize = 0;
+    return false;
+}
+
+void ShadowMaps::freeTiles(const ShadowedLight &light) {
+    if (light.tileSize == 0) return;
+    for (const glm::uvec2 tile : light.tiles) {
+        m_allocator.free(tile, light.tileSize);
+    }
+}
+
+void ShadowMaps::drawFaces(const vk::raii::CommandBuffer &commandBuffer, const Image& atlas, const std::vector<FaceDraw> &faces, const bool clear) const {
+    if (faces.empty()) return;
+
+    // the rest of the atlas belongs to other faces, so it's loaded and only the faces being drawn are cleared
+    const vk::RenderingAttachmentInfo depthAttachment = {
+        .imageView = *atlas.getView(),
+        .imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+        .loadOp = vk::AttachmentLoadOp::eLoad,
+        .storeOp = vk::AttachmentStoreOp::eStore,
+    };
+    const vk::RenderingInfo renderingInfo = {
+        .renderArea = {
+            .offset = {0, 0},
+            .extent = {ATLAS_SIZE, ATLAS_SIZE}
+        },
+        .layerCount = 1,
+        .pDepthAttachment = &depthAttachment
+    };
+    commandBuffer.beginRendering(renderingInfo);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline->getPipeline());
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), MODEL_SET_NUMBER, {*m_modelDescriptor}, {m_modelOffset});
+    const auto& pool = VulkanEngine::getAssetManager()->getGeometryPool();
+    pool.bind(commandBuffer);
+    vk::IndexType boundIndexType = vk::IndexType::eUint32;
+
+    constexpr u32 stride = sizeof(vk::DrawIndexedIndirectCommand);
+    const auto drawCommands = [&](const u32 firstCommand, const u32 commandCount, const vk::IndexType indexType) {
+        if (commandCount == 0) return;
+        if (indexType != boundIndexType) {
+            pool.bind(commandBuffer, indexType);
+            boundIndexType = indexType;
+        }
+        if (m_multiDrawIndirect) {
+            commandBuffer.drawIndexedIndirect(m_commands.buffer, m_commands.offset + firstCommand * stride, commandCount, stride);
+            return;
+        }
+        for (u32 i = 0; i < commandCount; ++i) {
+            commandBuffer.drawIndexedIndirect(m_commands.buffer, m_commands.offset + (firstCommand + i) * stride, 1, stride);
+        }
+    };
+
+    for (const FaceDraw& face : faces) {
+        const vk::Rect2D rect = {
+            .offset = {static_cast<i32>(face.tile.x), static_cast<i32>(face.tile.y)},
+            .extent = {face.tileSize, face.tileSize}
+        };
+        const vk::Viewport viewport = {
+            .x = static_cast<float>(face.tile.x),
+            .y = static_cast<float>(face.tile.y),
+            .width = static_cast<float>(face.tileSize),
+            .height = static_cast<float>(face.tileSize),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        };
+        commandBuffer.setViewport(0, viewport);
+        commandBuffer.setScissor(0, rect);
+
+        if (clear) {
+            const vk::ClearAttachment clearAttachment = {
+                .aspectMask = vk::ImageAspectFlagBits::eDepth,
+                .clearValue = vk::ClearDepthStencilValue(1.0f, 0)
+            };
+            const vk::ClearRect clearRect = {
+                .rect = rect,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            };
+            commandBuffer.clearAttachments(clearAttachment, clearRect);
+        }
+        if (face.commandCount == 0) continue;
+
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipeline->getLayout(), FRAME_SET_NUMBER, {*m_frameDescriptor}, {face.uniformOffset});
+        const u32 longCommandCount = face.commandCount - face.shortCommandCount;
+        drawCommands(face.firstCommand, longCommandCount, vk::IndexType::eUint32);
+        drawCommands(face.firstCommand + longCommandCount, face.shortCommandCount, vk::IndexType::eUint16);
+    }
+
+    commandBuffer.endRendering();
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "ECS.h"
+#include "FrameAllocator.h"
+#include "Image.h"
+#include "LightSystem.h"
+#include "Pipeline.h"
+#include "RenderGraph.h"
+#include "Volumes.h"
+
+struct ControlledCamera;
+
+// square tiles handed out from a square atlas by splitting it into quarters - freed tiles merge back with their
+// siblings, so the atlas doesn't fragment as lights change resolution
+class AtlasAllocator {
+public:
+    AtlasAllocator(u32 size, u32 minTileSize);
+
+    // top left corner of a free tile, or nothing if there is no space - size must be a power of two
+    std::optional<glm::uvec2> allocate(u32 size);
+    void free(glm::uvec2 offset, u32 size);
+
+private:
+    u32 getLevel(u32 size) const;
+
+    u32 m_size;
+    // free tiles of each size, from the whole atlas down to the smallest tile
+    std::vector<std::vector<glm::uvec2>> m_freeTiles;
+};
+
+// cube shadow maps for point lights, packed into one depth atlas
+//
+// static casters are drawn into a cache atlas only when a face is invalidated - by a caster moving, appearing or
+// disappearing within it, or by the light moving or changing resolution. each frame the cached tiles that need it are
+// copied into the atlas that is sampled, and only casters that are currently moving are drawn on top
+//
+// a caster is dynamic from the frame its Transform changes until it has been still for STATIC_DELAY frames, when it
+// is baked into the cache
+class ShadowMaps {
+public:
+    static constexpr u32 ATLAS_SIZE = 4096;
+    static constexpr u32 MAX_TILE_SIZE = 512;
+    static constexpr u32 MIN_TILE_SIZE = 64;
+    // both must match lighting.glsl
+    static constexpr u32 FACE_COUNT = 6;
+    static constexpr u32 MAX_SHADOWED_LIGHTS = 64;
+    static constexpr u32 STATIC_DELAY = 30;
+
+    // std430 layout, matching ShadowFace in lighting.glsl
+    struct ShadowFace {
+        glm::mat4 viewProjection;
+        // offset and size of the face's tile in atlas UVs
+        glm::vec4 atlasRect;
+    };
+
+    // std430 layout, matching ShadowBuffer in lighting.glsl - followed by the index of each light's first face, or -1
+    // if it isn't shadowed, with room for as many lights as the capacity
+    struct ShadowData {
+        std::array<ShadowFace, MAX_SHADOWED_LIGHTS * FACE_COUNT> faces;
+    };
+
+    struct DebugInfo {
+        u32 shadowedLights = 0;
+        // faces whose static cache was redrawn this frame
+        u32 cachedFaces = 0;
+        // faces with moving casters drawn into them this frame
+        u32 dynamicFaces = 0;
+    };
+
+    ShadowMaps();
+
+    void onCasterAdd(ECS::Entity entity);
+    void onCasterRemove(ECS::Entity entity);
+
+    // pick the shadowed lights and their resolutions from their size on screen, then cull the casters into each face
+    void update(const std::vector<ECS::Entity>& casters, const Frustum& cameraFrustum, const ControlledCamera& camera, u32 screenHeight);
+
+    // import the atlases - the cache pass writes getCacheResource, and shading passes sample getAtlasResource
+    void addResources(RenderGraph& graph);
+    RenderGraph::Handle getCacheResource() const;
+    RenderGraph::Handle getAtlasResource() const;
+
+    // each leaves its own pipeline, sets and viewport bound
+    void drawCache(const vk::raii::CommandBuffer& commandBuffer) const;
+    void copyCache(const vk::raii::CommandBuffer& commandBuffer) const;
+    void drawDynamic(const vk::raii::CommandBuffer& commandBuffer) const;
+
+    // point bindings at the shadow data, given by getDataOffset when binding, and the atlas - the data binding is
+    // written again whenever the capacity for lights grows
+    void addToSet(const vk::raii::DescriptorSet& descriptorSet, u32 dataBinding, u32 atlasBinding);
+    u32 getDataOffset() const;
+
+    DebugInfo getDebugInfo() const;
+
+private:
+    struct ShadowedLight {
+        u32 tileSize = 0;
+        std::array<glm::uvec2, FACE_COUNT> tiles;
+        // the position and range the views, projection and frusta were built for, if they have been
+        bool built = false;
+        glm::vec3 position = glm::vec3(0.0f);
+        float range = 0.0f;
+        std::array<glm::mat4, FACE_COUNT> views;
+        glm::mat4 projection;
+        std::array<Frustum, FACE_COUNT> frusta;
+        // faces whose tile in the cache atlas is up to date
+        std::array<bool, FACE_COUNT> cached = {};
+        // faces that had moving casters drawn into them last frame, which have to be cleared by a copy
+        std::array<bool, FACE_COUNT> hadDynamic = {};
+    };
+
+    struct CasterState {
+        bool known = false;
+        bool dynamic = false;
+        u32 version = 0;
+        u32 stillFrames = 0;
+        // bounds the caster was baked into the cache with
+        OBB bakedBounds;
+    };
+
+    // a face to draw, with its casters as a range of indirect commands
+    struct FaceDraw {
+        glm::uvec2 tile;
+        u32 tileSize;
+        u32 uniformOffset;
+        u32 firstCommand;
+        u32 commandCount;
+        // the last of the commands draw meshes with 16 bit indexes, the rest 32 bit
+        u32 shortCommandCount;
+    };
+
+    void trackCasters(const std::vector<ECS::Entity>& casters);
+    // mark every cached face the bounds reach as needing a redraw
+    void invalidate(const OBB& bounds);
+    bool allocateTiles(ShadowedLight& light, u32 tileSize);
+    void freeTiles(const ShadowedLight& light);
+    void drawFaces(const vk::raii::CommandBuffer& commandBuffer, const Image& atlas, const std::vector<FaceDraw>& faces, bool clear) const;
+    // size of the shadow data with room for the light capacity
+    vk::DeviceSize getDataSize() const;
+    // make room for more lights, writing the data bindings again with the new size
+    void reserveLights(u32 capacity);
+
+    std::unique_ptr<Image> m_cacheAtlas;
+    std::unique_ptr<Image> m_atlas;
+    vk::raii::Sampler m_sampler = nullptr;
+    AtlasAllocator m_allocator;
+
+    std::unique_ptr<Pipeline> m_pipeline;
+    vk::raii::DescriptorSet m_frameDescriptor = nullptr;
+    vk::raii::DescriptorSet m_modelDescriptor = nullptr;
+    bool m_multiDrawIndirect;
+
+    RenderGraph::Handle m_cacheResource = 0;
+    RenderGraph::Handle m_atlasResource = 0;
+
+    // keyed by the light's entity, so a light keeps its tiles when others are added or removed
+    std::unordered_map<ECS::Entity, ShadowedLight> m_lights;
+    std::vector<CasterState> m_casters;
+
+    // this frame's work and allocations from the frame allocator
+    std::vector<FaceDraw> m_cacheDraws;
+    std::vector<FaceDraw> m_dynamicDraws;
+    std::vector<vk::ImageCopy> m_copies;
+    std::vector<vk::DrawIndexedIndirectCommand> m_commandList;
+    // a face's commands for meshes with 16 bit indexes, appended after its others once it's culled
+    std::vector<vk::DrawIndexedIndirectCommand> m_shortCommandList;
+    FrameAllocation<vk::DrawIndexedIndirectCommand> m_commands;
+    FrameAllocation<ShadowData> m_data;
+    // the first face of each light, following m_data
+    std::span<i32> m_lightFaces;
+    u32 m_lightCapacity = LightSystem::INITIAL_LIGHT_CAPACITY;
+    // every set and binding the shadow data was added to
+    std::vector<std::pair<vk::DescriptorSet, u32>> m_dataBindings;
+    u32 m_modelOffset = 0;
+
+    DebugInfo m_debugInfo;
+};
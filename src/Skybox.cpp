@@ -1,15 +1,28 @@
 #include "Skybox.h"
 
+#include <bit>
+
 #include <vulkan/vulkan_format_traits.hpp>
 
 #include "Renderer3D.h"
 #include "VulkanEngine.h"
 
-Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, const u32 height, const vk::Format format) {
+Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, const u32 height, const vk::Format format)
+    : m_size(width)
+    // the full chain, so anything sampling the sky sparsely can read a level where each texel covers its sample
+    , m_mips(std::bit_width(std::max(width, height)))
+{
     assert(vk::componentCount(format) == 4 && vk::componentBits(format, 0) == 8);
+    assert(width == height);
     constexpr u32 bitdepth = 4;
     vk::DeviceSize imageSize = width * height * bitdepth;
 
+    m_sourceHash = hashBytes(&format, sizeof(format));
+    m_sourceHash = hashBytes(&width, sizeof(width), m_sourceHash);
+    for (const unsigned char* face : pixels) {
+        m_sourceHash = hashBytes(face, imageSize, m_sourceHash);
+    }
+
     auto [stagingBuffer, stagingBufferMemory] = VulkanEngine::createBuffer(imageSize * 6, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
     void* data = stagingBufferMemory.mapMemory(0, imageSize * 6);
     for (u32 i = 0; i < 6; ++i) {
@@ -21,8 +34,9 @@ Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, co
         .width = width,
         .height = height,
         .format = format,
-        .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
         .properties = vk::MemoryPropertyFlagBits::eDeviceLocal,
+        .mips = m_mips,
         .arrayLayers = 6,
         .viewType = vk::ImageViewType::eCube,
         .flags = vk::ImageCreateFlagBits::eCubeCompatible
@@ -33,6 +47,7 @@ Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, co
     m_image->changeLayout(commandBuffer, {
         .oldLayout = vk::ImageLayout::eUndefined,
         .newLayout = vk::ImageLayout::eTransferDstOptimal,
+        .mips = m_mips,
         .arrayLayers = 6
     });
 
@@ -53,10 +68,48 @@ Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, co
 
     commandBuffer.copyBufferToImage(stagingBuffer, m_image->getImage(), vk::ImageLayout::eTransferDstOptimal, copyRegion);
 
+    // each level is blitted from the one above, which is then left as a transfer source
+    for (u32 mip = 1; mip < m_mips; ++mip) {
+        m_image->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+            .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .arrayLayers = 6,
+            .baseMip = mip - 1
+        });
+        const i32 srcSize = static_cast<i32>(std::max(width >> (mip - 1), 1u));
+        const i32 dstSize = static_cast<i32>(std::max(width >> mip, 1u));
+        const vk::ImageBlit blit = {
+            .srcSubresource = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .mipLevel = mip - 1,
+                .baseArrayLayer = 0,
+                .layerCount = 6
+            },
+            .srcOffsets = std::array{vk::Offset3D{0, 0, 0}, vk::Offset3D{srcSize, srcSize, 1}},
+            .dstSubresource = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .mipLevel = mip,
+                .baseArrayLayer = 0,
+                .layerCount = 6
+            },
+            .dstOffsets = std::array{vk::Offset3D{0, 0, 0}, vk::Offset3D{dstSize, dstSize, 1}}
+        };
+        commandBuffer.blitImage(m_image->getImage(), vk::ImageLayout::eTransferSrcOptimal, m_image->getImage(), vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+    }
+
+    if (m_mips > 1) {
+        m_image->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+            .mips = m_mips - 1,
+            .arrayLayers = 6
+        });
+    }
     m_image->changeLayout(commandBuffer, {
         .oldLayout = vk::ImageLayout::eTransferDstOptimal,
         .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-        .arrayLayers = 6
+        .arrayLayers = 6,
+        .baseMip = m_mips - 1
     });
     VulkanEngine::endSingleCommand(commandBuffer);
 
@@ -73,7 +126,7 @@ Skybox::Skybox(const std::array<unsigned char *, 6> &pixels, const u32 width, co
         .compareEnable = vk::False,
         .compareOp = vk::CompareOp::eAlways,
         .minLod = 0.0f,
-        .maxLod = 0.0f,
+        .maxLod = vk::LodClampNone,
         .unnormalizedCoordinates = vk::False
     };
 
@@ -105,3 +158,15 @@ const Image & Skybox::getImage() const {
 const vk::raii::Sampler & Skybox::getSampler() const {
     return m_sampler;
 }
+
+u32 Skybox::getSize() const {
+    return m_size;
+}
+
+u32 Skybox::getMipCount() const {
+    return m_mips;
+}
+
+u64 Skybox::getSourceHash() const {
+    return m_sourceHash;
+}
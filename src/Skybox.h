@@ -13,8 +13,15 @@ public:
 
     const Image& getImage() const;
     const vk::raii::Sampler& getSampler() const;
+    u32 getSize() const;
+    u32 getMipCount() const;
+    // hash of the faces' pixels and format, identifying the sky for anything derived from it
+    u64 getSourceHash() const;
 
 private:
     std::unique_ptr<Image> m_image;
     vk::raii::Sampler m_sampler = nullptr;
+    u32 m_size;
+    u32 m_mips;
+    u64 m_sourceHash;
 };
@@ -0,0 +1,216 @@
+#include "TemporalAntiAliasing.h"
+
+#include "VulkanEngine.h"
+
+namespace {
+    constexpr u32 WORKGROUP_SIZE = 8;
+
+    vk::raii::Sampler createSampler(const vk::Filter filter) {
+        const vk::SamplerCreateInfo samplerInfo = {
+            .magFilter = filter,
+            .minFilter = filter,
+            .mipmapMode = vk::SamplerMipmapMode::eNearest,
+            .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+            .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = vk::False,
+            .maxAnisotropy = 1.0f,
+            .compareEnable = vk::False,
+            .compareOp = vk::CompareOp::eAlways,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .unnormalizedCoordinates = vk::False
+        };
+        return {VulkanEngine::getDevice(), samplerInfo};
+    }
+
+    // parameters at binding 0, then the sampled inputs, then the storage images written
+    std::unique_ptr<Pipeline> createPipeline(const std::string& shader, const u32 inputCount, const u32 outputCount) {
+        Pipeline::Builder builder;
+        builder
+            .addShaderStage(shader)
+            .addBinding(0, 0, vk::DescriptorType::eUniformBufferDynamic, vk::ShaderStageFlagBits::eCompute);
+        for (u32 i = 1; i <= inputCount; ++i) {
+            builder.addBinding(0, i, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute);
+        }
+        for (u32 i = inputCount + 1; i <= inputCount + outputCount; ++i) {
+            builder.addBinding(0, i, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute);
+        }
+        return builder.create();
+    }
+
+    void writeImage(const vk::raii::DescriptorSet& descriptorSet, const u32 binding, const vk::ImageView view, const vk::Sampler sampler) {
+        const bool storage = !sampler;
+        const vk::DescriptorImageInfo imageInfo = {
+            .sampler = sampler,
+            .imageView = view,
+            .imageLayout = storage ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal
+        };
+        const vk::WriteDescriptorSet writeInfo = {
+            .dstSet = *descriptorSet,
+            .dstBinding = binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &imageInfo
+        };
+        VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
+    }
+
+    // low discrepancy sequence, so any few consecutive jitters are spread over the pixel
+    float halton(u32 index, const u32 base) {
+        float fraction = 1.0f;
+        float result = 0.0f;
+        while (index > 0) {
+            fraction /= static_cast<float>(base);
+            result += fraction * static_cast<float>(index % base);
+            index /= base;
+        }
+        return result;
+    }
+}
+
+TemporalAntiAliasing::TemporalAntiAliasing(const vk::Extent2D extent)
+    : m_nearestSampler(createSampler(vk::Filter::eNearest))
+    , m_linearSampler(createSampler(vk::Filter::eLinear))
+{
+    m_velocityPipeline = createPipeline("shaders/taa_velocity.comp.spv", 1, 1);
+    m_resolvePipeline = createPipeline("shaders/taa_resolve.comp.spv", 4, 2);
+
+    setExtent(extent);
+}
+
+void TemporalAntiAliasing::setExtent(const vk::Extent2D extent) {
+    m_extent = extent;
+    m_renderExtent = extent;
+    createHistory();
+}
+
+glm::vec2 TemporalAntiAliasing::nextJitter(const vk::Extent2D renderExtent) {
+    // starting from 1, as index 0 of the sequence is the pixel's corner on both axes
+    m_jitterIndex = m_jitterIndex % JITTER_PHASES + 1;
+    const glm::vec2 offset = glm::vec2(halton(m_jitterIndex, 2), halton(m_jitterIndex, 3)) - 0.5f;
+    m_jitter = offset * 2.0f / glm::vec2(renderExtent.width, renderExtent.height);
+    return m_jitter;
+}
+
+void TemporalAntiAliasing::update(const glm::mat4 &view, const glm::mat4 &projection, const vk::Extent2D renderExtent) {
+    // the history was resolved at a different scale, so can't be reprojected
+    if (renderExtent != m_renderExtent) {
+        m_renderExtent = renderExtent;
+        m_historyValid = false;
+    }
+
+    const glm::mat4 viewProjection = projection * view;
+    m_params = VulkanEngine::getFrameAllocator()->push<Params>({
+        .reprojection = m_previousViewProjection * glm::inverse(viewProjection),
+        .jitter = m_jitter,
+        .renderSize = glm::vec2(m_renderExtent.width, m_renderExtent.height),
+        .renderScale = glm::vec2(m_renderExtent.width, m_renderExtent.height) / glm::vec2(m_extent.width, m_extent.height),
+        .blend = m_historyValid ? HISTORY_BLEND : 1.0f,
+    });
+    m_previousViewProjection = viewProjection;
+    m_historyValid = true;
+    // last frame's output is this frame's history
+    m_current = 1 - m_current;
+}
+
+void TemporalAntiAliasing::setImages(RenderGraph &graph) const {
+    const Image& history = *m_history.at(m_current);
+    const Image& output = *m_history.at(1 - m_current);
+    graph.setImage(m_historyResource, *history.getImage(), *history.getView());
+    graph.setImage(m_historyOutputResource, *output.getImage(), *output.getView());
+}
+
+void TemporalAntiAliasing::addPasses(RenderGraph &graph, const RenderGraph::Handle depth, const RenderGraph::Handle colour) {
+    m_depthResource = depth;
+    m_colourResource = colour;
+    // the history is from whenever the passes last ran, if they have at all
+    m_historyValid = false;
+
+    // the history written this frame is read the next, so both wait for everything before them
+    m_historyResource = graph.importImage("TAA History", OUTPUT_FORMAT, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+    m_historyOutputResource = graph.importImage("TAA History Output", OUTPUT_FORMAT, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eAllCommands);
+
+    m_velocity = graph.createImage("TAA Velocity", {
+        .width = m_extent.width,
+        .height = m_extent.height,
+        .format = VELOCITY_FORMAT,
+    });
+    m_resolved = graph.createImage("TAA Resolved", {
+        .width = m_extent.width,
+        .height = m_extent.height,
+        .format = OUTPUT_FORMAT,
+    });
+
+    graph.addPass("TAA Velocity", {
+        {depth, ResourceUsage::Sampled},
+        {m_velocity, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer, *m_velocityPipeline, m_velocityDescriptor);
+    });
+    graph.addPass("TAA Resolve", {
+        {colour, ResourceUsage::Sampled},
+        {m_velocity, ResourceUsage::Sampled},
+        {depth, ResourceUsage::Sampled},
+        {m_historyResource, ResourceUsage::Sampled},
+        {m_resolved, ResourceUsage::StorageWrite},
+        {m_historyOutputResource, ResourceUsage::StorageWrite},
+    }, [this](const vk::raii::CommandBuffer& commandBuffer) {
+        dispatch(commandBuffer, *m_resolvePipeline, m_resolveDescriptors.at(m_current));
+    });
+}
+
+void TemporalAntiAliasing::writeDescriptors(const RenderGraph &graph) {
+    const FrameAllocator* frameAllocator = VulkanEngine::getFrameAllocator();
+    const auto createDescriptor = [&](const Pipeline& pipeline) {
+        vk::raii::DescriptorSet descriptorSet = pipeline.createDescriptorSet(0);
+        frameAllocator->addToSet(descriptorSet, 0, vk::DescriptorType::eUniformBufferDynamic, sizeof(Params));
+        return descriptorSet;
+    };
+
+    m_velocityDescriptor = createDescriptor(*m_velocityPipeline);
+    writeImage(m_velocityDescriptor, 1, graph.getImageView(m_depthResource), *m_nearestSampler);
+    writeImage(m_velocityDescriptor, 2, graph.getImageView(m_velocity), nullptr);
+
+    for (u32 i = 0; i < m_resolveDescriptors.size(); ++i) {
+        vk::raii::DescriptorSet& descriptorSet = m_resolveDescriptors.at(i);
+        descriptorSet = createDescriptor(*m_resolvePipeline);
+        writeImage(descriptorSet, 1, graph.getImageView(m_colourResource), *m_nearestSampler);
+        writeImage(descriptorSet, 2, graph.getImageView(m_velocity), *m_nearestSampler);
+        writeImage(descriptorSet, 3, graph.getImageView(m_depthResource), *m_nearestSampler);
+        writeImage(descriptorSet, 4, *m_history.at(i)->getView(), *m_linearSampler);
+        writeImage(descriptorSet, 5, graph.getImageView(m_resolved), nullptr);
+        writeImage(descriptorSet, 6, *m_history.at(1 - i)->getView(), nullptr);
+    }
+}
+
+RenderGraph::Handle TemporalAntiAliasing::getResource() const {
+    return m_resolved;
+}
+
+void TemporalAntiAliasing::createHistory() {
+    const vk::raii::CommandBuffer commandBuffer = VulkanEngine::beginSingleCommand();
+    for (std::unique_ptr<Image>& history : m_history) {
+        history = std::make_unique<Image>(ImageCreateInfo {
+            .width = m_extent.width,
+            .height = m_extent.height,
+            .format = OUTPUT_FORMAT,
+            .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+        });
+        // left in the layout the graph imports it with - the contents are never read until they have been written
+        history->changeLayout(commandBuffer, {
+            .oldLayout = vk::ImageLayout::eUndefined,
+            .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        });
+    }
+    VulkanEngine::endSingleCommand(commandBuffer);
+    m_historyValid = false;
+}
+
+void TemporalAntiAliasing::dispatch(const vk::raii::CommandBuffer &commandBuffer, const Pipeline &pipeline, const vk::raii::DescriptorSet &descriptorSet) const {
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getPipeline());
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.getLayout(), 0, {*descriptorSet}, {m_params.offset});
+    commandBuffer.dispatch((m_renderExtent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (m_renderExtent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "Common.h"
+#include "FrameAllocator.h"
+#include "Image.h"
+#include "Pipeline.h"
+#include "RenderGraph.h"
+
+// temporal anti-aliasing - the projection is offset by a different subpixel jitter every frame, and each pixel is
+// blended with last frame's result, reprojected through a velocity buffer and clamped to the colours around the
+// pixel this frame, so history from disoccluded or changed surfaces doesn't ghost
+//
+// velocity is reconstructed from depth and the camera's motion, so models moving on their own aren't reprojected
+// and lean on the clamping instead
+class TemporalAntiAliasing {
+public:
+    // std140 layout, matching Params in taa.glsl
+    struct Params {
+        // current unjittered clip space to the previous frame's
+        glm::mat4 reprojection;
+        // this frame's jitter in NDC
+        glm::vec2 jitter;
+        glm::vec2 renderSize;
+        // fraction of the images the render size covers
+        glm::vec2 renderScale;
+        // weight of this frame against the history, 1 to ignore the history
+        float blend;
+    };
+
+    // length of the jitter sequence
+    static constexpr u32 JITTER_PHASES = 8;
+    // weight of each new frame once the history is valid
+    static constexpr float HISTORY_BLEND = 0.1f;
+    static constexpr vk::Format VELOCITY_FORMAT = vk::Format::eR16G16Sfloat;
+    static constexpr vk::Format OUTPUT_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+
+    explicit TemporalAntiAliasing(vk::Extent2D extent);
+
+    // recreate the history for a new extent - the graph has to be recreated afterwards
+    void setExtent(vk::Extent2D extent);
+
+    // move on to the next jitter in the sequence, returning it in NDC to offset this frame's projection by
+    glm::vec2 nextJitter(vk::Extent2D renderExtent);
+    // push this frame's parameters with the unjittered projection - only while the passes are in the graph
+    void update(const glm::mat4& view, const glm::mat4& projection, vk::Extent2D renderExtent);
+    // point the graph at this frame's history, before it is executed
+    void setImages(RenderGraph& graph) const;
+
+    // add the passes resolving the colour attachment, once depth and colour have been written
+    void addPasses(RenderGraph& graph, RenderGraph::Handle depth, RenderGraph::Handle colour);
+    // point the passes at the graph's images, once it has been compiled
+    void writeDescriptors(const RenderGraph& graph);
+    // the anti-aliased colour, covering the same region as the colour attachment
+    RenderGraph::Handle getResource() const;
+
+private:
+    void createHistory();
+    void dispatch(const vk::raii::CommandBuffer& commandBuffer, const Pipeline& pipeline, const vk::raii::DescriptorSet& descriptorSet) const;
+
+    vk::Extent2D m_extent;
+    vk::Extent2D m_renderExtent;
+
+    std::unique_ptr<Pipeline> m_velocityPipeline;
+    std::unique_ptr<Pipeline> m_resolvePipeline;
+    vk::raii::DescriptorSet m_velocityDescriptor = nullptr;
+    // one per history image being read
+    std::array<vk::raii::DescriptorSet, 2> m_resolveDescriptors = {nullptr, nullptr};
+    vk::raii::Sampler m_nearestSampler = nullptr;
+    vk::raii::Sampler m_linearSampler = nullptr;
+
+    // read and written in turn, so the resolve never copies its result back
+    std::array<std::unique_ptr<Image>, 2> m_history;
+    // the history read this frame
+    u32 m_current = 0;
+
+    RenderGraph::Handle m_depthResource = 0;
+    RenderGraph::Handle m_colourResource = 0;
+    RenderGraph::Handle m_velocity = 0;
+    RenderGraph::Handle m_resolved = 0;
+    RenderGraph::Handle m_historyResource = 0;
+    RenderGraph::Handle m_historyOutputResource = 0;
+
+    FrameAllocation<Params> m_params;
+    glm::vec2 m_jitter = glm::vec2(0.0f);
+    u32 m_jitterIndex = 0;
+    glm::mat4 m_previousViewProjection = glm::mat4(1.0f);
+    bool m_historyValid = false;
+};
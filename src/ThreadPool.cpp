@@ -0,0 +1,92 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(const u32 workerCount) {
+    m_workers.reserve(workerCount);
+    for (u32 i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(const u32 count, const u32 minChunkSize, const std::function<void(u32 begin, u32 end)>& task) {
+    if (count == 0) return;
+
+    // a few chunks per thread evens out chunks that take longer than others
+    const u32 chunkSize = std::max({1u, minChunkSize, count / (getThreadCount() * 4)});
+    const u32 chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount == 1 || m_workers.empty()) {
+        task(0, count);
+        return;
+    }
+
+    {
+        std::unique_lock lock(m_mutex);
+        // workers that joined the previous task late may still be checking for chunks
+        m_doneCondition.wait(lock, [this] { return m_activeWorkers == 0; });
+
+        m_task = &task;
+        m_count = count;
+        m_chunkSize = chunkSize;
+        m_chunkCount = chunkCount;
+        m_nextChunk = 0;
+        m_remainingChunks = chunkCount;
+        ++m_generation;
+    }
+    m_wakeCondition.notify_all();
+
+    runChunks();
+
+    std::unique_lock lock(m_mutex);
+    m_doneCondition.wait(lock, [this] { return m_remainingChunks == 0; });
+}
+
+u32 ThreadPool::getThreadCount() const {
+    return static_cast<u32>(m_workers.size()) + 1;
+}
+
+void ThreadPool::workerLoop() {
+    u64 generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_wakeCondition.wait(lock, [&] { return m_stopping || m_generation != generation; });
+            if (m_stopping) return;
+            generation = m_generation;
+            ++m_activeWorkers;
+        }
+
+        runChunks();
+
+        {
+            std::lock_guard lock(m_mutex);
+            --m_activeWorkers;
+        }
+        m_doneCondition.notify_all();
+    }
+}
+
+void ThreadPool::runChunks() {
+    while (true) {
+        const u32 chunk = m_nextChunk.fetch_add(1);
+        if (chunk >= m_chunkCount) return;
+
+        const u32 begin = chunk * m_chunkSize;
+        (*m_task)(begin, std::min(begin + m_chunkSize, m_count));
+
+        if (m_remainingChunks.fetch_sub(1) == 1) {
+            // lock so the notification can't be missed between the caller's check and wait
+            std::lock_guard lock(m_mutex);
+            m_doneCondition.notify_all();
+        }
+    }
+}
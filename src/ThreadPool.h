@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Common.h"
+
+// fixed set of worker threads for splitting per-frame work into chunks
+class ThreadPool {
+public:
+    // defaults to one worker per hardware thread, leaving one for the calling thread
+    explicit ThreadPool(u32 workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // split [0, count) into chunks of at least minChunkSize and call task(begin, end) for each, returning once all
+    // chunks are done - the calling thread works on chunks too
+    void parallelFor(u32 count, u32 minChunkSize, const std::function<void(u32 begin, u32 end)>& task);
+
+    // number of threads that work on a parallelFor, including the calling thread
+    u32 getThreadCount() const;
+
+private:
+    void workerLoop();
+    // run chunks of the current task until there are none left
+    void runChunks();
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_doneCondition;
+    bool m_stopping = false;
+    u64 m_generation = 0;
+    u32 m_activeWorkers = 0;
+
+    // current task, only changed while no workers are active
+    const std::function<void(u32, u32)>* m_task = nullptr;
+    u32 m_count = 0;
+    u32 m_chunkSize = 0;
+    u32 m_chunkCount = 0;
+    std::atomic<u32> m_nextChunk = 0;
+    std::atomic<u32> m_remainingChunks = 0;
+};
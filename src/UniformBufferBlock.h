@@ -92,29 +92,26 @@ private:
 	T* m_data;
 };
 
+// tightly packed array of T in a host visible storage buffer, indexed in shaders (e.g. by gl_InstanceIndex)
+// extra usage flags allow the same buffer to be used for other purposes, such as indirect draw commands
 template <typename T>
-class DynamicUniformBufferBlock {
+class StorageBufferBlock {
 public:
-	DynamicUniformBufferBlock(const u32 size = 256) : m_size(size), m_alignedItemSize(calculateAlignment()) {
-		createBuffers();
-	}
-
-	~DynamicUniformBufferBlock() {
-		m_deviceMemory.unmapMemory();
+	explicit StorageBufferBlock(const u32 size = 256, const vk::BufferUsageFlags extraUsage = {}) : m_size(size) {
+		const vk::DeviceSize bufferSize = sizeof(T) * m_size;
+		std::tie(m_buffer, m_deviceMemory) = VulkanEngine::createBuffer(bufferSize, vk::BufferUsageFlagBits::eStorageBuffer | extraUsage, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+		m_data = static_cast<T*>(m_deviceMemory.mapMemory(0, bufferSize));
 	}
 
-	// resize the buffer to newSize count elements - this will delete any data stored in the buffer
-	void resize(const u32 newSize) {
-		m_size = newSize;
+	~StorageBufferBlock() {
 		m_deviceMemory.unmapMemory();
-		createBuffers();
 	}
 
 	void addToSet(const vk::raii::DescriptorSet& descriptorSet, const u32 binding) const {
 		const vk::DescriptorBufferInfo bufferInfo = {
 			.buffer = m_buffer,
 			.offset = 0,
-			.range = sizeof(T),
+			.range = vk::WholeSize,
 		};
 
 		const vk::WriteDescriptorSet writeInfo = {
@@ -122,41 +119,29 @@ public:
 			.dstBinding = binding,
 			.dstArrayElement = 0,
 			.descriptorCount = 1,
-			.descriptorType = vk::DescriptorType::eUniformBufferDynamic,
+			.descriptorType = vk::DescriptorType::eStorageBuffer,
 			.pBufferInfo = &bufferInfo,
 		};
 		VulkanEngine::getDevice().updateDescriptorSets(writeInfo, nullptr);
 	}
 
-	void setData(u32 index, const T& data) {
+	void setData(const u32 index, const T& data) {
 		assert(index < m_size && "Index out of range");
-		std::memcpy(m_data + index * m_alignedItemSize, &data, m_alignedItemSize);
-	}
-
-	u32 getItemSize() const {
-		return m_alignedItemSize;
+		std::memcpy(m_data + index, &data, sizeof(T));
 	}
 
 	u32 getSize() const {
 		return m_size;
 	}
 
-private:
-	u32 calculateAlignment() const {
-		const u32 minAlignment = static_cast<u32>(VulkanEngine::getPhysicalDevice().getProperties().limits.minUniformBufferOffsetAlignment);
-		return static_cast<u32>(sizeof(T) + minAlignment - 1) & ~(minAlignment - 1); // calculate the dynamic alignment size - https://github.com/SaschaWillems/Vulkan/tree/master/examples/dynamicuniformbuffer
-	}
-
-	void createBuffers() {
-		const vk::DeviceSize bufferSize = m_alignedItemSize * m_size;
-		std::tie(m_buffer, m_deviceMemory) = VulkanEngine::createBuffer(bufferSize, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
-		m_data = static_cast<char*>(m_deviceMemory.mapMemory(0, bufferSize));
+	const vk::raii::Buffer& getBuffer() const {
+		return m_buffer;
 	}
 
+private:
 	vk::raii::Buffer m_buffer = nullptr;
 	vk::raii::DeviceMemory m_deviceMemory = nullptr;
-	char* m_data = nullptr;
+	T* m_data = nullptr;
 
 	u32 m_size; // maximum number of elements
-	u32 m_alignedItemSize; // size of each element + padding
 };
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <array>
+
 #include <vulkan/vulkan_raii.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "Common.h"
 
 struct BasicVertex {
     glm::vec3 pos;
+
+    // uploaded as it is
+    using Packed = BasicVertex;
+
     static vk::VertexInputBindingDescription getBindingDescription() {
         return {
             .binding = 0,
@@ -26,16 +35,31 @@ struct BasicVertex {
     }
 };
 
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec2 uv;
-    glm::vec3 normal;
-    glm::vec3 tangent;
+// map a direction onto the faces of an octahedron, unfolded into [-1, 1]^2 - decoded in model.vert
+inline glm::vec2 octahedralEncode(const glm::vec3& direction) {
+    const float length = glm::abs(direction.x) + glm::abs(direction.y) + glm::abs(direction.z);
+    if (length == 0.0f) return glm::vec2(0.0f);
+    const glm::vec3 n = direction / length;
+    if (n.z >= 0.0f) return glm::vec2(n.x, n.y);
+    // the lower half is folded out over the corners
+    return (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// the layout meshes are stored in on the GPU - 20 bytes against the 44 of Vertex
+struct PackedVertex {
+    // snorm position within the mesh's quantisation box, see Mesh::getDequantisation - w is unused
+    // held as two halves, as a u64 would align the vertex to 8 bytes and pad it out to 24
+    std::array<u32, 2> pos;
+    // half float
+    u32 uv;
+    // octahedral encoded snorm
+    u32 normal;
+    u32 tangent;
 
     static vk::VertexInputBindingDescription getBindingDescription() {
         return {
             .binding = 0,
-            .stride = sizeof(Vertex),
+            .stride = sizeof(PackedVertex),
             .inputRate = vk::VertexInputRate::eVertex
         };
     }
@@ -46,30 +70,52 @@ struct Vertex {
         descriptions.push_back({
             .location = 0,
             .binding = 0,
-            .format = vk::Format::eR32G32B32Sfloat,
-            .offset = offsetof(Vertex, pos)
+            .format = vk::Format::eR16G16B16A16Snorm,
+            .offset = offsetof(PackedVertex, pos)
         });
-        // color
+        // uv
         descriptions.push_back({
             .location = 1,
             .binding = 0,
-            .format = vk::Format::eR32G32Sfloat,
-            .offset = offsetof(Vertex, uv)
+            .format = vk::Format::eR16G16Sfloat,
+            .offset = offsetof(PackedVertex, uv)
         });
         // normal
         descriptions.push_back({
             .location = 2,
             .binding = 0,
-            .format = vk::Format::eR32G32B32Sfloat,
-            .offset = offsetof(Vertex, normal)
+            .format = vk::Format::eR16G16Snorm,
+            .offset = offsetof(PackedVertex, normal)
         });
         // tangent
         descriptions.push_back({
             .location = 3,
             .binding = 0,
-            .format = vk::Format::eR32G32B32Sfloat,
-            .offset = offsetof(Vertex, tangent)
+            .format = vk::Format::eR16G16Snorm,
+            .offset = offsetof(PackedVertex, tangent)
         });
         return descriptions;
     }
 };
+static_assert(sizeof(PackedVertex) == 20);
+
+// the vertex meshes are loaded and processed as, before being packed into the geometry pool
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec2 uv;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+
+    using Packed = PackedVertex;
+
+    // positions are moved into a box of half size scale around center, which has to contain them
+    static PackedVertex pack(const Vertex& vertex, const glm::vec3& center, const float scale) {
+        const u64 pos = glm::packSnorm4x16(glm::vec4((vertex.pos - center) / scale, 0.0f));
+        return {
+            .pos = {static_cast<u32>(pos), static_cast<u32>(pos >> 32)},
+            .uv = glm::packHalf2x16(vertex.uv),
+            .normal = glm::packSnorm2x16(octahedralEncode(vertex.normal)),
+            .tangent = glm::packSnorm2x16(octahedralEncode(vertex.tangent)),
+        };
+    }
+};
@@ -115,6 +115,26 @@ private:
 struct Frustum {
     Plane top, bottom, right, left, near, far;
 
+    // extract the planes of a view projection matrix with 0 to 1 depth, facing inwards
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        const auto row = [&](const int i) {
+            return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        };
+        // a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+        const auto toPlane = [](const glm::vec4& plane) {
+            const float length = glm::length(glm::vec3(plane));
+            return Plane(glm::vec3(plane) / length, -plane.w / length);
+        };
+        return {
+            .top = toPlane(row(3) - row(1)),
+            .bottom = toPlane(row(3) + row(1)),
+            .right = toPlane(row(3) - row(0)),
+            .left = toPlane(row(3) + row(0)),
+            .near = toPlane(row(2)),
+            .far = toPlane(row(3) - row(2)),
+        };
+    }
+
     bool intersects(const Sphere& sphere) const {
         return sphere.intersectsOrForwards(top)
             && sphere.intersectsOrForwards(bottom)
@@ -18,8 +18,13 @@
 #include "AssetManager.h"
 #include "Components.h"
 #include "EntitySystem.h"
+#include "FrameAllocator.h"
 #include "LightSystem.h"
+#include "MaterialTable.h"
+#include "PipelineCache.h"
 #include "Renderer3D.h"
+#include "ShaderReloader.h"
+#include "ThreadPool.h"
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -52,6 +57,7 @@ static VKAPI_ATTR vk::Bool32 VKAPI_CALL debugCallback(
 
 void VulkanEngine::run() {
 	VulkanEngine& e = get();
+	e.m_startTime = std::chrono::high_resolution_clock::now();
 	e.initWindow();
 	e.initVulkan();
 	e.initECS();
@@ -69,7 +75,11 @@ GLFWwindow * VulkanEngine::getWindow() {
 }
 
 FrameTimeInfo VulkanEngine::getFrameTimeInfo() {
-	auto [result, data] = m_queryPool.getResults<u64>(0, 2, 2 * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+	// the last frame to use this slot has passed its fence, so the results are ready without waiting
+	if (!m_timestampsWritten[m_frameIndex]) return m_timeInfo;
+
+	auto [result, data] = m_queryPool.getResults<u64>(m_frameIndex * 2, 2, 2 * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64);
+	if (result != vk::Result::eSuccess) return m_timeInfo;
 	const float nsPerTick = m_physicalDevice.getProperties().limits.timestampPeriod;
 	m_timeInfo.gpuTime = static_cast<float>(data[1] - data[0]) * nsPerTick / 1000000.0f;
 	return m_timeInfo;
@@ -106,6 +116,10 @@ const vk::raii::Queue & VulkanEngine::getGraphicsQueue() {
 	return get().m_graphicsQueue;
 }
 
+u32 VulkanEngine::getGraphicsQueueFamily() {
+	return get().findQueueFamilies(get().m_physicalDevice).graphicsFamily.value();
+}
+
 const vk::raii::Device & VulkanEngine::getDevice() {
 	return get().m_device;
 }
@@ -126,6 +140,34 @@ AssetManager * VulkanEngine::getAssetManager() {
 	return get().m_assetManager.get();
 }
 
+ThreadPool * VulkanEngine::getThreadPool() {
+	return get().m_threadPool.get();
+}
+
+u32 VulkanEngine::getFrameIndex() {
+	return get().m_frameIndex;
+}
+
+FrameAllocator * VulkanEngine::getFrameAllocator() {
+	return get().m_frameAllocator.get();
+}
+
+PipelineCache * VulkanEngine::getPipelineCache() {
+	return get().m_pipelineCache.get();
+}
+
+PipelineStateSupport VulkanEngine::getPipelineStateSupport() {
+	return get().m_pipelineStateSupport;
+}
+
+bool VulkanEngine::getMeshShaderSupport() {
+	return get().m_meshShaderSupport;
+}
+
+ShaderReloader * VulkanEngine::getShaderReloader() {
+	return get().m_shaderReloader.get();
+}
+
 void VulkanEngine::setPresentMode(vk::PresentModeKHR mode) {
 	get().m_presentMode = mode;
 	queueSwapRecreation();
@@ -198,9 +240,15 @@ void VulkanEngine::initVulkan() {
 	createQueryPool();
 	createDescriptorPool();
 	createSyncObjects();
+	m_frameAllocator = std::make_unique<FrameAllocator>(FRAME_ALLOCATOR_REGION_SIZE);
+	m_pipelineCache = std::make_unique<PipelineCache>(PIPELINE_CACHE_PATH);
+#ifdef SHADER_HOT_RELOAD
+	m_shaderReloader = std::make_unique<ShaderReloader>(SHADER_SOURCE_DIR);
+#endif
 }
 
 void VulkanEngine::initECS() {
+	m_threadPool = std::make_unique<ThreadPool>();
 	ECS::init();
 
 	InputManager::setWindow(m_window);
@@ -293,22 +341,112 @@ void VulkanEngine::createLogicalDevice() {
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	// materials are bound as one array of textures indexed in the shader, which needs descriptor indexing
+	const auto supportedFeatures = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+	const auto& indexingFeatures = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+	if (!indexingFeatures.runtimeDescriptorArray ||
+		!indexingFeatures.descriptorBindingPartiallyBound ||
+		!indexingFeatures.descriptorBindingSampledImageUpdateAfterBind ||
+		!indexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+		throw std::runtime_error("Physical device does not support descriptor indexing");
+	}
+
+	// indirect draws pass each instance's offset into the model uniforms as their first instance
+	const vk::PhysicalDeviceFeatures supportedCoreFeatures = m_physicalDevice.getFeatures();
+	if (!supportedCoreFeatures.drawIndirectFirstInstance) {
+		throw std::runtime_error("Physical device does not support a first instance in indirect draws");
+	}
+
 	vk::PhysicalDeviceFeatures deviceFeatures = {
+		.multiDrawIndirect = supportedCoreFeatures.multiDrawIndirect,
+		.drawIndirectFirstInstance = vk::True,
 		.fillModeNonSolid = vk::True,
 		.samplerAnisotropy = vk::True,
 	};
+
+	// state changed at runtime - sample count, polygon mode and depth - is set while recording where the device allows,
+	// and otherwise pipelines are linked from parts so only the part holding it is rebuilt
+	const auto availableExtensions = m_physicalDevice.enumerateDeviceExtensionProperties();
+	const auto hasExtension = [&availableExtensions](const std::string_view name) {
+		return std::ranges::any_of(availableExtensions, [name](const vk::ExtensionProperties& extension) {
+			return name == extension.extensionName.data();
+		});
+	};
+	std::vector<const char*> extensions(deviceExtensions.begin(), deviceExtensions.end());
+	m_pipelineStateSupport = PipelineStateSupport::Rebuild;
+	if (hasExtension(vk::EXTExtendedDynamicState3ExtensionName)) {
+		const auto dynamicStateFeatures = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>()
+			.get<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+		if (dynamicStateFeatures.extendedDynamicState3RasterizationSamples && dynamicStateFeatures.extendedDynamicState3PolygonMode) {
+			m_pipelineStateSupport = PipelineStateSupport::Dynamic;
+			extensions.push_back(vk::EXTExtendedDynamicState3ExtensionName);
+		}
+	}
+	if (m_pipelineStateSupport == PipelineStateSupport::Rebuild && hasExtension(vk::EXTGraphicsPipelineLibraryExtensionName)) {
+		const auto libraryFeatures = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>()
+			.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+		if (libraryFeatures.graphicsPipelineLibrary) {
+			m_pipelineStateSupport = PipelineStateSupport::Library;
+			extensions.push_back(vk::KHRPipelineLibraryExtensionName);
+			extensions.push_back(vk::EXTGraphicsPipelineLibraryExtensionName);
+		}
+	}
+	static constexpr std::array stateSupportNames = { "dynamic state", "pipeline libraries", "full rebuilds" };
+	Logger::info("Pipeline state changes use {}", stateSupportNames.at(static_cast<u32>(m_pipelineStateSupport)));
+
+	// culled meshlets are drawn by task and mesh shaders where the device has them, and otherwise have their indexes
+	// compacted by a compute pass and drawn indirectly
+	m_meshShaderSupport = false;
+	if (hasExtension(vk::EXTMeshShaderExtensionName)) {
+		const auto meshShaderFeatures = m_physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMeshShaderFeaturesEXT>()
+			.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+		if (meshShaderFeatures.taskShader && meshShaderFeatures.meshShader) {
+			m_meshShaderSupport = true;
+			extensions.push_back(vk::EXTMeshShaderExtensionName);
+		}
+	}
+	Logger::info("Culled meshlets are drawn with {}", m_meshShaderSupport ? "mesh shaders" : "compacted indexes");
+
 	vk::StructureChain createInfo = {
 		vk::DeviceCreateInfo {
 			.queueCreateInfoCount = static_cast<u32>(queueCreateInfos.size()),
 			.pQueueCreateInfos = queueCreateInfos.data(),
-			.enabledExtensionCount = static_cast<u32>(deviceExtensions.size()),
-			.ppEnabledExtensionNames = deviceExtensions.data(),
+			.enabledExtensionCount = static_cast<u32>(extensions.size()),
+			.ppEnabledExtensionNames = extensions.data(),
 			.pEnabledFeatures = &deviceFeatures,
 		},
-		vk::PhysicalDeviceDynamicRenderingFeatures {
+		vk::PhysicalDeviceVulkan12Features {
+			.descriptorIndexing = vk::True,
+			.shaderSampledImageArrayNonUniformIndexing = vk::True,
+			.descriptorBindingSampledImageUpdateAfterBind = vk::True,
+			.descriptorBindingPartiallyBound = vk::True,
+			.runtimeDescriptorArray = vk::True
+		},
+		vk::PhysicalDeviceVulkan13Features {
+			.synchronization2 = vk::True,
 			.dynamicRendering = vk::True
+		},
+		vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT {
+			.extendedDynamicState3PolygonMode = vk::True,
+			.extendedDynamicState3RasterizationSamples = vk::True
+		},
+		vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT {
+			.graphicsPipelineLibrary = vk::True
+		},
+		vk::PhysicalDeviceMeshShaderFeaturesEXT {
+			.taskShader = vk::True,
+			.meshShader = vk::True
 		}
 	};
+	if (m_pipelineStateSupport != PipelineStateSupport::Dynamic) {
+		createInfo.unlink<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+	}
+	if (m_pipelineStateSupport != PipelineStateSupport::Library) {
+		createInfo.unlink<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+	}
+	if (!m_meshShaderSupport) {
+		createInfo.unlink<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+	}
 
 	m_device = vk::raii::Device(m_physicalDevice, createInfo.get<vk::DeviceCreateInfo>());
 	m_graphicsQueue = vk::raii::Queue(m_device, indices.graphicsFamily.value(), 0);
@@ -392,15 +530,19 @@ void VulkanEngine::createCommandBuffers() {
 	vk::CommandBufferAllocateInfo allocInfo{
 		.commandPool = m_commandPool,
 		.level = vk::CommandBufferLevel::ePrimary,
-		.commandBufferCount = 1,
+		.commandBufferCount = FRAMES_IN_FLIGHT,
 	};
 
-	m_commandBuffer = std::move(m_device.allocateCommandBuffers(allocInfo).front());
+	m_commandBuffers = m_device.allocateCommandBuffers(allocInfo);
 }
 
 void VulkanEngine::createSyncObjects() {
-	m_imageAvailableSemaphore = vk::raii::Semaphore(m_device, vk::SemaphoreCreateInfo{});
-	m_inFlightFence = vk::raii::Fence(m_device, vk::FenceCreateInfo{ .flags = vk::FenceCreateFlagBits::eSignaled });
+	for (u32 i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+		m_imageAvailableSemaphores.emplace_back(m_device, vk::SemaphoreCreateInfo{});
+		m_inFlightFences.emplace_back(m_device, vk::FenceCreateInfo{ .flags = vk::FenceCreateFlagBits::eSignaled });
+	}
+
+	// signalled by the frame and waited on by present, so there is one per swap image rather than per frame
 
 	for (size_t i = 0; i < m_swapImageViews.size(); ++i) {
 		m_renderFinishedSemaphores.emplace_back(m_device, vk::SemaphoreCreateInfo{});
@@ -416,7 +558,7 @@ void VulkanEngine::createQueryPool() {
 
 	vk::QueryPoolCreateInfo createInfo = {
 		.queryType = vk::QueryType::eTimestamp,
-		.queryCount = 2,
+		.queryCount = 2 * FRAMES_IN_FLIGHT,
 	};
 
 	m_queryPool = vk::raii::QueryPool(m_device, createInfo);
@@ -425,15 +567,18 @@ void VulkanEngine::createQueryPool() {
 void VulkanEngine::createDescriptorPool() {
 	std::array poolSizes = {
 		vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer, 256},
-		vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, 256},
-		vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic, 32}
+		vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, 256 + MaterialTable::MAX_TEXTURES},
+		vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic, 32},
+		vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 32},
+		vk::DescriptorPoolSize{vk::DescriptorType::eStorageBufferDynamic, 32},
+		vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage, 32}
 	};
 	u32 maxSets = 0;
 	for (const auto& poolSize : poolSizes) {
 		maxSets += poolSize.descriptorCount;
 	}
 	vk::DescriptorPoolCreateInfo poolInfo = {
-		.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+		.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
 		.maxSets = maxSets,
 		.poolSizeCount = static_cast<u32>(poolSizes.size()),
 		.pPoolSizes = poolSizes.data(),
@@ -542,10 +687,10 @@ vk::Extent2D VulkanEngine::chooseExtent(const vk::SurfaceCapabilitiesKHR& capabi
 	return extent;
 }
 
-void VulkanEngine::copyBuffer(const vk::Buffer src, const vk::Buffer dst, const vk::DeviceSize size) {
+void VulkanEngine::copyBuffer(const vk::Buffer src, const vk::Buffer dst, const vk::DeviceSize size, const vk::DeviceSize srcOffset, const vk::DeviceSize dstOffset) {
 	vk::raii::CommandBuffer commandBuffer = beginSingleCommand();
 
-	vk::BufferCopy copyRegion{.size = size};
+	vk::BufferCopy copyRegion{.srcOffset = srcOffset, .dstOffset = dstOffset, .size = size};
 	commandBuffer.copyBuffer(src, dst, copyRegion);
 
 	endSingleCommand(commandBuffer);
@@ -614,6 +759,7 @@ VulkanEngine & VulkanEngine::get() {
 void VulkanEngine::mainLoop() {
 	using clock = std::chrono::high_resolution_clock;
 	auto prevTime = static_cast<float>(glfwGetTime());
+	bool firstFrame = true;
 	while (!glfwWindowShouldClose(m_window)) {
 		InputManager::update();
 		glfwPollEvents();
@@ -625,6 +771,16 @@ void VulkanEngine::mainLoop() {
 		m_timeInfo.cpuTime = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - updateStartTime).count()) / 1000000.0;
 
 		drawFrame();
+		if (firstFrame) {
+			firstFrame = false;
+			Logger::info(
+				"First frame after {:.0f} ms, with {} pipelines created in {:.0f} ms from a {} pipeline cache",
+				std::chrono::duration<double, std::milli>(clock::now() - m_startTime).count(),
+				m_pipelineCache->getPipelineCount(),
+				m_pipelineCache->getCreationTime(),
+				m_pipelineCache->isWarm() ? "warm" : "cold"
+			);
+		}
 
 		const auto nowTime = static_cast<float>(glfwGetTime());
 		m_deltaTime = nowTime - prevTime;
@@ -636,29 +792,39 @@ void VulkanEngine::mainLoop() {
 }
 
 void VulkanEngine::drawFrame() {
-	while (m_device.waitForFences(*m_inFlightFence, vk::True, std::numeric_limits<u64>::max()) == vk::Result::eTimeout) {}
-
-	auto [result, imageIndex] = m_swapChain.acquireNextImage(std::numeric_limits<u64>::max(), *m_imageAvailableSemaphore, nullptr);
+	// only wait for the frame that last used this frame's resources, the others can still be in flight
+	const vk::raii::Fence& inFlightFence = m_inFlightFences[m_frameIndex];
+	const vk::raii::Semaphore& imageAvailableSemaphore = m_imageAvailableSemaphores[m_frameIndex];
+	const vk::raii::CommandBuffer& commandBuffer = m_commandBuffers[m_frameIndex];
+	while (m_device.waitForFences(*inFlightFence, vk::True, std::numeric_limits<u64>::max()) == vk::Result::eTimeout) {}
+	m_frameAllocator->beginFrame(m_frameIndex);
+
+	auto [result, imageIndex] = m_swapChain.acquireNextImage(std::numeric_limits<u64>::max(), *imageAvailableSemaphore, nullptr);
 	if (result == vk::Result::eErrorOutOfDateKHR) {
 		recreateSwapChain();
 		return;
 	}
-	m_device.resetFences(*m_inFlightFence);
-	m_commandBuffer.reset();
-	recordCommandBuffer(m_commandBuffer, imageIndex);
+	m_device.resetFences(*inFlightFence);
+	// between frames, so a reloaded pipeline is used by the whole of the next one
+	if (m_shaderReloader) {
+		m_shaderReloader->update();
+	}
+	commandBuffer.reset();
+	recordCommandBuffer(commandBuffer, imageIndex);
 
 	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
 	const vk::SubmitInfo submitInfo = {
 		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &*m_imageAvailableSemaphore,
+		.pWaitSemaphores = &*imageAvailableSemaphore,
 		.pWaitDstStageMask = waitStages,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &*m_commandBuffer,
+		.pCommandBuffers = &*commandBuffer,
 		.signalSemaphoreCount = 1,
 		.pSignalSemaphores = &*m_renderFinishedSemaphores[imageIndex],
 	};
 
-	m_graphicsQueue.submit(submitInfo, m_inFlightFence);
+	m_graphicsQueue.submit(submitInfo, inFlightFence);
+	m_frameIndex = (m_frameIndex + 1) % FRAMES_IN_FLIGHT;
 
 	const vk::PresentInfoKHR presentInfo = {
 		.waitSemaphoreCount = 1,
@@ -686,11 +852,13 @@ void VulkanEngine::recordCommandBuffer(const vk::raii::CommandBuffer& commandBuf
 	const auto drawStartTime = clock::now();
 
 	commandBuffer.begin({});
-	commandBuffer.resetQueryPool(m_queryPool, 0, 2);
-	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool, 0);
+	const u32 firstQuery = m_frameIndex * 2;
+	commandBuffer.resetQueryPool(m_queryPool, firstQuery, 2);
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool, firstQuery);
 	m_renderer->render(commandBuffer, m_swapChain.getImages().at(imageIndex), m_swapImageViews[imageIndex]);
-	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPool, 1);
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPool, firstQuery + 1);
 	commandBuffer.end();
+	m_timestampsWritten[m_frameIndex] = true;
 
 	m_timeInfo.drawWriteTime = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - drawStartTime).count()) / 1000000.0;
 }
@@ -716,6 +884,8 @@ void VulkanEngine::recreateSwapChain() {
 }
 
 void VulkanEngine::cleanup() const {
+	// the device is idle by now, so every pipeline that will be created has been
+	m_pipelineCache->save();
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
 	ECS::destroy();
@@ -3,6 +3,7 @@
 #include <vector>
 #include <optional>
 #include <array>
+#include <chrono>
 
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
@@ -17,6 +18,12 @@
 constexpr u32 WINDOW_WIDTH = 1280;
 constexpr u32 WINDOW_HEIGHT = 720;
 
+// size of each frame's region in the frame allocator
+constexpr vk::DeviceSize FRAME_ALLOCATOR_REGION_SIZE = 8 * 1024 * 1024;
+
+// where compiled pipelines are kept between runs, relative to the working directory
+constexpr auto PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
 constexpr std::array validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
 };
@@ -31,6 +38,17 @@ constexpr std::array deviceExtensions = {
 	vk::KHRDynamicRenderingExtensionName,
 };
 
+// how pipelines change the state allowed by Pipeline::Builder::allowStateChanges, best first, picked by what the
+// device supports
+enum class PipelineStateSupport {
+	// set while recording, with VK_EXT_extended_dynamic_state3
+	Dynamic,
+	// linked from VK_EXT_graphics_pipeline_library parts, relinking only the part holding the state
+	Library,
+	// built again as a whole
+	Rebuild,
+};
+
 #ifdef NDEBUG
 constexpr bool ENABLE_VALIDATION_LAYERS = false;
 #else
@@ -42,6 +60,10 @@ class DebugWindow;
 class AssetManager;
 class Pipeline;
 class Renderer3D;
+class ThreadPool;
+class FrameAllocator;
+class PipelineCache;
+class ShaderReloader;
 
 struct QueueFamilyIndices {
 	std::optional<u32> graphicsFamily;
@@ -61,11 +83,24 @@ public:
 	VRAMUsageInfo getVramUsage() const;
 	static const vk::raii::Instance& getInstance();
 	static const vk::raii::Queue& getGraphicsQueue();
+	static u32 getGraphicsQueueFamily();
 	static const vk::raii::Device& getDevice();
 	static const vk::raii::PhysicalDevice& getPhysicalDevice();
 	static const vk::raii::DescriptorPool& getDescriptorPool();
 	static Renderer3D *getRenderer();
 	static AssetManager* getAssetManager();
+	static ThreadPool* getThreadPool();
+	// which set of per-frame resources the frame being recorded should write to
+	static u32 getFrameIndex();
+	// transient per-frame GPU data, reset at the start of each frame
+	static FrameAllocator* getFrameAllocator();
+	// shared by every pipeline, along with their shader modules
+	static PipelineCache* getPipelineCache();
+	static PipelineStateSupport getPipelineStateSupport();
+	// whether culled meshlets are drawn by task and mesh shaders, with VK_EXT_mesh_shader
+	static bool getMeshShaderSupport();
+	// watches the shader sources while running, when built with SHADER_HOT_RELOAD - nullptr otherwise
+	static ShaderReloader* getShaderReloader();
 	static void setPresentMode(vk::PresentModeKHR mode);
 	static vk::PresentModeKHR getPresentMode();
 
@@ -80,7 +115,7 @@ public:
 	static void addUpdateListener(IUpdatable* updatable);
 
 	static std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
-	static void copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize size);
+	static void copyBuffer(vk::Buffer src, vk::Buffer dst, vk::DeviceSize size, vk::DeviceSize srcOffset = 0, vk::DeviceSize dstOffset = 0);
 	static vk::raii::DeviceMemory allocateMemory(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties);
 
 	static vk::raii::CommandBuffer beginSingleCommand();
@@ -152,16 +187,27 @@ private:
 	vk::Extent2D m_swapExtent;
 
 	vk::raii::CommandPool m_commandPool = nullptr;
-	vk::raii::CommandBuffer m_commandBuffer = nullptr;
+	std::vector<vk::raii::CommandBuffer> m_commandBuffers;
 
-	vk::raii::Semaphore m_imageAvailableSemaphore = nullptr;
+	std::vector<vk::raii::Semaphore> m_imageAvailableSemaphores;
 	std::vector<vk::raii::Semaphore> m_renderFinishedSemaphores;
-	vk::raii::Fence m_inFlightFence = nullptr;
+	std::vector<vk::raii::Fence> m_inFlightFences;
+	u32 m_frameIndex = 0;
 
+	// two timestamps per frame in flight
 	vk::raii::QueryPool m_queryPool = nullptr;
+	std::array<bool, FRAMES_IN_FLIGHT> m_timestampsWritten = {};
 	vk::raii::DescriptorPool m_descriptorPool = nullptr;
+	std::unique_ptr<FrameAllocator> m_frameAllocator;
+	std::unique_ptr<PipelineCache> m_pipelineCache;
+	PipelineStateSupport m_pipelineStateSupport = PipelineStateSupport::Rebuild;
+	bool m_meshShaderSupport = false;
+	std::unique_ptr<ShaderReloader> m_shaderReloader;
+	// for the time to the first frame, which depends on how many pipelines the cache already has
+	std::chrono::high_resolution_clock::time_point m_startTime;
 
 	std::unique_ptr<AssetManager> m_assetManager;
 	std::unique_ptr<DebugWindow> m_debugWindow;
+	std::unique_ptr<ThreadPool> m_threadPool;
 };
 
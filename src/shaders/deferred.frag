@@ -0,0 +1,54 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+// lights every pixel the G-buffer pass covered - the background is left for the skybox
+
+layout(location = 0) in vec2 UV;
+
+layout(location = 0) out vec4 OutColor;
+
+#include "material.glsl"
+#include "lighting.glsl"
+
+layout(set = 3, binding = 0) uniform sampler2D gAlbedoAO;
+layout(set = 3, binding = 1) uniform sampler2D gNormal;
+layout(set = 3, binding = 2) uniform sampler2D gMetallicRoughness;
+layout(set = 3, binding = 3) uniform sampler2D gDepth;
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0) {
+        discard;
+    }
+
+    vec4 ndc = vec4(UV * 2.0 - 1.0, depth, 1.0);
+    vec4 worldPosition = inverseViewProjection * ndc;
+    vec3 position = worldPosition.xyz / worldPosition.w;
+
+    vec4 albedoAO = texelFetch(gAlbedoAO, pixel, 0);
+    vec2 metallicRoughness = texelFetch(gMetallicRoughness, pixel, 0).rg;
+
+    Surface surface;
+    surface.albedo = albedoAO.rgb;
+    surface.alpha = 1.0;
+    surface.metallic = metallicRoughness.r;
+    surface.roughness = metallicRoughness.g;
+    surface.ao = albedoAO.a;
+    surface.normal = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+
+    vec3 V = normalize(cameraPosition - position);
+    vec3 result = shadeSurface(surface, position, V, gl_FragCoord.xy);
+
+    OutColor = vec4(applyFog(result, position, V), 1.0);
+}
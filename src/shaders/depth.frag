@@ -0,0 +1,33 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+// only used by alpha masked materials - opaque materials write depth without a fragment shader
+
+struct MaterialData {
+    vec4 baseColourFactor;
+    uint baseTexture;
+    uint metallicRoughnessTexture;
+    uint aoTexture;
+    uint normalTexture;
+    float metallicFactor;
+    float roughnessFactor;
+    float aoStrength;
+    float normalScale;
+    float alphaCutoff;
+};
+
+layout(location = 0) in vec2 UV;
+layout(location = 1) flat in uint MaterialID;
+
+layout(std430, set = 1, binding = 0) readonly buffer MaterialBuffer {
+    MaterialData materials[];
+};
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+void main() {
+    MaterialData material = materials[MaterialID];
+    float alpha = texture(textures[nonuniformEXT(material.baseTexture)], UV).a * material.baseColourFactor.a;
+    if (alpha < material.alphaCutoff) {
+        discard;
+    }
+}
@@ -0,0 +1,33 @@
+#version 460
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inUV;
+
+layout(location = 0) out vec2 UV;
+layout(location = 1) flat out uint MaterialID;
+
+// must match model.vert exactly, so the shading pass can test for equal depth
+invariant gl_Position;
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+};
+
+struct ModelData {
+    mat3x4 model;
+    uint materialID;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer ModelBuffer {
+    ModelData models[];
+};
+
+void main() {
+    mat3x4 model = models[gl_InstanceIndex].model;
+    MaterialID = models[gl_InstanceIndex].materialID;
+
+    vec3 FragPos = vec4(inPosition, 1.0) * model;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    UV = vec2(inUV.x, 1.0 - inUV.y);
+}
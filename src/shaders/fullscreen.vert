@@ -0,0 +1,10 @@
+#version 460
+
+// a single triangle covering the screen, with no vertex buffer
+
+layout(location = 0) out vec2 UV;
+
+void main() {
+    UV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(UV * 2.0 - 1.0, 0.0, 1.0);
+}
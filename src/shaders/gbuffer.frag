@@ -0,0 +1,42 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+// writes the surface to the G-buffer for the deferred lighting pass - blended materials are still shaded forward
+
+#define ALPHA_OPAQUE 0
+#define ALPHA_MASK 1
+
+layout(constant_id = 0) const uint ALPHA_MODE = ALPHA_OPAQUE;
+
+layout(location = 0) in vec2 UV;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec3 FragPos;
+layout(location = 3) in mat3 TBN;
+layout(location = 6) flat in uint MaterialID;
+
+// must match the G-buffer formats in Renderer3D
+layout(location = 0) out vec4 OutAlbedoAO;
+layout(location = 1) out vec2 OutNormal;
+layout(location = 2) out vec2 OutMetallicRoughness;
+
+#include "material.glsl"
+
+// octahedral encoding, folding the lower hemisphere over the upper one
+vec2 encodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
+void main() {
+    MaterialData material = materials[MaterialID];
+    Surface surface = sampleSurface(material, UV, TBN);
+    if (ALPHA_MODE == ALPHA_MASK && surface.alpha < material.alphaCutoff) {
+        discard;
+    }
+
+    OutAlbedoAO = vec4(surface.albedo, surface.ao);
+    OutNormal = encodeNormal(surface.normal);
+    OutMetallicRoughness = vec2(surface.metallic, surface.roughness);
+}
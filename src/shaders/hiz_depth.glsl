@@ -0,0 +1,46 @@
+// builds the first level of the depth pyramid from the depth attachment, each texel the furthest of the 2x2 pixels
+// under it - define MULTISAMPLED before including to take the furthest of every sample
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+#include "meshlet.glsl"
+
+#ifdef MULTISAMPLED
+layout(set = 0, binding = 1) uniform sampler2DMS depthBuffer;
+#else
+layout(set = 0, binding = 1) uniform sampler2D depthBuffer;
+#endif
+
+layout(set = 0, binding = 2, r32f) uniform writeonly image2D pyramid;
+
+float loadDepth(ivec2 pixel) {
+#ifdef MULTISAMPLED
+    float depth = 0.0;
+    for (int i = 0; i < textureSamples(depthBuffer); i++)
+    {
+        depth = max(depth, texelFetch(depthBuffer, pixel, i).r);
+    }
+    return depth;
+#else
+    return texelFetch(depthBuffer, pixel, 0).r;
+#endif
+}
+
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(coord, imageSize(pyramid)))) return;
+
+    // pixels outside the rendered region are left at the near plane, so they never raise the maximum - the culling
+    // pass only looks at the rendered region, but levels above cover both
+    float depth = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 pixel = coord * 2 + ivec2(i & 1, i >> 1);
+        if (all(lessThan(pixel, ivec2(renderSize))))
+        {
+            depth = max(depth, loadDepth(pixel));
+        }
+    }
+    imageStore(pyramid, coord, vec4(depth));
+}
@@ -0,0 +1,60 @@
+// shared by the image based lighting passes, which write every face of a cubemap at once, one dispatch per mip
+
+#define PI 3.1415926535897932384626433
+
+// direction through the centre of a texel on a cube face, following Vulkan's cube map face layout
+vec3 cubeDirection(uvec3 id, uint size)
+{
+    vec2 uv = (vec2(id.xy) + 0.5) / float(size) * 2.0 - 1.0;
+    switch (id.z)
+    {
+        case 0: return normalize(vec3(1.0, -uv.y, -uv.x));
+        case 1: return normalize(vec3(-1.0, -uv.y, uv.x));
+        case 2: return normalize(vec3(uv.x, 1.0, uv.y));
+        case 3: return normalize(vec3(uv.x, -1.0, -uv.y));
+        case 4: return normalize(vec3(uv.x, -uv.y, 1.0));
+        default: return normalize(vec3(-uv.x, -uv.y, -1.0));
+    }
+}
+
+// low discrepancy points in [0, 1)^2, covering the square more evenly than random ones
+vec2 hammersley(uint i, uint count)
+{
+    return vec2(float(i) / float(count), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// tangent space around N to world space
+mat3 tangentFrame(vec3 N)
+{
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    return mat3(tangent, bitangent, N);
+}
+
+// half vector in tangent space, distributed by GGX
+vec3 importanceSampleGGX(vec2 Xi, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * Xi.x;
+    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    return vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+}
+
+float distributionGGX(float NdotH, float roughness)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+// level of a cubemap where one texel covers the solid angle a sample with this pdf stands for, so sparse samples
+// average the sky between them instead of aliasing
+float sampleLod(float pdf, uint sampleCount, float size)
+{
+    float sampleSolidAngle = 1.0 / (float(sampleCount) * pdf + 0.0001);
+    float texelSolidAngle = 4.0 * PI / (6.0 * size * size);
+    return max(0.5 * log2(sampleSolidAngle / texelSolidAngle), 0.0);
+}
@@ -2,22 +2,26 @@
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inUV;
-layout(location = 2) in vec3 inNorm;
-layout(location = 3) in vec3 inTang;
+layout(location = 2) in vec2 inNorm;
+layout(location = 3) in vec2 inTang;
 
 layout(set = 0, binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 projection;
 };
 
-layout(set = 2, binding = 0) uniform ModelUniforms {
-    mat4 model;
+struct ModelData {
+    mat3x4 model;
     int id;
 };
 
+layout(std430, set = 2, binding = 0) readonly buffer ModelBuffer {
+    ModelData models[];
+};
+
 layout (location = 0) flat out int outID;
 
 void main() {
-    gl_Position = projection * view * model * vec4(inPosition.xyz, 1.0);
-    outID = id;
+    gl_Position = projection * view * vec4(vec4(inPosition.xyz, 1.0) * models[gl_InstanceIndex].model, 1.0);
+    outID = models[gl_InstanceIndex].id;
 }
\ No newline at end of file
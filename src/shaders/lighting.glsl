@@ -0,0 +1,258 @@
+// clustered PBR lighting, image based ambient lighting and fog, shared by the forward and deferred shading shaders
+// needs material.glsl for Surface
+
+#define PI 3.1415926535897932384626433
+#define BRDF_EPSILON 0.000001
+
+#define DIELECTRIC_F0 0.04
+
+// must match ClusteredLighting
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+// must match ShadowMaps
+#define MAX_SHADOWED_LIGHTS 64
+#define SHADOW_FACE_COUNT 6
+
+struct BRDFParams {
+    vec3 V;
+    vec3 F0;
+    vec3 albedo;
+    float roughness;
+    float metallic;
+    vec3 normal;
+};
+
+struct PointLight {
+    vec3 position;
+    float range;
+    vec3 colour;
+    float strength;
+};
+
+struct Cluster {
+    uint lightCount;
+    uint lights[MAX_LIGHTS_PER_CLUSTER];
+};
+
+struct ShadowFace {
+    mat4 viewProjection;
+    // offset and size of the face's tile in atlas UVs
+    vec4 atlasRect;
+};
+
+layout(std140, set = 0, binding = 1) uniform FrameData {
+    mat4 view;
+    mat4 inverseViewProjection;
+    vec3 cameraPosition;
+    float far;
+    vec2 screenSize;
+    // map the log of view depth to a cluster slice
+    float clusterScale;
+    float clusterBias;
+    float fog;
+    // whether ambientOcclusionMap has this frame's screen space occlusion
+    uint ambientOcclusionEnabled;
+};
+
+layout(set = 0, binding = 2) uniform samplerCube skybox;
+
+layout(std430, set = 0, binding = 3) readonly buffer LightBuffer {
+    PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer ClusterBuffer {
+    Cluster clusters[];
+};
+
+layout(std430, set = 0, binding = 5) readonly buffer ShadowBuffer {
+    ShadowFace shadowFaces[MAX_SHADOWED_LIGHTS * SHADOW_FACE_COUNT];
+    // index of each light's first face, or -1 if it isn't shadowed
+    int lightShadows[];
+};
+
+layout(set = 0, binding = 6) uniform sampler2DShadow shadowAtlas;
+
+// half resolution screen space occlusion, with the view depth it was computed at
+layout(set = 0, binding = 7) uniform sampler2D ambientOcclusionMap;
+
+// relative difference in view depth before a half resolution texel is treated as a different surface
+#define AO_DEPTH_TOLERANCE 0.1
+
+// image based lighting from the skybox
+layout(set = 0, binding = 8) uniform samplerCube irradianceMap;
+layout(set = 0, binding = 9) uniform samplerCube specularMap;
+layout(set = 0, binding = 10) uniform sampler2D brdfLut;
+
+// must match ImageBasedLighting::SPECULAR_MIPS - 1
+#define MAX_SPECULAR_LOD 5.0
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+float distributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float NdH = max(dot(N, H), 0.0);
+    float NdH2 = NdH * NdH;
+
+    float numerator = a2;
+    float temp = (NdH2) * (a2 - 1.0) + 1.0;
+    float denominator = PI * temp * temp;
+    return numerator / denominator;
+}
+
+float geometrySchlickGGX(float NdV, float roughness)
+{
+    float r = roughness + 1.0;
+    float k = r*r / 8.0;
+    float denominator = NdV * (1 - k) + k;
+    return NdV / denominator;
+}
+
+float geometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2  = geometrySchlickGGX(NdotV, roughness);
+    float ggx1  = geometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+
+vec3 pointLightContribution(PointLight pLight, BRDFParams p, vec3 position)
+{
+    vec3 L = normalize(pLight.position - position);
+    vec3 H = normalize(p.V + L);
+
+    float distance = length(pLight.position - position);
+    // windowed so the light reaches zero at its range, rather than cutting off at the edge of its clusters
+    float falloff = clamp(1.0 - pow(distance / pLight.range, 4.0), 0.0, 1.0);
+    float attenuation = pLight.strength / (distance * distance) * falloff * falloff;
+    vec3 radiance = pLight.colour * attenuation;
+
+    vec3 F = fresnelSchlick(max(dot(H, p.V), 0.0), p.F0, p.roughness);
+    float NDF = distributionGGX(p.normal, H, p.roughness);
+    float G = geometrySmith(p.normal, p.V, L, p.roughness);
+
+    vec3 numerator = NDF * G * F;
+    float denominator = 4.0 * max(dot(p.normal, p.V), 0.0) * max(dot(p.normal, L), 0.0) + BRDF_EPSILON;
+    vec3 specular = numerator / denominator;
+
+    vec3 kD = (vec3(1.0) - F) * (1.0 - p.metallic);
+
+    float NdL = max(dot(p.normal, L), 0.0);
+    return (kD * p.albedo / PI + specular) * radiance * NdL;
+}
+
+// fraction of the light reaching position, from the cube face facing it
+float shadowFactor(uint lightIndex, vec3 position, vec3 lightPosition)
+{
+    int firstFace = lightShadows[lightIndex];
+    if (firstFace < 0) return 1.0;
+
+    // faces are ordered +x, -x, +y, -y, +z, -z - the major axis of the direction from the light picks one
+    vec3 direction = position - lightPosition;
+    vec3 absDirection = abs(direction);
+    int face;
+    if (absDirection.x >= absDirection.y && absDirection.x >= absDirection.z) face = direction.x > 0.0 ? 0 : 1;
+    else if (absDirection.y >= absDirection.z) face = direction.y > 0.0 ? 2 : 3;
+    else face = direction.z > 0.0 ? 4 : 5;
+
+    ShadowFace shadowFace = shadowFaces[firstFace + face];
+    vec4 clip = shadowFace.viewProjection * vec4(position, 1.0);
+    vec3 ndc = clip.xyz / clip.w;
+
+    // kept half a texel inside the tile, so filtering never reads a neighbouring face
+    vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0));
+    vec2 uv = shadowFace.atlasRect.xy + clamp(ndc.xy * 0.5 + 0.5, 0.0, 1.0) * shadowFace.atlasRect.zw;
+    uv = clamp(uv, shadowFace.atlasRect.xy + halfTexel, shadowFace.atlasRect.xy + shadowFace.atlasRect.zw - halfTexel);
+    return texture(shadowAtlas, vec3(uv, ndc.z));
+}
+
+// screen space occlusion, upsampled from half resolution using only the texels on the same surface
+float screenSpaceOcclusion(vec2 fragCoord, float viewDepth)
+{
+    if (ambientOcclusionEnabled == 0) return 1.0;
+
+    // the map may be larger than what was rendered to this frame
+    ivec2 size = ivec2(ceil(screenSize * 0.5));
+    vec2 halfCoord = fragCoord * 0.5 - 0.5;
+    ivec2 base = ivec2(floor(halfCoord));
+    vec2 f = halfCoord - vec2(base);
+
+    float total = 0.0;
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec2 texel = texelFetch(ambientOcclusionMap, clamp(base + offset, ivec2(0), size - 1), 0).rg;
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y * max(0.0, 1.0 - abs(texel.g - viewDepth) / (viewDepth * AO_DEPTH_TOLERANCE));
+        total += texel.r * weight;
+        weightSum += weight;
+    }
+    // surfaces the occlusion wasn't computed for, like blended ones, aren't occluded
+    return weightSum > 0.0001 ? total / weightSum : 1.0;
+}
+
+// diffuse and specular light from the sky, using the split sum approximation for specular
+vec3 imageBasedLighting(BRDFParams p)
+{
+    float NdotV = max(dot(p.normal, p.V), 0.0);
+    vec3 F = fresnelSchlick(NdotV, p.F0, p.roughness);
+    vec3 kD = (1.0 - F) * (1.0 - p.metallic);
+    vec3 diffuse = texture(irradianceMap, p.normal).rgb * p.albedo;
+
+    vec3 R = reflect(-p.V, p.normal);
+    vec3 prefiltered = textureLod(specularMap, R, p.roughness * MAX_SPECULAR_LOD).rgb;
+    vec2 brdf = texture(brdfLut, vec2(NdotV, p.roughness)).rg;
+    vec3 specular = prefiltered * (F * brdf.x + brdf.y);
+
+    return kD * diffuse + specular;
+}
+
+// ambient light plus every light in the cluster containing the fragment at fragCoord
+vec3 shadeSurface(Surface surface, vec3 position, vec3 V, vec2 fragCoord)
+{
+    BRDFParams params;
+    params.V = V;
+    params.F0 = mix(vec3(DIELECTRIC_F0), surface.albedo, surface.metallic);
+    params.albedo = surface.albedo;
+    params.roughness = surface.roughness;
+    params.metallic = surface.metallic;
+    params.normal = surface.normal;
+
+    float viewDepth = -(view * vec4(position, 1.0)).z;
+    uint slice = uint(clamp(log(viewDepth) * clusterScale - clusterBias, 0.0, CLUSTERS_Z - 1));
+    uvec2 tile = min(uvec2(fragCoord / screenSize * vec2(CLUSTERS_X, CLUSTERS_Y)), uvec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    uint clusterIndex = slice * CLUSTERS_X * CLUSTERS_Y + tile.y * CLUSTERS_X + tile.x;
+
+    vec3 Lo = vec3(0.0);
+    uint lightCount = clusters[clusterIndex].lightCount;
+    for (uint i = 0; i < lightCount; i++)
+    {
+        uint lightIndex = clusters[clusterIndex].lights[i];
+        PointLight light = lights[lightIndex];
+        Lo += pointLightContribution(light, params, position) * shadowFactor(lightIndex, position, light.position);
+    }
+
+    vec3 ambient = imageBasedLighting(params) * surface.ao * screenSpaceOcclusion(fragCoord, viewDepth);
+    return ambient + Lo;
+}
+
+// gamma correct and fade into the skybox behind the fragment, so fog doesn't rely on blending
+vec3 applyFog(vec3 colour, vec3 position, vec3 V)
+{
+    float distanceToFrag = length(position - cameraPosition);
+    float fogFactor = (distanceToFrag - (far - fog)) / fog;
+    fogFactor = 1 - clamp(fogFactor, 0, 1);
+
+    vec3 fogColour = texture(skybox, -V).rgb;
+    return mix(fogColour, pow(colour, vec3(1/2.2)), fogFactor);
+}
@@ -0,0 +1,52 @@
+// material table bindings and sampling, shared by the forward and G-buffer shaders
+// needs GL_EXT_nonuniform_qualifier
+
+struct MaterialData {
+    vec4 baseColourFactor;
+    uint baseTexture;
+    uint metallicRoughnessTexture;
+    uint aoTexture;
+    uint normalTexture;
+    float metallicFactor;
+    float roughnessFactor;
+    float aoStrength;
+    float normalScale;
+    float alphaCutoff;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer MaterialBuffer {
+    MaterialData materials[];
+};
+// instances of different materials can share a subgroup, so indexes must be marked as non-uniform
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+// everything shading needs to know about a point on a surface
+struct Surface {
+    vec3 albedo;
+    float alpha;
+    float metallic;
+    float roughness;
+    float ao;
+    vec3 normal;
+};
+
+Surface sampleSurface(MaterialData material, vec2 uv, mat3 tbn) {
+    Surface surface;
+    vec4 albedoAlpha = texture(textures[nonuniformEXT(material.baseTexture)], uv).rgba * material.baseColourFactor;
+    surface.albedo = albedoAlpha.rgb;
+    surface.alpha = albedoAlpha.a;
+
+    vec2 metallicRoughness = texture(textures[nonuniformEXT(material.metallicRoughnessTexture)], uv).rg;
+    metallicRoughness *= vec2(material.metallicFactor, material.roughnessFactor);
+    surface.metallic = metallicRoughness.r;
+    surface.roughness = metallicRoughness.g;
+
+    float ao = texture(textures[nonuniformEXT(material.aoTexture)], uv).r;
+    surface.ao = 1.0 + material.aoStrength * (ao - 1.0);
+
+    vec3 normal = texture(textures[nonuniformEXT(material.normalTexture)], uv).rgb;
+    normal = normal * 2.0 - vec3(1.0);
+    normal.xy *= material.normalScale;
+    surface.normal = normalize(tbn * normal);
+    return surface;
+}
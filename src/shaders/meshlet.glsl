@@ -0,0 +1,23 @@
+// parameters shared by the meshlet culling pass and the passes building the depth pyramid it tests against, and by
+// the task shaders culling meshlets in its place - define MESHLET_SET before including to bind them to another set
+
+#ifndef MESHLET_SET
+#define MESHLET_SET 0
+#endif
+
+// must match MeshletCulling::Params
+layout(std140, set = MESHLET_SET, binding = 0) uniform Params {
+    mat4 previousViewProjection;
+    // inward facing planes as (normal, distance)
+    vec4 frustumPlanes[6];
+    // the first culled instance of each alpha mode's pipeline, indexed by ALPHA_MODE - w is unused
+    uvec4 firstInstances;
+    vec3 cameraPosition;
+    uint instanceCount;
+    // the region of the depth attachment rendered to this frame, and the one the pyramid was built from
+    vec2 renderSize;
+    vec2 previousRenderSize;
+    uint pyramidLevels;
+    uint coneCulling;
+    uint occlusionCulling;
+};
@@ -0,0 +1,152 @@
+// the meshlets and instances culled each frame, and the tests culling them - shared by the compute pass compacting
+// the indexes of the meshlets left and the task shaders passing them on to mesh shaders
+
+#include "meshlet.glsl"
+
+// must match Meshlet in GeometryPool.h
+struct Meshlet {
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;
+    uint firstIndex;
+    uint indexCount;
+    uint shortIndexes;
+};
+
+// must match MeshletCulling::Instance
+struct Instance {
+    uint firstMeshlet;
+    uint meshletCount;
+};
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+// the most meshlets a task shader workgroup tests, and passes on to mesh shaders - must match
+// MeshletCulling::TASK_MESHLETS
+#define TASK_MESHLETS 32
+
+// what a task shader workgroup passes on to the mesh shader workgroups it launches, one per meshlet kept
+struct MeshletPayload {
+    uint instance;
+    uint meshlets[TASK_MESHLETS];
+};
+
+layout(set = MESHLET_SET, binding = 1) uniform sampler2D depthPyramid;
+
+layout(std430, set = MESHLET_SET, binding = 2) readonly buffer MeshletBuffer {
+    Meshlet meshlets[];
+};
+
+layout(std430, set = MESHLET_SET, binding = 3) readonly buffer IndexBuffer {
+    uint indexes[];
+};
+
+layout(std430, set = MESHLET_SET, binding = 4) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+// the compute pass counts each instance's kept indexes into indexCount, and firstIndex is the start of its range of
+// the compacted indexes - mesh shaders only read the vertex offset and first instance
+layout(std430, set = MESHLET_SET, binding = 6) buffer CommandBuffer {
+    DrawCommand commands[];
+};
+
+// an instance's model matrix, with what culling its meshlets needs from it
+struct InstanceTransform {
+    mat3x4 model;
+    mat3 linear;
+    float maxScale;
+    // cones are only kept by uniform scales
+    bool coneValid;
+};
+
+InstanceTransform instanceTransform(mat3x4 model) {
+    InstanceTransform transform;
+    transform.model = model;
+    transform.linear = mat3(transpose(model));
+    vec3 scale = vec3(length(transform.linear[0]), length(transform.linear[1]), length(transform.linear[2]));
+    transform.maxScale = max(scale.x, max(scale.y, scale.z));
+    transform.coneValid = coneCulling != 0 && transform.maxScale <= min(scale.x, min(scale.y, scale.z)) * 1.01;
+    return transform;
+}
+
+bool inFrustum(vec3 center, float radius) {
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustumPlanes[i].xyz, center) - frustumPlanes[i].w < -radius) return false;
+    }
+    return true;
+}
+
+// every triangle faces away from the camera
+bool backFacing(vec3 center, float radius, vec3 coneAxis, float coneCutoff) {
+    vec3 direction = center - cameraPosition;
+    return dot(direction, coneAxis) >= coneCutoff * length(direction) + radius;
+}
+
+// whether the sphere was behind everything in the last frame's depth, over the whole of its bounds on screen
+bool occluded(vec3 center, float radius) {
+    vec2 minUV = vec2(1.0);
+    vec2 maxUV = vec2(0.0);
+    float nearestDepth = 1.0;
+    // the corners of the box around the sphere, whose projection contains the sphere's
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = previousViewProjection * vec4(corner, 1.0);
+        // reaches in front of the near plane, where its projection isn't bounded
+        if (clip.z < 0.0) return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+        maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+    // off screen last frame, so there's no depth to test against
+    if (any(greaterThan(minUV, vec2(1.0))) || any(lessThan(maxUV, vec2(0.0)))) return false;
+
+    vec2 minPixel = clamp(minUV, 0.0, 1.0) * previousRenderSize;
+    vec2 maxPixel = clamp(maxUV, 0.0, 1.0) * previousRenderSize;
+
+    // a texel of level n covers 2^(n + 1) pixels, so this is the first level where the bounds span at most 2x2 texels
+    vec2 size = (maxPixel - minPixel) * 0.5;
+    int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, int(pyramidLevels) - 1);
+    ivec2 maxCoord = textureSize(depthPyramid, level) - 1;
+    ivec2 minTexel = min(ivec2(minPixel) >> (level + 1), maxCoord);
+    ivec2 maxTexel = min(ivec2(maxPixel) >> (level + 1), maxCoord);
+
+    float furthestDepth = 0.0;
+    for (int y = minTexel.y; y <= maxTexel.y; y++)
+    {
+        for (int x = minTexel.x; x <= maxTexel.x; x++)
+        {
+            furthestDepth = max(furthestDepth, texelFetch(depthPyramid, ivec2(x, y), level).r);
+        }
+    }
+    return nearestDepth > furthestDepth;
+}
+
+// bounds are moved into world space, with the radius grown by the largest scale
+bool meshletVisible(Meshlet meshlet, InstanceTransform transform) {
+    vec3 center = vec4(meshlet.center, 1.0) * transform.model;
+    float radius = meshlet.radius * transform.maxScale;
+
+    if (!inFrustum(center, radius)) return false;
+    if (transform.coneValid && backFacing(center, radius, normalize(transform.linear * meshlet.coneAxis), meshlet.coneCutoff)) return false;
+    if (occlusionCulling != 0 && occluded(center, radius)) return false;
+    return true;
+}
+
+// 16 bit indexes are packed two to a word, the first in the low half
+uint readIndex(Meshlet meshlet, uint i) {
+    uint index = meshlet.firstIndex + i;
+    if (meshlet.shortIndexes == 0) return indexes[index];
+    return (indexes[index >> 1] >> ((index & 1) * 16)) & 0xFFFF;
+}
@@ -0,0 +1,130 @@
+// draws a meshlet kept by meshlet.task per workgroup, with an invocation per triangle - included by the mesh shaders,
+// which define writeVertex to write the outputs their fragment shader reads
+//
+// meshlets are ranges of the pool's indexes rather than lists of their own vertices, so the list is rebuilt here: each
+// distinct index takes the next output vertex the first time it's inserted into a table in shared memory
+
+#define MESHLET_SET 3
+#include "meshlet_cull.glsl"
+
+// must match Mesh::MESHLET_MAX_VERTICES and Mesh::MESHLET_MAX_TRIANGLES
+#define MAX_VERTICES 64
+#define MAX_TRIANGLES 124
+// a table entry per invocation, twice the vertices there can be, so probing for a free entry stays short
+#define TABLE_SIZE 128
+#define EMPTY_ENTRY 0xFFFFFFFFu
+
+layout(local_size_x = TABLE_SIZE) in;
+layout(triangles, max_vertices = MAX_VERTICES, max_primitives = MAX_TRIANGLES) out;
+
+// must match the vertex shaders exactly, as the pre-pass and the shading pass each draw culled instances this way
+// and whole ones through the vertex shaders, and the shading pass tests for equal depth
+out gl_MeshPerVertexEXT {
+    invariant vec4 gl_Position;
+} gl_MeshVerticesEXT[];
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+};
+
+struct ModelData {
+    // first three rows of the affine model matrix
+    mat3x4 model;
+    uint materialID;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer ModelBuffer {
+    ModelData models[];
+};
+
+// the pool's vertices, five words to each PackedVertex
+layout(std430, set = MESHLET_SET, binding = 5) readonly buffer VertexBuffer {
+    uint vertexWords[];
+};
+
+taskPayloadSharedEXT MeshletPayload payload;
+
+// a vertex as the vertex shaders' inputs see it
+struct MeshVertex {
+    // quantised within the mesh's bounds - the dequantisation is part of the model matrix
+    vec3 position;
+    vec2 uv;
+    // octahedral encoded, see octahedralEncode in Vertex.h
+    vec2 normal;
+    vec2 tangent;
+};
+
+// write every output of a vertex but its position
+void writeVertex(uint outputIndex, MeshVertex vertex, ModelData model, vec3 worldPosition);
+
+// the index held by each entry, and the output vertex it was given
+shared uint tableIndexes[TABLE_SIZE];
+shared uint tableVertices[TABLE_SIZE];
+shared uint vertexCount;
+
+// unpacked the same way as the vertex input formats in PackedVertex::getAttributeDescriptions
+MeshVertex readVertex(uint vertex) {
+    uint word = vertex * 5;
+    MeshVertex result;
+    result.position = vec3(unpackSnorm2x16(vertexWords[word]), unpackSnorm2x16(vertexWords[word + 1]).x);
+    result.uv = unpackHalf2x16(vertexWords[word + 2]);
+    result.normal = unpackSnorm2x16(vertexWords[word + 3]);
+    result.tangent = unpackSnorm2x16(vertexWords[word + 4]);
+    return result;
+}
+
+// the entry holding index, inserting it if it hasn't been seen yet
+uint insertIndex(uint index) {
+    // multiplicative hash, keeping the top bits
+    uint entry = (index * 2654435761u) >> 25;
+    while (true)
+    {
+        uint previous = atomicCompSwap(tableIndexes[entry], EMPTY_ENTRY, index);
+        if (previous == EMPTY_ENTRY)
+        {
+            tableVertices[entry] = atomicAdd(vertexCount, 1);
+            return entry;
+        }
+        if (previous == index) return entry;
+        entry = (entry + 1) % TABLE_SIZE;
+    }
+}
+
+void main()
+{
+    Meshlet meshlet = meshlets[payload.meshlets[gl_WorkGroupID.x]];
+    DrawCommand command = commands[payload.instance];
+    uint triangleCount = meshlet.indexCount / 3;
+    uint thread = gl_LocalInvocationIndex;
+
+    tableIndexes[thread] = EMPTY_ENTRY;
+    if (thread == 0) vertexCount = 0;
+    barrier();
+
+    uvec3 entries = uvec3(0);
+    if (thread < triangleCount)
+    {
+        for (uint corner = 0; corner < 3; corner++)
+        {
+            entries[corner] = insertIndex(readIndex(meshlet, thread * 3 + corner));
+        }
+    }
+    barrier();
+
+    SetMeshOutputsEXT(vertexCount, triangleCount);
+    if (thread < triangleCount)
+    {
+        gl_PrimitiveTriangleIndicesEXT[thread] = uvec3(tableVertices[entries.x], tableVertices[entries.y], tableVertices[entries.z]);
+    }
+
+    uint index = tableIndexes[thread];
+    if (index == EMPTY_ENTRY) return;
+
+    ModelData model = models[command.firstInstance];
+    MeshVertex vertex = readVertex(uint(command.vertexOffset + int(index)));
+    uint outputIndex = tableVertices[thread];
+    vec3 worldPosition = vec4(vertex.position, 1.0) * model.model;
+    gl_MeshVerticesEXT[outputIndex].gl_Position = projection * view * vec4(worldPosition, 1.0);
+    writeVertex(outputIndex, vertex, model, worldPosition);
+}
@@ -1,33 +1,62 @@
 #version 460
 
+// quantised within the mesh's bounds - the dequantisation is part of the model matrix
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inUV;
-layout(location = 2) in vec3 inNorm;
-layout(location = 3) in vec3 inTang;
+// octahedral encoded, see octahedralEncode in Vertex.h
+layout(location = 2) in vec2 inNorm;
+layout(location = 3) in vec2 inTang;
 
 layout(location = 0) out vec2 UV;
 layout(location = 1) out vec3 Normal;
 layout(location = 2) out vec3 FragPos;
 layout(location = 3) out mat3 TBN;
+layout(location = 6) flat out uint MaterialID;
+
+// must match depth.vert exactly, so the depth pre-pass produces identical depths
+invariant gl_Position;
 
 layout(set = 0, binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 projection;
 };
 
-layout(set = 2, binding = 0) uniform ModelUniforms {
-    mat4 model;
-    mat4 normalMatrix;
+struct ModelData {
+    // first three rows of the affine model matrix
+    mat3x4 model;
+    uint materialID;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer ModelBuffer {
+    ModelData models[];
 };
 
+// cofactor matrix - the inverse transpose up to a scale factor, which is normalised away
+mat3 normalMatrixFrom(mat3 m) {
+    mat3 cofactor = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    return cofactor * sign(dot(m[0], cofactor[0]));
+}
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // unfold the lower half back over the corners
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
 void main() {
-    gl_Position = projection * view * model * vec4(inPosition.xyz, 1.0);
+    mat3x4 model = models[gl_InstanceIndex].model;
+    MaterialID = models[gl_InstanceIndex].materialID;
+    mat3 normalMatrix = normalMatrixFrom(mat3(transpose(model)));
+
+    FragPos = vec4(inPosition, 1.0) * model;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
     UV = vec2(inUV.x, 1.0 - inUV.y);
-    Normal = mat3(normalMatrix) * inNorm;
-    FragPos = vec3(model * vec4(inPosition, 1));
 
-    vec3 T = normalize(vec3(model * vec4(inTang, 0.0)));
-    vec3 N = normalize(vec3(model * vec4(inNorm, 0.0)));
+    vec3 T = normalize(vec3(vec4(octahedralDecode(inTang), 0.0) * model));
+    vec3 N = normalize(normalMatrix * octahedralDecode(inNorm));
     vec3 B = cross(N, T);
+    Normal = N;
     TBN = mat3(T, B, N);
-}
\ No newline at end of file
+}
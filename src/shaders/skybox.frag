@@ -4,7 +4,7 @@ layout(location = 0) out vec4 FragColour;
 
 layout(location = 0) in vec3 UV;
 
-uniform layout(set = 0, binding = 1) samplerCube skybox;
+layout(set = 0, binding = 2) uniform samplerCube skybox;
 
 void main() {
     FragColour = texture(skybox, UV);
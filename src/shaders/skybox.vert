@@ -1,9 +1,10 @@
 #version 460
 
+// the unit cube spans its whole quantisation box, so its positions need no dequantising
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inUV;
-layout(location = 2) in vec3 inNorm;
-layout(location = 3) in vec3 inTang;
+layout(location = 2) in vec2 inNorm;
+layout(location = 3) in vec2 inTang;
 
 layout(location = 0) out vec3 UV;
 
@@ -0,0 +1,34 @@
+// parameters shared by the screen space ambient occlusion passes, which all run at half resolution
+
+// must match AmbientOcclusion::Params
+layout(std140, set = 0, binding = 0) uniform Params {
+    mat4 projection;
+    // current view space to the previous frame's clip space
+    mat4 reprojection;
+    vec2 fullSize;
+    vec2 halfSize;
+    float near;
+    float far;
+    float radius;
+    float intensity;
+    uint sampleCount;
+    uint frame;
+    // weight of this frame against the accumulated history, 1 to ignore the history
+    float blend;
+};
+
+// relative difference in view depth before two texels are treated as different surfaces
+#define DEPTH_TOLERANCE 0.05
+
+// view depth from a 0 to 1 depth buffer value
+float linearDepth(float depth)
+{
+    return near * far / (depth * (near - far) + far);
+}
+
+// view space position at a screen UV and view depth
+vec3 viewPosition(vec2 uv, float viewDepth)
+{
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3(ndc.x * viewDepth / projection[0][0], ndc.y * viewDepth / projection[1][1], -viewDepth);
+}
@@ -0,0 +1,29 @@
+// halves the depth buffer to linear view depth for the occlusion passes
+// define MULTISAMPLED before including to read sample 0 of a multisampled depth buffer
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+#include "ssao.glsl"
+
+#ifdef MULTISAMPLED
+layout(set = 0, binding = 1) uniform sampler2DMS depthBuffer;
+#else
+layout(set = 0, binding = 1) uniform sampler2D depthBuffer;
+#endif
+
+layout(set = 0, binding = 2, r32f) uniform writeonly image2D halfDepth;
+
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(coord, ivec2(halfSize)))) return;
+
+    // the closest of the four, so thin foreground edges aren't lost - the last argument is the sample or the mip
+    ivec2 maxCoord = ivec2(fullSize) - 1;
+    float depth = 1.0;
+    for (int i = 0; i < 4; i++)
+    {
+        depth = min(depth, texelFetch(depthBuffer, min(coord * 2 + ivec2(i & 1, i >> 1), maxCoord), 0).r);
+    }
+    imageStore(halfDepth, coord, vec4(linearDepth(depth)));
+}
@@ -0,0 +1,14 @@
+// parameters shared by the temporal anti-aliasing passes, which run over the rendered region of each image
+
+// must match TemporalAntiAliasing::Params
+layout(std140, set = 0, binding = 0) uniform Params {
+    // current unjittered clip space to the previous frame's
+    mat4 reprojection;
+    // this frame's projection jitter in NDC
+    vec2 jitter;
+    vec2 renderSize;
+    // fraction of the images the render size covers
+    vec2 renderScale;
+    // weight of this frame against the history, 1 to ignore the history
+    float blend;
+};
@@ -0,0 +1,41 @@
+#version 460
+
+// scales the rendered part of the scene up to the whole output, then sharpens it to recover some of the detail lost
+// to filtering - sharpening is reduced where the neighbourhood already has high contrast, so edges don't ring
+
+layout(location = 0) in vec2 UV;
+
+layout(location = 0) out vec4 outColour;
+
+// must match Renderer3D::UpscaleParams
+layout(std140, set = 0, binding = 0) uniform UpscaleParams {
+    // size of the rendered region in UVs of the scene image
+    vec2 renderScale;
+    // size of a texel of the scene image in UVs
+    vec2 texelSize;
+    float sharpness;
+};
+
+layout(set = 0, binding = 1) uniform sampler2D scene;
+
+// kept half a texel inside the rendered region, so filtering doesn't reach what wasn't rendered this frame
+vec3 sampleScene(vec2 uv)
+{
+    return texture(scene, clamp(uv, texelSize * 0.5, renderScale - texelSize * 0.5)).rgb;
+}
+
+void main() {
+    vec2 uv = UV * renderScale;
+    vec3 centre = sampleScene(uv);
+    vec3 north = sampleScene(uv - vec2(0.0, texelSize.y));
+    vec3 south = sampleScene(uv + vec2(0.0, texelSize.y));
+    vec3 east = sampleScene(uv + vec2(texelSize.x, 0.0));
+    vec3 west = sampleScene(uv - vec2(texelSize.x, 0.0));
+
+    vec3 minimum = min(centre, min(min(north, south), min(east, west)));
+    vec3 maximum = max(centre, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, 0.0001), 0.0, 1.0));
+    vec3 weight = -amount * sharpness * 0.2;
+
+    outColour = vec4((centre + (north + south + east + west) * weight) / (1.0 + 4.0 * weight), 1.0);
+}